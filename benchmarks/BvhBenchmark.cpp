@@ -0,0 +1,188 @@
+// Times the scene Bvh over 100k boxes: the SAH build, refitting after 10% of the boxes moved,
+// frustum queries from several views and nearest hit raycasts, the queries against brute force
+// loops over every box. Exits non-zero when a query disagrees with its brute force result.
+
+#include "Bvh.hpp"
+#include "Camera.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace learnVulkan;
+
+namespace {
+
+constexpr uint32_t OBJECT_COUNT = 100000;
+constexpr uint32_t VIEW_COUNT = 16;
+constexpr uint32_t RAY_COUNT = 1000;
+constexpr float MOVED_FRACTION = .1f;
+constexpr float WORLD_EXTENT = 500.f;  // boxes are spread over [-extent, extent] on every axis
+constexpr int RUNS = 5;
+
+struct Scene {
+  std::vector<uint32_t> items;
+  std::vector<Aabb> bounds;
+  std::vector<Aabb> movedBounds;  // bounds with every tenth box moved
+  std::vector<Frustum> frustums;
+  std::vector<Ray> rays;
+};
+
+Scene makeScene(uint32_t count) {
+  std::mt19937 rng{1234};
+  std::uniform_real_distribution<float> position{-WORLD_EXTENT, WORLD_EXTENT};
+  std::uniform_real_distribution<float> size{.5f, 5.f};
+  std::uniform_real_distribution<float> offset{-10.f, 10.f};
+  std::uniform_real_distribution<float> unit{-1.f, 1.f};
+
+  Scene scene;
+  scene.items.resize(count);
+  scene.bounds.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    glm::vec3 center{position(rng), position(rng), position(rng)};
+    glm::vec3 halfExtent = glm::vec3{size(rng), size(rng), size(rng)} * .5f;
+    scene.items[i] = i;
+    scene.bounds[i] = {center - halfExtent, center + halfExtent};
+  }
+  scene.movedBounds = scene.bounds;
+  auto movedStride = static_cast<uint32_t>(1.f / MOVED_FRACTION);
+  for (uint32_t i = 0; i < count; i += movedStride) {
+    glm::vec3 delta{offset(rng), offset(rng), offset(rng)};
+    scene.movedBounds[i].min += delta;
+    scene.movedBounds[i].max += delta;
+  }
+
+  for (uint32_t i = 0; i < VIEW_COUNT; i++) {
+    Camera camera{};
+    camera.setPerspectiveProjection(0.87f, 16.f / 9.f, 0.1f, WORLD_EXTENT);
+    glm::vec3 eye{position(rng), position(rng), position(rng)};
+    camera.setViewDirection(eye, glm::vec3{unit(rng), unit(rng), unit(rng)});
+    scene.frustums.push_back(Frustum::fromMatrix(camera.getProjection() * camera.getView()));
+  }
+  for (uint32_t i = 0; i < RAY_COUNT; i++) {
+    Ray ray{};
+    ray.origin = {position(rng), position(rng), position(rng)};
+    ray.direction = {unit(rng), unit(rng), unit(rng)};
+    scene.rays.push_back(ray);
+  }
+  return scene;
+}
+
+template <typename Fn>
+double bestOfRuns(Fn &&fn) {
+  double best = std::numeric_limits<double>::max();
+  for (int run = 0; run < RUNS; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    fn();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main() {
+  Scene scene = makeScene(OBJECT_COUNT);
+  Bvh bvh;
+
+  double buildMs = bestOfRuns(
+      [&] { bvh.build(scene.items.data(), scene.bounds.data(), OBJECT_COUNT); });
+  float builtCost = bvh.getCost();
+
+  // every run moves the boxes one way or back, so each refit has the same amount of work
+  bool moved = false;
+  auto movedStride = static_cast<uint32_t>(1.f / MOVED_FRACTION);
+  double refitMs = bestOfRuns([&] {
+    moved = !moved;
+    const std::vector<Aabb> &bounds = moved ? scene.movedBounds : scene.bounds;
+    for (uint32_t i = 0; i < OBJECT_COUNT; i += movedStride) {
+      bvh.updateItem(i, bounds[i]);
+    }
+    bvh.refit();
+  });
+  if (moved) {
+    for (uint32_t i = 0; i < OBJECT_COUNT; i += movedStride) {
+      bvh.updateItem(i, scene.bounds[i]);
+    }
+    bvh.refit();
+  }
+
+  printf("%u objects, best of %d runs\n", OBJECT_COUNT, RUNS);
+  printf("build: %.2f ms, %u nodes, SAH cost %.2f\n", buildMs, bvh.getNodeCount(), builtCost);
+  printf("refit %.0f%% moved: %.3f ms, SAH cost %.2f, %u rebuilds\n",
+         MOVED_FRACTION * 100.f, refitMs, bvh.getCost(), bvh.getRebuildCount());
+
+  bool passed = true;
+  printf("%-16s %12s %12s %10s %12s\n", "query", "brute ms", "bvh ms", "speedup", "results");
+
+  std::vector<std::vector<uint32_t>> bruteVisible(VIEW_COUNT);
+  std::vector<std::vector<uint32_t>> bvhVisible(VIEW_COUNT);
+  double bruteFrustumMs = bestOfRuns([&] {
+    for (uint32_t view = 0; view < VIEW_COUNT; view++) {
+      bruteVisible[view].clear();
+      for (uint32_t i = 0; i < OBJECT_COUNT; i++) {
+        if (scene.frustums[view].intersectsAabb(scene.bounds[i].min, scene.bounds[i].max)) {
+          bruteVisible[view].push_back(i);
+        }
+      }
+    }
+  });
+  double bvhFrustumMs = bestOfRuns([&] {
+    for (uint32_t view = 0; view < VIEW_COUNT; view++) {
+      bvhVisible[view].clear();
+      bvh.queryFrustum(scene.frustums[view], bvhVisible[view]);
+    }
+  });
+  size_t visibleCount = 0;
+  bool frustumOk = true;
+  for (uint32_t view = 0; view < VIEW_COUNT; view++) {
+    std::sort(bvhVisible[view].begin(), bvhVisible[view].end());
+    frustumOk = frustumOk && bvhVisible[view] == bruteVisible[view];
+    visibleCount += bruteVisible[view].size();
+  }
+  passed = passed && frustumOk;
+  printf("%-16s %12.2f %12.2f %10.1f %12zu%s\n",
+         "frustum x16", bruteFrustumMs, bvhFrustumMs, bruteFrustumMs / bvhFrustumMs,
+         visibleCount, frustumOk ? "" : "  MISMATCH");
+
+  std::vector<RayHit> bruteHits(RAY_COUNT);
+  std::vector<RayHit> bvhHits(RAY_COUNT);
+  double bruteRayMs = bestOfRuns([&] {
+    for (uint32_t ray = 0; ray < RAY_COUNT; ray++) {
+      RayHit hit{};
+      for (uint32_t i = 0; i < OBJECT_COUNT; i++) {
+        float distance;
+        if (intersectRayAabb(scene.rays[ray], scene.bounds[i], distance) &&
+            distance < hit.distance) {
+          hit = {i, distance};
+        }
+      }
+      bruteHits[ray] = hit;
+    }
+  });
+  double bvhRayMs = bestOfRuns([&] {
+    for (uint32_t ray = 0; ray < RAY_COUNT; ray++) {
+      bvhHits[ray] = RayHit{};
+      bvh.raycast(scene.rays[ray], bvhHits[ray]);
+    }
+  });
+  // boxes hit at exactly the same distance may come back in either order
+  uint32_t hitCount = 0;
+  bool rayOk = true;
+  for (uint32_t ray = 0; ray < RAY_COUNT; ray++) {
+    rayOk = rayOk && bvhHits[ray].distance == bruteHits[ray].distance;
+    hitCount += bruteHits[ray].item != RayHit{}.item;
+  }
+  passed = passed && rayOk;
+  printf("%-16s %12.2f %12.2f %10.1f %12u%s\n",
+         "raycast x1000", bruteRayMs, bvhRayMs, bruteRayMs / bvhRayMs, hitCount,
+         rayOk ? "" : "  MISMATCH");
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,774 @@
+// Renders a deterministic scene headless for a fixed number of frames and reports CPU frame
+// time, draw calls and memory use as JSON. The scene, the camera path and the animation only
+// depend on the options and the frame number, so two runs of the same build on the same
+// driver record identical command streams; it runs on CPU implementations such as lavapipe
+// or SwiftShader, which makes it usable on every commit.
+//
+// usage: SceneBenchmark [--objects N] [--meshes M] [--grid-resolution R | --mesh file.obj]
+//                       [--animated F]
+//                       [--frames N] [--warmup N] [--path indirect|instanced|per-object]
+//                       [--threads T[,T...]] [--vertex-usage static|dynamic]
+//                       [--vertex-layout standard|compressed|compact] [--meshlets]
+//                       [--lod-error PIXELS] [--bvh] [--occlusion] [--walls N]
+//                       [--no-sort] [--depth-prepass]
+//                       [--frames-in-flight 1-4] [--extent WxH] [--seed S]
+//                       [--output results.json]
+//
+// --grid-resolution swaps the cubes for R x R quad grids, which turns the scene into a vertex
+// throughput test; combined with --vertex-usage it compares device local against host
+// visible vertex buffers, and with --vertex-layout full float against quantized vertices
+// (memory.vertexBytes in the output). --mesh loads every mesh from an OBJ file through its binary cache;
+// sceneLoadMs in the output then compares a first run (parse and write the cache) with the
+// following ones (map the cache). Meshes load in parallel on the job system; sceneReadyMs is
+// the time until the scene could be drawn with placeholders, sceneLoadMs until every mesh is
+// uploaded. --threads with a list runs the scene once per thread count
+// (instanced and per-object paths only) to measure command recording scaling. --meshlets
+// builds every mesh with meshlets, which the indirect path culls one by one; the runs then
+// report the meshlets left visible per frame out of meshletDraws. The pipelines draw both
+// sides, so only the frustum test culls meshlets and the image matches the whole mesh draws.
+// --lod-error draws every object at the coarsest level of detail whose error stays within
+// that many pixels (grids get their chains built at load, OBJ meshes have them in the
+// cache); trianglesPerFrame in the output shows what it saves. 0, the default, draws full
+// detail. --bvh frustum culls the instanced and per-object paths on the CPU through a
+// SceneBvh, refit every frame for the animated objects; updateMs includes the refit,
+// trianglesPerFrame only counts visible objects.
+// --walls adds N walls across the lattice on both horizontal axes, splitting it into rooms
+// like a dense interior where most objects hide behind the nearest walls. --occlusion culls the
+// indirect path against a depth pyramid in two passes; occludedPerFrame counts the objects
+// both passes rejected. Compare cpuFrameMs and the "render pass" GPU scopes of a run with and
+// without it, e.g. --objects 20000 --walls 6 against --objects 20000 --walls 6 --occlusion.
+// The instanced and per-object paths sort their draws by state and front to back unless
+// --no-sort is given, and --depth-prepass lays down depth before shading; both show in
+// pipelineBindsPerFrame, modelBindsPerFrame and overdraw, the fragment shader invocations per
+// pixel (-1 when the device has no pipeline statistics queries).
+
+#include "AssetLoader.hpp"
+#include "Camera.hpp"
+#include "DepthPyramid.hpp"
+#include "Device.hpp"
+#include "EntityRegistry.hpp"
+#include "GpuCullingSystem.hpp"
+#include "MeshSimplifier.hpp"
+#include "OverdrawCounter.hpp"
+#include "Primitives.hpp"
+#include "Renderer.hpp"
+#include "SceneBvh.hpp"
+#include "SimpleRenderSystem.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace learnVulkan;
+
+namespace {
+
+enum class RenderPath { Indirect, Instanced, PerObject };
+
+struct Options {
+  uint32_t objectCount = 1000;
+  uint32_t meshCount = 1;
+  uint32_t gridResolution = 0;  // 0 renders cubes
+  std::string meshPath;         // OBJ file used instead of cubes or grids
+  float animatedFraction = 0.f;
+  uint32_t frameCount = 300;
+  uint32_t warmupFrames = 30;
+  RenderPath path = RenderPath::Indirect;
+  std::vector<uint32_t> threadCounts{1};
+  Model::VertexUsage vertexUsage = Model::VertexUsage::Static;
+  std::string vertexLayoutName = "standard";
+  VertexLayout vertexLayout = VertexLayout::standard();
+  bool meshlets = false;
+  float lodPixelError = 0.f;
+  bool bvh = false;
+  bool occlusion = false;
+  uint32_t wallCount = 0;  // per horizontal axis
+  bool sortDraws = true;
+  bool depthPrePass = false;
+  uint32_t framesInFlight = SwapChain::DEFAULT_FRAMES_IN_FLIGHT;
+  VkExtent2D extent{800, 600};
+  uint32_t seed = 1234;
+  std::string outputPath;  // stdout when empty
+};
+
+struct Timings {
+  std::vector<double> frameMs;
+  std::vector<double> updateMs;
+  std::vector<double> recordMs;
+  uint64_t drawCalls = 0;
+  uint64_t visibleMeshlets = 0;
+  uint64_t triangles = 0;
+  uint64_t occluded = 0;
+  uint64_t pipelineBinds = 0;
+  uint64_t modelBinds = 0;
+  double overdraw = 0.0;  // summed over overdrawFrames
+  uint32_t overdrawFrames = 0;
+};
+
+struct RunResult {
+  uint32_t threadCount;
+  Timings timings;
+  std::vector<Profiler::ScopeStats> gpuStats;
+  float presentRate = 0.f;
+  uint32_t meshletDraws = 0;  // per frame, when culled per meshlet
+};
+
+const char *pathName(RenderPath path) {
+  switch (path) {
+    case RenderPath::Indirect:
+      return "indirect";
+    case RenderPath::Instanced:
+      return "instanced";
+    case RenderPath::PerObject:
+      return "per-object";
+  }
+  return "unknown";
+}
+
+std::vector<uint32_t> parseThreadCounts(const std::string &list) {
+  std::vector<uint32_t> counts;
+  std::stringstream stream{list};
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    uint32_t count = static_cast<uint32_t>(std::stoul(item));
+    if (count == 0) {
+      throw std::invalid_argument("--threads needs counts of at least 1");
+    }
+    counts.push_back(count);
+  }
+  if (counts.empty()) {
+    throw std::invalid_argument("--threads needs at least one count");
+  }
+  return counts;
+}
+
+Options parseArguments(int argc, char **argv) {
+  Options options{};
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--objects") == 0 && hasValue) {
+      options.objectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--meshes") == 0 && hasValue) {
+      options.meshCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--grid-resolution") == 0 && hasValue) {
+      options.gridResolution = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--mesh") == 0 && hasValue) {
+      options.meshPath = argv[++i];
+    } else if (strcmp(argv[i], "--animated") == 0 && hasValue) {
+      options.animatedFraction = std::stof(argv[++i]);
+    } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+      options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--warmup") == 0 && hasValue) {
+      options.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--path") == 0 && hasValue) {
+      std::string path = argv[++i];
+      if (path == "indirect") {
+        options.path = RenderPath::Indirect;
+      } else if (path == "instanced") {
+        options.path = RenderPath::Instanced;
+      } else if (path == "per-object") {
+        options.path = RenderPath::PerObject;
+      } else {
+        throw std::invalid_argument("unknown render path: " + path);
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+      options.threadCounts = parseThreadCounts(argv[++i]);
+    } else if (strcmp(argv[i], "--vertex-usage") == 0 && hasValue) {
+      std::string usage = argv[++i];
+      if (usage == "static") {
+        options.vertexUsage = Model::VertexUsage::Static;
+      } else if (usage == "dynamic") {
+        options.vertexUsage = Model::VertexUsage::Dynamic;
+      } else {
+        throw std::invalid_argument("unknown vertex usage: " + usage);
+      }
+    } else if (strcmp(argv[i], "--vertex-layout") == 0 && hasValue) {
+      options.vertexLayoutName = argv[++i];
+      if (options.vertexLayoutName == "standard") {
+        options.vertexLayout = VertexLayout::standard();
+      } else if (options.vertexLayoutName == "compressed") {
+        options.vertexLayout = VertexLayout::compressed();
+      } else if (options.vertexLayoutName == "compact") {
+        options.vertexLayout = VertexLayout::compact();
+      } else {
+        throw std::invalid_argument("unknown vertex layout: " + options.vertexLayoutName);
+      }
+    } else if (strcmp(argv[i], "--meshlets") == 0) {
+      options.meshlets = true;
+    } else if (strcmp(argv[i], "--lod-error") == 0 && hasValue) {
+      options.lodPixelError = std::stof(argv[++i]);
+    } else if (strcmp(argv[i], "--bvh") == 0) {
+      options.bvh = true;
+    } else if (strcmp(argv[i], "--occlusion") == 0) {
+      options.occlusion = true;
+    } else if (strcmp(argv[i], "--walls") == 0 && hasValue) {
+      options.wallCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--no-sort") == 0) {
+      options.sortDraws = false;
+    } else if (strcmp(argv[i], "--depth-prepass") == 0) {
+      options.depthPrePass = true;
+    } else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue) {
+      options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--extent") == 0 && hasValue) {
+      std::string extent = argv[++i];
+      size_t separator = extent.find('x');
+      if (separator == std::string::npos) {
+        throw std::invalid_argument("--extent needs WIDTHxHEIGHT");
+      }
+      options.extent.width = static_cast<uint32_t>(std::stoul(extent.substr(0, separator)));
+      options.extent.height = static_cast<uint32_t>(std::stoul(extent.substr(separator + 1)));
+    } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+      options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+      options.outputPath = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("unknown or incomplete argument: ") + argv[i]);
+    }
+  }
+
+  if (options.objectCount == 0 || options.meshCount == 0 || options.frameCount == 0) {
+    throw std::invalid_argument("--objects, --meshes and --frames must be at least 1");
+  }
+  if (options.extent.width == 0 || options.extent.height == 0) {
+    throw std::invalid_argument("--extent must not be empty");
+  }
+  if (!options.meshPath.empty() && options.gridResolution > 0) {
+    throw std::invalid_argument("--mesh and --grid-resolution are exclusive");
+  }
+  options.animatedFraction = std::min(std::max(options.animatedFraction, 0.f), 1.f);
+  if (options.path == RenderPath::Indirect &&
+      (options.threadCounts.size() > 1 || options.threadCounts.front() != 1)) {
+    throw std::invalid_argument("--threads only applies to the instanced and per-object paths");
+  }
+  if (options.occlusion && options.path != RenderPath::Indirect) {
+    throw std::invalid_argument("--occlusion only applies to the indirect path");
+  }
+  if ((!options.sortDraws || options.depthPrePass) && options.path == RenderPath::Indirect) {
+    throw std::invalid_argument(
+        "--no-sort and --depth-prepass only apply to the instanced and per-object paths");
+  }
+  return options;
+}
+
+// Objects sit on a jittered cubic lattice with random rotations, scales and colors, and use
+// the meshes round robin. The first animatedFraction of the shuffled handles spin every frame.
+struct Scene {
+  std::vector<EntityHandle> animated;
+  std::vector<glm::vec3> animatedBaseRotations;
+  glm::vec3 center{0.f};
+  float radius = 1.f;
+};
+
+// device bytes of all meshes, vertex buffers as encoded in their layout
+struct MeshMemory {
+  VkDeviceSize vertexBytes = 0;
+  VkDeviceSize indexBytes = 0;
+};
+
+MeshMemory measureMeshMemory(EntityRegistry &entities) {
+  MeshMemory memory{};
+  for (ModelId id = 0; id < entities.getModelCount(); id++) {
+    memory.vertexBytes += entities.getModel(id).getVertexBufferSize();
+    memory.indexBytes += entities.getModel(id).getIndexBufferSize();
+  }
+  return memory;
+}
+
+Scene buildScene(const Options &options, AssetLoader &loader, EntityRegistry &entities) {
+  std::mt19937 rng{options.seed};
+  std::uniform_real_distribution<float> jitter{-.25f, .25f};
+  std::uniform_real_distribution<float> angle{0.f, glm::two_pi<float>()};
+  std::uniform_real_distribution<float> scale{.3f, .7f};
+  std::uniform_real_distribution<float> channel{.1f, 1.f};
+
+  std::vector<ModelId> models;
+  for (uint32_t mesh = 0; mesh < options.meshCount; mesh++) {
+    // every mesh gets its own buffers, which is what distinct assets cost to bind and draw
+    Model::VertexUsage vertexUsage = options.vertexUsage;
+    VertexLayout vertexLayout = options.vertexLayout;
+    bool meshlets = options.meshlets;
+    if (!options.meshPath.empty()) {
+      models.push_back(loader.loadModel(options.meshPath, vertexUsage, vertexLayout, meshlets));
+    } else if (options.gridResolution > 0) {
+      uint32_t resolution = options.gridResolution;
+      bool lods = options.lodPixelError > 0.f;
+      models.push_back(loader.loadModel([resolution, vertexUsage, vertexLayout, meshlets, lods] {
+        Model::Builder builder = buildGrid(resolution, vertexUsage);
+        builder.vertexLayout = vertexLayout;
+        builder.meshlets = meshlets;
+        if (lods) {
+          generateLods(builder);
+        }
+        return builder;
+      }));
+    } else {
+      models.push_back(loader.loadModel([vertexUsage, vertexLayout, meshlets] {
+        Model::Builder builder = buildCube({0.f, 0.f, 0.f}, vertexUsage);
+        builder.vertexLayout = vertexLayout;
+        builder.meshlets = meshlets;
+        return builder;
+      }));
+    }
+  }
+
+  const float spacing = 2.f;
+  uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(options.objectCount))));
+  float halfExtent = .5f * spacing * static_cast<float>(side - 1);
+
+  entities.reserve(options.objectCount);
+  std::vector<EntityHandle> handles;
+  handles.reserve(options.objectCount);
+  for (uint32_t i = 0; i < options.objectCount; i++) {
+    uint32_t x = i % side;
+    uint32_t y = (i / side) % side;
+    uint32_t z = i / (side * side);
+    auto entity = entities.create();
+    entities.model(entity) = models[i % options.meshCount];
+    entities.translation(entity) = {
+        spacing * static_cast<float>(x) - halfExtent + jitter(rng),
+        spacing * static_cast<float>(y) - halfExtent + jitter(rng),
+        spacing * static_cast<float>(z) - halfExtent + jitter(rng)};
+    entities.rotation(entity) = {angle(rng), angle(rng), angle(rng)};
+    float uniformScale = scale(rng);
+    entities.scale(entity) = {uniformScale, uniformScale, uniformScale};
+    entities.color(entity) = {channel(rng), channel(rng), channel(rng)};
+    handles.push_back(entity);
+  }
+
+  // walls are not animated; they slice the lattice halfway between its rows
+  if (options.wallCount > 0) {
+    Model::VertexUsage vertexUsage = options.vertexUsage;
+    ModelId wallModel = loader.loadModel(
+        [vertexUsage] { return buildCube({0.f, 0.f, 0.f}, vertexUsage); });
+    float length = 2.f * halfExtent + spacing;
+    for (uint32_t axis = 0; axis < 2; axis++) {
+      for (uint32_t wall = 0; wall < options.wallCount; wall++) {
+        float row = std::floor(
+            static_cast<float>((wall + 1) * side) / static_cast<float>(options.wallCount + 1));
+        float offset = spacing * (row - .5f) - halfExtent;
+        auto entity = entities.create();
+        entities.model(entity) = wallModel;
+        entities.translation(entity) =
+            axis == 0 ? glm::vec3{offset, 0.f, 0.f} : glm::vec3{0.f, 0.f, offset};
+        entities.scale(entity) =
+            axis == 0 ? glm::vec3{.2f, length, length} : glm::vec3{length, length, .2f};
+        entities.color(entity) = {.5f, .5f, .5f};
+      }
+    }
+  }
+
+  Scene scene{};
+  std::shuffle(handles.begin(), handles.end(), rng);
+  auto animatedCount = static_cast<uint32_t>(
+      std::lround(options.animatedFraction * static_cast<float>(options.objectCount)));
+  scene.animated.assign(handles.begin(), handles.begin() + animatedCount);
+  for (auto entity : scene.animated) {
+    scene.animatedBaseRotations.push_back(entities.rotation(entity));
+  }
+  scene.radius = halfExtent * 1.75f + 4.f;
+  return scene;
+}
+
+// Scripted replacement for KeyboardMovementController: one orbit around the scene every
+// 240 frames, bobbing up and down, always looking at the center.
+void placeCamera(Camera &camera, const Scene &scene, uint32_t frame, float aspect) {
+  float t = static_cast<float>(frame) / 240.f * glm::two_pi<float>();
+  glm::vec3 eye = scene.center + glm::vec3{
+                                     scene.radius * std::cos(t),
+                                     -.35f * scene.radius * (1.f + .5f * std::sin(2.f * t)),
+                                     scene.radius * std::sin(t)};
+  camera.setViewTarget(eye, scene.center);
+  camera.setPerspectiveProjection(glm::radians(50.f), aspect, .1f, scene.radius * 3.f);
+}
+
+// Animation is a function of the frame number, not of wall time, so every run is identical.
+void animate(EntityRegistry &entities, const Scene &scene, uint32_t frame) {
+  float spin = .02f * static_cast<float>(frame);
+  for (size_t i = 0; i < scene.animated.size(); i++) {
+    glm::vec3 &rotation = entities.rotation(scene.animated[i]);
+    rotation = scene.animatedBaseRotations[i];
+    rotation.y += spin;
+  }
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
+
+RunResult runFrames(
+    const Options &options,
+    uint32_t threadCount,
+    Device &device,
+    Renderer &renderer,
+    EntityRegistry &entities,
+    const Scene &scene) {
+  Profiler &profiler = renderer.profiler();
+  SimpleRenderSystem renderSystem{device, renderer.getSwapChainRenderPass()};
+  renderSystem.setInstancingEnabled(options.path == RenderPath::Instanced);
+  renderSystem.setRecordThreadCount(threadCount);
+  renderSystem.setDrawSortingEnabled(options.sortDraws);
+  renderSystem.setDepthPrePassEnabled(options.depthPrePass);
+  OverdrawCounter overdrawCounter{device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+  // outlives the culling system, which keeps a pointer to it
+  std::unique_ptr<DepthPyramid> depthPyramid;
+  GpuCullingSystem cullingSystem{device};
+  if (options.occlusion) {
+    depthPyramid = std::make_unique<DepthPyramid>(device);
+    cullingSystem.setOcclusionCulling(depthPyramid.get());
+  }
+  SceneBvh sceneBvh;
+  bool cpuCulling = options.bvh && options.path != RenderPath::Indirect;
+
+  animate(entities, scene, 0);
+  entities.updateWorldTransforms();
+  if (options.path == RenderPath::Indirect) {
+    cullingSystem.setObjects(entities);
+  }
+  if (cpuCulling) {
+    sceneBvh.setObjects(entities);
+    renderSystem.setBvh(&sceneBvh);
+  }
+  // async uploads must have landed, or the first measured frames skip models
+  vkDeviceWaitIdle(device.device());
+
+  Camera camera{};
+  RunResult result{};
+  result.threadCount = threadCount;
+  result.timings.frameMs.reserve(options.frameCount);
+  result.timings.updateMs.reserve(options.frameCount);
+  result.timings.recordMs.reserve(options.frameCount);
+
+  uint32_t totalFrames = options.warmupFrames + options.frameCount;
+  for (uint32_t frame = 0; frame < totalFrames; frame++) {
+    bool measured = frame >= options.warmupFrames;
+    if (frame == options.warmupFrames) {
+      // GPU stats only cover the measured frames of this run
+      profiler.clearStats();
+      profiler.setEnabled(profiler.hasGpuTimestamps());
+    }
+    auto frameStart = std::chrono::high_resolution_clock::now();
+
+    placeCamera(camera, scene, frame, renderer.getAspectRatio());
+    LodSelector lodSelector{options.lodPixelError};
+    lodSelector.setViewport(
+        camera.getProjection(), static_cast<float>(renderer.getSwapChainExtent().height));
+    renderSystem.setLodSelector(lodSelector);
+    cullingSystem.setLodSelector(lodSelector);
+    auto updateStart = std::chrono::high_resolution_clock::now();
+    animate(entities, scene, frame);
+    entities.updateWorldTransforms();
+    if (options.path == RenderPath::Indirect) {
+      cullingSystem.updateChangedObjects(entities);
+    }
+    if (cpuCulling) {
+      sceneBvh.updateChangedObjects(entities);
+    }
+    double updateMs = elapsedMs(updateStart);
+
+    auto commandBuffer = renderer.beginFrame();
+    if (commandBuffer == nullptr) {
+      throw std::runtime_error("headless frame could not be started!");
+    }
+    int frameIndex = renderer.getFrameIndex();
+    auto recordStart = std::chrono::high_resolution_clock::now();
+    overdrawCounter.beginFrame(commandBuffer, frameIndex);
+    VkExtent2D extent = renderer.getSwapChainExtent();
+    uint64_t pixelCount = static_cast<uint64_t>(extent.width) * extent.height;
+    uint32_t drawCalls = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t modelBinds = 0;
+    if (options.path == RenderPath::Indirect) {
+      if (depthPyramid != nullptr) {
+        depthPyramid->resize(renderer.getSwapChainExtent());
+      }
+      cullingSystem.cull(commandBuffer, frameIndex, camera);
+      // spans both passes; the pyramid and the late cull in between are compute work
+      overdrawCounter.begin(commandBuffer, pixelCount, false);
+      renderer.beginSwapChainRenderPass(commandBuffer);
+      renderSystem.renderIndirect(commandBuffer, frameIndex, cullingSystem, camera);
+      if (cullingSystem.isOcclusionCullingActive()) {
+        drawCalls += renderSystem.getLastDrawCount();
+        pipelineBinds += renderSystem.getLastPipelineBindCount();
+        modelBinds += renderSystem.getLastModelBindCount();
+        renderer.endSwapChainRenderPass(commandBuffer);
+        depthPyramid->build(
+            commandBuffer,
+            frameIndex,
+            renderer.getCurrentDepthImage(),
+            renderer.getCurrentDepthImageView(),
+            renderer.getDepthFormat());
+        cullingSystem.cullLate(commandBuffer, frameIndex, camera);
+        renderer.resumeSwapChainRenderPass(commandBuffer);
+        renderSystem.renderIndirect(commandBuffer, frameIndex, cullingSystem, camera, true);
+      }
+    } else {
+      VkSubpassContents contents = renderSystem.getSubpassContents();
+      overdrawCounter.begin(
+          commandBuffer, pixelCount, contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+      SimpleRenderSystem::RecordTarget recordTarget{
+          renderer.getSwapChainRenderPass(),
+          renderer.getCurrentFramebuffer(),
+          renderer.getSwapChainExtent(),
+          overdrawCounter.getInheritedStatistics()};
+      renderer.beginSwapChainRenderPass(commandBuffer, contents);
+      renderSystem.renderEntities(commandBuffer, frameIndex, entities, camera, &recordTarget);
+    }
+    renderer.endSwapChainRenderPass(commandBuffer);
+    overdrawCounter.end(commandBuffer);
+    drawCalls += renderSystem.getLastDrawCount();
+    pipelineBinds += renderSystem.getLastPipelineBindCount();
+    modelBinds += renderSystem.getLastModelBindCount();
+    double recordMs = elapsedMs(recordStart);
+    renderer.endFrame();
+
+    if (measured) {
+      result.timings.frameMs.push_back(elapsedMs(frameStart));
+      result.timings.updateMs.push_back(updateMs);
+      result.timings.recordMs.push_back(recordMs);
+      result.timings.drawCalls += drawCalls;
+      result.timings.pipelineBinds += pipelineBinds;
+      result.timings.modelBinds += modelBinds;
+      // lags by the frames in flight like the GPU scopes
+      if (overdrawCounter.hasResult()) {
+        result.timings.overdraw += overdrawCounter.getOverdraw();
+        result.timings.overdrawFrames++;
+      }
+      result.timings.visibleMeshlets += cullingSystem.getVisibleMeshletCount();
+      result.timings.occluded += cullingSystem.getOccludedCount();
+      result.timings.triangles += options.path == RenderPath::Indirect
+                                      ? cullingSystem.getVisibleTriangleCount()
+                                      : renderSystem.getLastTriangleCount();
+    }
+  }
+  vkDeviceWaitIdle(device.device());
+
+  for (const auto &scope : profiler.getStats()) {
+    if (scope.gpu) {
+      result.gpuStats.push_back(scope);
+    }
+  }
+  profiler.setEnabled(false);
+  result.presentRate = renderer.framePacer().getPresentRate();
+  result.meshletDraws = cullingSystem.getMeshletDrawCount();
+  return result;
+}
+
+std::string jsonEscape(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+uint64_t peakResidentBytes() {
+#if defined(__APPLE__)
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss);  // bytes on macOS
+#elif defined(__unix__)
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // kilobytes on Linux
+#else
+  return 0;
+#endif
+}
+
+void writeStats(std::ostream &out, std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for (double sample : samples) {
+    sum += sample;
+  }
+  auto percentile = [&](size_t percent) {
+    return samples[std::min(samples.size() - 1, (samples.size() * percent) / 100)];
+  };
+  out << "{\"min\":" << samples.front() << ",\"avg\":" << sum / static_cast<double>(samples.size())
+      << ",\"p50\":" << percentile(50) << ",\"p99\":" << percentile(99)
+      << ",\"max\":" << samples.back() << "}";
+}
+
+void writeJson(
+    std::ostream &out,
+    const Options &options,
+    const Device &device,
+    const Renderer &renderer,
+    double sceneReadyMs,
+    double sceneLoadMs,
+    const std::vector<RunResult> &results,
+    const AllocatorStats &memory,
+    const MeshMemory &meshMemory) {
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"benchmark\": \"scene\",\n";
+  out << "  \"device\": \"" << device.properties.deviceName << "\",\n";
+  out << "  \"config\": {\"objects\":" << options.objectCount
+      << ",\"meshes\":" << options.meshCount << ",\"gridResolution\":" << options.gridResolution
+      << ",\"animatedFraction\":" << options.animatedFraction
+      << ",\"frames\":" << options.frameCount << ",\"warmupFrames\":" << options.warmupFrames
+      << ",\"path\":\"" << pathName(options.path) << "\",\"vertexUsage\":\""
+      << (options.vertexUsage == Model::VertexUsage::Static ? "static" : "dynamic")
+      << "\",\"vertexLayout\":\"" << options.vertexLayoutName
+      << "\",\"meshlets\":" << (options.meshlets ? "true" : "false")
+      << ",\"lodPixelError\":" << options.lodPixelError
+      << ",\"bvh\":" << (options.bvh ? "true" : "false")
+      << ",\"occlusion\":" << (options.occlusion ? "true" : "false")
+      << ",\"walls\":" << options.wallCount
+      << ",\"sort\":" << (options.sortDraws ? "true" : "false")
+      << ",\"depthPrePass\":" << (options.depthPrePass ? "true" : "false")
+      << ",\"framesInFlight\":" << options.framesInFlight << ",\"presentMode\":\""
+      << presentModeName(renderer.getActivePresentMode()) << "\""
+      << ",\"width\":" << options.extent.width << ",\"height\":" << options.extent.height
+      << ",\"seed\":" << options.seed << ",\"mesh\":\"" << jsonEscape(options.meshPath)
+      << "\"},\n";
+  out << "  \"sceneReadyMs\": " << sceneReadyMs << ",\n";
+  out << "  \"sceneLoadMs\": " << sceneLoadMs << ",\n";
+
+  out << "  \"runs\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const RunResult &result = results[i];
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    {\"threads\":" << result.threadCount << ",\n";
+    out << "     \"cpuFrameMs\":";
+    writeStats(out, result.timings.frameMs);
+    out << ",\n     \"updateMs\":";
+    writeStats(out, result.timings.updateMs);
+    out << ",\n     \"recordMs\":";
+    writeStats(out, result.timings.recordMs);
+    out << ",\n     \"drawCallsPerFrame\":"
+        << static_cast<double>(result.timings.drawCalls) /
+               static_cast<double>(result.timings.frameMs.size());
+    out << ",\"pipelineBindsPerFrame\":"
+        << static_cast<double>(result.timings.pipelineBinds) /
+               static_cast<double>(result.timings.frameMs.size())
+        << ",\"modelBindsPerFrame\":"
+        << static_cast<double>(result.timings.modelBinds) /
+               static_cast<double>(result.timings.frameMs.size());
+    out << ",\"overdraw\":"
+        << (result.timings.overdrawFrames > 0
+                ? result.timings.overdraw / static_cast<double>(result.timings.overdrawFrames)
+                : -1.0);
+    out << ",\n     \"presentsPerSecond\":" << result.presentRate;
+    // visible counts lag by the frames in flight, see GpuCullingSystem::getVisibleMeshletCount
+    out << ",\n     \"meshletDraws\":" << result.meshletDraws << ",\"visibleMeshletsPerFrame\":"
+        << static_cast<double>(result.timings.visibleMeshlets) /
+               static_cast<double>(result.timings.frameMs.size());
+    // lags like the visible counts on the indirect path, without the meshlet culled objects
+    out << ",\"trianglesPerFrame\":"
+        << static_cast<double>(result.timings.triangles) /
+               static_cast<double>(result.timings.frameMs.size());
+    out << ",\"occludedPerFrame\":"
+        << static_cast<double>(result.timings.occluded) /
+               static_cast<double>(result.timings.frameMs.size());
+    // GPU scopes are absent when the device has no timestamps on its graphics queue, and
+    // only cover the last Profiler::HISTORY_FRAMES frames
+    out << ",\n     \"gpuMs\":{";
+    for (size_t scope = 0; scope < result.gpuStats.size(); scope++) {
+      const auto &stats = result.gpuStats[scope];
+      out << (scope == 0 ? "" : ",") << "\"" << stats.name << "\":{\"min\":" << stats.minMs
+          << ",\"avg\":" << stats.avgMs << ",\"p99\":" << stats.p99Ms << "}";
+    }
+    out << "}}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"memory\": {\"deviceBytesReserved\":" << memory.bytesReserved
+      << ",\"deviceBytesUsed\":" << memory.bytesUsed << ",\"deviceBlocks\":" << memory.blockCount
+      << ",\"deviceAllocations\":" << memory.allocationCount
+      << ",\"vkAllocateMemoryCalls\":" << memory.deviceAllocationCalls
+      << ",\"vertexBytes\":" << meshMemory.vertexBytes
+      << ",\"indexBytes\":" << meshMemory.indexBytes
+      << ",\"peakResidentBytes\":" << peakResidentBytes() << "}\n";
+  out << "}\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  try {
+    Options options = parseArguments(argc, argv);
+
+    Device device{nullptr};
+    Renderer renderer{nullptr, device, options.extent};
+    renderer.setFramesInFlight(options.framesInFlight);
+    EntityRegistry entities;
+    JobSystem jobs;
+    AssetLoader loader{device, entities, jobs};
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    Scene scene = buildScene(options, loader, entities);
+    double sceneReadyMs = elapsedMs(loadStart);
+    // measured frames always draw the real meshes
+    loader.waitIdle();
+    double sceneLoadMs = elapsedMs(loadStart);
+    MeshMemory meshMemory = measureMeshMemory(entities);
+
+    std::vector<RunResult> results;
+    for (uint32_t threadCount : options.threadCounts) {
+      results.push_back(runFrames(options, threadCount, device, renderer, entities, scene));
+    }
+    AllocatorStats memory = device.getAllocatorStats();
+
+    if (options.outputPath.empty()) {
+      writeJson(
+          std::cout,
+          options,
+          device,
+          renderer,
+          sceneReadyMs,
+          sceneLoadMs,
+          results,
+          memory,
+          meshMemory);
+    } else {
+      std::ofstream file{options.outputPath, std::ios::trunc};
+      if (!file.is_open()) {
+        throw std::runtime_error("failed to open file for writing: " + options.outputPath);
+      }
+      writeJson(
+          file,
+          options,
+          device,
+          renderer,
+          sceneReadyMs,
+          sceneLoadMs,
+          results,
+          memory,
+          meshMemory);
+      if (!file) {
+        throw std::runtime_error("failed to write results: " + options.outputPath);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
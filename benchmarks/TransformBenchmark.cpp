@@ -0,0 +1,153 @@
+// Compares the batched transform kernel against the per-object path SimpleRenderSystem used
+// before (TransformComponent::mat4() followed by projectionView * world) over 1M transforms,
+// and checks every SIMD level against that reference. Exits non-zero on a tolerance failure.
+
+#include "Camera.hpp"
+#include "GameObject.hpp"
+#include "TransformKernel.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace learnVulkan;
+
+namespace {
+
+constexpr uint32_t TRANSFORM_COUNT = 1000000;
+constexpr int RUNS = 5;
+// Allowed error in float epsilons (see maxError). The polynomial sincos is within a couple of
+// ulp of libm, and composing the matrix and the projection adds a few roundings on top.
+constexpr float TOLERANCE_EPSILONS = 32.f;
+
+struct Scene {
+  std::vector<glm::vec3> translations;
+  std::vector<glm::vec3> rotations;
+  std::vector<glm::vec3> scales;
+  glm::mat4 projectionView{1.f};
+};
+
+Scene makeScene(uint32_t count) {
+  std::mt19937 rng{1234};
+  std::uniform_real_distribution<float> position{-100.f, 100.f};
+  std::uniform_real_distribution<float> angle{-6.2831853f, 6.2831853f};
+  std::uniform_real_distribution<float> scale{0.1f, 4.f};
+
+  Scene scene;
+  scene.translations.resize(count);
+  scene.rotations.resize(count);
+  scene.scales.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    scene.translations[i] = {position(rng), position(rng), position(rng)};
+    scene.rotations[i] = {angle(rng), angle(rng), angle(rng)};
+    scene.scales[i] = {scale(rng), scale(rng), scale(rng)};
+  }
+
+  Camera camera{};
+  camera.setPerspectiveProjection(0.87f, 4.f / 3.f, 0.1f, 500.f);
+  camera.setViewTarget(glm::vec3{-1.f, -2.f, -2.f}, glm::vec3{0.f, 0.f, 2.5f});
+  scene.projectionView = camera.getProjection() * camera.getView();
+  return scene;
+}
+
+template <typename Fn>
+double bestOfRuns(Fn &&fn) {
+  double best = std::numeric_limits<double>::max();
+  for (int run = 0; run < RUNS; run++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    fn();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+// Largest error in units of float epsilon. Each element is compared relative to
+// max(1, magnitude(column, row)), the size of the terms that were summed to produce it, since
+// cancellation can leave a tiny result with an error proportional to those terms.
+template <typename Magnitude>
+float maxError(
+    const std::vector<glm::mat4> &result,
+    const std::vector<glm::mat4> &reference,
+    Magnitude &&magnitude) {
+  float worst = 0.f;
+  for (size_t i = 0; i < reference.size(); i++) {
+    for (int column = 0; column < 4; column++) {
+      for (int row = 0; row < 4; row++) {
+        float error = std::fabs(result[i][column][row] - reference[i][column][row]) /
+                      std::max(1.f, magnitude(i, column, row));
+        worst = std::max(worst, error / std::numeric_limits<float>::epsilon());
+      }
+    }
+  }
+  return worst;
+}
+
+}  // namespace
+
+int main() {
+  Scene scene = makeScene(TRANSFORM_COUNT);
+  std::vector<glm::mat4> referenceWorld(TRANSFORM_COUNT);
+  std::vector<glm::mat4> referenceMvp(TRANSFORM_COUNT);
+  std::vector<glm::mat4> world(TRANSFORM_COUNT);
+  std::vector<glm::mat4> mvp(TRANSFORM_COUNT);
+
+  double referenceMs = bestOfRuns([&] {
+    for (uint32_t i = 0; i < TRANSFORM_COUNT; i++) {
+      TransformComponent transform{};
+      transform.translation = scene.translations[i];
+      transform.rotation = scene.rotations[i];
+      transform.scale = scene.scales[i];
+      referenceWorld[i] = transform.mat4();
+      referenceMvp[i] = scene.projectionView * referenceWorld[i];
+    }
+  });
+
+  printf("%u transforms, best of %d runs, detected level: %s\n",
+         TRANSFORM_COUNT, RUNS, simdLevelName(detectSimdLevel()));
+  printf("%-10s %10s %10s %12s %12s\n", "path", "ms", "speedup", "world err", "mvp err");
+  printf("%-10s %10.2f %10.2f %12s %12s\n", "per-object", referenceMs, 1.0, "-", "-");
+
+  bool passed = true;
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2}) {
+    if (level > detectSimdLevel()) {
+      continue;
+    }
+    double ms = bestOfRuns([&] {
+      computeTransforms(
+          level,
+          scene.translations.data(),
+          scene.rotations.data(),
+          scene.scales.data(),
+          TRANSFORM_COUNT,
+          scene.projectionView,
+          world.data(),
+          mvp.data());
+    });
+    float worldError = maxError(world, referenceWorld, [&](size_t i, int column, int row) {
+      return std::fabs(referenceWorld[i][column][row]);
+    });
+    float mvpError = maxError(mvp, referenceMvp, [&](size_t i, int column, int row) {
+      float sum = 0.f;
+      for (int k = 0; k < 4; k++) {
+        sum += std::fabs(scene.projectionView[k][row] * referenceWorld[i][column][k]);
+      }
+      return sum;
+    });
+    bool ok = worldError <= TOLERANCE_EPSILONS && mvpError <= TOLERANCE_EPSILONS;
+    passed = passed && ok;
+    printf("%-10s %10.2f %10.2f %10.1f e %10.1f e%s\n",
+           simdLevelName(level), ms, referenceMs / ms, worldError, mvpError,
+           ok ? "" : "  FAILED");
+  }
+
+  printf("errors in float epsilons relative to the summed term magnitudes, tolerance %.0f\n",
+         TOLERANCE_EPSILONS);
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,8 +1,10 @@
 // std
+#include <algorithm>
 #include <array>
 #include "App.hpp"
 #include <iostream>
 #include <cassert>
+#include <stdexcept>
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -10,19 +12,70 @@
 #include <glm/glm.hpp>
 #include <chrono>
 #include <glm/gtc/constants.hpp>
+#include "DepthPyramid.hpp"
+#include "GpuCullingSystem.hpp"
+#include "SceneBvh.hpp"
 #include "SimpleRenderSystem.hpp"
 #include "KeyboardMovementController.hpp"
 #include "Camera.hpp"
+#include "Primitives.hpp"
 namespace learnVulkan{
-    App::App() {        
-        loadGameObjects();
+    namespace {
+        PresentMode nextPresentMode(PresentMode mode) {
+            switch (mode) {
+                case PresentMode::Fifo: return PresentMode::FifoRelaxed;
+                case PresentMode::FifoRelaxed: return PresentMode::Mailbox;
+                case PresentMode::Mailbox: return PresentMode::Immediate;
+                case PresentMode::Immediate: return PresentMode::Uncapped;
+                case PresentMode::Uncapped: return PresentMode::Fifo;
+            }
+            return PresentMode::Fifo;
+        }
+    }  // namespace
+
+    App::App(const AppConfig& config)
+        : m_Config{config},
+          m_Window{config.headless ? nullptr : std::make_unique<Window>(WIDTH, HEIGHT, "Hello Vulkan!")} {
+        m_Renderer.setFramesInFlight(config.framesInFlight);
+        m_Renderer.setPresentMode(config.presentMode);
+        m_Renderer.framePacer().setMode(
+            config.lowLatency ? FramePacer::Mode::LowLatency : FramePacer::Mode::Throughput);
+        loadEntities();
+    }
+
+    bool App::isRunning(uint32_t renderedFrames) const {
+        if (m_Window == nullptr) {
+            return renderedFrames < std::max(m_Config.frameCount, 1u);
+        }
+        return !m_Window->shouldClose() &&
+               (m_Config.frameCount == 0 || renderedFrames < m_Config.frameCount);
     }
 
     App::~App() {
     }
 
     void App::run() {
+        Profiler& profiler = m_Renderer.profiler();
+        profiler.setEnabled(m_Config.profile || !m_Config.tracePath.empty());
+
         SimpleRenderSystem simpleRenderSystem{m_Device,m_Renderer.getSwapChainRenderPass()};
+        simpleRenderSystem.setProfiler(&profiler);
+        // outlives the culling system, which keeps a pointer to it
+        std::unique_ptr<DepthPyramid> depthPyramid;
+        GpuCullingSystem cullingSystem{m_Device};
+        if (m_Config.occlusionCulling) {
+            depthPyramid = std::make_unique<DepthPyramid>(m_Device);
+            cullingSystem.setOcclusionCulling(depthPyramid.get());
+        }
+        if (m_Renderer.isHeadless()) {
+            // saved frames are compared against each other, so they must not show placeholders
+            m_AssetLoader.waitIdle();
+        }
+        m_Entities.updateWorldTransforms();
+        cullingSystem.setObjects(m_Entities);
+        // CPU side spatial index, for picking entities with the mouse
+        SceneBvh sceneBvh;
+        sceneBvh.setObjects(m_Entities);
         Camera camera{};
         camera.setViewTarget(glm::vec3(-1.f, -2.f, -2.f), glm::vec3(0.f, 0.f, 2.5f));
 
@@ -30,82 +83,169 @@ namespace learnVulkan{
         KeyboardMovementController cameraController{};
 
         auto currentTime = std::chrono::high_resolution_clock::now();
+        bool presentModeKeyDown = false;
+        bool pickButtonDown = false;
+        uint32_t renderedFrames = 0;
+        if (m_Renderer.isHeadless() && !m_Config.outputPath.empty()) {
+            m_Renderer.setReadbackEnabled(true);
+        }
 
-        while (!m_Window.shouldClose()) {
-            glfwPollEvents();
+        while (isRunning(renderedFrames)) {
+            // everything from here to the camera update is the frame's input
+            m_Renderer.waitForNextFrame();
+            if (m_Window != nullptr) {
+                glfwPollEvents();
+            }
 
             auto newTime = std::chrono::high_resolution_clock::now();
             float frameTime =
                 std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
             currentTime = newTime;
 
-            cameraController.moveInPlaneXZ(m_Window.getGLFWwindow(), frameTime, viewerObject);
+            if (m_Window != nullptr) {
+                cameraController.moveInPlaneXZ(m_Window->getGLFWwindow(), frameTime, viewerObject);
+
+                bool keyDown = glfwGetKey(m_Window->getGLFWwindow(), GLFW_KEY_P) == GLFW_PRESS;
+                if (keyDown && !presentModeKeyDown) {
+                    m_Renderer.setPresentMode(nextPresentMode(m_Renderer.getRequestedPresentMode()));
+                }
+                presentModeKeyDown = keyDown;
+            }
             camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
 
 
 
             float aspect = m_Renderer.getAspectRatio();
             camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 10.f);
+            LodSelector lodSelector{m_Config.lodPixelError};
+            lodSelector.setViewport(
+                camera.getProjection(), static_cast<float>(m_Renderer.getSwapChainExtent().height));
+            cullingSystem.setLodSelector(lodSelector);
+
+            {
+                // only entities moved since the last frame, and their children, are recomputed
+                Profiler::CpuScope updateScope{profiler, "update"};
+                bool wasLoading = !m_AssetLoader.isIdle();
+                for (ModelId id : m_AssetLoader.update()) {
+                    cullingSystem.updateModel(m_Entities, id);
+                    sceneBvh.updateModel(m_Entities, id);
+                }
+                if (wasLoading && m_AssetLoader.isIdle()) {
+                    m_AssetsLoadedMs =
+                        std::chrono::duration<float, std::chrono::milliseconds::period>(
+                            std::chrono::high_resolution_clock::now() - m_StartTime).count();
+                }
+                m_Entities.updateWorldTransforms();
+                cullingSystem.updateChangedObjects(m_Entities);
+                sceneBvh.updateChangedObjects(m_Entities);
+            }
+
+            if (m_Window != nullptr) {
+                GLFWwindow* window = m_Window->getGLFWwindow();
+                bool buttonDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+                if (buttonDown && !pickButtonDown) {
+                    // cursor and window size are both in screen coordinates, y down like NDC
+                    double cursorX, cursorY;
+                    int windowWidth, windowHeight;
+                    glfwGetCursorPos(window, &cursorX, &cursorY);
+                    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+                    glm::vec2 ndc{
+                        2.f * static_cast<float>(cursorX) / std::max(windowWidth, 1) - 1.f,
+                        2.f * static_cast<float>(cursorY) / std::max(windowHeight, 1) - 1.f};
+                    Ray ray = makePickRay(camera.getProjection() * camera.getView(), ndc);
+                    RayHit hit{};
+                    m_PickedEntity = sceneBvh.pick(m_Entities, ray, hit)
+                                         ? m_Entities.handleAt(hit.item)
+                                         : EntityHandle{};
+                }
+                pickButtonDown = buttonDown;
+            }
 
             if(auto commandBuffer = m_Renderer.beginFrame()){
-                m_Renderer.beginSwapChainRenderPass(commandBuffer);
-                simpleRenderSystem.renderGameObjects(commandBuffer,m_GameObjects,camera);
-                m_Renderer.endSwapChainRenderPass(commandBuffer);
+                int frameIndex = m_Renderer.getFrameIndex();
+                {
+                    Profiler::CpuScope recordScope{profiler, "record"};
+                    if (depthPyramid != nullptr) {
+                        // after beginFrame, which may have recreated the swap chain
+                        depthPyramid->resize(m_Renderer.getSwapChainExtent());
+                    }
+                    {
+                        // culling runs before the render pass, compute dispatches are not allowed inside it
+                        Profiler::GpuScope cullScope{profiler, commandBuffer, "cull"};
+                        cullingSystem.cull(commandBuffer, frameIndex, camera);
+                    }
+                    m_Renderer.beginSwapChainRenderPass(commandBuffer);
+                    simpleRenderSystem.renderIndirect(commandBuffer, frameIndex, cullingSystem, camera);
+                    m_Renderer.endSwapChainRenderPass(commandBuffer);
+                    if (cullingSystem.isOcclusionCullingActive()) {
+                        // the pyramid built from the early draws serves the late pass of this
+                        // frame and the early pass of the next
+                        {
+                            Profiler::GpuScope occlusionScope{profiler, commandBuffer, "occlusion cull"};
+                            depthPyramid->build(
+                                commandBuffer,
+                                frameIndex,
+                                m_Renderer.getCurrentDepthImage(),
+                                m_Renderer.getCurrentDepthImageView(),
+                                m_Renderer.getDepthFormat());
+                            cullingSystem.cullLate(commandBuffer, frameIndex, camera);
+                        }
+                        m_Renderer.resumeSwapChainRenderPass(commandBuffer);
+                        simpleRenderSystem.renderIndirect(
+                            commandBuffer, frameIndex, cullingSystem, camera, true);
+                        m_Renderer.endSwapChainRenderPass(commandBuffer);
+                    }
+                }
                 m_Renderer.endFrame();
+                renderedFrames++;
+
+                if (m_FirstFrameMs < 0.f) {
+                    m_FirstFrameMs =
+                        std::chrono::duration<float, std::chrono::milliseconds::period>(
+                            std::chrono::high_resolution_clock::now() - m_StartTime).count();
+                }
             }
         }
 
         vkDeviceWaitIdle(m_Device.device()); //CPU block untill everything finished;
-    }
 
-    std::unique_ptr<Model> createCubeModel(Device& device, glm::vec3 offset) {
-        Model::Builder modelBuilder{};
-        modelBuilder.vertices = {
-            // left face (white)
-            {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
-            {{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
-            {{-.5f, -.5f, .5f}, {.9f, .9f, .9f}},
-            {{-.5f, .5f, -.5f}, {.9f, .9f, .9f}},
-
-            // right face (yellow)
-            {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}},
-            {{.5f, .5f, .5f}, {.8f, .8f, .1f}},
-            {{.5f, -.5f, .5f}, {.8f, .8f, .1f}},
-            {{.5f, .5f, -.5f}, {.8f, .8f, .1f}},
-
-            // top face (orange, remember y axis points down)
-            {{-.5f, -.5f, -.5f}, {.9f, .6f, .1f}},
-            {{.5f, -.5f, .5f}, {.9f, .6f, .1f}},
-            {{-.5f, -.5f, .5f}, {.9f, .6f, .1f}},
-            {{.5f, -.5f, -.5f}, {.9f, .6f, .1f}},
-
-            // bottom face (red)
-            {{-.5f, .5f, -.5f}, {.8f, .1f, .1f}},
-            {{.5f, .5f, .5f}, {.8f, .1f, .1f}},
-            {{-.5f, .5f, .5f}, {.8f, .1f, .1f}},
-            {{.5f, .5f, -.5f}, {.8f, .1f, .1f}},
-
-            // nose face (blue)
-            {{-.5f, -.5f, 0.5f}, {.1f, .1f, .8f}},
-            {{.5f, .5f, 0.5f}, {.1f, .1f, .8f}},
-            {{-.5f, .5f, 0.5f}, {.1f, .1f, .8f}},
-            {{.5f, -.5f, 0.5f}, {.1f, .1f, .8f}},
-
-            // tail face (green)
-            {{-.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
-            {{.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
-            {{-.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
-            {{.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
-        };
-        for (auto& v : modelBuilder.vertices) {
-            v.position += offset;
+        if (m_Renderer.isHeadless() && !m_Config.outputPath.empty()) {
+            if (!m_Renderer.saveFrame(m_Config.outputPath)) {
+                throw std::runtime_error("no frame was rendered to save!");
+            }
+            std::cout << "Saved last frame to " << m_Config.outputPath << std::endl;
         }
-
-        modelBuilder.indices = {0,  1,  2,  0,  3,  1,  4,  5,  6,  4,  7,  5,  8,  9,  10, 8,  11, 9,
-                                12, 13, 14, 12, 15, 13, 16, 17, 18, 16, 19, 17, 20, 21, 22, 20, 23, 21};
-
-        return std::make_unique<Model>(device, modelBuilder);
+        if (profiler.isEnabled()) {
+            profiler.printStats(std::cout);
+            if (m_FirstFrameMs >= 0.f) {
+                std::cout << "first frame after " << m_FirstFrameMs << " ms ("
+                          << (m_Device.isPipelineCacheWarm() ? "warm" : "cold")
+                          << " pipeline cache)" << std::endl;
+            }
+            if (m_AssetsLoadedMs >= 0.f) {
+                std::cout << "all assets loaded after " << m_AssetsLoadedMs << " ms" << std::endl;
+            }
+            if (cullingSystem.isOcclusionCullingActive()) {
+                std::cout << "occlusion culling: " << cullingSystem.getOccludedCount() << " of "
+                          << cullingSystem.getObjectCount() << " objects hidden, "
+                          << cullingSystem.getVisibleCount() << " drawn" << std::endl;
+            }
+            FramePacer::LatencyStats latency = m_Renderer.framePacer().getLatencyStats();
+            std::cout << "present mode " << presentModeName(m_Renderer.getActivePresentMode())
+                      << ", " << m_Renderer.framePacer().getPresentRate() << " presents/s"
+                      << std::endl;
+            std::cout << "input to present: avg " << latency.avgMs << " ms, p99 " << latency.p99Ms
+                      << " ms, max " << latency.maxMs << " ms (" << m_Renderer.getFramesInFlight()
+                      << " frames in flight, "
+                      << (m_Config.lowLatency ? "low latency" : "throughput") << " pacing)"
+                      << std::endl;
         }
+        if (!m_Config.tracePath.empty()) {
+            profiler.writeChromeTrace(m_Config.tracePath);
+            std::cout << "Wrote trace to " << m_Config.tracePath << std::endl;
+        }
+    }
+
     // std::unique_ptr<Model> createCubeModel(Device& device, glm::vec3 offset){
         
     //     std::vector<Model::Vertex> vertices{            
@@ -157,12 +297,25 @@ namespace learnVulkan{
     //     }
     //     return std::make_unique<Model>(device, vertices);
     // }
-    void App::loadGameObjects() {
-        std::shared_ptr<Model> model = createCubeModel(m_Device, {.0f, .0f, .0f});
-        auto cube = GameObject::createGameObject();
-        cube.model = model;
-        cube.transform.translation = {.0f, .0f, 2.5f};
-        cube.transform.scale = {.5f, .5f, .5f};
-        m_GameObjects.push_back(std::move(cube));
+    // Only queues the loads: every model shows the placeholder until the asset loader has
+    // parsed and uploaded it, so the first frame does not wait for the scene.
+    void App::loadEntities() {
+        ModelId cubeModel = m_AssetLoader.loadModel([] { return buildCube({.0f, .0f, .0f}); });
+        auto cube = m_Entities.create();
+        m_Entities.model(cube) = cubeModel;
+        m_Entities.translation(cube) = {.0f, .0f, 2.5f};
+        m_Entities.scale(cube) = {.5f, .5f, .5f};
+
+        for (size_t i = 0; i < m_Config.meshPaths.size(); i++) {
+            ModelId meshModel = m_AssetLoader.loadModel(
+                m_Config.meshPaths[i],
+                Model::VertexUsage::Static,
+                m_Config.meshLayout,
+                m_Config.meshlets);
+            auto mesh = m_Entities.create();
+            m_Entities.model(mesh) = meshModel;
+            m_Entities.translation(mesh) = {1.f + static_cast<float>(i), .0f, 2.5f};
+            m_Entities.scale(mesh) = {.5f, .5f, .5f};
+        }
     }
 }  // names
\ No newline at end of file
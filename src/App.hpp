@@ -1,34 +1,90 @@
 #pragma once
 #include "Window.hpp"
+#include "AssetLoader.hpp"
+#include "JobSystem.hpp"
 #include "Model.hpp"
 #include "Renderer.hpp"
+#include "EntityRegistry.hpp"
 #include "GameObject.hpp"
 #include "Device.hpp"
 #include "SwapChain.hpp"
 
 
+#include <chrono>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace learnVulkan
 {
+    struct AppConfig
+    {
+        // render offscreen without a window, e.g. on display-less nodes or in CI
+        bool headless = false;
+        // frames to render before returning; 0 runs until the window is closed, or a
+        // single frame when headless
+        uint32_t frameCount = 0;
+        // headless only: the last frame is read back and saved here as .ppm or .png
+        std::string outputPath;
+        // print min/avg/p99 of the CPU and GPU profiler scopes on exit
+        bool profile = false;
+        // write the profiler's Chrome trace here on exit; enables the profiler
+        std::string tracePath;
+        // frames recorded ahead of the GPU, 1 to SwapChain::MAX_FRAMES_IN_FLIGHT; deeper
+        // queues favour throughput, shallower ones latency
+        uint32_t framesInFlight = SwapChain::DEFAULT_FRAMES_IN_FLIGHT;
+        // sample input as late as possible, see FramePacer
+        bool lowLatency = false;
+        // requested present mode, cycled at runtime with the P key; Uncapped for benchmarks
+        PresentMode presentMode = PresentMode::Mailbox;
+        // OBJ files loaded in the background next to the cube, placeholders until ready
+        std::vector<std::string> meshPaths;
+        // GPU vertex format of the meshPaths models
+        VertexLayout meshLayout = VertexLayout::standard();
+        // split the meshPaths models into meshlets, culled one by one on the GPU
+        bool meshlets = false;
+        // largest simplification error, in pixels, a level of detail may show on screen; 0
+        // always draws full detail
+        float lodPixelError = 1.f;
+        // skip objects hidden behind others, tested against a depth pyramid in two passes; off
+        // until its cost against the saved draws has been measured on real scenes
+        bool occlusionCulling = false;
+    };
+
     class App
     {
     private:
-        Window m_Window{WIDTH,HEIGHT,"Hello Vulkan!"};
-        Device m_Device{m_Window};
-        Renderer m_Renderer{m_Window,m_Device};
-        std::vector<GameObject> m_GameObjects;
+        // declared first so it is taken before the window and device are created
+        std::chrono::high_resolution_clock::time_point m_StartTime{
+            std::chrono::high_resolution_clock::now()};
+        AppConfig m_Config;
+        std::unique_ptr<Window> m_Window;  // null when headless
+        Device m_Device{m_Window.get()};
+        Renderer m_Renderer{m_Window.get(), m_Device, {WIDTH, HEIGHT}};
+        EntityRegistry m_Entities;
+        JobSystem m_Jobs;
+        // after m_Jobs, its jobs have to finish before the job system goes away
+        AssetLoader m_AssetLoader{m_Device, m_Entities, m_Jobs};
+        // entity under the cursor at the last left click, invalid when it hit nothing
+        EntityHandle m_PickedEntity{};
+        // startup to the moment the asset loader went idle, negative while it is still loading
+        float m_AssetsLoadedMs = -1.f;
+        // startup to the end of the first frame, negative until it was rendered
+        float m_FirstFrameMs = -1.f;
 
         
-        void loadGameObjects();
+        void loadEntities();
+        bool isRunning(uint32_t renderedFrames) const;
     public:
-        App(/* args */);
+        explicit App(const AppConfig& config = {});
         ~App();
         App(const App&) = delete;
         App &operator=(const App&)=delete;
 
         void run();
+        EntityHandle getPickedEntity() const { return m_PickedEntity; }
+        float getAssetsLoadedMs() const { return m_AssetsLoadedMs; }
+        float getFirstFrameMs() const { return m_FirstFrameMs; }
         static constexpr int WIDTH = 800;
         static constexpr int HEIGHT = 600;
     };    
@@ -0,0 +1,154 @@
+#include "AssetLoader.hpp"
+
+#include "MeshLoader.hpp"
+#include "Primitives.hpp"
+
+// std
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace learnVulkan {
+
+AssetLoader::AssetLoader(Device &device, EntityRegistry &entities, JobSystem &jobs)
+    : device{device},
+      entities{entities},
+      jobs{jobs},
+      placeholder{createCubeModel(device, {0.f, 0.f, 0.f})} {}
+
+AssetLoader::~AssetLoader() {
+  // jobs still queued run as no-ops, the job system must outlive the loader
+  std::unique_lock<std::mutex> lock{mutex};
+  cancelled = true;
+  jobFinished.wait(lock, [this] { return runningJobs == 0; });
+}
+
+ModelId AssetLoader::loadModel(
+    const std::string &filepath,
+    Model::VertexUsage vertexUsage,
+    const VertexLayout &vertexLayout,
+    bool meshlets) {
+  return submit(
+      [filepath, vertexUsage, vertexLayout, meshlets](Model::Builder &builder) {
+        builder.vertexUsage = vertexUsage;
+        builder.vertexLayout = vertexLayout;
+        builder.meshlets = meshlets;
+        loadMeshCached(filepath, builder);
+      },
+      filepath);
+}
+
+ModelId AssetLoader::loadModel(std::function<Model::Builder()> build) {
+  return submit(
+      [build = std::move(build)](Model::Builder &builder) { builder = build(); }, "generated mesh");
+}
+
+ModelId AssetLoader::submit(std::function<void(Model::Builder &)> load, const std::string &name) {
+  ModelId id = entities.addModel(placeholder);
+  pendingCount++;
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    runningJobs++;
+  }
+
+  jobs.submit([this, id, name, load = std::move(load)] {
+    bool skip;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      skip = cancelled;
+    }
+
+    LoadedMesh mesh{};
+    mesh.id = id;
+    if (!skip) {
+      try {
+        load(mesh.builder);
+        // unless the mesh cache already had them, so the main thread only copies them
+        if (mesh.builder.meshlets && mesh.builder.meshletData.empty()) {
+          mesh.builder.buildMeshlets();
+        }
+      } catch (const std::exception &e) {
+        mesh.error = name + ": " + e.what();
+      }
+    }
+
+    // notified with the lock held, the destructor may return as soon as it is released
+    std::lock_guard<std::mutex> lock{mutex};
+    if (!skip) {
+      finished.push_back(std::move(mesh));
+    }
+    runningJobs--;
+    jobFinished.notify_all();
+  });
+  return id;
+}
+
+const std::vector<ModelId> &AssetLoader::update() {
+  swapped.clear();
+  if (pendingCount == 0) {
+    return swapped;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    for (auto &mesh : finished) {
+      toCreate.push_back(std::move(mesh));
+    }
+    finished.clear();
+  }
+
+  // creating a model copies its arrays into the staging ring, which blocks once the ring is
+  // full, so a burst of finished meshes is spread over several frames
+  size_t created = 0;
+  VkDeviceSize uploadedBytes = 0;
+  for (; created < toCreate.size(); created++) {
+    LoadedMesh &mesh = toCreate[created];
+    if (!mesh.error.empty()) {
+      std::string error = std::move(mesh.error);
+      toCreate.erase(toCreate.begin(), toCreate.begin() + created + 1);
+      pendingCount--;
+      throw std::runtime_error("failed to load model " + error);
+    }
+    VkDeviceSize bytes =
+        static_cast<VkDeviceSize>(mesh.builder.vertexLayout.stride()) *
+            mesh.builder.vertices.size() +
+        sizeof(uint32_t) * mesh.builder.indices.size();
+    if (created > 0 && uploadedBytes + bytes > uploadBudget) {
+      break;
+    }
+    uploads.push_back({mesh.id, std::make_shared<Model>(device, mesh.builder)});
+    uploadedBytes += bytes;
+  }
+  toCreate.erase(toCreate.begin(), toCreate.begin() + created);
+
+  // swapped only once the transfer has completed, so no frame ever draws a half uploaded model
+  size_t kept = 0;
+  for (auto &upload : uploads) {
+    if (upload.model->isReady()) {
+      entities.replaceModel(upload.id, std::move(upload.model));
+      swapped.push_back(upload.id);
+      pendingCount--;
+    } else {
+      uploads[kept++] = std::move(upload);
+    }
+  }
+  uploads.resize(kept);
+  return swapped;
+}
+
+void AssetLoader::waitIdle() {
+  while (pendingCount > 0) {
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      jobFinished.wait(lock, [this] {
+        return !finished.empty() || runningJobs == 0 || !toCreate.empty() || !uploads.empty();
+      });
+    }
+    update();
+    device.uploadScheduler().flush();
+    device.uploadScheduler().waitIdle();
+    update();
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Device.hpp"
+#include "EntityRegistry.hpp"
+#include "JobSystem.hpp"
+#include "Model.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace learnVulkan {
+
+// Loads models in the background. Parsing and decompression run as jobs on the JobSystem;
+// only the main thread touches Vulkan, creating the buffers of finished meshes in update(),
+// so every upload still goes through the device's UploadScheduler and is submitted by
+// Renderer::beginFrame. Until its model is uploaded a ModelId shows a shared placeholder
+// cube, which keeps the time to the first frame independent of the scene size.
+class AssetLoader {
+ public:
+  static constexpr VkDeviceSize DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+  AssetLoader(Device &device, EntityRegistry &entities, JobSystem &jobs);
+  // Waits for the jobs already running; queued ones are skipped.
+  ~AssetLoader();
+
+  AssetLoader(const AssetLoader &) = delete;
+  AssetLoader &operator=(const AssetLoader &) = delete;
+
+  // Returns a ModelId right away and loads the OBJ file (through its mesh cache) on a worker.
+  ModelId loadModel(
+      const std::string &filepath,
+      Model::VertexUsage vertexUsage = Model::VertexUsage::Static,
+      const VertexLayout &vertexLayout = {},
+      bool meshlets = false);
+  // Same for geometry generated in code; build runs on a worker thread.
+  ModelId loadModel(std::function<Model::Builder()> build);
+
+  // Call once per frame on the main thread, before Renderer::beginFrame. Creates the models of
+  // finished jobs, at most uploadBudget bytes of vertices and indices per call but always at
+  // least one model, and swaps in those whose upload has completed. Returns the ids swapped
+  // by this call, to be passed on to GpuCullingSystem::updateModel. Rethrows the error of a
+  // failed job.
+  const std::vector<ModelId> &update();
+
+  // Blocks until every requested model is swapped in, e.g. behind a loading screen.
+  void waitIdle();
+
+  // requested models that are not swapped in yet
+  uint32_t getPendingCount() const { return pendingCount; }
+  bool isIdle() const { return pendingCount == 0; }
+  void setUploadBudget(VkDeviceSize bytes) { uploadBudget = bytes; }
+
+ private:
+  struct LoadedMesh {
+    ModelId id = NO_MODEL;
+    Model::Builder builder{};
+    std::string error;  // set instead of builder when the job failed
+  };
+
+  struct Upload {
+    ModelId id = NO_MODEL;
+    std::shared_ptr<Model> model;
+  };
+
+  ModelId submit(std::function<void(Model::Builder &)> load, const std::string &name);
+
+  Device &device;
+  EntityRegistry &entities;
+  JobSystem &jobs;
+
+  // shown by every ModelId until its own model is ready; as the loader keeps it alive, the
+  // pointer EntityRegistry::replaceModel hands back is never the last reference and frames
+  // in flight can go on drawing it
+  std::shared_ptr<Model> placeholder;
+  VkDeviceSize uploadBudget = DEFAULT_UPLOAD_BUDGET;
+  uint32_t pendingCount = 0;
+
+  // main thread only
+  std::vector<LoadedMesh> toCreate;
+  std::vector<Upload> uploads;
+  std::vector<ModelId> swapped;
+
+  // handed over from the jobs, guarded by mutex
+  std::mutex mutex;
+  std::condition_variable jobFinished;
+  std::vector<LoadedMesh> finished;
+  uint32_t runningJobs = 0;
+  bool cancelled = false;
+};
+
+}  // namespace learnVulkan
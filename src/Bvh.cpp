@@ -0,0 +1,415 @@
+#include "Bvh.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace learnVulkan {
+
+namespace {
+
+// centroids are sorted into this many bins per axis to evaluate the split candidates
+constexpr uint32_t BIN_COUNT = 16;
+// cost of visiting a node relative to testing an item, in the surface area heuristic
+constexpr float TRAVERSAL_COST = 1.f;
+
+struct Bin {
+  Aabb bounds;
+  uint32_t count = 0;
+};
+
+uint32_t binOf(float centroid, float binMin, float binScale) {
+  auto bin = static_cast<uint32_t>((centroid - binMin) * binScale);
+  return std::min(bin, BIN_COUNT - 1);
+}
+
+bool intersectSlabs(
+    const glm::vec3 &origin,
+    const glm::vec3 &inverseDirection,
+    const glm::vec3 &boxMin,
+    const glm::vec3 &boxMax,
+    float maxDistance,
+    float &distance) {
+  glm::vec3 t0 = (boxMin - origin) * inverseDirection;
+  glm::vec3 t1 = (boxMax - origin) * inverseDirection;
+  glm::vec3 near = glm::min(t0, t1);
+  glm::vec3 far = glm::max(t0, t1);
+  float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+  float exit = std::min(std::min(far.x, far.y), far.z);
+  if (enter > exit || enter > maxDistance) {
+    return false;
+  }
+  distance = enter;
+  return true;
+}
+
+}  // namespace
+
+Aabb Aabb::transformed(const Aabb &local, const glm::mat4 &transform) {
+  // the extent along each world axis sums the absolute projections of the local half extents
+  glm::vec3 center = local.center();
+  glm::vec3 halfExtent = (local.max - local.min) * .5f;
+  glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.f));
+  glm::vec3 worldHalfExtent = glm::abs(glm::vec3(transform[0])) * halfExtent.x +
+                              glm::abs(glm::vec3(transform[1])) * halfExtent.y +
+                              glm::abs(glm::vec3(transform[2])) * halfExtent.z;
+  return {worldCenter - worldHalfExtent, worldCenter + worldHalfExtent};
+}
+
+bool intersectRayAabb(const Ray &ray, const Aabb &box, float &distance) {
+  return intersectSlabs(
+      ray.origin, 1.f / ray.direction, box.min, box.max, ray.maxDistance, distance);
+}
+
+void Bvh::clear() {
+  nodes.clear();
+  parents.clear();
+  slotItems.clear();
+  slotBounds.clear();
+  leafOfSlot.clear();
+  slotOfItem.clear();
+  dirtyFlags.clear();
+  dirtyNodes.clear();
+  builtArea = currentArea = 0.f;
+}
+
+void Bvh::build(const uint32_t *items, const Aabb *bounds, uint32_t count) {
+  clear();
+  if (count == 0) {
+    return;
+  }
+
+  std::vector<uint32_t> order(count);
+  std::iota(order.begin(), order.end(), 0u);
+  buildNodes(bounds, count, order);
+
+  slotItems.resize(count);
+  slotBounds.resize(count);
+  uint32_t maxItem = *std::max_element(items, items + count);
+  slotOfItem.assign(static_cast<size_t>(maxItem) + 1, NO_SLOT);
+  for (uint32_t slot = 0; slot < count; slot++) {
+    slotItems[slot] = items[order[slot]];
+    slotBounds[slot] = bounds[order[slot]];
+    assert(slotOfItem[slotItems[slot]] == NO_SLOT && "item ids must be unique");
+    slotOfItem[slotItems[slot]] = slot;
+  }
+  leafOfSlot.resize(count);
+  for (uint32_t index = 0; index < nodes.size(); index++) {
+    const Node &node = nodes[index];
+    for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+      leafOfSlot[slot] = index;
+    }
+  }
+  dirtyFlags.assign(nodes.size(), 0);
+  builtArea = currentArea = innerArea();
+}
+
+// Splits top down with an explicit stack. Each node takes the cheapest of the binned split
+// candidates on all three axes, or becomes a leaf when that is cheaper and small enough.
+// order is partitioned along, so every subtree ends up as one contiguous range of it.
+void Bvh::buildNodes(const Aabb *bounds, uint32_t count, std::vector<uint32_t> &order) {
+  std::vector<glm::vec3> centroids(count);
+  for (uint32_t i = 0; i < count; i++) {
+    centroids[i] = bounds[i].center();
+  }
+
+  struct Task {
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+  };
+  nodes.reserve(2 * static_cast<size_t>(count));
+  parents.reserve(2 * static_cast<size_t>(count));
+  nodes.push_back({});
+  parents.push_back(NO_NODE);
+  std::vector<Task> stack{{0, 0, count}};
+  while (!stack.empty()) {
+    Task task = stack.back();
+    stack.pop_back();
+    uint32_t itemCount = task.end - task.begin;
+
+    Aabb nodeBounds;
+    Aabb centroidBounds;
+    for (uint32_t i = task.begin; i < task.end; i++) {
+      nodeBounds.expand(bounds[order[i]]);
+      centroidBounds.expand(centroids[order[i]]);
+    }
+    nodes[task.node].boundsMin = nodeBounds.min;
+    nodes[task.node].boundsMax = nodeBounds.max;
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+    glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+    for (int axis = 0; itemCount > 1 && axis < 3; axis++) {
+      if (centroidExtent[axis] <= 0.f) {
+        continue;
+      }
+      float binScale = static_cast<float>(BIN_COUNT) / centroidExtent[axis];
+      Bin bins[BIN_COUNT];
+      for (uint32_t i = task.begin; i < task.end; i++) {
+        Bin &bin = bins[binOf(centroids[order[i]][axis], centroidBounds.min[axis], binScale)];
+        bin.bounds.expand(bounds[order[i]]);
+        bin.count++;
+      }
+
+      // split after bin b: left holds bins [0, b], right the rest
+      float rightArea[BIN_COUNT - 1];
+      uint32_t rightCount[BIN_COUNT - 1];
+      Aabb right;
+      uint32_t rightItems = 0;
+      for (uint32_t b = BIN_COUNT - 1; b > 0; b--) {
+        right.expand(bins[b].bounds);
+        rightItems += bins[b].count;
+        rightArea[b - 1] = right.surfaceArea();
+        rightCount[b - 1] = rightItems;
+      }
+      Aabb left;
+      uint32_t leftItems = 0;
+      for (uint32_t b = 0; b < BIN_COUNT - 1; b++) {
+        left.expand(bins[b].bounds);
+        leftItems += bins[b].count;
+        if (leftItems == 0 || rightCount[b] == 0) {
+          continue;
+        }
+        float cost = left.surfaceArea() * static_cast<float>(leftItems) +
+                     rightArea[b] * static_cast<float>(rightCount[b]);
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = b;
+        }
+      }
+    }
+
+    float nodeArea = nodeBounds.surfaceArea();
+    float leafCost = nodeArea * static_cast<float>(itemCount);
+    float splitCost = TRAVERSAL_COST * nodeArea + bestCost;
+    if (itemCount == 1 ||
+        (itemCount <= MAX_LEAF_ITEMS && (bestAxis < 0 || leafCost <= splitCost))) {
+      nodes[task.node].first = task.begin;
+      nodes[task.node].count = itemCount;
+      continue;
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0) {
+      float binMin = centroidBounds.min[bestAxis];
+      float binScale = static_cast<float>(BIN_COUNT) / centroidExtent[bestAxis];
+      auto split = std::partition(
+          order.begin() + task.begin, order.begin() + task.end, [&](uint32_t i) {
+            return binOf(centroids[i][bestAxis], binMin, binScale) <= bestBin;
+          });
+      middle = static_cast<uint32_t>(split - order.begin());
+    } else {
+      // every centroid in the same spot, no split separates them; halve to bound the leaves
+      middle = task.begin + itemCount / 2;
+    }
+
+    auto firstChild = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+    nodes.push_back({});
+    parents.push_back(task.node);
+    parents.push_back(task.node);
+    nodes[task.node].first = firstChild;
+    nodes[task.node].count = 0;
+    stack.push_back({firstChild, task.begin, middle});
+    stack.push_back({firstChild + 1, middle, task.end});
+  }
+}
+
+float Bvh::innerArea() const {
+  float area = 0.f;
+  for (const Node &node : nodes) {
+    if (node.count == 0) {
+      area += node.bounds().surfaceArea();
+    }
+  }
+  return area;
+}
+
+float Bvh::getCost() const {
+  if (nodes.empty()) {
+    return 0.f;
+  }
+  float rootArea = nodes[0].bounds().surfaceArea();
+  return rootArea > 0.f ? currentArea / rootArea : 0.f;
+}
+
+void Bvh::updateItem(uint32_t item, const Aabb &bounds) {
+  assert(contains(item) && "item was not part of the build");
+  uint32_t slot = slotOfItem[item];
+  slotBounds[slot] = bounds;
+  uint32_t leaf = leafOfSlot[slot];
+  if (!dirtyFlags[leaf]) {
+    dirtyFlags[leaf] = 1;
+    dirtyNodes.push_back(leaf);
+  }
+}
+
+void Bvh::refitNode(uint32_t index) {
+  Node &node = nodes[index];
+  Aabb bounds;
+  if (node.count > 0) {
+    for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+      bounds.expand(slotBounds[slot]);
+    }
+  } else {
+    bounds.expand(nodes[node.first].bounds());
+    bounds.expand(nodes[node.first + 1].bounds());
+    currentArea += bounds.surfaceArea() - node.bounds().surfaceArea();
+  }
+  node.boundsMin = bounds.min;
+  node.boundsMax = bounds.max;
+}
+
+// Children always come after their parent, so refitting in descending index order sees every
+// child before its parent.
+void Bvh::refit() {
+  if (dirtyNodes.empty()) {
+    return;
+  }
+
+  if (dirtyNodes.size() * 8 > nodes.size()) {
+    // most paths to the root are dirty anyway, one pass over all nodes is cheaper
+    for (uint32_t index = static_cast<uint32_t>(nodes.size()); index-- > 0;) {
+      refitNode(index);
+    }
+    currentArea = innerArea();
+  } else {
+    size_t leafCount = dirtyNodes.size();
+    for (size_t i = 0; i < leafCount; i++) {
+      // stops at the first ancestor another leaf already marked, with all of its own
+      for (uint32_t node = parents[dirtyNodes[i]]; node != NO_NODE && !dirtyFlags[node];
+           node = parents[node]) {
+        dirtyFlags[node] = 1;
+        dirtyNodes.push_back(node);
+      }
+    }
+    std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<uint32_t>());
+    for (uint32_t index : dirtyNodes) {
+      refitNode(index);
+    }
+  }
+  for (uint32_t index : dirtyNodes) {
+    dirtyFlags[index] = 0;
+  }
+  dirtyNodes.clear();
+
+  if (currentArea > builtArea * REBUILD_AREA_RATIO) {
+    std::vector<uint32_t> items = slotItems;
+    std::vector<Aabb> bounds = slotBounds;
+    build(items.data(), bounds.data(), static_cast<uint32_t>(items.size()));
+    rebuildCount++;
+  }
+}
+
+void Bvh::queryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const {
+  if (nodes.empty()) {
+    return;
+  }
+  struct Entry {
+    uint32_t node;
+    bool inside;  // an ancestor was entirely inside, skip the tests
+  };
+  std::vector<Entry> stack{{0, false}};
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    const Node &node = nodes[entry.node];
+    if (!entry.inside) {
+      Frustum::Containment containment = frustum.classifyAabb(node.boundsMin, node.boundsMax);
+      if (containment == Frustum::Containment::Outside) {
+        continue;
+      }
+      entry.inside = containment == Frustum::Containment::Inside;
+    }
+
+    if (node.count > 0) {
+      for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+        if (entry.inside || frustum.intersectsAabb(slotBounds[slot].min, slotBounds[slot].max)) {
+          items.push_back(slotItems[slot]);
+        }
+      }
+    } else {
+      stack.push_back({node.first + 1, entry.inside});
+      stack.push_back({node.first, entry.inside});
+    }
+  }
+}
+
+bool Bvh::raycast(const Ray &ray, RayHit &hit, const ItemRayTest &itemTest) const {
+  if (nodes.empty()) {
+    return false;
+  }
+  glm::vec3 inverseDirection = 1.f / ray.direction;
+  float best = ray.maxDistance;
+  uint32_t bestItem = NO_SLOT;
+
+  struct Entry {
+    uint32_t node;
+    float distance;  // where the ray enters the node
+  };
+  std::vector<Entry> stack;
+  float rootDistance;
+  if (intersectSlabs(
+          ray.origin, inverseDirection, nodes[0].boundsMin, nodes[0].boundsMax, best,
+          rootDistance)) {
+    stack.push_back({0, rootDistance});
+  }
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    if (entry.distance > best) {
+      continue;  // a hit found meanwhile is closer than the whole node
+    }
+    const Node &node = nodes[entry.node];
+
+    if (node.count > 0) {
+      for (uint32_t slot = node.first; slot < node.first + node.count; slot++) {
+        float distance;
+        if (!intersectSlabs(
+                ray.origin, inverseDirection, slotBounds[slot].min, slotBounds[slot].max, best,
+                distance)) {
+          continue;
+        }
+        if (itemTest && !itemTest(slotItems[slot], distance)) {
+          continue;
+        }
+        if (distance <= best) {
+          best = distance;
+          bestItem = slotItems[slot];
+        }
+      }
+      continue;
+    }
+
+    Entry children[2];
+    uint32_t childCount = 0;
+    for (uint32_t child = node.first; child < node.first + 2; child++) {
+      float distance;
+      if (intersectSlabs(
+              ray.origin, inverseDirection, nodes[child].boundsMin, nodes[child].boundsMax, best,
+              distance)) {
+        children[childCount++] = {child, distance};
+      }
+    }
+    // the nearer child goes on top
+    if (childCount == 2 && children[0].distance < children[1].distance) {
+      std::swap(children[0], children[1]);
+    }
+    for (uint32_t i = 0; i < childCount; i++) {
+      stack.push_back(children[i]);
+    }
+  }
+
+  if (bestItem == NO_SLOT) {
+    return false;
+  }
+  hit.item = bestItem;
+  hit.distance = best;
+  return true;
+}
+
+}  // namespace learnVulkan
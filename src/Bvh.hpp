@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Frustum.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace learnVulkan {
+
+struct Aabb {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{-std::numeric_limits<float>::max()};
+
+  void expand(const Aabb &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+  void expand(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  glm::vec3 center() const { return (min + max) * .5f; }
+  float surfaceArea() const {
+    glm::vec3 extent = glm::max(max - min, glm::vec3{0.f});
+    return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+  }
+
+  // box around the eight corners of a local space box moved by transform
+  static Aabb transformed(const Aabb &local, const glm::mat4 &transform);
+};
+
+struct Ray {
+  glm::vec3 origin{0.f};
+  glm::vec3 direction{0.f, 0.f, 1.f};  // need not be normalized, distances are in its units
+  float maxDistance = std::numeric_limits<float>::max();
+};
+
+struct RayHit {
+  uint32_t item = ~0u;
+  float distance = std::numeric_limits<float>::max();
+};
+
+// Distance along the ray to where it enters the box, 0 when it starts inside; false when it
+// misses or only enters beyond maxDistance.
+bool intersectRayAabb(const Ray &ray, const Aabb &box, float &distance);
+
+// Bounding volume hierarchy over the axis aligned boxes of items numbered by the caller.
+// build splits by the surface area heuristic over binned centroids; updateItem and refit then
+// follow moving items by growing and shrinking the boxes on their path to the root without
+// changing the tree. Once refits have grown the summed node area past REBUILD_AREA_RATIO
+// times the built tree's, refit rebuilds it, so queries stay fast for scenes that reshuffle.
+class Bvh {
+ public:
+  static constexpr uint32_t MAX_LEAF_ITEMS = 4;
+  static constexpr float REBUILD_AREA_RATIO = 1.5f;
+
+  // Item ids index nothing inside the tree; they come back from the queries as given.
+  void build(const uint32_t *items, const Aabb *bounds, uint32_t count);
+  void clear();
+
+  bool contains(uint32_t item) const {
+    return item < slotOfItem.size() && slotOfItem[item] != NO_SLOT;
+  }
+  // Takes effect with the next refit; item must have been part of the build.
+  void updateItem(uint32_t item, const Aabb &bounds);
+  void refit();
+
+  // Appends every item whose box intersects the frustum, in tree order. Subtrees entirely
+  // inside are appended without testing their items.
+  void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const;
+
+  // Called for items whose box the ray enters closer than the best hit so far, to test the
+  // item's real shape. Returns false on a miss, otherwise sets distance.
+  using ItemRayTest = std::function<bool(uint32_t item, float &distance)>;
+  // Nearest item along the ray; by box unless an itemTest is given. Children are visited
+  // nearest first, so most far subtrees are skipped.
+  bool raycast(const Ray &ray, RayHit &hit, const ItemRayTest &itemTest = nullptr) const;
+
+  uint32_t getItemCount() const { return static_cast<uint32_t>(slotItems.size()); }
+  uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+  // summed surface area of the inner nodes relative to the root's, the SAH traversal cost
+  float getCost() const;
+  uint32_t getRebuildCount() const { return rebuildCount; }
+
+ private:
+  static constexpr uint32_t NO_SLOT = ~0u;
+  static constexpr uint32_t NO_NODE = ~0u;
+
+  // Inner nodes have count 0 and their children at first and first + 1, always after the
+  // node itself; leaves hold the item slots [first, first + count).
+  struct Node {
+    glm::vec3 boundsMin;
+    uint32_t first;
+    glm::vec3 boundsMax;
+    uint32_t count;
+
+    Aabb bounds() const { return {boundsMin, boundsMax}; }
+  };
+
+  void buildNodes(const Aabb *bounds, uint32_t count, std::vector<uint32_t> &order);
+  void refitNode(uint32_t index);
+  float innerArea() const;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> parents;
+  // item slots in leaf order
+  std::vector<uint32_t> slotItems;
+  std::vector<Aabb> slotBounds;
+  std::vector<uint32_t> leafOfSlot;
+  std::vector<uint32_t> slotOfItem;  // indexed by item id
+
+  std::vector<uint8_t> dirtyFlags;  // per node
+  std::vector<uint32_t> dirtyNodes;
+  float builtArea = 0.f;
+  float currentArea = 0.f;  // innerArea, kept up to date by refit
+  uint32_t rebuildCount = 0;
+};
+
+}  // namespace learnVulkan
@@ -0,0 +1,58 @@
+#include "ComputePipeline.hpp"
+#include "Pipeline.hpp"
+#include <cassert>
+#include <stdexcept>
+namespace learnVulkan
+{
+    ComputePipeline::ComputePipeline(
+            Device& device,
+            const std::string& computeFilePath,
+            VkPipelineLayout pipelineLayout)
+        : device{device}
+    {
+        assert(
+            pipelineLayout != nullptr &&
+            "Cannot create compute pipeline: no pipelineLayout provided");
+
+        auto code = Pipeline::readFile(computeFilePath);
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(device.device(), &moduleInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module");
+        }
+
+        // A compute pipeline is a single shader stage plus its layout.
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        VkResult result = vkCreateComputePipelines(
+            device.device(), device.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline);
+
+        // The module is only needed while the pipeline is being created.
+        vkDestroyShaderModule(device.device(), shaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+    }
+
+    ComputePipeline::~ComputePipeline() {
+        vkDestroyPipeline(device.device(), computePipeline, nullptr);
+    }
+
+    void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    }
+} // namespace learnVulkan
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+#include "Device.hpp"
+
+namespace learnVulkan
+{
+    class ComputePipeline
+    {
+    public:
+        ComputePipeline(
+            Device& device,
+            const std::string& computeFilePath,
+            VkPipelineLayout pipelineLayout);
+
+        ~ComputePipeline();
+
+        ComputePipeline(const ComputePipeline&) = delete;
+        ComputePipeline& operator=(const ComputePipeline&) = delete;
+
+        void bind(VkCommandBuffer commandBuffer);
+
+    private:
+        Device& device;
+        VkPipeline computePipeline;
+    };
+} // namespace learnVulkan
@@ -0,0 +1,365 @@
+#include "DepthPyramid.hpp"
+
+#include "SwapChain.hpp"
+
+// std
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+static constexpr uint32_t REDUCE_GROUP_SIZE = 8;  // local_size_x and _y in depth_reduce.comp
+
+static bool hasStencilComponent(VkFormat format) {
+  return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+         format == VK_FORMAT_D16_UNORM_S8_UINT;
+}
+
+DepthPyramid::DepthPyramid(Device &device) : device{device} {
+  createSampler();
+  createDescriptorSetLayout();
+  createDescriptorPool();
+  createPipelineLayout();
+  reducePipeline = std::make_unique<ComputePipeline>(
+      device, "../src/shaders/compiled/depth_reduce.comp.spv", pipelineLayout);
+}
+
+DepthPyramid::~DepthPyramid() {
+  destroyImage();
+  vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+  // destroying the pool frees the sets allocated from it
+  vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
+  vkDestroySampler(device.device(), sampler, nullptr);
+}
+
+// Levels are read with texelFetch only, so filtering never mixes depths.
+void DepthPyramid::createSampler() {
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.minLod = 0.f;
+  samplerInfo.maxLod = static_cast<float>(MAX_LEVELS);
+  if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid sampler!");
+  }
+}
+
+void DepthPyramid::createDescriptorSetLayout() {
+  // 0: the level or depth attachment read, 1: the level written
+  std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+  if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &descriptorSetLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+  }
+}
+
+void DepthPyramid::createDescriptorPool() {
+  uint32_t setCount = SwapChain::MAX_FRAMES_IN_FLIGHT + MAX_LEVELS;
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = setCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1].descriptorCount = setCount;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = setCount;
+  if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+  }
+}
+
+void DepthPyramid::createPipelineLayout() {
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+  }
+}
+
+void DepthPyramid::resize(VkExtent2D extent) {
+  if (image != VK_NULL_HANDLE && extent.width == depthExtent.width &&
+      extent.height == depthExtent.height) {
+    return;
+  }
+  // frames in flight may still read the old pyramid
+  vkDeviceWaitIdle(device.device());
+  destroyImage();
+
+  depthExtent = extent;
+  levelExtents.clear();
+  VkExtent2D level{(extent.width + 1) / 2, (extent.height + 1) / 2};
+  levelExtents.push_back(level);
+  while ((level.width > 1 || level.height > 1) && levelExtents.size() < MAX_LEVELS) {
+    level = {(level.width + 1) / 2, (level.height + 1) / 2};
+    levelExtents.push_back(level);
+  }
+  createImage();
+  writeDescriptorSets();
+  built = false;
+  version++;
+}
+
+void DepthPyramid::createImage() {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = levelExtents[0].width;
+  imageInfo.extent.height = levelExtents[0].height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = getLevelCount();
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R32_SFLOAT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageAllocation);
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = VK_FORMAT_R32_SFLOAT;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = getLevelCount();
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+  if (vkCreateImageView(device.device(), &viewInfo, nullptr, &pyramidView) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create depth pyramid image view!");
+  }
+  levelViews.resize(getLevelCount());
+  for (uint32_t level = 0; level < getLevelCount(); level++) {
+    viewInfo.subresourceRange.baseMipLevel = level;
+    viewInfo.subresourceRange.levelCount = 1;
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &levelViews[level]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid image view!");
+    }
+  }
+
+  // the culling shaders bind the pyramid before the first build, so it needs its layout now
+  VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, getLevelCount(), 0, 1};
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      1,
+      &barrier);
+  device.endSingleTimeCommands(commandBuffer);
+}
+
+void DepthPyramid::destroyImage() {
+  if (image == VK_NULL_HANDLE) {
+    return;
+  }
+  for (VkImageView view : levelViews) {
+    vkDestroyImageView(device.device(), view, nullptr);
+  }
+  levelViews.clear();
+  vkDestroyImageView(device.device(), pyramidView, nullptr);
+  device.destroyImage(image, imageAllocation);
+  image = VK_NULL_HANDLE;
+  pyramidView = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::writeDescriptorSets() {
+  vkResetDescriptorPool(device.device(), descriptorPool, 0);
+  frameSets.assign(SwapChain::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+  levelSets.assign(getLevelCount() - 1, VK_NULL_HANDLE);
+  std::vector<VkDescriptorSetLayout> layouts(
+      frameSets.size() + levelSets.size(), descriptorSetLayout);
+  std::vector<VkDescriptorSet> sets(layouts.size());
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(sets.size());
+  allocInfo.pSetLayouts = layouts.data();
+  if (vkAllocateDescriptorSets(device.device(), &allocInfo, sets.data()) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate depth pyramid descriptor sets!");
+  }
+  std::copy(sets.begin(), sets.begin() + frameSets.size(), frameSets.begin());
+  std::copy(sets.begin() + frameSets.size(), sets.end(), levelSets.begin());
+
+  // every set writes the level it reduces into; level sets also read the level above, while
+  // frame sets get the depth attachment with each build
+  std::vector<VkDescriptorImageInfo> imageInfos;
+  imageInfos.reserve(2 * sets.size());
+  std::vector<VkWriteDescriptorSet> writes;
+  auto addWrite = [&](VkDescriptorSet set, uint32_t binding, VkDescriptorImageInfo info) {
+    imageInfos.push_back(info);
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                        : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.pImageInfo = &imageInfos.back();
+    writes.push_back(write);
+  };
+  for (VkDescriptorSet set : frameSets) {
+    addWrite(set, 1, {VK_NULL_HANDLE, levelViews[0], VK_IMAGE_LAYOUT_GENERAL});
+  }
+  for (uint32_t level = 1; level < getLevelCount(); level++) {
+    addWrite(levelSets[level - 1], 0, {sampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL});
+    addWrite(levelSets[level - 1], 1, {VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL});
+  }
+  vkUpdateDescriptorSets(
+      device.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void DepthPyramid::build(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    VkImage depthImage,
+    VkImageView depthView,
+    VkFormat depthFormat) {
+  assert(image != VK_NULL_HANDLE && "Depth pyramid must be resized before it is built");
+
+  // beginFrame waited on this frame's fence, so its set is no longer in use
+  VkDescriptorImageInfo depthInfo{
+      sampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = frameSets[frameIndex];
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &depthInfo;
+  vkUpdateDescriptorSets(device.device(), 1, &write, 0, nullptr);
+
+  // the depth writes of the pass have to land before they are read, and the culling reads of
+  // the old pyramid have to finish before it is overwritten
+  std::array<VkImageMemoryBarrier, 2> barriers{};
+  VkImageMemoryBarrier &depthBarrier = barriers[0];
+  depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  depthBarrier.image = depthImage;
+  depthBarrier.subresourceRange.aspectMask =
+      VK_IMAGE_ASPECT_DEPTH_BIT |
+      (hasStencilComponent(depthFormat) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+  depthBarrier.subresourceRange.levelCount = 1;
+  depthBarrier.subresourceRange.layerCount = 1;
+
+  VkImageMemoryBarrier &pyramidBarrier = barriers[1];
+  pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  pyramidBarrier.srcAccessMask = 0;
+  pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  pyramidBarrier.image = image;
+  pyramidBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, getLevelCount(), 0, 1};
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      static_cast<uint32_t>(barriers.size()),
+      barriers.data());
+
+  reducePipeline->bind(commandBuffer);
+  for (uint32_t level = 0; level < getLevelCount(); level++) {
+    VkDescriptorSet set = level == 0 ? frameSets[frameIndex] : levelSets[level - 1];
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdDispatch(
+        commandBuffer,
+        (levelExtents[level].width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+        (levelExtents[level].height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+        1);
+
+    // the next level reads this one; after the last, the culling reads them all
+    pyramidBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    pyramidBarrier.subresourceRange.baseMipLevel = level;
+    pyramidBarrier.subresourceRange.levelCount = 1;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0,
+        nullptr,
+        0,
+        nullptr,
+        1,
+        &pyramidBarrier);
+  }
+
+  // back to the attachment layout, once the reads are done, for the passes that follow
+  depthBarrier.srcAccessMask = 0;
+  depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      1,
+      &depthBarrier);
+  built = true;
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ComputePipeline.hpp"
+#include "Device.hpp"
+
+// std
+#include <memory>
+#include <vector>
+
+namespace learnVulkan {
+
+// Hierarchical depth buffer for occlusion culling: a mip chain of R32 float images in which
+// every texel holds the farthest depth of the area it covers. Level 0 is half the depth
+// attachment's size, rounded up, and every further level halves the one before, down to a
+// single texel. Rounding up lets the last row and column of an odd sized level cover the
+// texels left over, so no depth is lost and a test against the pyramid never rejects
+// anything that is visible in the attachment it was built from.
+//
+// The pyramid is shared by all frames in flight: a build is ordered after the reads of
+// earlier frames, and the reads of later frames see it, by submission order on the one queue.
+class DepthPyramid {
+ public:
+  static constexpr uint32_t MAX_LEVELS = 16;
+
+  explicit DepthPyramid(Device &device);
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid &) = delete;
+  DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+  // Sizes the pyramid for a depth attachment of extent. A new extent recreates the image and
+  // waits for the device to go idle, so call it every frame before the pyramid is bound, right
+  // after the frame began and any swap chain recreation happened.
+  void resize(VkExtent2D extent);
+
+  // Records the reduction of the depth attachment of the pass that just ended into the
+  // pyramid, outside of a render pass. The attachment is expected, and left, in
+  // DEPTH_STENCIL_ATTACHMENT_OPTIMAL, as the render passes leave it.
+  void build(
+      VkCommandBuffer commandBuffer,
+      int frameIndex,
+      VkImage depthImage,
+      VkImageView depthView,
+      VkFormat depthFormat);
+
+  // whether the pyramid holds depth, i.e. was built since the last recreation
+  bool isBuilt() const { return built; }
+  // changes whenever resize recreates the image, and with it the view
+  uint32_t getVersion() const { return version; }
+  // every level, always in VK_IMAGE_LAYOUT_GENERAL
+  VkImageView getView() const { return pyramidView; }
+  VkSampler getSampler() const { return sampler; }
+  VkExtent2D getDepthExtent() const { return depthExtent; }
+  uint32_t getLevelCount() const { return static_cast<uint32_t>(levelExtents.size()); }
+
+ private:
+  void createSampler();
+  void createDescriptorSetLayout();
+  void createDescriptorPool();
+  void createPipelineLayout();
+  void createImage();
+  void destroyImage();
+  void writeDescriptorSets();
+
+  Device &device;
+
+  VkSampler sampler = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  std::unique_ptr<ComputePipeline> reducePipeline;
+
+  VkExtent2D depthExtent{0, 0};
+  std::vector<VkExtent2D> levelExtents;
+  VkImage image = VK_NULL_HANDLE;
+  Allocation imageAllocation{};
+  VkImageView pyramidView = VK_NULL_HANDLE;
+  std::vector<VkImageView> levelViews;
+  // level 0 reads the frame's depth attachment through the set of its frame in flight,
+  // rewritten by every build; level i > 0 reads level i - 1 through levelSets[i - 1]
+  std::vector<VkDescriptorSet> frameSets;
+  std::vector<VkDescriptorSet> levelSets;
+
+  bool built = false;
+  uint32_t version = 0;
+};
+
+}  // namespace learnVulkan
@@ -1,7 +1,9 @@
 #include "Device.hpp"
 
 // std headers
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -50,7 +52,12 @@ void DestroyDebugUtilsMessengerEXT(
 // Constructor for the Device class, responsible for initializing a Vulkan device
 // by setting up necessary components like instance, debug messenger, surface, 
 // physical device, logical device, and command pool.
-Device::Device(Window &window) : window{window} {
+Device::Device(Window *window) : window{window} {
+    // Without a window nothing is presented, so the swap chain extension is not needed.
+    if (isHeadless()) {
+        deviceExtensions.clear();
+    }
+
     // Creates a Vulkan instance, which is the connection between the application 
     // and the Vulkan library. It stores information about the application and Vulkan runtime.
     createInstance();
@@ -61,6 +68,7 @@ Device::Device(Window &window) : window{window} {
 
     // Creates a Vulkan surface for the application window. The surface acts as 
     // an interface between Vulkan and the platform-specific windowing system.
+    // A headless device has no window and skips it.
     createSurface();
 
     // Selects a suitable physical device (GPU) that supports Vulkan. This involves
@@ -75,10 +83,26 @@ Device::Device(Window &window) : window{window} {
     // Creates a command pool, which is a container for Vulkan command buffers.
     // Command buffers store rendering commands that are submitted to the GPU for execution.
     createCommandPool();
+
+    // Creates the sub-allocator that hands out ranges of large VkDeviceMemory blocks,
+    // so buffers and images do not each cost a vkAllocateMemory call.
+    createAllocator();
+
+    // Creates the upload scheduler that streams staging data to device local buffers
+    // on the transfer queue without blocking the frame loop.
+    createUploadScheduler();
+
+    // Creates the pipeline cache, seeded from the previous run's cache file when it was
+    // written by the same driver and GPU, so pipelines are not recompiled on every launch.
+    createPipelineCache();
 }
 
 
 Device::~Device() {
+  savePipelineCache();
+  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+  uploadScheduler_.reset();
+  allocator_.reset();
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -86,7 +110,9 @@ Device::~Device() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -101,7 +127,19 @@ void Device::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // 1.1 for vkGetPhysicalDeviceFeatures2, used to query optional extension features. A 1.0
+  // loader rejects instances asking for more and has no vkEnumerateInstanceVersion, so only
+  // ask when it is there and reports 1.1.
+  auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(
+      nullptr, "vkEnumerateInstanceVersion");
+  uint32_t loaderVersion = VK_API_VERSION_1_0;
+  if (enumerateInstanceVersion != nullptr &&
+      enumerateInstanceVersion(&loaderVersion) != VK_SUCCESS) {
+    loaderVersion = VK_API_VERSION_1_0;
+  }
+  instanceApiVersion_ = loaderVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1
+                                                            : VK_API_VERSION_1_0;
+  appInfo.apiVersion = instanceApiVersion_;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -159,7 +197,10 @@ void Device::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.transferFamily};
+  if (indices.presentFamilyHasValue) {
+    uniqueQueueFamilies.insert(indices.presentFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -174,15 +215,46 @@ void Device::createLogicalDevice() {
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  // optional: one indirect call for many commands with their own firstInstance, which the
+  // per meshlet draws of GpuCullingSystem rely on
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  if (supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance) {
+    deviceFeatures.multiDrawIndirect = VK_TRUE;
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+    multiDrawIndirect_ = true;
+  }
+  // optional: fragment shader invocation counts for OverdrawCounter, also across secondary
+  // command buffers with inheritedQueries
+  if (supportedFeatures.pipelineStatisticsQuery) {
+    deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+    pipelineStatisticsQuery_ = true;
+    if (supportedFeatures.inheritedQueries) {
+      deviceFeatures.inheritedQueries = VK_TRUE;
+      inheritedQueries_ = true;
+    }
+  }
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+  // optional: 8 bit index buffers for meshes with up to 255 vertices
+  std::vector<const char *> enabledExtensions = deviceExtensions;
+  VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features{};
+  indexTypeUint8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+  if (queryIndexTypeUint8Support()) {
+    enabledExtensions.push_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+    indexTypeUint8Features.indexTypeUint8 = VK_TRUE;
+    createInfo.pNext = &indexTypeUint8Features;
+    indexTypeUint8_ = true;
+  }
+
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -198,7 +270,11 @@ void Device::createLogicalDevice() {
   }
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
-  vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  if (indices.presentFamilyHasValue) {
+    vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  }
+  vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+  queueFamilyIndices_ = indices;
 }
 
 void Device::createCommandPool() {
@@ -215,15 +291,97 @@ void Device::createCommandPool() {
   }
 }
 
-void Device::createSurface() { window.createWindowSurface(instance, &surface_); }
+void Device::createAllocator() {
+  allocator_ = std::make_unique<MemoryAllocator>(device_, physicalDevice);
+}
+
+void Device::createUploadScheduler() {
+  uploadScheduler_ = std::make_unique<UploadScheduler>(*this);
+}
+
+void Device::createPipelineCache() {
+  std::vector<char> initialData;
+  std::ifstream file{pipelineCachePath, std::ios::ate | std::ios::binary};
+  if (file.is_open()) {
+    initialData.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(initialData.data(), initialData.size());
+    if (!isPipelineCacheCompatible(initialData)) {
+      std::cout << "pipeline cache: discarding stale " << pipelineCachePath << std::endl;
+      initialData.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = initialData.size();
+  cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+  if (vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+  pipelineCacheWarm_ = !initialData.empty();
+}
+
+// The header layout is fixed by the spec: length, version, vendor ID, device ID, UUID.
+bool Device::isPipelineCacheCompatible(const std::vector<char> &data) {
+  uint32_t headerSize;
+  uint32_t headerVersion;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint8_t cacheUUID[VK_UUID_SIZE];
+  if (data.size() < 16 + VK_UUID_SIZE) {
+    return false;
+  }
+  memcpy(&headerSize, data.data(), 4);
+  memcpy(&headerVersion, data.data() + 4, 4);
+  memcpy(&vendorID, data.data() + 8, 4);
+  memcpy(&deviceID, data.data() + 12, 4);
+  memcpy(cacheUUID, data.data() + 16, VK_UUID_SIZE);
+
+  return headerSize >= 16 + VK_UUID_SIZE && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         vendorID == properties.vendorID && deviceID == properties.deviceID &&
+         memcmp(cacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void Device::savePipelineCache() {
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, nullptr) != VK_SUCCESS ||
+      dataSize == 0) {
+    return;
+  }
+  std::vector<char> data(dataSize);
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  // write next to the real file and rename, so a crash never leaves a truncated cache
+  const std::string tmpPath = pipelineCachePath + ".tmp";
+  {
+    std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) {
+      std::cerr << "pipeline cache: cannot write " << tmpPath << std::endl;
+      return;
+    }
+    file.write(data.data(), dataSize);
+  }
+  std::remove(pipelineCachePath.c_str());
+  std::rename(tmpPath.c_str(), pipelineCachePath.c_str());
+}
+
+void Device::createSurface() {
+  if (window != nullptr) {
+    window->createWindowSurface(instance, &surface_);
+  }
+}
 
 bool Device::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -231,7 +389,7 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-  return indices.isComplete() && extensionsSupported && swapChainAdequate &&
+  return indices.isComplete(!isHeadless()) && extensionsSupported && swapChainAdequate &&
          supportedFeatures.samplerAnisotropy;
 }
 
@@ -283,11 +441,14 @@ bool Device::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> Device::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  // surface extensions are only needed, and GLFW only initialized, with a window
+  std::vector<const char *> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -319,6 +480,42 @@ void Device::hasGflwRequiredInstanceExtensions() {
   }
 }
 
+bool Device::isDeviceExtensionSupported(VkPhysicalDevice device, const char *extensionName) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      device, nullptr, &extensionCount, availableExtensions.data());
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The extension alone does not promise the feature, it has to be queried through
+// vkGetPhysicalDeviceFeatures2, which needs a 1.1 instance and device. It is looked up at
+// runtime, as a 1.0 loader does not export it.
+bool Device::queryIndexTypeUint8Support() {
+  if (instanceApiVersion_ < VK_API_VERSION_1_1 || properties.apiVersion < VK_API_VERSION_1_1 ||
+      !isDeviceExtensionSupported(physicalDevice, VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME)) {
+    return false;
+  }
+  auto getPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(
+      instance, "vkGetPhysicalDeviceFeatures2");
+  if (getPhysicalDeviceFeatures2 == nullptr) {
+    return false;
+  }
+  VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features{};
+  indexTypeUint8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &indexTypeUint8Features;
+  getPhysicalDeviceFeatures2(physicalDevice, &features);
+  return indexTypeUint8Features.indexTypeUint8 == VK_TRUE;
+}
+
 bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   uint32_t extensionCount;
   vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -355,18 +552,35 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamilyHasValue = true;
     }
     VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    if (surface_ != VK_NULL_HANDLE) {
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+    }
     if (queueFamily.queueCount > 0 && presentSupport) {
       indices.presentFamily = i;
       indices.presentFamilyHasValue = true;
     }
-    if (indices.isComplete()) {
+    if (indices.isComplete(surface_ != VK_NULL_HANDLE)) {
       break;
     }
 
     i++;
   }
 
+  // prefer a transfer-only family (usually a DMA engine) so uploads run beside rendering
+  for (uint32_t j = 0; j < queueFamilyCount; j++) {
+    const auto &queueFamily = queueFamilies[j];
+    if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      indices.transferFamily = j;
+      indices.transferFamilyHasValue = true;
+      break;
+    }
+  }
+  if (!indices.transferFamilyHasValue && indices.graphicsFamilyHasValue) {
+    indices.transferFamily = indices.graphicsFamily;
+    indices.transferFamilyHasValue = true;
+  }
+
   return indices;
 }
 
@@ -430,13 +644,24 @@ void Device::createBuffer(
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
     VkBuffer &buffer,
-    VkDeviceMemory &bufferMemory) {
+    Allocation &bufferAllocation) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+  // buffers written by the transfer queue and read by the graphics queue are shared
+  // concurrently instead of paying for queue family ownership transfers
+  uint32_t queueFamilyIndices[] = {
+      queueFamilyIndices_.graphicsFamily, queueFamilyIndices_.transferFamily};
+  if ((usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) &&
+      queueFamilyIndices_.graphicsFamily != queueFamilyIndices_.transferFamily) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+  }
+
   if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to create vertex buffer!");
   }
@@ -444,16 +669,20 @@ void Device::createBuffer(
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  bufferAllocation = allocator_->allocate(
+      memRequirements,
+      findMemoryType(memRequirements.memoryTypeBits, properties),
+      MemoryAllocator::ResourceKind::Linear);
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  if (vkBindBufferMemory(device_, buffer, bufferAllocation.memory, bufferAllocation.offset) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to bind buffer memory!");
   }
+}
 
-  vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+void Device::destroyBuffer(VkBuffer buffer, Allocation &bufferAllocation) {
+  vkDestroyBuffer(device_, buffer, nullptr);
+  allocator_->free(bufferAllocation);
 }
 
 VkCommandBuffer Device::beginSingleTimeCommands() {
@@ -531,7 +760,7 @@ void Device::createImageWithInfo(
     const VkImageCreateInfo &imageInfo,
     VkMemoryPropertyFlags properties,
     VkImage &image,
-    VkDeviceMemory &imageMemory) {
+    Allocation &imageAllocation) {
   if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
     throw std::runtime_error("failed to create image!");
   }
@@ -539,18 +768,21 @@ void Device::createImageWithInfo(
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+  imageAllocation = allocator_->allocate(
+      memRequirements,
+      findMemoryType(memRequirements.memoryTypeBits, properties),
+      imageInfo.tiling == VK_IMAGE_TILING_LINEAR ? MemoryAllocator::ResourceKind::Linear
+                                                 : MemoryAllocator::ResourceKind::Optimal);
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
-  }
-
-  if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+  if (vkBindImageMemory(device_, image, imageAllocation.memory, imageAllocation.offset) !=
+      VK_SUCCESS) {
     throw std::runtime_error("failed to bind image memory!");
   }
 }
 
+void Device::destroyImage(VkImage image, Allocation &imageAllocation) {
+  vkDestroyImage(device_, image, nullptr);
+  allocator_->free(imageAllocation);
+}
+
 }  // namespace learnVulkan
\ No newline at end of file
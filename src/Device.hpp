@@ -1,8 +1,11 @@
 #pragma once
 
+#include "MemoryAllocator.hpp"
+#include "UploadScheduler.hpp"
 #include "Window.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,9 +20,14 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  uint32_t transferFamily;  // dedicated transfer family if present, else graphicsFamily
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
-  bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  bool transferFamilyHasValue = false;
+  // a headless device has no surface and so no present family
+  bool isComplete(bool needsPresent = true) {
+    return graphicsFamilyHasValue && (presentFamilyHasValue || !needsPresent);
+  }
 };
 
 class Device {
@@ -30,7 +38,11 @@ class Device {
   const bool enableValidationLayers = true;
 #endif
 
-  Device(Window &window);
+  Device(Window &window) : Device{&window} {}
+  // Without a window the device is headless, for offscreen rendering: no surface, no swap
+  // chain extension and no present queue, so it also runs on display-less machines and CPU
+  // drivers like lavapipe.
+  explicit Device(Window *window);
   ~Device();
 
   // Not copyable or movable
@@ -43,7 +55,20 @@ class Device {
   VkDevice device() { return device_; }
   VkSurfaceKHR surface() { return surface_; }
   VkQueue graphicsQueue() { return graphicsQueue_; }
-  VkQueue presentQueue() { return presentQueue_; }
+  VkQueue presentQueue() { return presentQueue_; }  // VK_NULL_HANDLE when headless
+  VkQueue transferQueue() { return transferQueue_; }
+  VkPipelineCache pipelineCache() { return pipelineCache_; }
+  bool isPipelineCacheWarm() const { return pipelineCacheWarm_; }
+  UploadScheduler &uploadScheduler() { return *uploadScheduler_; }
+  bool isHeadless() const { return window == nullptr; }
+  // VK_EXT_index_type_uint8 is enabled, index buffers may use VK_INDEX_TYPE_UINT8_EXT
+  bool supportsIndexTypeUint8() const { return indexTypeUint8_; }
+  // multiDrawIndirect and drawIndirectFirstInstance are enabled
+  bool supportsMultiDrawIndirect() const { return multiDrawIndirect_; }
+  // pipelineStatisticsQuery is enabled, and inheritedQueries for queries active while
+  // secondary command buffers execute
+  bool supportsPipelineStatistics() const { return pipelineStatisticsQuery_; }
+  bool supportsInheritedQueries() const { return inheritedQueries_; }
 
   SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -57,7 +82,8 @@ class Device {
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory);
+      Allocation &bufferAllocation);
+  void destroyBuffer(VkBuffer buffer, Allocation &bufferAllocation);
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
   void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -68,7 +94,10 @@ class Device {
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory);
+      Allocation &imageAllocation);
+  void destroyImage(VkImage image, Allocation &imageAllocation);
+
+  AllocatorStats getAllocatorStats() const { return allocator_->getStats(); }
 
   VkPhysicalDeviceProperties properties;
 
@@ -79,30 +108,49 @@ class Device {
   void pickPhysicalDevice();
   void createLogicalDevice();
   void createCommandPool();
+  void createAllocator();
+  void createUploadScheduler();
+  void createPipelineCache();
+  void savePipelineCache();
 
   // helper functions
   bool isDeviceSuitable(VkPhysicalDevice device);
+  bool isPipelineCacheCompatible(const std::vector<char> &data);
   std::vector<const char *> getRequiredExtensions();
   bool checkValidationLayerSupport();
   QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool isDeviceExtensionSupported(VkPhysicalDevice device, const char *extensionName);
+  bool queryIndexTypeUint8Support();
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
   VkInstance instance;
+  uint32_t instanceApiVersion_ = VK_API_VERSION_1_0;  // requested at instance creation
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-  Window &window;
+  Window *window = nullptr;
   VkCommandPool commandPool;
 
   VkDevice device_;
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_ = VK_NULL_HANDLE;
   VkQueue graphicsQueue_;
-  VkQueue presentQueue_;
+  VkQueue presentQueue_ = VK_NULL_HANDLE;
+  VkQueue transferQueue_;
+  QueueFamilyIndices queueFamilyIndices_;
+  std::unique_ptr<MemoryAllocator> allocator_;
+  std::unique_ptr<UploadScheduler> uploadScheduler_;
+  VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+  bool pipelineCacheWarm_ = false;
+  bool indexTypeUint8_ = false;
+  bool multiDrawIndirect_ = false;
+  bool pipelineStatisticsQuery_ = false;
+  bool inheritedQueries_ = false;
 
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-  const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  const std::string pipelineCachePath = "pipeline_cache.bin";
 };
 
 }  // namespace learnVulkan
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "EntityRegistry.hpp"
+
+#include "TransformKernel.hpp"
+
+// std
+#include <cassert>
+#include <utility>
+
+namespace learnVulkan {
+
+void EntityRegistry::reserve(uint32_t capacity) {
+  sparse.reserve(capacity);
+  generations.reserve(capacity);
+  freeSlots.reserve(capacity);
+  parentSlots.reserve(capacity);
+  firstChildSlots.reserve(capacity);
+  nextSiblingSlots.reserve(capacity);
+  dirtyFlags.reserve(capacity);
+  dirtySlots.reserve(capacity);
+  denseHandles.reserve(capacity);
+  translationData.reserve(capacity);
+  rotationData.reserve(capacity);
+  scaleData.reserve(capacity);
+  colorData.reserve(capacity);
+  modelData.reserve(capacity);
+  localData.reserve(capacity);
+  worldData.reserve(capacity);
+}
+
+EntityHandle EntityRegistry::create() {
+  EntityHandle entity{};
+  if (!freeSlots.empty()) {
+    entity.index = freeSlots.back();
+    freeSlots.pop_back();
+  } else {
+    entity.index = static_cast<uint32_t>(sparse.size());
+    sparse.push_back(EntityHandle::INVALID_INDEX);
+    generations.push_back(0);
+    parentSlots.push_back(EntityHandle::INVALID_INDEX);
+    firstChildSlots.push_back(EntityHandle::INVALID_INDEX);
+    nextSiblingSlots.push_back(EntityHandle::INVALID_INDEX);
+    dirtyFlags.push_back(0);
+  }
+  entity.generation = generations[entity.index];
+
+  sparse[entity.index] = size();
+  denseHandles.push_back(entity);
+  translationData.emplace_back(0.f);
+  rotationData.emplace_back(0.f);
+  scaleData.emplace_back(1.f);
+  colorData.emplace_back(0.f);
+  modelData.push_back(NO_MODEL);
+  localData.emplace_back(1.f);
+  worldData.emplace_back(1.f);
+  markDirty(entity.index);
+  return entity;
+}
+
+// Children of a destroyed entity are detached and become roots with their local transform.
+void EntityRegistry::destroy(EntityHandle entity) {
+  uint32_t index = indexOf(entity);
+  uint32_t last = size() - 1;
+
+  uint32_t child = firstChildSlots[entity.index];
+  while (child != EntityHandle::INVALID_INDEX) {
+    uint32_t next = nextSiblingSlots[child];
+    parentSlots[child] = EntityHandle::INVALID_INDEX;
+    nextSiblingSlots[child] = EntityHandle::INVALID_INDEX;
+    markDirty(child);
+    child = next;
+  }
+  firstChildSlots[entity.index] = EntityHandle::INVALID_INDEX;
+  unlinkFromParent(entity.index);
+
+  // fill the hole with the last entity so the arrays stay packed
+  if (index != last) {
+    EntityHandle moved = denseHandles[last];
+    denseHandles[index] = moved;
+    translationData[index] = translationData[last];
+    rotationData[index] = rotationData[last];
+    scaleData[index] = scaleData[last];
+    colorData[index] = colorData[last];
+    modelData[index] = modelData[last];
+    localData[index] = localData[last];
+    worldData[index] = worldData[last];
+    sparse[moved.index] = index;
+  }
+  denseHandles.pop_back();
+  translationData.pop_back();
+  rotationData.pop_back();
+  scaleData.pop_back();
+  colorData.pop_back();
+  modelData.pop_back();
+  localData.pop_back();
+  worldData.pop_back();
+
+  // a pending dirty flag stays set, updateWorldTransforms drops it for free slots; that
+  // way a reused slot is never listed twice
+  sparse[entity.index] = EntityHandle::INVALID_INDEX;
+  generations[entity.index]++;
+  freeSlots.push_back(entity.index);
+}
+
+void EntityRegistry::clear() {
+  for (const auto &entity : denseHandles) {
+    sparse[entity.index] = EntityHandle::INVALID_INDEX;
+    generations[entity.index]++;
+    freeSlots.push_back(entity.index);
+  }
+  denseHandles.clear();
+  translationData.clear();
+  rotationData.clear();
+  scaleData.clear();
+  colorData.clear();
+  modelData.clear();
+  localData.clear();
+  worldData.clear();
+
+  parentSlots.assign(parentSlots.size(), EntityHandle::INVALID_INDEX);
+  firstChildSlots.assign(firstChildSlots.size(), EntityHandle::INVALID_INDEX);
+  nextSiblingSlots.assign(nextSiblingSlots.size(), EntityHandle::INVALID_INDEX);
+  dirtyFlags.assign(dirtyFlags.size(), 0);
+  dirtySlots.clear();
+  changedTransforms.clear();
+}
+
+bool EntityRegistry::isAlive(EntityHandle entity) const {
+  return entity.index < sparse.size() && sparse[entity.index] != EntityHandle::INVALID_INDEX &&
+         generations[entity.index] == entity.generation;
+}
+
+uint32_t EntityRegistry::indexOf(EntityHandle entity) const {
+  assert(isAlive(entity) && "Entity handle is stale or invalid");
+  return sparse[entity.index];
+}
+
+ModelId EntityRegistry::addModel(std::shared_ptr<Model> model) {
+  modelTable.push_back(std::move(model));
+  return static_cast<ModelId>(modelTable.size() - 1);
+}
+
+std::shared_ptr<Model> EntityRegistry::replaceModel(ModelId id, std::shared_ptr<Model> model) {
+  assert(id < modelTable.size() && "Model id out of range");
+  std::swap(modelTable[id], model);
+  return model;
+}
+
+glm::vec3 &EntityRegistry::translation(EntityHandle entity) {
+  uint32_t index = indexOf(entity);
+  markDirty(entity.index);
+  return translationData[index];
+}
+
+glm::vec3 &EntityRegistry::rotation(EntityHandle entity) {
+  uint32_t index = indexOf(entity);
+  markDirty(entity.index);
+  return rotationData[index];
+}
+
+glm::vec3 &EntityRegistry::scale(EntityHandle entity) {
+  uint32_t index = indexOf(entity);
+  markDirty(entity.index);
+  return scaleData[index];
+}
+
+void EntityRegistry::markDirty(uint32_t slot) {
+  if (!dirtyFlags[slot]) {
+    dirtyFlags[slot] = 1;
+    dirtySlots.push_back(slot);
+  }
+}
+
+void EntityRegistry::unlinkFromParent(uint32_t slot) {
+  uint32_t parent = parentSlots[slot];
+  if (parent == EntityHandle::INVALID_INDEX) {
+    return;
+  }
+  uint32_t *link = &firstChildSlots[parent];
+  while (*link != slot) {
+    link = &nextSiblingSlots[*link];
+  }
+  *link = nextSiblingSlots[slot];
+  nextSiblingSlots[slot] = EntityHandle::INVALID_INDEX;
+  parentSlots[slot] = EntityHandle::INVALID_INDEX;
+}
+
+void EntityRegistry::setParent(EntityHandle entity, EntityHandle parent) {
+  assert(isAlive(entity) && "Entity handle is stale or invalid");
+  if (parent.isValid()) {
+    assert(isAlive(parent) && "Parent handle is stale or invalid");
+    for (uint32_t ancestor = parent.index; ancestor != EntityHandle::INVALID_INDEX;
+         ancestor = parentSlots[ancestor]) {
+      assert(ancestor != entity.index && "Parenting would create a cycle");
+    }
+  }
+
+  unlinkFromParent(entity.index);
+  if (parent.isValid()) {
+    parentSlots[entity.index] = parent.index;
+    nextSiblingSlots[entity.index] = firstChildSlots[parent.index];
+    firstChildSlots[parent.index] = entity.index;
+  }
+  markDirty(entity.index);
+}
+
+EntityHandle EntityRegistry::getParent(EntityHandle entity) const {
+  assert(isAlive(entity) && "Entity handle is stale or invalid");
+  uint32_t parent = parentSlots[entity.index];
+  if (parent == EntityHandle::INVALID_INDEX) {
+    return EntityHandle{};
+  }
+  return EntityHandle{parent, generations[parent]};
+}
+
+void EntityRegistry::updateWorldTransforms() {
+  changedTransforms.clear();
+  if (dirtySlots.empty()) {
+    return;
+  }
+
+  // local matrices of the dirty entities, batched through the SIMD kernel
+  localDirty.clear();
+  for (uint32_t slot : dirtySlots) {
+    if (sparse[slot] == EntityHandle::INVALID_INDEX) {
+      dirtyFlags[slot] = 0;  // destroyed since it was marked
+      continue;
+    }
+    localDirty.push_back(sparse[slot]);
+  }
+  uint32_t dirtyCount = static_cast<uint32_t>(localDirty.size());
+  batchTranslations.resize(dirtyCount);
+  batchRotations.resize(dirtyCount);
+  batchScales.resize(dirtyCount);
+  batchMatrices.resize(dirtyCount);
+  for (uint32_t i = 0; i < dirtyCount; i++) {
+    batchTranslations[i] = translationData[localDirty[i]];
+    batchRotations[i] = rotationData[localDirty[i]];
+    batchScales[i] = scaleData[localDirty[i]];
+  }
+  computeTransforms(
+      batchTranslations.data(),
+      batchRotations.data(),
+      batchScales.data(),
+      dirtyCount,
+      glm::mat4{1.f},
+      batchMatrices.data(),
+      nullptr);
+  for (uint32_t i = 0; i < dirtyCount; i++) {
+    localData[localDirty[i]] = batchMatrices[i];
+  }
+
+  // world matrices, once per dirty subtree starting from its topmost dirty ancestor
+  for (uint32_t slot : dirtySlots) {
+    if (!dirtyFlags[slot]) {
+      continue;  // freed, or already covered by an ancestor's subtree
+    }
+    uint32_t top = slot;
+    for (uint32_t ancestor = parentSlots[slot]; ancestor != EntityHandle::INVALID_INDEX;
+         ancestor = parentSlots[ancestor]) {
+      if (dirtyFlags[ancestor]) {
+        top = ancestor;
+      }
+    }
+    updateSubtree(top);
+  }
+  dirtySlots.clear();
+}
+
+// Parents are always popped before their children, so every parent world is current when
+// a child reads it.
+void EntityRegistry::updateSubtree(uint32_t slot) {
+  traversalStack.clear();
+  traversalStack.push_back(slot);
+  while (!traversalStack.empty()) {
+    uint32_t current = traversalStack.back();
+    traversalStack.pop_back();
+
+    uint32_t index = sparse[current];
+    uint32_t parent = parentSlots[current];
+    worldData[index] = parent != EntityHandle::INVALID_INDEX
+                           ? worldData[sparse[parent]] * localData[index]
+                           : localData[index];
+    dirtyFlags[current] = 0;
+    changedTransforms.push_back(index);
+
+    for (uint32_t child = firstChildSlots[current]; child != EntityHandle::INVALID_INDEX;
+         child = nextSiblingSlots[child]) {
+      traversalStack.push_back(child);
+    }
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Model.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace learnVulkan {
+
+// Index into the model table of an EntityRegistry.
+using ModelId = uint32_t;
+static constexpr ModelId NO_MODEL = ~0u;
+
+// Stable reference to an entity. The generation is bumped whenever a slot is reused, so a
+// handle to a destroyed entity never aliases a newer one.
+struct EntityHandle {
+  static constexpr uint32_t INVALID_INDEX = ~0u;
+
+  uint32_t index = INVALID_INDEX;
+  uint32_t generation = 0;
+
+  bool isValid() const { return index != INVALID_INDEX; }
+  bool operator==(const EntityHandle &other) const {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const EntityHandle &other) const { return !(*this == other); }
+};
+
+// Entity storage as a sparse set over structure of arrays. Components live in parallel dense
+// arrays with no holes, so systems walk them linearly with [0, size()). Handles map to dense
+// indices through the sparse array; destroy moves the last entity into the freed dense slot.
+// Dense indices, and pointers into the arrays, are only stable until the next create,
+// destroy or clear.
+//
+// Entities form a transform hierarchy. Local and world matrices are cached and only
+// recomputed by updateWorldTransforms for entities marked dirty and their descendants.
+class EntityRegistry {
+ public:
+  EntityRegistry() = default;
+
+  EntityRegistry(const EntityRegistry &) = delete;
+  EntityRegistry &operator=(const EntityRegistry &) = delete;
+
+  // Reserving up front keeps create() from allocating.
+  void reserve(uint32_t capacity);
+
+  EntityHandle create();
+  void destroy(EntityHandle entity);
+  void clear();
+  bool isAlive(EntityHandle entity) const;
+
+  uint32_t size() const { return static_cast<uint32_t>(denseHandles.size()); }
+  uint32_t indexOf(EntityHandle entity) const;
+  EntityHandle handleAt(uint32_t index) const { return denseHandles[index]; }
+
+  // Models are shared between entities through a table instead of a shared_ptr per entity.
+  ModelId addModel(std::shared_ptr<Model> model);
+  // Points id at another model, e.g. a loaded mesh replacing its placeholder; entities keep
+  // their ModelId. Returns the previous model, which frames in flight may still be drawing.
+  std::shared_ptr<Model> replaceModel(ModelId id, std::shared_ptr<Model> model);
+  Model &getModel(ModelId id) { return *modelTable[id]; }
+  uint32_t getModelCount() const { return static_cast<uint32_t>(modelTable.size()); }
+
+  // dense component arrays, indexed by indexOf(entity)
+  glm::vec3 *translations() { return translationData.data(); }
+  glm::vec3 *rotations() { return rotationData.data(); }
+  glm::vec3 *scales() { return scaleData.data(); }
+  glm::vec3 *colors() { return colorData.data(); }
+  ModelId *models() { return modelData.data(); }
+  const glm::vec3 *translations() const { return translationData.data(); }
+  const glm::vec3 *rotations() const { return rotationData.data(); }
+  const glm::vec3 *scales() const { return scaleData.data(); }
+  const glm::vec3 *colors() const { return colorData.data(); }
+  const ModelId *models() const { return modelData.data(); }
+
+  // Per entity access for setup code; systems should prefer the dense arrays. Handing out a
+  // writable transform component marks the entity dirty.
+  glm::vec3 &translation(EntityHandle entity);
+  glm::vec3 &rotation(EntityHandle entity);
+  glm::vec3 &scale(EntityHandle entity);
+  glm::vec3 &color(EntityHandle entity) { return colorData[indexOf(entity)]; }
+  ModelId &model(EntityHandle entity) { return modelData[indexOf(entity)]; }
+
+  // Transforms written through the dense arrays have to be flagged by hand.
+  void markTransformDirty(EntityHandle entity) { markDirty(entity.index); }
+  void markTransformDirty(uint32_t index) { markDirty(denseHandles[index].index); }
+
+  // Parents the entity's transform to parent, or detaches it for an invalid handle.
+  void setParent(EntityHandle entity, EntityHandle parent);
+  EntityHandle getParent(EntityHandle entity) const;
+
+  // Recomputes the local matrices of dirty entities and the world matrices of their
+  // subtrees. Call once per frame after gameplay changes, before anything reads worlds.
+  void updateWorldTransforms();
+  const glm::mat4 *worldMatrices() const { return worldData.data(); }
+  const glm::mat4 &worldMatrix(uint32_t index) const { return worldData[index]; }
+  // dense indices whose world matrix changed in the last updateWorldTransforms
+  const std::vector<uint32_t> &getChangedTransforms() const { return changedTransforms; }
+
+ private:
+  void markDirty(uint32_t slot);
+  void unlinkFromParent(uint32_t slot);
+  void updateSubtree(uint32_t slot);
+
+  // sparse side, indexed by EntityHandle::index
+  std::vector<uint32_t> sparse;  // dense index, or INVALID_INDEX for free slots
+  std::vector<uint32_t> generations;
+  std::vector<uint32_t> freeSlots;
+
+  // hierarchy as intrusive child lists of slots, INVALID_INDEX terminated
+  std::vector<uint32_t> parentSlots;
+  std::vector<uint32_t> firstChildSlots;
+  std::vector<uint32_t> nextSiblingSlots;
+  std::vector<uint8_t> dirtyFlags;
+  std::vector<uint32_t> dirtySlots;  // may hold stale or repeated slots, dirtyFlags decides
+
+  // dense side
+  std::vector<EntityHandle> denseHandles;
+  std::vector<glm::vec3> translationData;
+  std::vector<glm::vec3> rotationData;
+  std::vector<glm::vec3> scaleData;
+  std::vector<glm::vec3> colorData;
+  std::vector<ModelId> modelData;
+  std::vector<glm::mat4> localData;
+  std::vector<glm::mat4> worldData;
+
+  // scratch of updateWorldTransforms, kept to avoid per frame allocations
+  std::vector<uint32_t> localDirty;
+  std::vector<glm::vec3> batchTranslations;
+  std::vector<glm::vec3> batchRotations;
+  std::vector<glm::vec3> batchScales;
+  std::vector<glm::mat4> batchMatrices;
+  std::vector<uint32_t> traversalStack;
+  std::vector<uint32_t> changedTransforms;
+
+  std::vector<std::shared_ptr<Model>> modelTable;
+};
+
+}  // namespace learnVulkan
@@ -0,0 +1,84 @@
+#include "FramePacer.hpp"
+
+// std
+#include <algorithm>
+#include <thread>
+
+namespace learnVulkan {
+
+void FramePacer::setMode(Mode newMode) {
+  mode = newMode;
+  delayMs = 0.0;
+}
+
+void FramePacer::sleepBeforeInput() {
+  if (mode != Mode::LowLatency || delayMs <= 0.0) {
+    return;
+  }
+  std::this_thread::sleep_until(
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double, std::milli>(delayMs)));
+}
+
+void FramePacer::markInputSampled() {
+  inputTime = Clock::now();
+  inputSampled = true;
+  blockedMs = 0.0;
+}
+
+void FramePacer::markPresented() {
+  if (!inputSampled) {
+    return;
+  }
+  inputSampled = false;
+  Clock::time_point now = Clock::now();
+  float latency = std::chrono::duration<float, std::milli>(now - inputTime).count();
+  if (latencyMs.size() < HISTORY_FRAMES) {
+    latencyMs.push_back(latency);
+    presentTimes.push_back(now);
+  } else {
+    latencyMs[nextLatency] = latency;
+    presentTimes[nextLatency] = now;
+  }
+  nextLatency = (nextLatency + 1) % HISTORY_FRAMES;
+
+  // Blocking after input means input could have been sampled that much later. Sleeping that
+  // long before input next frame shifts the wait; a frame that did not block at all backs
+  // the sleep off again, so a slower GPU or a faster CPU is followed within a few frames.
+  if (mode == Mode::LowLatency) {
+    delayMs += GAIN * (blockedMs - TARGET_BLOCKED_MS);
+    delayMs = std::min(std::max(delayMs, 0.0), MAX_DELAY_MS);
+  }
+}
+
+float FramePacer::getPresentRate() const {
+  if (presentTimes.size() < 2) {
+    return 0.f;
+  }
+  // the slot before the cursor is the newest present, the cursor the oldest once wrapped
+  size_t newest = (nextLatency + HISTORY_FRAMES - 1) % HISTORY_FRAMES;
+  size_t oldest = presentTimes.size() < HISTORY_FRAMES ? 0 : nextLatency;
+  float seconds =
+      std::chrono::duration<float>(presentTimes[newest] - presentTimes[oldest]).count();
+  return seconds > 0.f ? static_cast<float>(presentTimes.size() - 1) / seconds : 0.f;
+}
+
+FramePacer::LatencyStats FramePacer::getLatencyStats() const {
+  LatencyStats stats{};
+  if (latencyMs.empty()) {
+    return stats;
+  }
+  std::vector<float> sorted = latencyMs;
+  std::sort(sorted.begin(), sorted.end());
+  float sum = 0.f;
+  for (float sample : sorted) {
+    sum += sample;
+  }
+  stats.sampleCount = static_cast<uint32_t>(sorted.size());
+  stats.avgMs = sum / static_cast<float>(sorted.size());
+  stats.p99Ms = sorted[std::min(sorted.size() - 1, (sorted.size() * 99) / 100)];
+  stats.maxMs = sorted.back();
+  return stats;
+}
+
+}  // namespace learnVulkan
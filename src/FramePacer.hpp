@@ -0,0 +1,71 @@
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Decides when the CPU starts working on a frame and measures input to present latency, the
+// time from sampling input for a frame until its present call returns, and the present rate.
+//
+// Throughput pacing starts every frame as early as the frames in flight allow; the CPU then
+// blocks in acquire or present whenever it runs ahead of the GPU or the display, with the
+// frame's input already sampled. LowLatency waits for the frame slot before input is sampled,
+// and moves the blocking that is still left after it (swap chain acquire and present) in
+// front of input sampling too, as a sleep that is adjusted every frame. Work queued on the
+// GPU behind earlier frames still adds latency; fewer frames in flight removes that.
+class FramePacer {
+ public:
+  enum class Mode { Throughput, LowLatency };
+
+  struct LatencyStats {
+    uint32_t sampleCount = 0;
+    float avgMs = 0.f;
+    float p99Ms = 0.f;
+    float maxMs = 0.f;
+  };
+
+  static constexpr uint32_t HISTORY_FRAMES = 300;  // latency samples kept for the statistics
+
+  void setMode(Mode newMode);
+  Mode getMode() const { return mode; }
+  // the sleep LowLatency currently puts in front of input sampling
+  float getDelayMs() const { return static_cast<float>(delayMs); }
+
+  // Driven by Renderer: sleepBeforeInput runs after the frame slot wait, markInputSampled
+  // when the frame's input is read, addBlockedTime for every wait after that, and
+  // markPresented once the present call returned.
+  void sleepBeforeInput();
+  void markInputSampled();
+  bool isInputSampled() const { return inputSampled; }
+  void addBlockedTime(double ms) { blockedMs += ms; }
+  void markPresented();
+
+  // over the last HISTORY_FRAMES frames
+  LatencyStats getLatencyStats() const;
+  // presents per second over the last HISTORY_FRAMES frames, 0 before the second present
+  float getPresentRate() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // blocking kept after input to absorb frame to frame jitter, and how much of the
+  // difference to it is corrected per frame
+  static constexpr double TARGET_BLOCKED_MS = 0.5;
+  static constexpr double GAIN = 0.5;
+  static constexpr double MAX_DELAY_MS = 50.0;
+
+  Mode mode = Mode::Throughput;
+  Clock::time_point inputTime{};
+  bool inputSampled = false;
+  double blockedMs = 0.0;  // since input was sampled this frame
+  double delayMs = 0.0;
+
+  std::vector<float> latencyMs;
+  std::vector<Clock::time_point> presentTimes;
+  size_t nextLatency = 0;  // shared write cursor of both rings
+};
+
+}  // namespace learnVulkan
@@ -0,0 +1,95 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace learnVulkan {
+
+// View frustum as six inward facing planes (xyz = normal, w = distance), extracted from a
+// projection * view matrix with Vulkan's [0, 1] clip space depth.
+struct Frustum {
+  enum Plane {
+    PLANE_LEFT = 0,
+    PLANE_RIGHT,
+    PLANE_BOTTOM,
+    PLANE_TOP,
+    PLANE_NEAR,
+    PLANE_FAR,
+    PLANE_COUNT
+  };
+
+  glm::vec4 planes[PLANE_COUNT];
+
+  static Frustum fromMatrix(const glm::mat4 &projectionView) {
+    const glm::mat4 &m = projectionView;
+    glm::vec4 row0{m[0][0], m[1][0], m[2][0], m[3][0]};
+    glm::vec4 row1{m[0][1], m[1][1], m[2][1], m[3][1]};
+    glm::vec4 row2{m[0][2], m[1][2], m[2][2], m[3][2]};
+    glm::vec4 row3{m[0][3], m[1][3], m[2][3], m[3][3]};
+
+    Frustum frustum{};
+    frustum.planes[PLANE_LEFT] = row3 + row0;
+    frustum.planes[PLANE_RIGHT] = row3 - row0;
+    frustum.planes[PLANE_BOTTOM] = row3 + row1;
+    frustum.planes[PLANE_TOP] = row3 - row1;
+    frustum.planes[PLANE_NEAR] = row2;
+    frustum.planes[PLANE_FAR] = row3 - row2;
+    for (auto &plane : frustum.planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+  }
+
+  bool intersectsSphere(const glm::vec3 &center, float radius) const {
+    for (const auto &plane : planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool intersectsAabb(const glm::vec3 &min, const glm::vec3 &max) const {
+    for (const auto &plane : planes) {
+      // test the corner furthest along the plane normal
+      glm::vec3 positive{
+          plane.x >= 0.f ? max.x : min.x,
+          plane.y >= 0.f ? max.y : min.y,
+          plane.z >= 0.f ? max.z : min.z};
+      if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.f) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  enum class Containment { Outside, Intersecting, Inside };
+
+  // Like intersectsAabb, but also tells boxes entirely inside apart, whose contents need no
+  // further tests.
+  Containment classifyAabb(const glm::vec3 &min, const glm::vec3 &max) const {
+    Containment result = Containment::Inside;
+    for (const auto &plane : planes) {
+      glm::vec3 positive{
+          plane.x >= 0.f ? max.x : min.x,
+          plane.y >= 0.f ? max.y : min.y,
+          plane.z >= 0.f ? max.z : min.z};
+      if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.f) {
+        return Containment::Outside;
+      }
+      // the opposite corner decides whether the box straddles the plane
+      glm::vec3 negative{
+          plane.x >= 0.f ? min.x : max.x,
+          plane.y >= 0.f ? min.y : max.y,
+          plane.z >= 0.f ? min.z : max.z};
+      if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.f) {
+        result = Containment::Intersecting;
+      }
+    }
+    return result;
+  }
+};
+
+}  // namespace learnVulkan
@@ -10,7 +10,11 @@ struct TransformComponent {
   glm::vec3 scale{1.f, 1.f,1.f};
   glm::vec3 rotation;
 
-   glm::mat4 mat4() {
+   glm::mat4 mat4() const { return compose(translation, rotation, scale); }
+
+  // Tait-Bryan Y(1), X(2), Z(3) rotation, scaled then translated.
+  static glm::mat4 compose(
+      const glm::vec3 &translation, const glm::vec3 &rotation, const glm::vec3 &scale) {
     const float c3 = glm::cos(rotation.z);
     const float s3 = glm::sin(rotation.z);
     const float c2 = glm::cos(rotation.x);
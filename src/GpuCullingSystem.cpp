@@ -0,0 +1,754 @@
+#include "GpuCullingSystem.hpp"
+
+#include "Frustum.hpp"
+#include "SimpleRenderSystem.hpp"
+#include "SwapChain.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+static constexpr uint32_t CULL_GROUP_SIZE = 64;  // local_size_x in cull.comp
+// the draw buffer starts with the visible object, meshlet and occluded object counters,
+// padded to 16 bytes
+static constexpr VkDeviceSize DRAW_HEADER_SIZE = 16;
+// 0-3 are used by the object pass, 4-6 by the meshlet pass, which also reads 0-2, and 7-9 by
+// the occlusion passes, which replace the object pass
+static constexpr uint32_t CULL_BINDING_COUNT = 4;
+static constexpr uint32_t MESHLET_CULL_BINDING_COUNT = 7;
+static constexpr uint32_t OCCLUSION_CULL_BINDING_COUNT = 10;
+static constexpr uint32_t PYRAMID_BINDING = 7;
+
+// shared by all passes; each reads the members it needs
+struct CullPushConstantData {
+  glm::vec4 planes[Frustum::PLANE_COUNT];
+  uint32_t objectCount;
+  uint32_t firstMeshletObject;  // of this dispatch, one workgroup per meshlet object
+  float lodThreshold;           // LodSelector::getThreshold
+  uint32_t occlusionPass;       // 0 early, 1 late
+  glm::vec4 cameraPosition;     // world space
+};
+
+static CullPushConstantData makePushConstantData(
+    const Camera &camera, uint32_t objectCount, float lodThreshold) {
+  CullPushConstantData push{};
+  Frustum frustum = Frustum::fromMatrix(camera.getProjection() * camera.getView());
+  std::copy(std::begin(frustum.planes), std::end(frustum.planes), std::begin(push.planes));
+  push.objectCount = objectCount;
+  push.lodThreshold = lodThreshold;
+  push.cameraPosition = glm::vec4(glm::vec3(glm::inverse(camera.getView())[3]), 1.f);
+  return push;
+}
+
+// levels of detail a batch gets commands for; meshlets cover LOD 0 only
+static uint32_t drawnLodCount(const Model &model, bool culledPerMeshlet) {
+  if (culledPerMeshlet) {
+    return 1;
+  }
+  uint32_t lodCount = static_cast<uint32_t>(model.getLods().size());
+  return std::max(1u, std::min(lodCount, MAX_MESH_LODS));
+}
+
+GpuCullingSystem::GpuCullingSystem(Device &device) : device{device} {
+  createDescriptorSetLayout();
+  createDescriptorPool();
+  createPipelineLayout();
+  cullPipeline = std::make_unique<ComputePipeline>(
+      device, "../src/shaders/compiled/cull.comp.spv", pipelineLayout);
+  meshletCullPipeline = std::make_unique<ComputePipeline>(
+      device, "../src/shaders/compiled/meshlet_cull.comp.spv", pipelineLayout);
+  occlusionCullPipeline = std::make_unique<ComputePipeline>(
+      device, "../src/shaders/compiled/occlusion_cull.comp.spv", pipelineLayout);
+  frames.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+}
+
+GpuCullingSystem::~GpuCullingSystem() {
+  destroyBuffers();
+  vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+  // destroying the pool frees the sets allocated from it
+  vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayout, nullptr);
+}
+
+void GpuCullingSystem::createDescriptorSetLayout() {
+  // 0: objects, 1: draw commands, 2: visible instances, 3: batches, 4: meshlets,
+  // 5: meshlet objects, 6: meshlet draw commands, 7: depth pyramid, 8: occluded flags,
+  // 9: occlusion view
+  std::array<VkDescriptorSetLayoutBinding, OCCLUSION_CULL_BINDING_COUNT> bindings{};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i == PYRAMID_BINDING ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                      : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+  if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo, nullptr, &descriptorSetLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create culling descriptor set layout!");
+  }
+}
+
+void GpuCullingSystem::createDescriptorPool() {
+  std::array<VkDescriptorPoolSize, 2> poolSizes{};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount =
+      (OCCLUSION_CULL_BINDING_COUNT - 1) * SwapChain::MAX_FRAMES_IN_FLIGHT;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[1].descriptorCount = SwapChain::MAX_FRAMES_IN_FLIGHT;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = SwapChain::MAX_FRAMES_IN_FLIGHT;
+  if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create culling descriptor pool!");
+  }
+}
+
+void GpuCullingSystem::createPipelineLayout() {
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(CullPushConstantData);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create culling pipeline layout!");
+  }
+}
+
+void GpuCullingSystem::destroyBuffers() {
+  if (objectBuffer != VK_NULL_HANDLE) {
+    device.destroyBuffer(objectBuffer, objectAllocation);
+    objectBuffer = VK_NULL_HANDLE;
+  }
+  if (meshletBuffer != VK_NULL_HANDLE) {
+    device.destroyBuffer(meshletBuffer, meshletAllocation);
+    device.destroyBuffer(meshletObjectBuffer, meshletObjectAllocation);
+    meshletBuffer = meshletObjectBuffer = VK_NULL_HANDLE;
+  }
+  for (auto &frame : frames) {
+    if (frame.stagingBuffer != VK_NULL_HANDLE) {
+      device.destroyBuffer(frame.stagingBuffer, frame.stagingAllocation);
+      device.destroyBuffer(frame.drawBuffer, frame.drawAllocation);
+      device.destroyBuffer(frame.batchBuffer, frame.batchAllocation);
+      device.destroyBuffer(frame.instanceBuffer, frame.instanceAllocation);
+      frame.stagingBuffer = frame.drawBuffer = frame.batchBuffer = frame.instanceBuffer =
+          VK_NULL_HANDLE;
+    }
+    if (frame.meshletDrawBuffer != VK_NULL_HANDLE) {
+      device.destroyBuffer(frame.meshletDrawBuffer, frame.meshletDrawAllocation);
+      frame.meshletDrawBuffer = VK_NULL_HANDLE;
+    }
+    if (frame.occludedBuffer != VK_NULL_HANDLE) {
+      device.destroyBuffer(frame.occludedBuffer, frame.occludedAllocation);
+      device.destroyBuffer(frame.occlusionViewBuffer, frame.occlusionViewAllocation);
+      frame.occludedBuffer = frame.occlusionViewBuffer = VK_NULL_HANDLE;
+    }
+  }
+}
+
+void GpuCullingSystem::createBuffers() {
+  VkDeviceSize objectBytes = sizeof(ObjectData) * objects.size();
+  // the late occlusion pass gets a second set of commands and instances
+  uint32_t passCount = occlusionActive ? 2 : 1;
+  device.createBuffer(
+      objectBytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      objectBuffer,
+      objectAllocation);
+
+  for (auto &frame : frames) {
+    device.createBuffer(
+        objectBytes,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        frame.stagingBuffer,
+        frame.stagingAllocation);
+    // small and rewritten by the CPU every frame, so they stay host visible
+    device.createBuffer(
+        DRAW_HEADER_SIZE + sizeof(VkDrawIndexedIndirectCommand) * commandCount * passCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        frame.drawBuffer,
+        frame.drawAllocation);
+    device.createBuffer(
+        sizeof(BatchData) * batches.size(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        frame.batchBuffer,
+        frame.batchAllocation);
+    device.createBuffer(
+        sizeof(InstanceData) * instanceCount * passCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        frame.instanceBuffer,
+        frame.instanceAllocation);
+    if (occlusionActive) {
+      device.createBuffer(
+          sizeof(uint32_t) * objects.size(),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+          frame.occludedBuffer,
+          frame.occludedAllocation);
+      device.createBuffer(
+          sizeof(OcclusionViewData),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+          frame.occlusionViewBuffer,
+          frame.occlusionViewAllocation);
+    }
+    frame.usedOnce = false;
+  }
+}
+
+// Meshlets and meshlet objects only change with setObjects, which has waited for the device
+// anyway, so they are uploaded once and waited for.
+void GpuCullingSystem::createMeshletBuffers(const std::vector<Meshlet> &meshlets) {
+  VkDeviceSize meshletBytes = sizeof(Meshlet) * meshlets.size();
+  VkDeviceSize meshletObjectBytes = sizeof(MeshletObject) * meshletObjects.size();
+  device.createBuffer(
+      meshletBytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      meshletBuffer,
+      meshletAllocation);
+  device.createBuffer(
+      meshletObjectBytes,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      meshletObjectBuffer,
+      meshletObjectAllocation);
+  UploadScheduler &uploads = device.uploadScheduler();
+  uploads.enqueueBufferUpload(meshletBuffer, 0, meshlets.data(), meshletBytes);
+  UploadTicket ticket = uploads.enqueueBufferUpload(
+      meshletObjectBuffer, 0, meshletObjects.data(), meshletObjectBytes);
+  uploads.flush();
+  uploads.wait(ticket);
+
+  for (auto &frame : frames) {
+    device.createBuffer(
+        sizeof(VkDrawIndexedIndirectCommand) * meshletDrawCount,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        frame.meshletDrawBuffer,
+        frame.meshletDrawAllocation);
+  }
+}
+
+void GpuCullingSystem::writeDescriptorSets() {
+  for (auto &frame : frames) {
+    if (frame.descriptorSet == VK_NULL_HANDLE) {
+      VkDescriptorSetAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfo.descriptorPool = descriptorPool;
+      allocInfo.descriptorSetCount = 1;
+      allocInfo.pSetLayouts = &descriptorSetLayout;
+      if (vkAllocateDescriptorSets(device.device(), &allocInfo, &frame.descriptorSet) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate culling descriptor set!");
+      }
+    }
+
+    std::array<VkDescriptorBufferInfo, OCCLUSION_CULL_BINDING_COUNT> bufferInfos{};
+    bufferInfos[0] = {objectBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[1] = {frame.drawBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = {frame.instanceBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = {frame.batchBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = {meshletBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[5] = {meshletObjectBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[6] = {frame.meshletDrawBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[8] = {frame.occludedBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[9] = {frame.occlusionViewBuffer, 0, VK_WHOLE_SIZE};
+
+    // the meshlet and occlusion bindings stay unwritten while no pipeline that reads them is
+    // dispatched; the pyramid is written by the first cull that needs it
+    std::array<VkWriteDescriptorSet, OCCLUSION_CULL_BINDING_COUNT> writes{};
+    uint32_t writeCount = 0;
+    for (uint32_t i = 0; i < OCCLUSION_CULL_BINDING_COUNT; i++) {
+      bool meshletBinding = i >= CULL_BINDING_COUNT && i < MESHLET_CULL_BINDING_COUNT;
+      bool occlusionBinding = i >= MESHLET_CULL_BINDING_COUNT && i != PYRAMID_BINDING;
+      if ((meshletBinding && meshletObjects.empty()) || (occlusionBinding && !occlusionActive) ||
+          i == PYRAMID_BINDING) {
+        continue;
+      }
+      VkWriteDescriptorSet &write = writes[writeCount++];
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = frame.descriptorSet;
+      write.dstBinding = i;
+      write.descriptorCount = 1;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write.pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(device.device(), writeCount, writes.data(), 0, nullptr);
+    frame.pyramidVersion = 0;
+  }
+}
+
+// Resizing the pyramid recreates its view. The frame's set is rewritten with the new one at
+// its next cull, after beginFrame waited for the frame's last use of the set.
+void GpuCullingSystem::writePyramidDescriptor(FrameResources &frame) {
+  if (frame.pyramidVersion == occlusionPyramid->getVersion()) {
+    return;
+  }
+  VkDescriptorImageInfo imageInfo{
+      occlusionPyramid->getSampler(), occlusionPyramid->getView(), VK_IMAGE_LAYOUT_GENERAL};
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = frame.descriptorSet;
+  write.dstBinding = PYRAMID_BINDING;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(device.device(), 1, &write, 0, nullptr);
+  frame.pyramidVersion = occlusionPyramid->getVersion();
+}
+
+// The bounding sphere is moved into world space; scaling grows its radius by the largest
+// axis scale so the sphere stays conservative under non uniform scale. LOD errors grow by the
+// same factor.
+GpuCullingSystem::ObjectData GpuCullingSystem::makeObjectData(
+    EntityRegistry &entities, uint32_t entity, uint32_t batch) const {
+  ObjectData data{};
+  data.transform = entities.worldMatrix(entity);
+  data.color = glm::vec4(entities.colors()[entity], 1.f);
+  data.batch = batch;
+  data.instanceBase = batches[batch].instanceBase;
+  data.drawnByMeshlets = batches[batch].meshletCount > 0 ? 1 : 0;
+
+  const glm::vec4 &localSphere = batches[batch].model->getBoundingSphere();
+  glm::vec4 center = data.transform * glm::vec4(glm::vec3(localSphere), 1.f);
+  float maxScale = glm::max(
+      glm::length(glm::vec3(data.transform[0])),
+      glm::max(glm::length(glm::vec3(data.transform[1])), glm::length(glm::vec3(data.transform[2]))));
+  data.boundingSphere = glm::vec4(glm::vec3(center), localSphere.w * maxScale);
+  data.lodScale = maxScale;
+  return data;
+}
+
+void GpuCullingSystem::setObjects(EntityRegistry &entities) {
+  // the old buffers may still be read by frames in flight
+  vkDeviceWaitIdle(device.device());
+  destroyBuffers();
+
+  // group by model, giving every model a contiguous range of the instance buffer
+  const ModelId *models = entities.models();
+  batchOfModel.assign(entities.getModelCount(), NO_OBJECT);
+  batches.clear();
+  objectOfEntity.assign(entities.size(), NO_OBJECT);
+  uint32_t objectCount = 0;
+  for (uint32_t i = 0; i < entities.size(); i++) {
+    if (models[i] == NO_MODEL) {
+      continue;
+    }
+    if (batchOfModel[models[i]] == NO_OBJECT) {
+      batchOfModel[models[i]] = static_cast<uint32_t>(batches.size());
+      batches.push_back({&entities.getModel(models[i]), 0, 0, 0, 0, 0, 0});
+    }
+    batches[batchOfModel[models[i]]].objectCount++;
+    objectOfEntity[i] = objectCount++;
+  }
+  // batches culled per meshlet get their meshlets appended to one array and a range of
+  // commands per object, the others a command and an instance range per level of detail
+  bool meshletCulling = meshletCullingEnabled && device.supportsMultiDrawIndirect();
+  std::vector<Meshlet> meshlets;
+  std::vector<uint32_t> firstMeshletOfBatch(batches.size(), 0);
+  commandCount = 0;
+  instanceCount = 0;
+  meshletDrawCount = 0;
+  for (size_t i = 0; i < batches.size(); i++) {
+    DrawBatch &batch = batches[i];
+    bool culledPerMeshlet = meshletCulling && batch.model->hasMeshlets();
+    batch.lodCount = drawnLodCount(*batch.model, culledPerMeshlet);
+    batch.instanceBase = instanceCount;
+    batch.drawOffset = DRAW_HEADER_SIZE + sizeof(VkDrawIndexedIndirectCommand) * commandCount;
+    instanceCount += batch.objectCount * batch.lodCount;
+    commandCount += batch.lodCount;
+    if (culledPerMeshlet) {
+      const std::vector<Meshlet> &modelMeshlets = batch.model->getMeshlets();
+      batch.meshletCount = static_cast<uint32_t>(modelMeshlets.size());
+      batch.meshletDrawOffset = sizeof(VkDrawIndexedIndirectCommand) * meshletDrawCount;
+      meshletDrawCount += batch.objectCount * batch.meshletCount;
+      firstMeshletOfBatch[i] = static_cast<uint32_t>(meshlets.size());
+      meshlets.insert(meshlets.end(), modelMeshlets.begin(), modelMeshlets.end());
+    }
+  }
+  if (!backFaceCulling) {
+    // a cutoff of 1 never passes the cone test, back facing meshlets are drawn like the whole
+    // model's back faces are
+    for (Meshlet &meshlet : meshlets) {
+      meshlet.cone.w = 1.f;
+    }
+  }
+
+  objects.resize(objectCount);
+  dirtyObjects.clear();
+  dirtyFlags.assign(objectCount, true);
+  meshletObjects.clear();
+  std::vector<uint32_t> placedInBatch(batches.size(), 0);
+  for (uint32_t i = 0; i < entities.size(); i++) {
+    if (objectOfEntity[i] == NO_OBJECT) {
+      continue;
+    }
+    uint32_t batchIndex = batchOfModel[models[i]];
+    objects[objectOfEntity[i]] = makeObjectData(entities, i, batchIndex);
+    dirtyObjects.push_back(objectOfEntity[i]);
+
+    const DrawBatch &batch = batches[batchIndex];
+    if (batch.meshletCount > 0) {
+      // fixed instance slots, as every meshlet command of the object points at it
+      uint32_t placed = placedInBatch[batchIndex]++;
+      MeshletObject meshletObject{};
+      meshletObject.object = objectOfEntity[i];
+      meshletObject.instance = batch.instanceBase + placed;
+      meshletObject.firstMeshlet = firstMeshletOfBatch[batchIndex];
+      meshletObject.meshletCount = batch.meshletCount;
+      meshletObject.firstCommand =
+          static_cast<uint32_t>(batch.meshletDrawOffset / sizeof(VkDrawIndexedIndirectCommand)) +
+          placed * batch.meshletCount;
+      meshletObjects.push_back(meshletObject);
+    }
+  }
+  lastVisibleCount = 0;
+  lastVisibleMeshletCount = 0;
+  lastOccludedCount = 0;
+  occlusionActive = occlusionPyramid != nullptr && !objects.empty();
+
+  if (objects.empty()) {
+    return;
+  }
+  createBuffers();
+  if (!meshletObjects.empty()) {
+    createMeshletBuffers(meshlets);
+  }
+  writeDescriptorSets();
+}
+
+void GpuCullingSystem::updateObject(EntityRegistry &entities, EntityHandle entity) {
+  uint32_t entityIndex = entities.indexOf(entity);
+  assert(entityIndex < objectOfEntity.size() && "Entity was created after setObjects");
+  uint32_t index = objectOfEntity[entityIndex];
+  assert(index != NO_OBJECT && "Entity had no model at setObjects");
+  assert(
+      batches[objects[index].batch].model == &entities.getModel(entities.models()[entityIndex]) &&
+      "Changing the model of an entity requires setObjects");
+
+  refreshObject(entities, entityIndex, index);
+}
+
+void GpuCullingSystem::updateChangedObjects(EntityRegistry &entities) {
+  for (uint32_t entityIndex : entities.getChangedTransforms()) {
+    if (entityIndex >= objectOfEntity.size() || objectOfEntity[entityIndex] == NO_OBJECT) {
+      continue;  // no model, or created after setObjects
+    }
+    refreshObject(entities, entityIndex, objectOfEntity[entityIndex]);
+  }
+}
+
+void GpuCullingSystem::updateModel(EntityRegistry &entities, ModelId id) {
+  if (id >= batchOfModel.size() || batchOfModel[id] == NO_OBJECT) {
+    return;  // no entity used the model at setObjects
+  }
+  // index and vertex counts are written into the draw commands on every cull
+  // so are the LOD ranges, but a different number of levels resizes the draw buffers
+  uint32_t batch = batchOfModel[id];
+  bool meshletCulling = meshletCullingEnabled && device.supportsMultiDrawIndirect();
+  if (batches[batch].meshletCount > 0 ||
+      (meshletCulling && entities.getModel(id).hasMeshlets()) ||
+      drawnLodCount(entities.getModel(id), false) != batches[batch].lodCount) {
+    setObjects(entities);
+    return;
+  }
+  batches[batch].model = &entities.getModel(id);
+
+  uint32_t entityCount = std::min(entities.size(), static_cast<uint32_t>(objectOfEntity.size()));
+  for (uint32_t i = 0; i < entityCount; i++) {
+    if (objectOfEntity[i] != NO_OBJECT && objects[objectOfEntity[i]].batch == batch) {
+      refreshObject(entities, i, objectOfEntity[i]);
+    }
+  }
+}
+
+void GpuCullingSystem::refreshObject(EntityRegistry &entities, uint32_t entity, uint32_t index) {
+  objects[index] = makeObjectData(entities, entity, objects[index].batch);
+  if (!dirtyFlags[index]) {
+    dirtyFlags[index] = true;
+    dirtyObjects.push_back(index);
+  }
+}
+
+// Dirty objects go through this frame's staging buffer and are copied into the shared object
+// buffer in the frame's own command buffer, so earlier frames still culling with the old data
+// are ordered before the copy by the barrier below.
+void GpuCullingSystem::recordObjectUploads(VkCommandBuffer commandBuffer, FrameResources &frame) {
+  if (dirtyObjects.empty()) {
+    return;
+  }
+
+  // sorting lets neighbouring objects share one copy region
+  std::sort(dirtyObjects.begin(), dirtyObjects.end());
+  auto *staging = static_cast<ObjectData *>(frame.stagingAllocation.mappedData);
+  copyRegions.clear();
+  for (uint32_t index : dirtyObjects) {
+    staging[index] = objects[index];
+    dirtyFlags[index] = false;
+
+    VkDeviceSize offset = sizeof(ObjectData) * index;
+    if (!copyRegions.empty() &&
+        copyRegions.back().srcOffset + copyRegions.back().size == offset) {
+      copyRegions.back().size += sizeof(ObjectData);
+    } else {
+      copyRegions.push_back({offset, offset, sizeof(ObjectData)});
+    }
+  }
+  dirtyObjects.clear();
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = objectBuffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0,
+      0,
+      nullptr,
+      1,
+      &barrier,
+      0,
+      nullptr);
+
+  vkCmdCopyBuffer(
+      commandBuffer,
+      frame.stagingBuffer,
+      objectBuffer,
+      static_cast<uint32_t>(copyRegions.size()),
+      copyRegions.data());
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0,
+      nullptr,
+      1,
+      &barrier,
+      0,
+      nullptr);
+}
+
+void GpuCullingSystem::cull(VkCommandBuffer commandBuffer, int frameIndex, const Camera &camera) {
+  if (objects.empty()) {
+    return;
+  }
+  FrameResources &frame = frames[frameIndex];
+  recordObjectUploads(commandBuffer, frame);
+
+  // beginFrame waited on this frame's fence, so its last cull has finished and the draw
+  // buffer can be read back and rewritten directly
+  auto *drawData = static_cast<char *>(frame.drawAllocation.mappedData);
+  if (frame.usedOnce) {
+    memcpy(&lastVisibleCount, drawData, sizeof(uint32_t));
+    memcpy(&lastVisibleMeshletCount, drawData + sizeof(uint32_t), sizeof(uint32_t));
+    memcpy(&lastOccludedCount, drawData + 2 * sizeof(uint32_t), sizeof(uint32_t));
+    lastVisibleTriangleCount = 0;
+    for (uint32_t i = 0; i < commandCount * (occlusionActive ? 2 : 1); i++) {
+      VkDrawIndexedIndirectCommand command;
+      memcpy(
+          &command,
+          drawData + DRAW_HEADER_SIZE + sizeof(VkDrawIndexedIndirectCommand) * i,
+          sizeof(command));
+      lastVisibleTriangleCount += static_cast<uint64_t>(command.indexCount / 3) *
+                                  command.instanceCount;
+    }
+  }
+  frame.usedOnce = true;
+  memset(drawData, 0, DRAW_HEADER_SIZE);
+
+  // Non indexed models are drawn with vkCmdDrawIndirect from the same slot: its vertexCount
+  // and instanceCount line up with indexCount and instanceCount, and the remaining fields are
+  // zero either way, as such models have a single level.
+  auto *batchData = static_cast<BatchData *>(frame.batchAllocation.mappedData);
+  bool multiDraw = device.supportsMultiDrawIndirect();
+  for (size_t i = 0; i < batches.size(); i++) {
+    const DrawBatch &batch = batches[i];
+    const std::vector<MeshLod> &lods = batch.model->getLods();
+    BatchData data{};
+    data.firstCommand = static_cast<uint32_t>(
+        (batch.drawOffset - DRAW_HEADER_SIZE) / sizeof(VkDrawIndexedIndirectCommand));
+    data.lodCount = batch.lodCount;
+    data.objectCount = batch.objectCount;
+    for (uint32_t lod = 0; lod < batch.lodCount; lod++) {
+      VkDrawIndexedIndirectCommand command{};
+      if (batch.model->hasIndices()) {
+        command.indexCount = lods[lod].indexCount;
+        command.firstIndex = lods[lod].firstIndex;
+        data.lodErrors[lod] = lods[lod].error;
+      } else {
+        command.indexCount = batch.model->getVertexCount();
+      }
+      command.instanceCount = 0;  // incremented by the culling shader
+      command.firstInstance = multiDraw ? lod * batch.objectCount : 0;
+      VkDeviceSize offset = batch.drawOffset + sizeof(VkDrawIndexedIndirectCommand) * lod;
+      memcpy(drawData + offset, &command, sizeof(command));
+      if (occlusionActive) {
+        memcpy(drawData + offset + getLateDrawOffset(), &command, sizeof(command));
+      }
+    }
+    batchData[i] = data;
+  }
+
+  if (occlusionActive) {
+    writePyramidDescriptor(frame);
+    // the early pass tests against the pyramid of the previous frame, unless a resize since
+    // left it empty
+    VkExtent2D depthExtent = occlusionPyramid->getDepthExtent();
+    OcclusionViewData view{};
+    view.projectionView = camera.getProjection() * camera.getView();
+    view.depthSize[0] = depthExtent.width;
+    view.depthSize[1] = depthExtent.height;
+    view.pyramidLevels = occlusionPyramid->getLevelCount();
+    view.earlyTestEnabled = occlusionPyramid->isBuilt() ? 1 : 0;
+    view.lateCommandOffset = commandCount;
+    view.lateInstanceOffset = instanceCount;
+    memcpy(frame.occlusionViewAllocation.mappedData, &view, sizeof(view));
+  }
+
+  CullPushConstantData push =
+      makePushConstantData(camera, static_cast<uint32_t>(objects.size()), lodThreshold);
+  (occlusionActive ? occlusionCullPipeline : cullPipeline)->bind(commandBuffer);
+  vkCmdBindDescriptorSets(
+      commandBuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      pipelineLayout,
+      0,
+      1,
+      &frame.descriptorSet,
+      0,
+      nullptr);
+  vkCmdPushConstants(
+      commandBuffer,
+      pipelineLayout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(CullPushConstantData),
+      &push);
+  vkCmdDispatch(commandBuffer, (push.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  if (!meshletObjects.empty()) {
+    // same layout and descriptor set; split where the workgroup count would exceed the limit
+    meshletCullPipeline->bind(commandBuffer);
+    uint32_t maxGroups = device.properties.limits.maxComputeWorkGroupCount[0];
+    uint32_t meshletObjectCount = static_cast<uint32_t>(meshletObjects.size());
+    for (uint32_t first = 0; first < meshletObjectCount; first += maxGroups) {
+      push.firstMeshletObject = first;
+      vkCmdPushConstants(
+          commandBuffer,
+          pipelineLayout,
+          VK_SHADER_STAGE_COMPUTE_BIT,
+          0,
+          sizeof(CullPushConstantData),
+          &push);
+      vkCmdDispatch(commandBuffer, std::min(maxGroups, meshletObjectCount - first), 1, 1);
+    }
+  }
+
+  // the draws read the commands and instances written above, by either pass
+  recordDrawBarrier(commandBuffer);
+}
+
+void GpuCullingSystem::cullLate(
+    VkCommandBuffer commandBuffer, int frameIndex, const Camera &camera) {
+  if (!occlusionActive) {
+    return;
+  }
+  FrameResources &frame = frames[frameIndex];
+
+  // the occluded flags of the early pass; the pyramid build ordered its own writes
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  CullPushConstantData push =
+      makePushConstantData(camera, static_cast<uint32_t>(objects.size()), lodThreshold);
+  push.occlusionPass = 1;
+  occlusionCullPipeline->bind(commandBuffer);
+  vkCmdBindDescriptorSets(
+      commandBuffer,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      pipelineLayout,
+      0,
+      1,
+      &frame.descriptorSet,
+      0,
+      nullptr);
+  vkCmdPushConstants(
+      commandBuffer,
+      pipelineLayout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0,
+      sizeof(CullPushConstantData),
+      &push);
+  vkCmdDispatch(commandBuffer, (push.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+  recordDrawBarrier(commandBuffer);
+}
+
+void GpuCullingSystem::recordDrawBarrier(VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+}
+
+}  // namespace learnVulkan
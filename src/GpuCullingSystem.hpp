@@ -0,0 +1,258 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "ComputePipeline.hpp"
+#include "DepthPyramid.hpp"
+#include "Device.hpp"
+#include "EntityRegistry.hpp"
+#include "MeshLod.hpp"
+
+// std
+#include <memory>
+#include <vector>
+
+namespace learnVulkan {
+
+// Frustum culls entities on the GPU. Object transforms and bounds live in a device local
+// storage buffer; a compute pass tests every object against the camera frustum, appends the
+// survivors to a per-frame instance buffer and counts them into one indirect draw command per
+// model. Per frame the CPU only touches the draw commands of each model plus the objects marked
+// dirty with updateObject or updateChangedObjects, so its cost no longer grows with the
+// object count.
+//
+// Objects whose model was built with meshlets are culled per meshlet instead, by a second
+// pass that runs one workgroup per object: every meshlet is tested against the frustum and
+// gets its own indirect command, drawing one instance when it survived and none otherwise. A
+// partly visible large mesh then only costs the triangles of its visible meshlets. The normal
+// cone test, which also drops meshlets facing away from the camera, only runs when
+// setBackFaceCulling says the pipelines drawing them cull back faces; otherwise it would hide
+// triangles the whole model draws. This needs Device::supportsMultiDrawIndirect; without it
+// such models are drawn whole.
+//
+// With a LodSelector set, the culling shader also picks each visible object's level of detail
+// and counts it into the command of that level, so every model has one command per level.
+//
+// With a DepthPyramid set, objects are also occlusion culled in two phases. cull tests the
+// objects in the frustum against the pyramid of the previous frame and draws the ones it does
+// not reject; after those draws the pyramid is rebuilt from their depth and cullLate tests the
+// rejected objects again, drawing the ones that turned out visible through a second set of
+// commands and instances. Objects culled per meshlet are not occlusion tested.
+class GpuCullingSystem {
+ public:
+  // One indirect draw per unique model and level of detail. Visible instances drawn at level i
+  // are written to [instanceBase + i * objectCount, instanceBase + (i + 1) * objectCount) of
+  // the frame's instance buffer.
+  struct DrawBatch {
+    Model *model;
+    uint32_t instanceBase;
+    uint32_t objectCount;
+    // Commands follow each other from drawOffset, one per level. With multi draw indirect
+    // their firstInstance is i * objectCount, so one draw covers all levels; without it every
+    // level is drawn on its own with the instance buffer bound at its range.
+    uint32_t lodCount;
+    VkDeviceSize drawOffset;  // byte offset of the first command in the draw buffer
+    // Culled per meshlet when meshletCount > 0: objectCount * meshletCount commands, object
+    // by object, start at meshletDrawOffset in the meshlet draw buffer and carry the instance
+    // in firstInstance. The command at drawOffset is left unused and lodCount is 1, meshlets
+    // cover LOD 0 only.
+    uint32_t meshletCount;
+    VkDeviceSize meshletDrawOffset;
+  };
+
+  GpuCullingSystem(Device &device);
+  ~GpuCullingSystem();
+
+  GpuCullingSystem(const GpuCullingSystem &) = delete;
+  GpuCullingSystem &operator=(const GpuCullingSystem &) = delete;
+
+  // Rebuilds the object buffer from every entity with a model. Waits for the device to go
+  // idle, so call it on scene load rather than every frame, and again after entities were
+  // created or destroyed.
+  void setObjects(EntityRegistry &entities);
+  // Re-uploads the transform and color of one entity; its model must stay the same. Takes
+  // effect with the next cull.
+  void updateObject(EntityRegistry &entities, EntityHandle entity);
+  // Re-uploads every object whose world matrix changed in the last
+  // EntityRegistry::updateWorldTransforms.
+  void updateChangedObjects(EntityRegistry &entities);
+  // Picks up a model swapped in with EntityRegistry::replaceModel: the batch draws the new
+  // model and the bounds of its objects are recomputed. Cheaper than setObjects, no idle wait.
+  // A model with meshlets changes the size of the meshlet buffers, so swapping one in or out
+  // rebuilds everything like setObjects.
+  void updateModel(EntityRegistry &entities, ModelId id);
+
+  // Takes effect with the next setObjects; when off, models with meshlets are drawn whole.
+  void setMeshletCullingEnabled(bool enabled) { meshletCullingEnabled = enabled; }
+  bool isMeshletCullingActive() const { return !meshletObjects.empty(); }
+  // Whether the pipelines that draw the culled models cull back faces, counter clockwise in
+  // model space being front facing. Only then are meshlets whose triangles all face away
+  // culled by their normal cone. Off by default, as the pipelines draw both sides. Takes effect
+  // with the next setObjects.
+  void setBackFaceCulling(bool enabled) { backFaceCulling = enabled; }
+
+  // Takes effect with the next setObjects; nullptr turns occlusion culling off. The pyramid
+  // must stay alive while set.
+  void setOcclusionCulling(DepthPyramid *pyramid) { occlusionPyramid = pyramid; }
+  bool isOcclusionCullingActive() const { return occlusionActive; }
+
+  // Takes effect with the next cull. The default selector keeps every object at LOD 0.
+  void setLodSelector(const LodSelector &selector) { lodThreshold = selector.getThreshold(); }
+  // whether the last cull picked levels of detail, i.e. draws need more than LOD 0's command
+  bool isLodSelectionActive() const { return lodThreshold >= 0.f; }
+
+  // Records the object uploads and the culling dispatch. Must be called outside a render pass.
+  void cull(VkCommandBuffer commandBuffer, int frameIndex, const Camera &camera);
+  // Records the late occlusion pass, after the pyramid was built from the depth of the draws
+  // of cull's commands, with the same camera. Must be called outside a render pass; does
+  // nothing unless occlusion culling is active.
+  void cullLate(VkCommandBuffer commandBuffer, int frameIndex, const Camera &camera);
+
+  const std::vector<DrawBatch> &getBatches() const { return batches; }
+  VkBuffer getDrawBuffer(int frameIndex) const { return frames[frameIndex].drawBuffer; }
+  VkBuffer getInstanceBuffer(int frameIndex) const { return frames[frameIndex].instanceBuffer; }
+  VkBuffer getMeshletDrawBuffer(int frameIndex) const {
+    return frames[frameIndex].meshletDrawBuffer;
+  }
+  // With occlusion culling the late pass's commands follow the early ones in the draw buffer,
+  // at the same offsets plus getLateDrawOffset, and its instances those in the instance buffer,
+  // at the same indices plus getLateInstanceOffset.
+  VkDeviceSize getLateDrawOffset() const {
+    return sizeof(VkDrawIndexedIndirectCommand) * commandCount;
+  }
+  uint32_t getLateInstanceOffset() const { return instanceCount; }
+  uint32_t getObjectCount() const { return static_cast<uint32_t>(objects.size()); }
+  // visible objects counted by the most recently completed cull
+  uint32_t getVisibleCount() const { return lastVisibleCount; }
+  // meshlet draws of all objects culled per meshlet, and how many of them the most recently
+  // completed cull left visible
+  uint32_t getMeshletDrawCount() const { return meshletDrawCount; }
+  uint32_t getVisibleMeshletCount() const { return lastVisibleMeshletCount; }
+  // objects in the frustum that both occlusion passes of the most recently completed cull
+  // rejected
+  uint32_t getOccludedCount() const { return lastOccludedCount; }
+  // triangles the most recently completed cull left to draw, objects culled per meshlet aside
+  uint64_t getVisibleTriangleCount() const { return lastVisibleTriangleCount; }
+
+ private:
+  // matches ObjectData in cull.comp (std430)
+  struct ObjectData {
+    glm::mat4 transform{1.f};
+    glm::vec4 boundingSphere{};  // world space center, radius
+    glm::vec4 color{};
+    uint32_t batch = 0;
+    uint32_t instanceBase = 0;
+    uint32_t drawnByMeshlets = 0;  // skipped by cull.comp, culled by meshlet_cull.comp
+    float lodScale = 1.f;          // largest axis scale of the transform
+  };
+
+  // matches BatchData in cull.comp (std430), one per batch
+  struct BatchData {
+    uint32_t firstCommand;
+    uint32_t lodCount;
+    uint32_t objectCount;
+    uint32_t padding;
+    float lodErrors[MAX_MESH_LODS];
+  };
+
+  // matches MeshletObject in meshlet_cull.comp (std430), one per object culled per meshlet
+  struct MeshletObject {
+    uint32_t object;
+    uint32_t instance;      // fixed slot in the instance buffer
+    uint32_t firstMeshlet;  // in meshletBuffer
+    uint32_t meshletCount;
+    uint32_t firstCommand;  // in the meshlet draw buffer
+    uint32_t padding[3];
+  };
+
+  // matches OcclusionView in occlusion_cull.comp (std430), one per frame in flight
+  struct OcclusionViewData {
+    glm::mat4 projectionView;
+    uint32_t depthSize[2];
+    uint32_t pyramidLevels;
+    uint32_t earlyTestEnabled;
+    uint32_t lateCommandOffset;
+    uint32_t lateInstanceOffset;
+  };
+
+  struct FrameResources {
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;  // dirty objects on their way to objectBuffer
+    Allocation stagingAllocation{};
+    // visible count header + one command per batch and level of detail, twice with occlusion
+    // culling
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    Allocation drawAllocation{};
+    VkBuffer batchBuffer = VK_NULL_HANDLE;  // rewritten with the commands every cull
+    Allocation batchAllocation{};
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;  // twice instanceCount with occlusion culling
+    Allocation instanceAllocation{};
+    VkBuffer meshletDrawBuffer = VK_NULL_HANDLE;  // written entirely by every meshlet pass
+    Allocation meshletDrawAllocation{};
+    VkBuffer occludedBuffer = VK_NULL_HANDLE;  // per object flags from the early to the late pass
+    Allocation occludedAllocation{};
+    VkBuffer occlusionViewBuffer = VK_NULL_HANDLE;
+    Allocation occlusionViewAllocation{};
+    uint32_t pyramidVersion = 0;  // of the pyramid view the descriptor set holds
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    bool usedOnce = false;
+  };
+
+  void createDescriptorSetLayout();
+  void createDescriptorPool();
+  void createPipelineLayout();
+  void destroyBuffers();
+  void createBuffers();
+  void createMeshletBuffers(const std::vector<Meshlet> &meshlets);
+  void writeDescriptorSets();
+  void writePyramidDescriptor(FrameResources &frame);
+  ObjectData makeObjectData(EntityRegistry &entities, uint32_t entity, uint32_t batch) const;
+  void refreshObject(EntityRegistry &entities, uint32_t entity, uint32_t index);
+  void recordObjectUploads(VkCommandBuffer commandBuffer, FrameResources &frame);
+  void recordDrawBarrier(VkCommandBuffer commandBuffer);
+
+  Device &device;
+
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  std::unique_ptr<ComputePipeline> cullPipeline;
+  std::unique_ptr<ComputePipeline> meshletCullPipeline;
+  std::unique_ptr<ComputePipeline> occlusionCullPipeline;
+
+  static constexpr uint32_t NO_OBJECT = ~0u;
+
+  std::vector<ObjectData> objects;
+  std::vector<uint32_t> objectOfEntity;  // dense entity index at setObjects -> object index
+  std::vector<uint32_t> batchOfModel;    // model id at setObjects -> batch index
+  std::vector<DrawBatch> batches;
+  uint32_t commandCount = 0;   // in the draw buffer
+  uint32_t instanceCount = 0;  // slots in the instance buffer
+  VkBuffer objectBuffer = VK_NULL_HANDLE;
+  Allocation objectAllocation{};
+  std::vector<FrameResources> frames;  // one per frame in flight
+
+  bool meshletCullingEnabled = true;
+  bool backFaceCulling = false;
+  std::vector<MeshletObject> meshletObjects;
+  uint32_t meshletDrawCount = 0;
+  VkBuffer meshletBuffer = VK_NULL_HANDLE;  // the meshlets of every batch culled per meshlet
+  Allocation meshletAllocation{};
+  VkBuffer meshletObjectBuffer = VK_NULL_HANDLE;
+  Allocation meshletObjectAllocation{};
+
+  // objects waiting to be copied into objectBuffer; dirtyFlags keeps each index listed once
+  std::vector<uint32_t> dirtyObjects;
+  std::vector<bool> dirtyFlags;
+  std::vector<VkBufferCopy> copyRegions;
+
+  DepthPyramid *occlusionPyramid = nullptr;
+  bool occlusionActive = false;  // occlusionPyramid as of the last setObjects
+
+  float lodThreshold = -1.f;
+
+  uint32_t lastVisibleCount = 0;
+  uint32_t lastVisibleMeshletCount = 0;
+  uint64_t lastVisibleTriangleCount = 0;
+  uint32_t lastOccludedCount = 0;
+};
+
+}  // namespace learnVulkan
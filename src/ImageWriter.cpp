@@ -0,0 +1,145 @@
+#include "ImageWriter.hpp"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace learnVulkan {
+
+namespace {
+
+std::ofstream openForWrite(const std::string &path) {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file for writing: " + path);
+  }
+  return file;
+}
+
+void appendBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+  out.push_back(static_cast<uint8_t>(value >> 24));
+  out.push_back(static_cast<uint8_t>(value >> 16));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t crc32(const uint8_t *data, size_t size) {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> result{};
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      result[n] = c;
+    }
+    return result;
+  }();
+
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+uint32_t adler32(const uint8_t *data, size_t size) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (size_t i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+// length, type, data, and a CRC over type and data
+void appendChunk(std::vector<uint8_t> &out, const char *type, const std::vector<uint8_t> &data) {
+  appendBigEndian(out, static_cast<uint32_t>(data.size()));
+  size_t typeStart = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  appendBigEndian(out, crc32(out.data() + typeStart, out.size() - typeStart));
+}
+
+}  // namespace
+
+void writePpm(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba) {
+  std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+  for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+    rgb[3 * i] = rgba[4 * i];
+    rgb[3 * i + 1] = rgba[4 * i + 1];
+    rgb[3 * i + 2] = rgba[4 * i + 2];
+  }
+
+  std::ofstream file = openForWrite(path);
+  file << "P6\n" << width << " " << height << "\n255\n";
+  file.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+  if (!file) {
+    throw std::runtime_error("failed to write image: " + path);
+  }
+}
+
+void writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba) {
+  // every scanline starts with filter type 0 (none)
+  size_t rowSize = static_cast<size_t>(width) * 4;
+  std::vector<uint8_t> scanlines;
+  scanlines.reserve((rowSize + 1) * height);
+  for (uint32_t y = 0; y < height; y++) {
+    scanlines.push_back(0);
+    scanlines.insert(scanlines.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+  }
+
+  // zlib stream of stored deflate blocks, each at most 65535 bytes
+  std::vector<uint8_t> idat = {0x78, 0x01};
+  size_t offset = 0;
+  do {
+    size_t blockSize = std::min<size_t>(65535, scanlines.size() - offset);
+    bool last = offset + blockSize == scanlines.size();
+    idat.push_back(last ? 1 : 0);
+    idat.push_back(static_cast<uint8_t>(blockSize));
+    idat.push_back(static_cast<uint8_t>(blockSize >> 8));
+    idat.push_back(static_cast<uint8_t>(~blockSize));
+    idat.push_back(static_cast<uint8_t>(~blockSize >> 8));
+    idat.insert(
+        idat.end(),
+        scanlines.begin() + offset,
+        scanlines.begin() + offset + blockSize);
+    offset += blockSize;
+  } while (offset < scanlines.size());
+  appendBigEndian(idat, adler32(scanlines.data(), scanlines.size()));
+
+  std::vector<uint8_t> header;
+  appendBigEndian(header, width);
+  appendBigEndian(header, height);
+  header.insert(header.end(), {8, 6, 0, 0, 0});  // 8 bit RGBA, deflate, no filter, no interlace
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  appendChunk(png, "IHDR", header);
+  appendChunk(png, "IDAT", idat);
+  appendChunk(png, "IEND", {});
+
+  std::ofstream file = openForWrite(path);
+  file.write(reinterpret_cast<const char *>(png.data()), png.size());
+  if (!file) {
+    throw std::runtime_error("failed to write image: " + path);
+  }
+}
+
+void writeImage(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba) {
+  std::string extension = path.substr(path.find_last_of('.') + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  if (extension == "png") {
+    writePng(path, width, height, rgba);
+  } else {
+    writePpm(path, width, height, rgba);
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,19 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+
+namespace learnVulkan {
+
+// Writers for tightly packed RGBA8 pixels, top row first, as read back from an
+// OffscreenTarget. Both throw std::runtime_error when the file cannot be written.
+
+// binary PPM (P6); alpha is dropped
+void writePpm(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+// RGBA PNG stored without compression, so it needs no zlib; fine for test and CI images
+void writePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+// picks the format from the extension, .png or anything else as PPM
+void writeImage(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba);
+
+}  // namespace learnVulkan
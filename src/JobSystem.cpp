@@ -0,0 +1,124 @@
+#include "JobSystem.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+namespace learnVulkan {
+
+namespace {
+
+// lets submit from inside a job push to the running worker's own queue
+thread_local const JobSystem *currentSystem = nullptr;
+thread_local uint32_t currentWorker = 0;
+
+}  // namespace
+
+uint32_t JobSystem::defaultWorkerCount() {
+  uint32_t hardwareThreads = std::thread::hardware_concurrency();
+  return std::max(hardwareThreads, 2u) - 1;
+}
+
+JobSystem::JobSystem(uint32_t workerCount) {
+  assert(workerCount > 0 && "Job system needs at least one worker");
+  queues.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; i++) {
+    queues.push_back(std::make_unique<WorkerQueue>());
+  }
+  workers.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; i++) {
+    workers.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock{sleepMutex};
+    stopping = true;
+  }
+  workAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void JobSystem::submit(Job job) {
+  uint32_t queueIndex = currentSystem == this
+                            ? currentWorker
+                            : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+  // Counted before it is published: a worker that is already awake can pop and finish the job
+  // as soon as it is in the queue, and must never decrement the counters below zero or see
+  // unfinishedJobs reach zero while this job is pending.
+  {
+    std::lock_guard<std::mutex> lock{sleepMutex};
+    queuedJobs++;
+    unfinishedJobs++;
+  }
+  {
+    std::lock_guard<std::mutex> lock{queues[queueIndex]->mutex};
+    queues[queueIndex]->jobs.push_back(std::move(job));
+  }
+  workAvailable.notify_one();
+}
+
+void JobSystem::waitIdle() {
+  assert(currentSystem != this && "waitIdle called from a job");
+  std::unique_lock<std::mutex> lock{sleepMutex};
+  allDone.wait(lock, [this] { return unfinishedJobs == 0; });
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex) {
+  currentSystem = this;
+  currentWorker = workerIndex;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{sleepMutex};
+      workAvailable.wait(lock, [this] { return stopping || queuedJobs > 0; });
+      if (stopping) {
+        return;
+      }
+    }
+
+    // another worker may take the job between the wake up and here, then we simply wait again
+    Job job;
+    if (!popOrSteal(workerIndex, job)) {
+      std::this_thread::yield();
+      continue;
+    }
+    job();
+
+    std::lock_guard<std::mutex> lock{sleepMutex};
+    if (--unfinishedJobs == 0) {
+      allDone.notify_all();
+    }
+  }
+}
+
+// The own queue is used as a stack, newest job first, since its data is most likely still
+// in cache. Thieves take from the other end, so the jobs submitted first are not starved.
+bool JobSystem::popOrSteal(uint32_t workerIndex, Job &job) {
+  uint32_t queueCount = static_cast<uint32_t>(queues.size());
+  for (uint32_t i = 0; i < queueCount; i++) {
+    WorkerQueue &queue = *queues[(workerIndex + i) % queueCount];
+    std::unique_lock<std::mutex> lock{queue.mutex};
+    if (queue.jobs.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    } else {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    lock.unlock();
+
+    std::lock_guard<std::mutex> sleepLock{sleepMutex};
+    queuedJobs--;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,66 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace learnVulkan {
+
+// Work stealing pool for independent fire and forget jobs, such as parsing assets. Every
+// worker owns a queue: it takes its newest job first, and when the queue runs dry it steals
+// the oldest job of another worker, so a few long jobs never leave the other workers idle.
+// Unlike ThreadPool the submitting thread does not take part and submit never blocks.
+class JobSystem {
+ public:
+  using Job = std::function<void()>;
+
+  // One worker per hardware thread minus the main thread, at least one.
+  static uint32_t defaultWorkerCount();
+
+  explicit JobSystem(uint32_t workerCount = defaultWorkerCount());
+  // Finishes the running jobs and drops the queued ones.
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+  // Queues a job, callable from any thread including jobs. Jobs must not throw.
+  void submit(Job job);
+
+  // Blocks until every submitted job has finished. Must not be called from a job.
+  void waitIdle();
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  void workerLoop(uint32_t workerIndex);
+  bool popOrSteal(uint32_t workerIndex, Job &job);
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+  // sleeping and waking, queuedJobs and unfinishedJobs only change with sleepMutex held
+  std::mutex sleepMutex;
+  std::condition_variable workAvailable;
+  std::condition_variable allDone;
+  uint32_t queuedJobs = 0;
+  uint32_t unfinishedJobs = 0;
+  bool stopping = false;
+
+  // round robin target for jobs submitted from outside the pool
+  std::atomic<uint32_t> nextQueue{0};
+};
+
+}  // namespace learnVulkan
@@ -0,0 +1,249 @@
+#include "MemoryAllocator.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+struct FreeRange {
+  VkDeviceSize offset;
+  VkDeviceSize size;
+};
+
+struct MemoryBlock {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  uint32_t memoryTypeIndex = 0;
+  MemoryAllocator::ResourceKind kind = MemoryAllocator::ResourceKind::Linear;
+  bool dedicated = false;
+  void *mapped = nullptr;
+
+  std::vector<FreeRange> freeRanges;  // sorted by offset, never adjacent
+  VkDeviceSize bytesUsed = 0;
+  VkDeviceSize bytesWasted = 0;
+  uint32_t allocationCount = 0;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+MemoryAllocator::MemoryAllocator(
+    VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize)
+    : device{device}, preferredBlockSize{preferredBlockSize} {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  for (auto &block : blocks) {
+    if (block->mapped != nullptr) {
+      vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, nullptr);
+  }
+}
+
+// Small heaps (integrated GPUs, BAR memory) get proportionally smaller blocks so a single
+// block never claims a large share of the heap.
+VkDeviceSize MemoryAllocator::blockSizeForType(uint32_t memoryTypeIndex) const {
+  uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+  VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+  if (heapSize <= 1024ull * 1024 * 1024) {
+    return std::min(preferredBlockSize, alignUp(heapSize / 8, 32));
+  }
+  return preferredBlockSize;
+}
+
+MemoryBlock *MemoryAllocator::createBlock(
+    VkDeviceSize size, uint32_t memoryTypeIndex, ResourceKind kind, bool dedicated) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+  auto block = std::make_unique<MemoryBlock>();
+  if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate device memory block!");
+  }
+  deviceAllocationCalls++;
+
+  block->size = size;
+  block->memoryTypeIndex = memoryTypeIndex;
+  block->kind = kind;
+  block->dedicated = dedicated;
+  block->freeRanges.push_back({0, size});
+
+  if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+      // the block is not tracked yet, so nothing else would free its memory
+      vkFreeMemory(device, block->memory, nullptr);
+      throw std::runtime_error("failed to map device memory block!");
+    }
+  }
+
+  blocks.push_back(std::move(block));
+  return blocks.back().get();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock *block) {
+  auto it = std::find_if(blocks.begin(), blocks.end(), [block](const auto &b) {
+    return b.get() == block;
+  });
+  assert(it != blocks.end() && "Block does not belong to this allocator");
+
+  if (block->mapped != nullptr) {
+    vkUnmapMemory(device, block->memory);
+  }
+  vkFreeMemory(device, block->memory, nullptr);
+  blocks.erase(it);
+}
+
+// Best fit: pick the smallest free range that still holds the aligned request, which keeps
+// large ranges intact for large resources.
+bool MemoryAllocator::tryAllocateFromBlock(
+    MemoryBlock &block, const VkMemoryRequirements &requirements, Allocation &allocation) {
+  size_t best = block.freeRanges.size();
+  VkDeviceSize bestSize = std::numeric_limits<VkDeviceSize>::max();
+  for (size_t i = 0; i < block.freeRanges.size(); i++) {
+    const FreeRange &range = block.freeRanges[i];
+    VkDeviceSize alignedOffset = alignUp(range.offset, requirements.alignment);
+    VkDeviceSize padding = alignedOffset - range.offset;
+    if (padding + requirements.size <= range.size && range.size < bestSize) {
+      best = i;
+      bestSize = range.size;
+    }
+  }
+  if (best == block.freeRanges.size()) {
+    return false;
+  }
+
+  FreeRange &range = block.freeRanges[best];
+  VkDeviceSize alignedOffset = alignUp(range.offset, requirements.alignment);
+  VkDeviceSize consumed = alignedOffset - range.offset + requirements.size;
+
+  allocation.memory = block.memory;
+  allocation.offset = alignedOffset;
+  allocation.size = requirements.size;
+  allocation.mappedData =
+      block.mapped != nullptr ? static_cast<char *>(block.mapped) + alignedOffset : nullptr;
+  allocation.block = &block;
+  allocation.rangeOffset = range.offset;
+  allocation.rangeSize = consumed;
+
+  if (consumed == range.size) {
+    block.freeRanges.erase(block.freeRanges.begin() + best);
+  } else {
+    range.offset += consumed;
+    range.size -= consumed;
+  }
+
+  block.bytesUsed += requirements.size;
+  block.bytesWasted += consumed - requirements.size;
+  block.allocationCount++;
+  return true;
+}
+
+Allocation MemoryAllocator::allocate(
+    const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, ResourceKind kind) {
+  Allocation allocation{};
+  VkDeviceSize blockSize = blockSizeForType(memoryTypeIndex);
+
+  // resources larger than half a block would mostly waste a shared block
+  if (requirements.size > blockSize / 2) {
+    MemoryBlock *block = createBlock(requirements.size, memoryTypeIndex, kind, true);
+    tryAllocateFromBlock(*block, requirements, allocation);
+    return allocation;
+  }
+
+  for (auto &block : blocks) {
+    if (block->dedicated || block->memoryTypeIndex != memoryTypeIndex || block->kind != kind) {
+      continue;
+    }
+    if (tryAllocateFromBlock(*block, requirements, allocation)) {
+      return allocation;
+    }
+  }
+
+  MemoryBlock *block = createBlock(blockSize, memoryTypeIndex, kind, false);
+  if (!tryAllocateFromBlock(*block, requirements, allocation)) {
+    throw std::runtime_error("failed to sub-allocate from a fresh memory block!");
+  }
+  return allocation;
+}
+
+void MemoryAllocator::free(Allocation &allocation) {
+  MemoryBlock *block = allocation.block;
+  if (block == nullptr) {
+    return;
+  }
+
+  block->bytesUsed -= allocation.size;
+  block->bytesWasted -= allocation.rangeSize - allocation.size;
+  block->allocationCount--;
+
+  // insert the range back in offset order and coalesce with its neighbours
+  auto &ranges = block->freeRanges;
+  auto it = std::lower_bound(
+      ranges.begin(),
+      ranges.end(),
+      allocation.rangeOffset,
+      [](const FreeRange &range, VkDeviceSize offset) { return range.offset < offset; });
+  it = ranges.insert(it, {allocation.rangeOffset, allocation.rangeSize});
+  if (it + 1 != ranges.end() && it->offset + it->size == (it + 1)->offset) {
+    it->size += (it + 1)->size;
+    ranges.erase(it + 1);
+  }
+  if (it != ranges.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+    (it - 1)->size += it->size;
+    ranges.erase(it);
+  }
+
+  allocation = Allocation{};
+
+  if (block->allocationCount > 0) {
+    return;
+  }
+
+  // keep one empty shared block per memory type around so load/unload cycles do not
+  // bounce memory back and forth with the driver
+  bool keep = !block->dedicated && std::none_of(blocks.begin(), blocks.end(), [block](const auto &b) {
+    return b.get() != block && !b->dedicated && b->allocationCount == 0 &&
+           b->memoryTypeIndex == block->memoryTypeIndex && b->kind == block->kind;
+  });
+  if (!keep) {
+    destroyBlock(block);
+  }
+}
+
+AllocatorStats MemoryAllocator::getStats() const {
+  AllocatorStats stats{};
+  stats.deviceAllocationCalls = deviceAllocationCalls;
+
+  VkDeviceSize totalFree = 0;
+  VkDeviceSize largestFree = 0;
+  for (const auto &block : blocks) {
+    stats.blockCount++;
+    if (block->dedicated) {
+      stats.dedicatedBlockCount++;
+    }
+    stats.allocationCount += block->allocationCount;
+    stats.bytesReserved += block->size;
+    stats.bytesUsed += block->bytesUsed;
+    stats.bytesWasted += block->bytesWasted;
+    for (const auto &range : block->freeRanges) {
+      totalFree += range.size;
+      largestFree = std::max(largestFree, range.size);
+    }
+  }
+  if (totalFree > 0) {
+    stats.fragmentation =
+        1.f - static_cast<float>(largestFree) / static_cast<float>(totalFree);
+  }
+  return stats;
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <memory>
+#include <vector>
+
+namespace learnVulkan {
+
+struct MemoryBlock;
+
+// A sub-range of a VkDeviceMemory block handed out by MemoryAllocator.
+// Bind resources with (memory, offset); mappedData is non-null for host visible memory types,
+// which are persistently mapped for the lifetime of their block.
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  void *mappedData = nullptr;
+
+  // bookkeeping used by MemoryAllocator::free
+  MemoryBlock *block = nullptr;
+  VkDeviceSize rangeOffset = 0;
+  VkDeviceSize rangeSize = 0;
+};
+
+struct AllocatorStats {
+  uint32_t blockCount = 0;           // live VkDeviceMemory objects (shared + dedicated)
+  uint32_t dedicatedBlockCount = 0;  // blocks holding a single oversized resource
+  uint32_t allocationCount = 0;      // live sub-allocations
+  uint64_t deviceAllocationCalls = 0;  // total vkAllocateMemory calls since creation
+  VkDeviceSize bytesReserved = 0;    // sum of all block sizes
+  VkDeviceSize bytesUsed = 0;        // bytes requested by live allocations
+  VkDeviceSize bytesWasted = 0;      // alignment padding inside live allocations
+  float fragmentation = 0.f;         // 1 - largest free range / total free bytes
+};
+
+// Block based sub-allocator. Memory is reserved from the driver in large blocks per
+// memory type and carved up with a best-fit free list. Buffers (linear) and optimal tiling
+// images never share a block, which keeps bufferImageGranularity from ever applying.
+class MemoryAllocator {
+ public:
+  enum class ResourceKind { Linear, Optimal };
+
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+  MemoryAllocator(
+      VkDevice device,
+      VkPhysicalDevice physicalDevice,
+      VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+  ~MemoryAllocator();
+
+  MemoryAllocator(const MemoryAllocator &) = delete;
+  MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+  Allocation allocate(
+      const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, ResourceKind kind);
+  void free(Allocation &allocation);
+
+  AllocatorStats getStats() const;
+
+ private:
+  VkDeviceSize blockSizeForType(uint32_t memoryTypeIndex) const;
+  MemoryBlock *createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, ResourceKind kind, bool dedicated);
+  void destroyBlock(MemoryBlock *block);
+  bool tryAllocateFromBlock(
+      MemoryBlock &block, const VkMemoryRequirements &requirements, Allocation &allocation);
+
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  VkDeviceSize preferredBlockSize;
+  std::vector<std::unique_ptr<MemoryBlock>> blocks;
+  uint64_t deviceAllocationCalls = 0;
+};
+
+}  // namespace learnVulkan
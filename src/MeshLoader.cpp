@@ -0,0 +1,614 @@
+#include "MeshLoader.hpp"
+
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+// std
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace learnVulkan {
+
+namespace {
+
+template <typename T>
+void hashCombine(size_t &seed, const T &value) {
+  seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// -0.f == 0.f, so both have to hash the same
+void hashFloats(size_t &seed, const float *values, int count) {
+  for (int i = 0; i < count; i++) {
+    float value = values[i] == 0.f ? 0.f : values[i];
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    hashCombine(seed, bits);
+  }
+}
+
+struct VertexHasher {
+  size_t operator()(const Model::Vertex &vertex) const {
+    size_t seed = 0;
+    hashFloats(seed, &vertex.position.x, 3);
+    hashFloats(seed, &vertex.color.x, 3);
+    hashFloats(seed, &vertex.normal.x, 3);
+    hashFloats(seed, &vertex.uv.x, 2);
+    return seed;
+  }
+};
+
+std::string readFile(const std::string &filepath) {
+  std::ifstream file{filepath, std::ios::ate | std::ios::binary};
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file: " + filepath);
+  }
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  std::string buffer(fileSize, '\0');
+  file.seekg(0);
+  file.read(&buffer[0], fileSize);
+  return buffer;
+}
+
+const char *skipSpaces(const char *p, const char *lineEnd) {
+  while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// Parses up to maxCount floats of the current line and returns how many were found. The
+// buffer is NUL terminated, and strtof is only called on a non-space inside the line, so it
+// never reads past the line.
+int parseFloats(const char *&p, const char *lineEnd, float *out, int maxCount) {
+  int count = 0;
+  while (count < maxCount) {
+    p = skipSpaces(p, lineEnd);
+    if (p == lineEnd || *p == '#') {
+      break;
+    }
+    char *next;
+    float value = strtof(p, &next);
+    if (next == p) {
+      break;
+    }
+    out[count++] = value;
+    p = next;
+  }
+  return count;
+}
+
+// Parses the uv or normal index of a face vertex, 0 when there is none. strtol skips leading
+// whitespace, newlines included, so it is only called on a sign or digit inside the line;
+// otherwise a face like "f 1/2/" would read the first number of the next line.
+long parseIndex(const char *&p, const char *lineEnd) {
+  if (p == lineEnd || !(isdigit(static_cast<unsigned char>(*p)) || *p == '-' || *p == '+')) {
+    return 0;
+  }
+  char *next;
+  long value = strtol(p, &next, 10);
+  p = next;
+  return value;
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element defined so far.
+uint32_t resolveIndex(long index, size_t count, const std::string &filepath) {
+  long resolved = index > 0 ? index - 1 : static_cast<long>(count) + index;
+  if (index == 0 || resolved < 0 || resolved >= static_cast<long>(count)) {
+    throw std::runtime_error("invalid face index in " + filepath);
+  }
+  return static_cast<uint32_t>(resolved);
+}
+
+struct SourceStamp {
+  uint64_t size = 0;
+  int64_t time = 0;
+};
+
+bool readSourceStamp(const std::string &filepath, SourceStamp &stamp) {
+  std::error_code error;
+  stamp.size = std::filesystem::file_size(filepath, error);
+  if (error) {
+    return false;
+  }
+  auto time = std::filesystem::last_write_time(filepath, error);
+  if (error) {
+    return false;
+  }
+  stamp.time = static_cast<int64_t>(time.time_since_epoch().count());
+  return true;
+}
+
+constexpr char CACHE_MAGIC[4] = {'L', 'V', 'M', 'C'};
+// 2: meshes are stored after optimizeMesh
+// 3: level of detail chains follow the indices
+// 4: meshlets of LOD 0 follow the levels of detail
+constexpr uint32_t CACHE_VERSION = 4;
+
+// Followed by vertexCount vertices, indexCount 32 bit indices, lodCount MeshLods and
+// meshletCount Meshlets. 48 bytes keeps the arrays 4 byte aligned in the page aligned mapping.
+struct MeshCacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t vertexSize;  // sizeof(Model::Vertex) of the writer, a layout change invalidates
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t lodCount;
+  uint32_t meshletCount;
+  uint32_t padding;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+};
+
+// Read only mapping of a whole file; data() is null if the file could not be mapped.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+    file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+      return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+      return;
+    }
+    bytes = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    length = bytes != nullptr ? static_cast<size_t>(fileSize.QuadPart) : 0;
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      return;
+    }
+    void *address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      return;
+    }
+    bytes = static_cast<const uint8_t *>(address);
+    length = static_cast<size_t>(info.st_size);
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (bytes != nullptr) {
+      UnmapViewOfFile(bytes);
+    }
+    if (mapping != nullptr) {
+      CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+    }
+#else
+    if (bytes != nullptr) {
+      munmap(const_cast<uint8_t *>(bytes), length);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+
+ private:
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+  const uint8_t *bytes = nullptr;
+  size_t length = 0;
+};
+
+const MeshCacheHeader *findValidHeader(const MappedFile &cache, const SourceStamp &stamp) {
+  if (cache.data() == nullptr || cache.size() < sizeof(MeshCacheHeader)) {
+    return nullptr;
+  }
+  auto *header = reinterpret_cast<const MeshCacheHeader *>(cache.data());
+  uint64_t expectedSize = sizeof(MeshCacheHeader) +
+                          static_cast<uint64_t>(header->vertexCount) * sizeof(Model::Vertex) +
+                          static_cast<uint64_t>(header->indexCount) * sizeof(uint32_t) +
+                          static_cast<uint64_t>(header->lodCount) * sizeof(MeshLod) +
+                          static_cast<uint64_t>(header->meshletCount) * sizeof(Meshlet);
+  bool valid = memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+               header->version == CACHE_VERSION &&
+               header->vertexSize == sizeof(Model::Vertex) &&
+               header->sourceSize == stamp.size && header->sourceTime == stamp.time &&
+               cache.size() == expectedSize && header->vertexCount >= 3 &&
+               header->indexCount >= 3 && header->indexCount % 3 == 0 &&
+               header->lodCount <= MAX_MESH_LODS;
+  if (valid) {
+    auto *meshlets = reinterpret_cast<const Meshlet *>(
+        cache.data() + (expectedSize - sizeof(Meshlet) * header->meshletCount));
+    auto *lods = reinterpret_cast<const MeshLod *>(
+        reinterpret_cast<const uint8_t *>(meshlets) - sizeof(MeshLod) * header->lodCount);
+    for (uint32_t i = 0; i < header->lodCount; i++) {
+      valid &= lods[i].indexCount <= header->indexCount &&
+               lods[i].firstIndex <= header->indexCount - lods[i].indexCount;
+    }
+    for (uint32_t i = 0; i < header->meshletCount; i++) {
+      valid &= meshlets[i].indexCount <= header->indexCount &&
+               meshlets[i].firstIndex <= header->indexCount - meshlets[i].indexCount;
+    }
+  }
+  if (valid) {
+    // the indices are uploaded as they are, one past the vertices would make the GPU fetch
+    // outside the vertex buffer; this pass also brings them into cache for the staging copy
+    auto *indices = reinterpret_cast<const uint32_t *>(
+        cache.data() + sizeof(MeshCacheHeader) +
+        sizeof(Model::Vertex) * static_cast<size_t>(header->vertexCount));
+    uint32_t largestIndex = 0;
+    for (uint32_t i = 0; i < header->indexCount; i++) {
+      largestIndex = indices[i] > largestIndex ? indices[i] : largestIndex;
+    }
+    valid = largestIndex < header->vertexCount;
+  }
+  return valid ? header : nullptr;
+}
+
+}  // namespace
+
+void loadObj(const std::string &filepath, Model::Builder &builder) {
+  std::string text = readFile(filepath);
+
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> colors;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::unordered_map<Model::Vertex, uint32_t, VertexHasher> uniqueVertices;
+  std::vector<uint32_t> face;
+
+  builder.vertices.clear();
+  builder.indices.clear();
+
+  const char *p = text.c_str();
+  const char *end = p + text.size();
+  while (p < end) {
+    const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+    p = skipSpaces(p, lineEnd);
+
+    if (p + 1 < lineEnd && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      float values[6];
+      p += 2;
+      int count = parseFloats(p, lineEnd, values, 6);
+      if (count < 3) {
+        throw std::runtime_error("invalid vertex position in " + filepath);
+      }
+      positions.push_back({values[0], values[1], values[2]});
+      colors.push_back(count == 6 ? glm::vec3{values[3], values[4], values[5]} : glm::vec3{1.f});
+    } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+      float values[3] = {0.f, 0.f, 0.f};
+      p += 3;
+      parseFloats(p, lineEnd, values, 3);
+      // OBJ puts v = 0 at the bottom of the image, Vulkan at the top
+      uvs.push_back({values[0], 1.f - values[1]});
+    } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+      float values[3] = {0.f, 0.f, 0.f};
+      p += 3;
+      parseFloats(p, lineEnd, values, 3);
+      normals.push_back({values[0], values[1], values[2]});
+    } else if (p + 1 < lineEnd && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      p += 2;
+      face.clear();
+      while (true) {
+        p = skipSpaces(p, lineEnd);
+        if (p == lineEnd || *p == '#') {
+          break;
+        }
+        char *next;
+        long positionIndex = strtol(p, &next, 10);
+        if (next == p) {
+          throw std::runtime_error("invalid face in " + filepath);
+        }
+        p = next;
+        long uvIndex = 0;
+        long normalIndex = 0;
+        if (p < lineEnd && *p == '/') {
+          p++;
+          uvIndex = parseIndex(p, lineEnd);
+          if (p < lineEnd && *p == '/') {
+            p++;
+            normalIndex = parseIndex(p, lineEnd);
+          }
+        }
+
+        Model::Vertex vertex{};
+        uint32_t position = resolveIndex(positionIndex, positions.size(), filepath);
+        vertex.position = positions[position];
+        vertex.color = colors[position];
+        if (uvIndex != 0) {
+          vertex.uv = uvs[resolveIndex(uvIndex, uvs.size(), filepath)];
+        }
+        if (normalIndex != 0) {
+          vertex.normal = normals[resolveIndex(normalIndex, normals.size(), filepath)];
+        }
+
+        auto inserted =
+            uniqueVertices.emplace(vertex, static_cast<uint32_t>(builder.vertices.size()));
+        if (inserted.second) {
+          builder.vertices.push_back(vertex);
+        }
+        face.push_back(inserted.first->second);
+      }
+
+      for (size_t i = 1; i + 1 < face.size(); i++) {
+        builder.indices.push_back(face[0]);
+        builder.indices.push_back(face[i]);
+        builder.indices.push_back(face[i + 1]);
+      }
+    }
+    p = lineEnd + 1;
+  }
+
+  if (builder.vertices.size() < 3 || builder.indices.empty()) {
+    throw std::runtime_error("no triangles in " + filepath);
+  }
+}
+
+void writeObj(const std::string &filepath, const Model::Builder &builder) {
+  bool hasUvs = false;
+  bool hasNormals = false;
+  for (const auto &vertex : builder.vertices) {
+    hasUvs = hasUvs || vertex.uv != glm::vec2{0.f};
+    hasNormals = hasNormals || vertex.normal != glm::vec3{0.f};
+  }
+
+  std::ofstream file{filepath, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file: " + filepath);
+  }
+  // 9 significant digits give back the same floats, so loadObj merges exactly what was written
+  char line[160];
+  for (const auto &vertex : builder.vertices) {
+    const glm::vec3 &p = vertex.position;
+    const glm::vec3 &c = vertex.color;
+    snprintf(
+        line, sizeof(line), "v %.9g %.9g %.9g %.9g %.9g %.9g\n", p.x, p.y, p.z, c.x, c.y, c.z);
+    file << line;
+  }
+  if (hasUvs) {
+    for (const auto &vertex : builder.vertices) {
+      snprintf(line, sizeof(line), "vt %.9g %.9g\n", vertex.uv.x, 1.f - vertex.uv.y);
+      file << line;
+    }
+  }
+  if (hasNormals) {
+    for (const auto &vertex : builder.vertices) {
+      const glm::vec3 &n = vertex.normal;
+      snprintf(line, sizeof(line), "vn %.9g %.9g %.9g\n", n.x, n.y, n.z);
+      file << line;
+    }
+  }
+  for (size_t i = 0; i + 2 < builder.indices.size(); i += 3) {
+    file << 'f';
+    for (size_t k = 0; k < 3; k++) {
+      uint32_t index = builder.indices[i + k] + 1;
+      if (hasUvs && hasNormals) {
+        snprintf(line, sizeof(line), " %u/%u/%u", index, index, index);
+      } else if (hasUvs) {
+        snprintf(line, sizeof(line), " %u/%u", index, index);
+      } else if (hasNormals) {
+        snprintf(line, sizeof(line), " %u//%u", index, index);
+      } else {
+        snprintf(line, sizeof(line), " %u", index);
+      }
+      file << line;
+    }
+    file << '\n';
+  }
+  if (!file) {
+    throw std::runtime_error("failed to write file: " + filepath);
+  }
+}
+
+std::string meshCachePath(const std::string &filepath) { return filepath + ".lvmesh"; }
+
+namespace {
+
+bool writeCache(
+    const std::string &cachePath, const SourceStamp &stamp, const Model::Builder &builder) {
+  MeshCacheHeader header{};
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.vertexSize = sizeof(Model::Vertex);
+  header.vertexCount = static_cast<uint32_t>(builder.vertices.size());
+  header.indexCount = static_cast<uint32_t>(builder.indices.size());
+  header.lodCount = static_cast<uint32_t>(builder.lods.size());
+  header.meshletCount = static_cast<uint32_t>(builder.meshletData.size());
+  header.sourceSize = stamp.size;
+  header.sourceTime = stamp.time;
+
+  // written to a temporary first, so a reader never maps a half written cache; the name is
+  // per thread because loader jobs may write the cache of the same file at the same time
+  std::string tempPath =
+      cachePath + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) +
+      ".tmp";
+  {
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) {
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(
+        reinterpret_cast<const char *>(builder.vertices.data()),
+        sizeof(Model::Vertex) * builder.vertices.size());
+    file.write(
+        reinterpret_cast<const char *>(builder.indices.data()),
+        sizeof(uint32_t) * builder.indices.size());
+    file.write(
+        reinterpret_cast<const char *>(builder.lods.data()),
+        sizeof(MeshLod) * builder.lods.size());
+    file.write(
+        reinterpret_cast<const char *>(builder.meshletData.data()),
+        sizeof(Meshlet) * builder.meshletData.size());
+    if (!file) {
+      file.close();
+      std::remove(tempPath.c_str());
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, cachePath, error);
+  if (error) {
+    std::remove(tempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool writeMeshCache(
+    const std::string &cachePath, const std::string &sourcePath, const Model::Builder &builder) {
+  SourceStamp stamp;
+  return readSourceStamp(sourcePath, stamp) && writeCache(cachePath, stamp, builder);
+}
+
+namespace {
+
+// Returns the current cache contents of filepath, or a mesh without vertices when the cache
+// is missing or outdated. The arrays point into cache and live as long as the mapping.
+Model::MeshData mapCachedMesh(const MappedFile &cache, const SourceStamp &stamp) {
+  Model::MeshData mesh{};
+  if (const MeshCacheHeader *header = findValidHeader(cache, stamp)) {
+    const uint8_t *data = cache.data() + sizeof(MeshCacheHeader);
+    mesh.vertices = reinterpret_cast<const Model::Vertex *>(data);
+    mesh.vertexCount = header->vertexCount;
+    mesh.indices = reinterpret_cast<const uint32_t *>(
+        data + sizeof(Model::Vertex) * static_cast<size_t>(header->vertexCount));
+    mesh.indexCount = header->indexCount;
+    mesh.lods = reinterpret_cast<const MeshLod *>(
+        reinterpret_cast<const uint8_t *>(mesh.indices) +
+        sizeof(uint32_t) * static_cast<size_t>(header->indexCount));
+    mesh.lodCount = header->lodCount;
+    mesh.meshletData = reinterpret_cast<const Meshlet *>(
+        reinterpret_cast<const uint8_t *>(mesh.lods) +
+        sizeof(MeshLod) * static_cast<size_t>(header->lodCount));
+    mesh.meshletCount = header->meshletCount;
+  }
+  return mesh;
+}
+
+// taken before parsing, so a source changed meanwhile leaves the cache outdated
+SourceStamp requireSourceStamp(const std::string &filepath) {
+  SourceStamp stamp;
+  if (!readSourceStamp(filepath, stamp)) {
+    throw std::runtime_error("failed to open file: " + filepath);
+  }
+  return stamp;
+}
+
+// the cache holds the optimized mesh, its levels of detail and meshlets, so the reordering,
+// simplification and meshlet building are paid once per source change; meshlets are stored
+// whether this load asked for them or not, the cache is shared by every load of the file
+void parseAndCache(
+    const std::string &filepath,
+    const std::string &cachePath,
+    const SourceStamp &stamp,
+    Model::Builder &builder) {
+  loadObj(filepath, builder);
+  optimizeMesh(builder);
+  generateLods(builder);
+  builder.buildMeshlets();
+  writeCache(cachePath, stamp, builder);
+  if (!builder.meshlets) {
+    builder.meshletData.clear();
+  }
+}
+
+}  // namespace
+
+void loadMeshCached(const std::string &filepath, Model::Builder &builder) {
+  SourceStamp stamp = requireSourceStamp(filepath);
+  std::string cachePath = meshCachePath(filepath);
+  {
+    MappedFile cache{cachePath};
+    Model::MeshData mesh = mapCachedMesh(cache, stamp);
+    if (mesh.vertexCount > 0) {
+      builder.vertices.assign(mesh.vertices, mesh.vertices + mesh.vertexCount);
+      builder.indices.assign(mesh.indices, mesh.indices + mesh.indexCount);
+      builder.lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+      if (builder.meshlets) {
+        builder.meshletData.assign(mesh.meshletData, mesh.meshletData + mesh.meshletCount);
+      }
+      return;
+    }
+  }
+
+  parseAndCache(filepath, cachePath, stamp, builder);
+}
+
+std::unique_ptr<Model> loadModelCached(
+    Device &device,
+    const std::string &filepath,
+    Model::VertexUsage vertexUsage,
+    const VertexLayout &vertexLayout,
+    bool meshlets) {
+  SourceStamp stamp = requireSourceStamp(filepath);
+  std::string cachePath = meshCachePath(filepath);
+  {
+    MappedFile cache{cachePath};
+    Model::MeshData mesh = mapCachedMesh(cache, stamp);
+    if (mesh.vertexCount > 0) {
+      mesh.vertexUsage = vertexUsage;
+      mesh.vertexLayout = vertexLayout;
+      mesh.meshlets = meshlets;
+      // the model copies the arrays into the staging ring, the mapping can go afterwards
+      return std::make_unique<Model>(device, mesh);
+    }
+  }
+
+  Model::Builder builder{};
+  builder.vertexUsage = vertexUsage;
+  builder.vertexLayout = vertexLayout;
+  builder.meshlets = meshlets;
+  parseAndCache(filepath, cachePath, stamp, builder);
+  return std::make_unique<Model>(device, builder);
+}
+
+}  // namespace learnVulkan
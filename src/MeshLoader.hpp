@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Device.hpp"
+#include "Model.hpp"
+
+// std
+#include <memory>
+#include <string>
+
+namespace learnVulkan {
+
+// Replaces the builder's vertices and indices with the triangles of a Wavefront OBJ file.
+// Understands v (with optional r g b vertex colors), vt, vn and f with any of the v, v/vt,
+// v//vn and v/vt/vn forms, including negative indices; polygons are triangulated as fans and
+// everything else is skipped. Identical vertices are merged, so the result is indexed.
+// Throws if the file cannot be read or refers to elements it does not define.
+void loadObj(const std::string &filepath, Model::Builder &builder);
+
+// Writes the builder as an OBJ file with one v, vt and vn line per vertex, in vertex order,
+// so loadObj reads back the same vertex and index arrays. vt and vn are left out when every
+// vertex has a zero uv or normal. Throws if the file cannot be written.
+void writeObj(const std::string &filepath, const Model::Builder &builder);
+
+// Binary mesh cache: a small header followed by the vertex and the index array exactly as
+// they are uploaded, the levels of detail and the meshlets. The header records the size and
+// modification time of the source file and the vertex layout, so an outdated cache is
+// detected and rebuilt, as is one whose triangles refer to vertices it does not hold.
+std::string meshCachePath(const std::string &filepath);
+// Returns false when the cache could not be written; loading works without it.
+bool writeMeshCache(
+    const std::string &cachePath, const std::string &sourcePath, const Model::Builder &builder);
+
+// Fills the builder from filepath's cache when it is current, otherwise parses the OBJ file,
+// runs optimizeMesh, generateLods and Builder::buildMeshlets on it and writes the cache.
+// meshletData is only filled when the builder asks for meshlets. Touches no Vulkan state, so
+// loader jobs call it on worker threads.
+void loadMeshCached(const std::string &filepath, Model::Builder &builder);
+
+// Creates the model from filepath's cache when it is current, by memory mapping it and
+// handing the arrays straight to the upload path. Otherwise parses, optimizes and simplifies
+// the OBJ file, writes the cache next to it and creates the model from the parsed data. The
+// cache always holds Model::Vertex, vertexLayout only applies to the upload.
+std::unique_ptr<Model> loadModelCached(
+    Device &device,
+    const std::string &filepath,
+    Model::VertexUsage vertexUsage,
+    const VertexLayout &vertexLayout = {},
+    bool meshlets = false);
+
+}  // namespace learnVulkan
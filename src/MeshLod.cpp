@@ -0,0 +1,25 @@
+#include "MeshLod.hpp"
+
+namespace learnVulkan {
+
+void LodSelector::setViewport(const glm::mat4 &projection, float viewportHeight) {
+  float pixelsPerError = projection[1][1] * .5f * viewportHeight;
+  threshold = maxPixelError > 0.f && pixelsPerError > 0.f ? maxPixelError / pixelsPerError : -1.f;
+}
+
+uint32_t LodSelector::select(
+    const std::vector<MeshLod> &lods, float errorScale, float distance) const {
+  // errors grow along the chain, so the first acceptable level from the coarse end wins
+  for (uint32_t i = static_cast<uint32_t>(lods.size()); i-- > 1;) {
+    if (lods[i].error * errorScale <= threshold * distance) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+float distanceToSphere(const glm::vec3 &point, const glm::vec4 &sphere) {
+  return glm::max(glm::length(glm::vec3(sphere) - point) - sphere.w, 0.f);
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,52 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+static constexpr uint32_t MAX_MESH_LODS = 8;
+
+// One level of detail of a model: a range of its index buffer over the shared vertices.
+// error bounds the distance of the simplified surface from the full one, in model space.
+struct MeshLod {
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  float error = 0.f;
+  uint32_t padding = 0;
+};
+
+// Picks levels of detail by how far their error projects on screen: the coarsest level whose
+// error covers at most maxPixelError pixels wins. There are no distance thresholds, so the
+// choice follows the field of view and resolution, and stays below what can be seen to pop.
+class LodSelector {
+ public:
+  // 0 turns selection off and keeps every object at LOD 0
+  explicit LodSelector(float maxPixelError = 0.f) : maxPixelError{maxPixelError} {}
+
+  // An error e at distance d covers e / d * projection[1][1] * viewportHeight / 2 pixels.
+  void setViewport(const glm::mat4 &projection, float viewportHeight);
+
+  // Geometric error allowed per unit of distance, negative while selection is off. The
+  // culling shader compares with it the same way select() does.
+  float getThreshold() const { return threshold; }
+
+  // errorScale turns model space errors into world space, usually the largest axis scale.
+  // distance is measured from the camera to the object's bounding sphere.
+  uint32_t select(const std::vector<MeshLod> &lods, float errorScale, float distance) const;
+
+ private:
+  float maxPixelError;
+  float threshold = -1.f;
+};
+
+// Distance from a point to the surface of a sphere (xyz center, w radius), 0 inside it.
+float distanceToSphere(const glm::vec3 &point, const glm::vec4 &sphere);
+
+}  // namespace learnVulkan
@@ -0,0 +1,391 @@
+#include "MeshOptimizer.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+namespace learnVulkan {
+
+namespace {
+
+// Forsyth's scoring constants; the scored cache is an LRU of 32 vertices, larger than the
+// FIFO the statistics simulate, so vertices about to fall out still pull their triangles in.
+constexpr uint32_t SCORE_CACHE_SIZE = 32;
+constexpr uint32_t SCORE_MAX_VALENCE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = .75f;
+constexpr float VALENCE_BOOST_SCALE = 2.f;
+constexpr float VALENCE_BOOST_POWER = .5f;
+
+constexpr uint32_t NO_TRIANGLE = ~0u;
+
+struct ScoreTables {
+  float cache[SCORE_CACHE_SIZE];
+  float valence[SCORE_MAX_VALENCE + 1];
+
+  ScoreTables() {
+    for (uint32_t i = 0; i < SCORE_CACHE_SIZE; i++) {
+      if (i < 3) {
+        // the last triangle's vertices get a fixed score, or the order would favour strips
+        // over the fans that reuse them best
+        cache[i] = LAST_TRIANGLE_SCORE;
+      } else {
+        float scaler = 1.f / static_cast<float>(SCORE_CACHE_SIZE - 3);
+        cache[i] = std::pow(1.f - static_cast<float>(i - 3) * scaler, CACHE_DECAY_POWER);
+      }
+    }
+    valence[0] = 0.f;
+    for (uint32_t i = 1; i <= SCORE_MAX_VALENCE; i++) {
+      // vertices with few triangles left are finished off first, instead of being left behind
+      valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+    }
+  }
+};
+
+float vertexScore(const ScoreTables &tables, int cachePosition, uint32_t remainingValence) {
+  if (remainingValence == 0) {
+    // no triangle left to draw, it must not influence any choice
+    return -1.f;
+  }
+  float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.f;
+  return score + tables.valence[std::min(remainingValence, SCORE_MAX_VALENCE)];
+}
+
+// FIFO that tells whether a vertex had to be transformed again
+class FifoCache {
+ public:
+  FifoCache(uint32_t vertexCount, uint32_t cacheSize)
+      : timestamps(vertexCount, 0), size{cacheSize} {}
+
+  bool access(uint32_t vertex) {
+    // a vertex is cached while fewer than size others were transformed after it
+    if (timestamps[vertex] != 0 && time - timestamps[vertex] < size) {
+      return false;
+    }
+    time++;
+    timestamps[vertex] = time;
+    return true;
+  }
+
+  void reset() { time += size; }
+
+ private:
+  std::vector<uint32_t> timestamps;
+  uint32_t size;
+  uint32_t time = 0;
+};
+
+uint32_t triangleMisses(FifoCache &cache, const uint32_t *triangle) {
+  return static_cast<uint32_t>(cache.access(triangle[0])) +
+         static_cast<uint32_t>(cache.access(triangle[1])) +
+         static_cast<uint32_t>(cache.access(triangle[2]));
+}
+
+struct Cluster {
+  size_t begin;  // first index
+  size_t end;
+  float sortKey;
+};
+
+}  // namespace
+
+VertexCacheStats analyzeVertexCache(
+    const uint32_t *indices,
+    size_t indexCount,
+    uint32_t vertexCount,
+    uint32_t cacheSize) {
+  assert(indexCount % 3 == 0 && "index count must be a multiple of 3");
+  VertexCacheStats stats{};
+  if (indexCount == 0) {
+    return stats;
+  }
+
+  FifoCache cache{vertexCount, cacheSize};
+  std::vector<bool> referenced(vertexCount, false);
+  uint32_t misses = 0;
+  uint32_t referencedCount = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    assert(indices[i] < vertexCount && "index out of range");
+    misses += cache.access(indices[i]) ? 1 : 0;
+    if (!referenced[indices[i]]) {
+      referenced[indices[i]] = true;
+      referencedCount++;
+    }
+  }
+  stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+  stats.atvr = static_cast<float>(misses) / static_cast<float>(referencedCount);
+  return stats;
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount) {
+  assert(indexCount % 3 == 0 && "index count must be a multiple of 3");
+  const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+  if (triangleCount == 0) {
+    return;
+  }
+  static const ScoreTables tables{};
+
+  // triangles of every vertex; the first activeCount of each range are still to be drawn
+  std::vector<uint32_t> valence(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; i++) {
+    assert(indices[i] < vertexCount && "index out of range");
+    valence[indices[i]]++;
+  }
+  std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    triangleOffsets[v + 1] = triangleOffsets[v] + valence[v];
+  }
+  std::vector<uint32_t> vertexTriangles(indexCount);
+  std::vector<uint32_t> activeCount(vertexCount, 0);
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    for (uint32_t k = 0; k < 3; k++) {
+      uint32_t v = indices[t * 3 + k];
+      vertexTriangles[triangleOffsets[v] + activeCount[v]++] = t;
+    }
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    vertexScores[v] = vertexScore(tables, -1, activeCount[v]);
+  }
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    const uint32_t *triangle = indices + t * 3;
+    triangleScores[t] =
+        vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+  }
+
+  std::vector<uint32_t> input(indices, indices + indexCount);
+  uint32_t cache[SCORE_CACHE_SIZE + 3];
+  uint32_t cacheCount = 0;
+  uint32_t newCache[SCORE_CACHE_SIZE + 3];
+
+  uint32_t best = static_cast<uint32_t>(
+      std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+  // where to look for a fresh start once no cached vertex has a triangle left; input order
+  // keeps that scan linear overall, where searching for the best score would be quadratic
+  uint32_t nextInput = 0;
+
+  for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+    if (best == NO_TRIANGLE) {
+      while (emitted[nextInput]) {
+        nextInput++;
+      }
+      best = nextInput;
+    }
+
+    const uint32_t *triangle = input.data() + best * 3;
+    indices[emittedCount * 3 + 0] = triangle[0];
+    indices[emittedCount * 3 + 1] = triangle[1];
+    indices[emittedCount * 3 + 2] = triangle[2];
+    emitted[best] = true;
+
+    // the triangle's vertices move to the front of the LRU cache
+    uint32_t newCount = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      uint32_t v = triangle[k];
+      newCache[newCount++] = v;
+
+      uint32_t *begin = vertexTriangles.data() + triangleOffsets[v];
+      uint32_t *end = begin + activeCount[v];
+      uint32_t *it = std::find(begin, end, best);
+      assert(it != end && "triangle missing from its vertex");
+      std::swap(*it, *(end - 1));
+      activeCount[v]--;
+    }
+    for (uint32_t i = 0; i < cacheCount; i++) {
+      uint32_t v = cache[i];
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        newCache[newCount++] = v;
+      }
+    }
+
+    // rescore every vertex that moved, including the up to three that just fell out
+    best = NO_TRIANGLE;
+    float bestScore = -1.f;
+    for (uint32_t i = 0; i < newCount; i++) {
+      uint32_t v = newCache[i];
+      int position = i < SCORE_CACHE_SIZE ? static_cast<int>(i) : -1;
+      cachePosition[v] = position;
+      float score = vertexScore(tables, position, activeCount[v]);
+      float delta = score - vertexScores[v];
+      vertexScores[v] = score;
+
+      const uint32_t *begin = vertexTriangles.data() + triangleOffsets[v];
+      for (const uint32_t *t = begin; t != begin + activeCount[v]; t++) {
+        triangleScores[*t] += delta;
+        if (triangleScores[*t] > bestScore) {
+          bestScore = triangleScores[*t];
+          best = *t;
+        }
+      }
+    }
+
+    cacheCount = std::min(newCount, SCORE_CACHE_SIZE);
+    std::copy(newCache, newCache + cacheCount, cache);
+  }
+}
+
+bool optimizeOverdraw(
+    uint32_t *indices,
+    size_t indexCount,
+    const Model::Vertex *vertices,
+    uint32_t vertexCount,
+    float threshold) {
+  assert(indexCount % 3 == 0 && "index count must be a multiple of 3");
+  if (indexCount < 6) {
+    return false;
+  }
+
+  // hard cuts where the cache order starts over anyway: every vertex of the triangle misses
+  std::vector<size_t> hardCuts;
+  {
+    FifoCache cache{vertexCount, DEFAULT_VERTEX_CACHE_SIZE};
+    for (size_t i = 0; i < indexCount; i += 3) {
+      if (triangleMisses(cache, indices + i) == 3) {
+        hardCuts.push_back(i);
+      }
+    }
+    hardCuts.push_back(indexCount);
+  }
+
+  // soft cuts inside those, wherever the cluster so far already transforms about as few
+  // vertices per triangle as the whole cluster, so starting over cold costs little
+  std::vector<Cluster> clusters;
+  FifoCache cache{vertexCount, DEFAULT_VERTEX_CACHE_SIZE};
+  for (size_t h = 0; h + 1 < hardCuts.size(); h++) {
+    size_t begin = hardCuts[h];
+    size_t end = hardCuts[h + 1];
+
+    cache.reset();
+    uint32_t clusterMisses = 0;
+    for (size_t i = begin; i < end; i += 3) {
+      clusterMisses += triangleMisses(cache, indices + i);
+    }
+    float clusterAcmr = static_cast<float>(clusterMisses) / static_cast<float>((end - begin) / 3);
+
+    cache.reset();
+    size_t start = begin;
+    uint32_t misses = 0;
+    for (size_t i = begin; i < end; i += 3) {
+      misses += triangleMisses(cache, indices + i);
+      size_t triangles = (i + 3 - start) / 3;
+      float acmr = static_cast<float>(misses) / static_cast<float>(triangles);
+      if (i + 3 < end && acmr <= clusterAcmr * threshold) {
+        clusters.push_back({start, i + 3, 0.f});
+        start = i + 3;
+        misses = 0;
+        cache.reset();
+      }
+    }
+    if (start < end) {
+      clusters.push_back({start, end, 0.f});
+    }
+  }
+  if (clusters.size() < 2) {
+    return false;
+  }
+
+  // sort key: how far the cluster lies out along the direction it faces, seen from the mesh
+  // center; clusters on the outside facing away from it are likely to occlude the others
+  glm::vec3 meshCenter{0.f};
+  float meshArea = 0.f;
+  std::vector<glm::vec3> clusterCentroids(clusters.size());
+  std::vector<glm::vec3> clusterNormals(clusters.size());
+  for (size_t c = 0; c < clusters.size(); c++) {
+    glm::vec3 centroid{0.f};
+    glm::vec3 normal{0.f};
+    float area = 0.f;
+    for (size_t i = clusters[c].begin; i < clusters[c].end; i += 3) {
+      const glm::vec3 &p0 = vertices[indices[i + 0]].position;
+      const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+      const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+      glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+      float triangleArea = glm::length(cross);
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+      normal += cross;
+      area += triangleArea;
+    }
+    clusterCentroids[c] = area > 0.f ? centroid / area : glm::vec3{0.f};
+    float normalLength = glm::length(normal);
+    clusterNormals[c] = normalLength > 0.f ? normal / normalLength : glm::vec3{0.f};
+    meshCenter += centroid;
+    meshArea += area;
+  }
+  if (meshArea > 0.f) {
+    meshCenter /= meshArea;
+  }
+  for (size_t c = 0; c < clusters.size(); c++) {
+    clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCenter, clusterNormals[c]);
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<uint32_t> reordered;
+  reordered.reserve(indexCount);
+  for (const Cluster &cluster : clusters) {
+    reordered.insert(reordered.end(), indices + cluster.begin, indices + cluster.end);
+  }
+
+  // every cut costs a cold cache in the new order, which is checked as a whole
+  float before = analyzeVertexCache(indices, indexCount, vertexCount).acmr;
+  float after = analyzeVertexCache(reordered.data(), indexCount, vertexCount).acmr;
+  if (after > before * threshold) {
+    return false;
+  }
+  std::copy(reordered.begin(), reordered.end(), indices);
+  return true;
+}
+
+void optimizeVertexFetch(std::vector<Model::Vertex> &vertices, std::vector<uint32_t> &indices) {
+  constexpr uint32_t UNUSED = ~0u;
+  std::vector<uint32_t> remap(vertices.size(), UNUSED);
+  uint32_t nextVertex = 0;
+  for (uint32_t &index : indices) {
+    assert(index < vertices.size() && "index out of range");
+    if (remap[index] == UNUSED) {
+      remap[index] = nextVertex++;
+    }
+    index = remap[index];
+  }
+
+  std::vector<Model::Vertex> reordered(nextVertex);
+  for (size_t v = 0; v < vertices.size(); v++) {
+    if (remap[v] != UNUSED) {
+      reordered[remap[v]] = vertices[v];
+    }
+  }
+  vertices = std::move(reordered);
+}
+
+MeshOptimizationStats optimizeMesh(Model::Builder &builder, float overdrawThreshold) {
+  MeshOptimizationStats stats{};
+  if (builder.indices.empty()) {
+    return stats;
+  }
+  uint32_t vertexCount = static_cast<uint32_t>(builder.vertices.size());
+  size_t indexCount = builder.indices.size();
+
+  stats.before = analyzeVertexCache(builder.indices.data(), indexCount, vertexCount);
+  optimizeVertexCache(builder.indices.data(), indexCount, vertexCount);
+  stats.overdrawApplied = optimizeOverdraw(
+      builder.indices.data(),
+      indexCount,
+      builder.vertices.data(),
+      vertexCount,
+      overdrawThreshold);
+  optimizeVertexFetch(builder.vertices, builder.indices);
+  stats.after = analyzeVertexCache(
+      builder.indices.data(), indexCount, static_cast<uint32_t>(builder.vertices.size()));
+  return stats;
+}
+
+}  // namespace learnVulkan
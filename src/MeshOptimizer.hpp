@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Model.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Post transform vertex cache efficiency of an index order, simulated with a FIFO cache.
+// acmr is transformed vertices per triangle (0.5 is the limit for large regular grids, 3 the
+// worst case), atvr is transformed vertices per referenced vertex (1 is ideal).
+struct VertexCacheStats {
+  float acmr = 0.f;
+  float atvr = 0.f;
+};
+
+struct MeshOptimizationStats {
+  VertexCacheStats before;
+  VertexCacheStats after;
+  bool overdrawApplied = false;  // false when the reorder would have cost too much locality
+};
+
+// Roughly the reuse window of current GPUs, used by default for the statistics.
+static constexpr uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+VertexCacheStats analyzeVertexCache(
+    const uint32_t *indices,
+    size_t indexCount,
+    uint32_t vertexCount,
+    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post transform cache hits with Tom Forsyth's linear speed algorithm:
+// the next triangle is the best scored one among those touching recently used vertices, where
+// recently used and rarely referenced vertices score highest.
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t vertexCount);
+
+// Reorders clusters of a cache optimized triangle order so that outward facing parts are drawn
+// first, which lets depth testing reject more of what lies behind them. Clusters are cut where
+// the cache restarts anyway or where it costs little, and the result is kept only if its
+// ACMR stays within threshold times the input's.
+// Returns false and leaves the indices unchanged otherwise.
+bool optimizeOverdraw(
+    uint32_t *indices,
+    size_t indexCount,
+    const Model::Vertex *vertices,
+    uint32_t vertexCount,
+    float threshold = 1.05f);
+
+// Renumbers vertices in the order the indices first use them, so vertex fetches walk memory
+// forward, and drops vertices no triangle references.
+void optimizeVertexFetch(std::vector<Model::Vertex> &vertices, std::vector<uint32_t> &indices);
+
+// Runs all three passes on an indexed triangle list: vertex cache, then overdraw, then fetch.
+// Non indexed builders are left as they are.
+MeshOptimizationStats optimizeMesh(Model::Builder &builder, float overdrawThreshold = 1.05f);
+
+}  // namespace learnVulkan
@@ -0,0 +1,401 @@
+#include "MeshSimplifier.hpp"
+
+#include "MeshOptimizer.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+namespace learnVulkan {
+
+namespace {
+
+// planes through open borders count this much more than faces, so borders keep their shape
+constexpr float BORDER_WEIGHT = 10.f;
+// collapses turning a face by more than ~75 degrees are rejected as (near) flips
+constexpr float MIN_FACE_ALIGNMENT = .25f;
+
+// levels stop below this many triangles, or once a level keeps more than the given share
+constexpr size_t MIN_LOD_TRIANGLES = 32;
+constexpr float MIN_LOD_REDUCTION = .85f;
+// per level error limit relative to the bounding radius; beyond it the shape is gone anyway
+constexpr float MAX_LOD_ERROR = .25f;
+
+// Sum of squared distances to a set of weighted planes, as the symmetric matrix A, the vector
+// b and the constant c of p^T A p + 2 b.p + c. Doubles, since the terms cancel a lot.
+struct Quadric {
+  double a00 = 0., a01 = 0., a02 = 0., a11 = 0., a12 = 0., a22 = 0.;
+  double b0 = 0., b1 = 0., b2 = 0.;
+  double c = 0.;
+  double weight = 0.;
+
+  // plane normal.p + distance = 0 with a unit normal
+  static Quadric fromPlane(const glm::vec3 &normal, float distance, float weight) {
+    double x = normal.x, y = normal.y, z = normal.z, d = distance, w = weight;
+    Quadric q;
+    q.a00 = w * x * x;
+    q.a01 = w * x * y;
+    q.a02 = w * x * z;
+    q.a11 = w * y * y;
+    q.a12 = w * y * z;
+    q.a22 = w * z * z;
+    q.b0 = w * x * d;
+    q.b1 = w * y * d;
+    q.b2 = w * z * d;
+    q.c = w * d * d;
+    q.weight = w;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a11 += other.a11;
+    a12 += other.a12;
+    a22 += other.a22;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+    return *this;
+  }
+
+  // weighted sum of squared distances, not yet divided by the weight
+  double evaluate(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return a00 * x * x + a11 * y * y + a22 * z * z +
+           2. * (a01 * x * y + a02 * x * z + a12 * y * z) + 2. * (b0 * x + b1 * y + b2 * z) + c;
+  }
+};
+
+enum class VertexKind : uint8_t { Manifold, Border, Locked };
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;  // mean squared distance of the merged quadric at to
+};
+
+// triangles around each vertex, in compressed rows
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+
+  void build(const std::vector<uint32_t> &indices, uint32_t vertexCount) {
+    offsets.assign(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+      offsets[index + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    triangles.resize(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+      triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+};
+
+// whether some triangle has the edge a -> b in its winding
+bool hasEdge(
+    const Adjacency &adjacency, const std::vector<uint32_t> &indices, uint32_t a, uint32_t b) {
+  for (uint32_t k = adjacency.offsets[a]; k < adjacency.offsets[a + 1]; k++) {
+    const uint32_t *triangle = &indices[adjacency.triangles[k] * 3];
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      if (triangle[corner] == a && triangle[(corner + 1) % 3] == b) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// an edge only one triangle uses, in either direction
+bool isBorderEdge(
+    const Adjacency &adjacency, const std::vector<uint32_t> &indices, uint32_t a, uint32_t b) {
+  return hasEdge(adjacency, indices, a, b) != hasEdge(adjacency, indices, b, a);
+}
+
+glm::vec3 faceNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+  return glm::cross(p1 - p0, p2 - p0);
+}
+
+// Vertices sharing their position with another one split the surface for the attributes, so
+// moving one of them alone would tear it.
+std::vector<VertexKind> lockSeams(const Model::Vertex *vertices, uint32_t vertexCount) {
+  std::vector<uint32_t> order(vertexCount);
+  std::iota(order.begin(), order.end(), 0u);
+  auto less = [vertices](uint32_t a, uint32_t b) {
+    const glm::vec3 &pa = vertices[a].position;
+    const glm::vec3 &pb = vertices[b].position;
+    if (pa.x != pb.x) return pa.x < pb.x;
+    if (pa.y != pb.y) return pa.y < pb.y;
+    return pa.z < pb.z;
+  };
+  std::sort(order.begin(), order.end(), less);
+
+  std::vector<VertexKind> kinds(vertexCount, VertexKind::Manifold);
+  for (uint32_t i = 1; i < vertexCount; i++) {
+    if (vertices[order[i]].position == vertices[order[i - 1]].position) {
+      kinds[order[i]] = VertexKind::Locked;
+      kinds[order[i - 1]] = VertexKind::Locked;
+    }
+  }
+  return kinds;
+}
+
+bool flipsTriangle(
+    const Adjacency &adjacency,
+    const std::vector<uint32_t> &indices,
+    const Model::Vertex *vertices,
+    uint32_t from,
+    uint32_t to) {
+  const glm::vec3 &target = vertices[to].position;
+  for (uint32_t k = adjacency.offsets[from]; k < adjacency.offsets[from + 1]; k++) {
+    const uint32_t *triangle = &indices[adjacency.triangles[k] * 3];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue;  // collapses away
+    }
+    glm::vec3 p[3];
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      p[corner] = vertices[triangle[corner]].position;
+    }
+    glm::vec3 before = faceNormal(p[0], p[1], p[2]);
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      if (triangle[corner] == from) {
+        p[corner] = target;
+      }
+    }
+    glm::vec3 after = faceNormal(p[0], p[1], p[2]);
+    if (glm::dot(before, after) <=
+        MIN_FACE_ALIGNMENT * glm::length(before) * glm::length(after)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+std::vector<uint32_t> simplifyMesh(
+    const uint32_t *indices,
+    size_t indexCount,
+    const Model::Vertex *vertices,
+    uint32_t vertexCount,
+    size_t targetIndexCount,
+    float maxError,
+    float *error) {
+  assert(indexCount % 3 == 0 && "index count must be a multiple of 3");
+  std::vector<uint32_t> result(indices, indices + indexCount);
+  double worstCost = 0.;
+
+  const std::vector<VertexKind> seamKinds = lockSeams(vertices, vertexCount);
+  Adjacency adjacency;
+  adjacency.build(result, vertexCount);
+
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i < result.size(); i += 3) {
+    const uint32_t *triangle = &result[i];
+    glm::vec3 normal = faceNormal(
+        vertices[triangle[0]].position,
+        vertices[triangle[1]].position,
+        vertices[triangle[2]].position);
+    float doubleArea = glm::length(normal);
+    if (doubleArea == 0.f) {
+      continue;
+    }
+    normal /= doubleArea;
+    Quadric face = Quadric::fromPlane(
+        normal, -glm::dot(normal, vertices[triangle[0]].position), doubleArea * .5f);
+    for (uint32_t corner = 0; corner < 3; corner++) {
+      quadrics[triangle[corner]] += face;
+
+      // a plane along the border edge, perpendicular to the face, holds the border in place
+      uint32_t a = triangle[corner];
+      uint32_t b = triangle[(corner + 1) % 3];
+      if (!hasEdge(adjacency, result, b, a)) {
+        glm::vec3 edge = vertices[b].position - vertices[a].position;
+        glm::vec3 borderNormal = glm::cross(edge, normal);
+        float length = glm::length(borderNormal);
+        if (length > 0.f) {
+          borderNormal /= length;
+          Quadric border = Quadric::fromPlane(
+              borderNormal,
+              -glm::dot(borderNormal, vertices[a].position),
+              glm::dot(edge, edge) * BORDER_WEIGHT);
+          quadrics[a] += border;
+          quadrics[b] += border;
+        }
+      }
+    }
+  }
+
+  const double maxCost = static_cast<double>(maxError) * maxError;
+  std::vector<VertexKind> kinds;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+
+  auto cost = [&](uint32_t from, uint32_t to) {
+    const Quadric &a = quadrics[from];
+    const Quadric &b = quadrics[to];
+    double weight = a.weight + b.weight;
+    double sum = a.evaluate(vertices[to].position) + b.evaluate(vertices[to].position);
+    return weight > 0. ? std::max(sum, 0.) / weight : 0.;
+  };
+
+  // Each pass collapses the cheapest edges whose neighbourhoods do not overlap, so the costs
+  // and flip tests of one pass never go stale, then rebuilds the connectivity.
+  while (result.size() > targetIndexCount) {
+    kinds = seamKinds;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t a = result[i + corner];
+        uint32_t b = result[i + (corner + 1) % 3];
+        if (!hasEdge(adjacency, result, b, a)) {
+          for (uint32_t v : {a, b}) {
+            if (kinds[v] == VertexKind::Manifold) {
+              kinds[v] = VertexKind::Border;
+            }
+          }
+        }
+      }
+    }
+
+    auto allowed = [&](uint32_t from, uint32_t to) {
+      switch (kinds[from]) {
+        case VertexKind::Manifold:
+          return true;
+        case VertexKind::Border:
+          return isBorderEdge(adjacency, result, from, to);
+        default:
+          return false;
+      }
+    };
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (uint32_t corner = 0; corner < 3; corner++) {
+        uint32_t a = result[i + corner];
+        uint32_t b = result[i + (corner + 1) % 3];
+        // inner edges show up in two triangles, keep one of them
+        if (a == b || (a > b && hasEdge(adjacency, result, b, a))) {
+          continue;
+        }
+        bool forward = allowed(a, b);
+        bool backward = allowed(b, a);
+        double forwardCost = forward ? cost(a, b) : 0.;
+        double backwardCost = backward ? cost(b, a) : 0.;
+        if (forward && (!backward || forwardCost <= backwardCost)) {
+          collapses.push_back({a, b, forwardCost});
+        } else if (backward) {
+          collapses.push_back({b, a, backwardCost});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+      return a.cost < b.cost;
+    });
+
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::fill(touched.begin(), touched.end(), false);
+    size_t triangleCount = result.size() / 3;
+    size_t targetTriangles = targetIndexCount / 3;
+    size_t applied = 0;
+    for (const Collapse &collapse : collapses) {
+      if (triangleCount <= targetTriangles || collapse.cost > maxCost) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to] ||
+          flipsTriangle(adjacency, result, vertices, collapse.from, collapse.to)) {
+        continue;
+      }
+      for (uint32_t k = adjacency.offsets[collapse.from];
+           k < adjacency.offsets[collapse.from + 1];
+           k++) {
+        const uint32_t *triangle = &result[adjacency.triangles[k] * 3];
+        bool removed = false;
+        for (uint32_t corner = 0; corner < 3; corner++) {
+          touched[triangle[corner]] = true;
+          removed |= triangle[corner] == collapse.to;
+        }
+        if (removed) {
+          triangleCount--;
+        }
+      }
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      worstCost = std::max(worstCost, collapse.cost);
+      applied++;
+    }
+    if (applied == 0) {
+      break;
+    }
+
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t a = remap[result[i]];
+      uint32_t b = remap[result[i + 1]];
+      uint32_t c = remap[result[i + 2]];
+      if (a != b && b != c && c != a) {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+    result.resize(write);
+    adjacency.build(result, vertexCount);
+  }
+
+  if (error) {
+    *error = static_cast<float>(std::sqrt(worstCost));
+  }
+  return result;
+}
+
+void generateLods(Model::Builder &builder) {
+  builder.lods.clear();
+  if (builder.indices.empty()) {
+    return;
+  }
+  const uint32_t vertexCount = static_cast<uint32_t>(builder.vertices.size());
+  builder.lods.push_back({0, static_cast<uint32_t>(builder.indices.size()), 0.f});
+
+  glm::vec3 boundsMin = builder.vertices[0].position;
+  glm::vec3 boundsMax = boundsMin;
+  for (const Model::Vertex &vertex : builder.vertices) {
+    boundsMin = glm::min(boundsMin, vertex.position);
+    boundsMax = glm::max(boundsMax, vertex.position);
+  }
+  const float maxError = glm::length(boundsMax - boundsMin) * .5f * MAX_LOD_ERROR;
+
+  // each level simplifies the previous one, so its error adds to the previous level's
+  std::vector<uint32_t> previous = builder.indices;
+  while (builder.lods.size() < MAX_MESH_LODS && previous.size() / 3 > MIN_LOD_TRIANGLES) {
+    float error = 0.f;
+    std::vector<uint32_t> lod = simplifyMesh(
+        previous.data(),
+        previous.size(),
+        builder.vertices.data(),
+        vertexCount,
+        previous.size() / 6 * 3,
+        maxError,
+        &error);
+    if (lod.empty() || lod.size() > previous.size() * MIN_LOD_REDUCTION) {
+      break;
+    }
+    optimizeVertexCache(lod.data(), lod.size(), vertexCount);
+
+    MeshLod level{};
+    level.firstIndex = static_cast<uint32_t>(builder.indices.size());
+    level.indexCount = static_cast<uint32_t>(lod.size());
+    level.error = builder.lods.back().error + error;
+    builder.lods.push_back(level);
+    builder.indices.insert(builder.indices.end(), lod.begin(), lod.end());
+    previous = std::move(lod);
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "MeshLod.hpp"
+#include "Model.hpp"
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Removes triangles by collapsing edges onto one of their end points, cheapest first by
+// quadric error (Garland and Heckbert) until at most targetIndexCount indices are left or the
+// next collapse would move the surface by more than maxError. Vertices are shared with the
+// input, so the result indexes the same vertex buffer. Vertices other vertices sit on top of
+// (uv or normal seams) stay in place and open borders only slide along themselves, which
+// keeps the silhouette and texture seams intact at the price of a coarser limit.
+// Returns the indices; error receives the root of the worst collapse's mean squared distance
+// to the planes it replaced, an estimate of how far the surface moved.
+std::vector<uint32_t> simplifyMesh(
+    const uint32_t *indices,
+    size_t indexCount,
+    const Model::Vertex *vertices,
+    uint32_t vertexCount,
+    size_t targetIndexCount,
+    float maxError,
+    float *error = nullptr);
+
+// Appends a chain of simplified levels to an indexed builder, each about half the triangles
+// of the one before, and describes all of them in builder.lods with LOD 0 being the input.
+// The chain ends when simplifying stops paying off or MAX_MESH_LODS is reached.
+void generateLods(Model::Builder &builder);
+
+}  // namespace learnVulkan
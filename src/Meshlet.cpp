@@ -0,0 +1,140 @@
+#include "Meshlet.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace learnVulkan {
+
+namespace {
+
+// with normals more than ~84 degrees off the axis the cone test would hardly ever pass
+constexpr float MIN_CONE_SPREAD = .1f;
+
+const glm::vec3 &positionAt(const glm::vec3 *positions, size_t stride, uint32_t index) {
+  return *reinterpret_cast<const glm::vec3 *>(
+      reinterpret_cast<const uint8_t *>(positions) + stride * index);
+}
+
+constexpr uint32_t NO_MESHLET = ~0u;
+
+// corners of the triangle not in the meshlet yet; those repeated by a degenerate triangle
+// count once
+uint32_t countNewVertices(
+    const uint32_t *triangle, const std::vector<uint32_t> &lastMeshlet, uint32_t meshletId) {
+  uint32_t count = lastMeshlet[triangle[0]] != meshletId ? 1 : 0;
+  if (lastMeshlet[triangle[1]] != meshletId && triangle[1] != triangle[0]) {
+    count++;
+  }
+  if (lastMeshlet[triangle[2]] != meshletId && triangle[2] != triangle[0] &&
+      triangle[2] != triangle[1]) {
+    count++;
+  }
+  return count;
+}
+
+void computeBounds(
+    Meshlet &meshlet, const uint32_t *indices, const glm::vec3 *positions, size_t stride) {
+  const uint32_t *first = indices + meshlet.firstIndex;
+  const uint32_t *last = first + meshlet.indexCount;
+
+  glm::vec3 boundsMin = positionAt(positions, stride, *first);
+  glm::vec3 boundsMax = boundsMin;
+  for (const uint32_t *index = first; index != last; index++) {
+    boundsMin = glm::min(boundsMin, positionAt(positions, stride, *index));
+    boundsMax = glm::max(boundsMax, positionAt(positions, stride, *index));
+  }
+  glm::vec3 center = (boundsMin + boundsMax) * .5f;
+  float radius = 0.f;
+  for (const uint32_t *index = first; index != last; index++) {
+    radius = std::max(radius, glm::length(positionAt(positions, stride, *index) - center));
+  }
+  meshlet.boundingSphere = glm::vec4(center, radius);
+
+  // the axis averages the face normals, the cutoff follows from the one furthest off it
+  glm::vec3 normalSum{0.f};
+  for (const uint32_t *triangle = first; triangle != last; triangle += 3) {
+    const glm::vec3 &p0 = positionAt(positions, stride, triangle[0]);
+    glm::vec3 normal = glm::cross(
+        positionAt(positions, stride, triangle[1]) - p0,
+        positionAt(positions, stride, triangle[2]) - p0);
+    float length = glm::length(normal);
+    if (length > 0.f) {
+      normalSum += normal / length;
+    }
+  }
+  float sumLength = glm::length(normalSum);
+  if (sumLength == 0.f) {
+    return;
+  }
+  glm::vec3 axis = normalSum / sumLength;
+
+  float minDot = 1.f;
+  for (const uint32_t *triangle = first; triangle != last; triangle += 3) {
+    const glm::vec3 &p0 = positionAt(positions, stride, triangle[0]);
+    glm::vec3 normal = glm::cross(
+        positionAt(positions, stride, triangle[1]) - p0,
+        positionAt(positions, stride, triangle[2]) - p0);
+    float length = glm::length(normal);
+    if (length > 0.f) {
+      minDot = std::min(minDot, glm::dot(normal / length, axis));
+    }
+  }
+  if (minDot <= MIN_CONE_SPREAD) {
+    return;
+  }
+  // The normals lie within acos(minDot) of the axis. Widening by 90 degrees on both sides and
+  // flipping gives the directions all triangles are seen from the back, whose cosine is
+  // -cos(a + 90) = sin(a).
+  meshlet.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+}
+
+}  // namespace
+
+std::vector<Meshlet> buildMeshlets(
+    const uint32_t *indices,
+    uint32_t indexCount,
+    const glm::vec3 *positions,
+    size_t positionStride,
+    uint32_t vertexCount) {
+  assert(indexCount % 3 == 0 && "index count must be a multiple of 3");
+  std::vector<Meshlet> meshlets;
+  if (indexCount == 0) {
+    return meshlets;
+  }
+
+  // the meshlet a vertex was last counted for, so membership tests need no clearing
+  std::vector<uint32_t> lastMeshlet(vertexCount, NO_MESHLET);
+
+  Meshlet current{};
+  uint32_t currentId = 0;
+  for (uint32_t i = 0; i < indexCount; i += 3) {
+    const uint32_t *triangle = indices + i;
+    assert(
+        triangle[0] < vertexCount && triangle[1] < vertexCount && triangle[2] < vertexCount &&
+        "index out of range");
+    uint32_t newVertices = countNewVertices(triangle, lastMeshlet, currentId);
+    if (current.indexCount / 3 == MAX_MESHLET_TRIANGLES ||
+        current.vertexCount + newVertices > MAX_MESHLET_VERTICES) {
+      meshlets.push_back(current);
+      current = Meshlet{};
+      current.firstIndex = i;
+      currentId++;
+      newVertices = countNewVertices(triangle, lastMeshlet, currentId);
+    }
+    for (uint32_t k = 0; k < 3; k++) {
+      lastMeshlet[triangle[k]] = currentId;
+    }
+    current.vertexCount += newVertices;
+    current.indexCount += 3;
+  }
+  meshlets.push_back(current);
+
+  for (Meshlet &meshlet : meshlets) {
+    computeBounds(meshlet, indices, positions, positionStride);
+  }
+  return meshlets;
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,48 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+static constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+static constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+// A run of consecutive triangles of a model's index buffer, small enough to be culled on its
+// own. Matches Meshlet in meshlet_cull.comp (std430).
+struct Meshlet {
+  glm::vec4 boundingSphere{0.f};  // local space center, radius
+  // Normal cone: xyz axis, w cutoff. Every triangle faces away from a camera at c when
+  //   dot(center - c, axis) >= cutoff * length(center - c) + radius
+  // A cutoff of 1 never passes, for meshlets whose normals spread too far.
+  glm::vec4 cone{0.f, 0.f, 0.f, 1.f};
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+  uint32_t vertexCount = 0;  // distinct vertices referenced, at most MAX_MESHLET_VERTICES
+  uint32_t padding = 0;
+};
+
+// Splits an indexed triangle list into meshlets of at most MAX_MESHLET_VERTICES distinct
+// vertices and MAX_MESHLET_TRIANGLES triangles without reordering it: a meshlet ends where the
+// next triangle would exceed a limit. Run on a vertex cache optimized order (optimizeMesh),
+// neighbouring triangles follow each other and the meshlets come out compact. positions are
+// read with a byte stride so Model::Vertex arrays can be passed directly.
+//
+// The cone assumes triangles wound counter clockwise seen from their front, as OBJ files are.
+// Culling by it is only correct when the meshlets are drawn with back faces culled: with
+// VK_CULL_MODE_NONE a meshlet facing away still has visible triangles, e.g. the far side of
+// an open surface. GpuCullingSystem::setBackFaceCulling switches the test on.
+std::vector<Meshlet> buildMeshlets(
+    const uint32_t *indices,
+    uint32_t indexCount,
+    const glm::vec3 *positions,
+    size_t positionStride,
+    uint32_t vertexCount);
+
+}  // namespace learnVulkan
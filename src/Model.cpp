@@ -1,114 +1,269 @@
 #include "Model.hpp"
 
+#include "MeshLoader.hpp"
+#include "SwapChain.hpp"
+
 // std
 #include <cassert>
 #include <cstring>
+#include <vector>
 
 namespace learnVulkan {
 
-Model::Model(Device &device, const Model::Builder &builder) : device{device} {
-  createVertexBuffers(builder.vertices);
-  createIndexBuffers(builder.indices);
+static_assert(sizeof(Model::Vertex) == 44, "VertexLayout::standard() mirrors Model::Vertex");
+
+Model::Model(Device &device, const Model::Builder &builder)
+    : Model{
+          device,
+          MeshData{
+              builder.vertices.data(),
+              static_cast<uint32_t>(builder.vertices.size()),
+              builder.indices.data(),
+              static_cast<uint32_t>(builder.indices.size()),
+              builder.vertexUsage,
+              builder.vertexLayout,
+              builder.meshlets,
+              builder.lods.data(),
+              static_cast<uint32_t>(builder.lods.size()),
+              builder.meshletData.data(),
+              static_cast<uint32_t>(builder.meshletData.size())}} {}
+
+Model::Model(Device &device, const MeshData &mesh)
+    : device{device}, vertexUsage{mesh.vertexUsage}, vertexLayout{mesh.vertexLayout} {
+  // the bounds decide how positions are quantized
+  computeBounds(mesh.vertices, mesh.vertexCount);
+  positionDequantization = vertexLayout.dequantization(boundsMin, boundsMax);
+  createVertexBuffers(mesh.vertices, mesh.vertexCount);
+  createIndexBuffers(mesh.indices, mesh.indexCount);
+  if (hasIndexBuffer) {
+    if (mesh.lodCount > 0) {
+      assert(mesh.lods[0].firstIndex == 0 && "LOD 0 must start the index buffer");
+      lods.assign(mesh.lods, mesh.lods + mesh.lodCount);
+    } else {
+      lods.push_back({0, indexCount, 0.f});
+    }
+  }
+  if (mesh.meshlets && hasIndexBuffer) {
+    if (mesh.meshletCount > 0) {
+      meshlets.assign(mesh.meshletData, mesh.meshletData + mesh.meshletCount);
+    } else {
+      meshlets = buildMeshlets(
+          mesh.indices,
+          lods[0].indexCount,
+          &mesh.vertices[0].position,
+          sizeof(Vertex),
+          vertexCount);
+    }
+  }
+}
+
+std::unique_ptr<Model> Model::createModelFromFile(
+    Device &device,
+    const std::string &filepath,
+    VertexUsage vertexUsage,
+    const VertexLayout &vertexLayout,
+    bool meshlets) {
+  return loadModelCached(device, filepath, vertexUsage, vertexLayout, meshlets);
+}
+
+void Model::Builder::loadModel(const std::string &filepath) { loadObj(filepath, *this); }
+
+void Model::Builder::buildMeshlets() {
+  meshletData.clear();
+  if (indices.empty()) {
+    return;
+  }
+  uint32_t lod0IndexCount =
+      lods.empty() ? static_cast<uint32_t>(indices.size()) : lods[0].indexCount;
+  meshletData = learnVulkan::buildMeshlets(
+      indices.data(),
+      lod0IndexCount,
+      &vertices[0].position,
+      sizeof(Vertex),
+      static_cast<uint32_t>(vertices.size()));
 }
 
 Model::~Model() {
-  vkDestroyBuffer(device.device(), vertexBuffer, nullptr);
-  vkFreeMemory(device.device(), vertexBufferMemory, nullptr);
+  device.uploadScheduler().wait(uploadTicket);
+  device.destroyBuffer(vertexBuffer, vertexBufferAllocation);
   if (hasIndexBuffer) {
-    vkDestroyBuffer(device.device(), indexBuffer, nullptr);
-    vkFreeMemory(device.device(), indexBufferMemory, nullptr);
+    device.destroyBuffer(indexBuffer, indexBufferAllocation);
   }
 }
 
-void Model::createVertexBuffers(const std::vector<Vertex> &vertices) {
-  vertexCount = static_cast<uint32_t>(vertices.size());
-  assert(vertexCount >= 3 && "Vertex count must be at least 3");
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
+VkDeviceSize Model::getIndexBufferSize() const {
+  switch (indexType) {
+    case VK_INDEX_TYPE_UINT8_EXT:
+      return indexCount;
+    case VK_INDEX_TYPE_UINT16:
+      return sizeof(uint16_t) * static_cast<VkDeviceSize>(indexCount);
+    default:
+      return sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount);
+  }
+}
+
+VkDeviceSize Model::getVertexBufferSize() const {
+  VkDeviceSize size = static_cast<VkDeviceSize>(vertexLayout.stride()) * vertexCount;
+  return vertexUsage == VertexUsage::Dynamic ? size * SwapChain::MAX_FRAMES_IN_FLIGHT : size;
+}
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
+void Model::createVertexBuffers(const Vertex *vertices, uint32_t count) {
+  vertexCount = count;
+  assert(vertexCount >= 3 && "Vertex count must be at least 3");
+  VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexLayout.stride()) * vertexCount;
 
+  if (vertexUsage == VertexUsage::Dynamic) {
+    vertexFrameStride = bufferSize;
+    device.createBuffer(
+        bufferSize * SwapChain::MAX_FRAMES_IN_FLIGHT,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        vertexBuffer,
+        vertexBufferAllocation);
+    for (int i = 0; i < SwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+      writeVertices(i, vertices);
+    }
+    return;
+  }
 
   device.createBuffer(
       bufferSize,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, //VK_BUFFER_USAGE_VERTEX_BUFFER_BIT VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
       vertexBuffer,
-      vertexBufferMemory);
+      vertexBufferAllocation);
+  if (vertexLayout == VertexLayout::standard()) {
+    uploadTicket = device.uploadScheduler().enqueueBufferUpload(
+        vertexBuffer, 0, vertices, bufferSize);
+    return;
+  }
+  // the scheduler copies into its staging ring right away, the encoded data can go after
+  std::vector<uint8_t> encoded(static_cast<size_t>(bufferSize));
+  encodeVertices(vertices, encoded.data());
+  uploadTicket = device.uploadScheduler().enqueueBufferUpload(
+      vertexBuffer, 0, encoded.data(), bufferSize);
+}
 
-  void *data;
-  vkMapMemory(device.device(), vertexBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-  vkUnmapMemory(device.device(), vertexBufferMemory);
+void Model::updateVertices(int frameIndex, const std::vector<Vertex> &vertices) {
+  assert(vertexUsage == VertexUsage::Dynamic && "Only dynamic models can update vertices");
+  assert(vertices.size() == vertexCount && "Vertex count of a model cannot change");
+  writeVertices(frameIndex, vertices.data());
 }
-void Model::createIndexBuffers(const std::vector<uint32_t> &indices) {
-  indexCount = static_cast<uint32_t>(indices.size());
+
+void Model::writeVertices(int frameIndex, const Vertex *vertices) {
+  auto *dst =
+      static_cast<uint8_t *>(vertexBufferAllocation.mappedData) + vertexFrameStride * frameIndex;
+  if (vertexLayout == VertexLayout::standard()) {
+    memcpy(dst, vertices, static_cast<size_t>(vertexFrameStride));
+  } else {
+    encodeVertices(vertices, dst);
+  }
+}
+
+void Model::encodeVertices(const Vertex *vertices, uint8_t *dst) const {
+  uint32_t stride = vertexLayout.stride();
+  for (uint32_t i = 0; i < vertexCount; i++) {
+    const Vertex &vertex = vertices[i];
+    vertexLayout.encode(
+        vertex.position, vertex.color, vertex.normal, vertex.uv, positionDequantization, dst);
+    dst += stride;
+  }
+}
+
+VkIndexType Model::chooseIndexType(uint32_t vertexCount, bool uint8Supported) {
+  if (uint8Supported && vertexCount <= 0xFF) {
+    return VK_INDEX_TYPE_UINT8_EXT;
+  }
+  // the all ones index stays unused, so enabling primitive restart later cannot break meshes
+  return vertexCount <= 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+namespace {
+
+template <typename T>
+std::vector<T> narrowIndices(const uint32_t *indices, uint32_t count, uint32_t vertexCount) {
+  std::vector<T> narrowed(count);
+  for (uint32_t i = 0; i < count; i++) {
+    assert(indices[i] < vertexCount && "Index refers to a vertex the model does not have");
+    narrowed[i] = static_cast<T>(indices[i]);
+  }
+  return narrowed;
+}
+
+}  // namespace
+
+// Indices arrive as uint32_t and are narrowed to the smallest type that can address every
+// vertex, which halves or quarters index memory and fetch bandwidth for small meshes.
+void Model::createIndexBuffers(const uint32_t *indices, uint32_t count) {
+  indexCount = count;
   hasIndexBuffer = indexCount > 0;
   if (!hasIndexBuffer) {
     return;
   }
-  VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  device.createBuffer(
-      bufferSize,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      stagingBuffer,
-      stagingBufferMemory);
-
-  void *data;
-  vkMapMemory(device.device(), stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
-  vkUnmapMemory(device.device(), stagingBufferMemory);
+  indexType = chooseIndexType(vertexCount, device.supportsIndexTypeUint8());
+  VkDeviceSize bufferSize = getIndexBufferSize();
   device.createBuffer(
       bufferSize,
       VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
       indexBuffer,
-      indexBufferMemory);
-  device.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-  vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-  vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+      indexBufferAllocation);
 
-}
-void Model::draw(VkCommandBuffer commandBuffer) {
-  if (hasIndexBuffer) {
-    vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+  // the scheduler copies into its staging ring right away, the narrowed copies can go after
+  if (indexType == VK_INDEX_TYPE_UINT8_EXT) {
+    std::vector<uint8_t> narrowed = narrowIndices<uint8_t>(indices, count, vertexCount);
+    uploadTicket = device.uploadScheduler().enqueueBufferUpload(
+        indexBuffer, 0, narrowed.data(), bufferSize);
+  } else if (indexType == VK_INDEX_TYPE_UINT16) {
+    std::vector<uint16_t> narrowed = narrowIndices<uint16_t>(indices, count, vertexCount);
+    uploadTicket = device.uploadScheduler().enqueueBufferUpload(
+        indexBuffer, 0, narrowed.data(), bufferSize);
   } else {
-    vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+    uploadTicket = device.uploadScheduler().enqueueBufferUpload(
+        indexBuffer, 0, indices, bufferSize);
   }
 }
 
-void Model::bind(VkCommandBuffer commandBuffer) {
-  VkBuffer buffers[] = {vertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
-  if (hasIndexBuffer) {
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+void Model::computeBounds(const Vertex *vertices, uint32_t count) {
+  boundsMin = boundsMax = vertices[0].position;
+  for (uint32_t i = 0; i < count; i++) {
+    boundsMin = glm::min(boundsMin, vertices[i].position);
+    boundsMax = glm::max(boundsMax, vertices[i].position);
   }
+
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+  float radius = 0.f;
+  for (uint32_t i = 0; i < count; i++) {
+    radius = glm::max(radius, glm::length(vertices[i].position - center));
+  }
+  boundingSphere = glm::vec4(center, radius);
 }
 
-std::vector<VkVertexInputBindingDescription> Model::Vertex::getBindingDescriptions() {
-  std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-  bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof(Vertex);
-  bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  return bindingDescriptions;
+bool Model::isReady() {
+  if (!uploadComplete) {
+    uploadComplete = device.uploadScheduler().isComplete(uploadTicket);
+  }
+  return uploadComplete;
 }
 
-std::vector<VkVertexInputAttributeDescription> Model::Vertex::getAttributeDescriptions() {
-  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(2);
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex,position);
+void Model::draw(
+    VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance, uint32_t lod) {
+  if (hasIndexBuffer) {
+    assert(lod < lods.size() && "level of detail out of range");
+    vkCmdDrawIndexed(
+        commandBuffer, lods[lod].indexCount, instanceCount, lods[lod].firstIndex, 0, firstInstance);
+  } else {
+    vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
+  }
+}
 
-  attributeDescriptions[1].binding = 0;
-  attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, color);
-  return attributeDescriptions;
+void Model::bind(VkCommandBuffer commandBuffer, int frameIndex) {
+  VkBuffer buffers[] = {vertexBuffer};
+  VkDeviceSize offsets[] = {vertexFrameStride * frameIndex};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+  if (hasIndexBuffer) {
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+  }
 }
 
 }  // namespace learnVulkan
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Device.hpp"
+#include "MeshLod.hpp"
+#include "Meshlet.hpp"
+#include "VertexLayout.hpp"
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -8,44 +11,157 @@
 #include <glm/glm.hpp>
 
 // std
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace learnVulkan {
 class Model {
  public:
+  // Static vertices live in device local memory; Dynamic keeps one host visible copy per
+  // frame in flight so they can be rewritten every frame without stalling the GPU.
+  enum class VertexUsage { Static, Dynamic };
+
+  // Normal and uv come from mesh files and are carried along for later shading; the
+  // current pipelines only read position and color. This is the CPU side format, the GPU
+  // copy is encoded in the model's VertexLayout.
   struct Vertex {
-    glm::vec3 position;
-    glm::vec3 color;
+    glm::vec3 position{};
+    glm::vec3 color{};
+    glm::vec3 normal{};
+    glm::vec2 uv{};
 
-    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+    bool operator==(const Vertex &other) const {
+      return position == other.position && color == other.color && normal == other.normal &&
+             uv == other.uv;
+    }
   };
 
   struct Builder {
     std::vector<Vertex> vertices{};
-    std::vector<uint32_t> indices{};
+    std::vector<uint32_t> indices{};  // narrowed to 16 or 8 bit on upload where possible
+    VertexUsage vertexUsage = VertexUsage::Static;
+    VertexLayout vertexLayout{};
+    // split into meshlets for GpuCullingSystem's per meshlet culling, see buildMeshlets
+    bool meshlets = false;
+    // ranges of indices for the levels of detail, see generateLods; empty means the whole
+    // index buffer is LOD 0
+    std::vector<MeshLod> lods{};
+    // meshlets of LOD 0 built ahead of construction by buildMeshlets; when empty, a model
+    // asking for meshlets builds them in its constructor
+    std::vector<Meshlet> meshletData{};
+
+    // Replaces the contents with the triangles of a Wavefront OBJ file, see loadObj.
+    void loadModel(const std::string &filepath);
+    // Fills meshletData from the current indices and lods, so the work can run on a loader
+    // worker instead of the thread creating the model.
+    void buildMeshlets();
+  };
+
+  // Vertex and index data owned by someone else, e.g. a memory mapped mesh cache. It is
+  // copied during construction and can be released right after.
+  struct MeshData {
+    const Vertex *vertices = nullptr;
+    uint32_t vertexCount = 0;
+    const uint32_t *indices = nullptr;
+    uint32_t indexCount = 0;
+    VertexUsage vertexUsage = VertexUsage::Static;
+    VertexLayout vertexLayout{};
+    bool meshlets = false;
+    const MeshLod *lods = nullptr;
+    uint32_t lodCount = 0;
+    const Meshlet *meshletData = nullptr;  // prebuilt, see Builder::meshletData
+    uint32_t meshletCount = 0;
   };
+
   Model(Device &device, const Model::Builder &builder);
+  Model(Device &device, const MeshData &mesh);
+
+  // Loads an OBJ file through its binary cache, see loadModelCached.
+  static std::unique_ptr<Model> createModelFromFile(
+      Device &device,
+      const std::string &filepath,
+      VertexUsage vertexUsage = VertexUsage::Static,
+      const VertexLayout &vertexLayout = {},
+      bool meshlets = false);
   ~Model();
 
   Model(const Model &) = delete;
   Model &operator=(const Model &) = delete;
 
-  void bind(VkCommandBuffer commandBuffer);
-  void draw(VkCommandBuffer commandBuffer);
+  void bind(VkCommandBuffer commandBuffer, int frameIndex = 0);
+  void draw(
+      VkCommandBuffer commandBuffer,
+      uint32_t instanceCount = 1,
+      uint32_t firstInstance = 0,
+      uint32_t lod = 0);
+
+  // Dynamic models only: overwrites the copy used by frameIndex. Quantized positions keep the
+  // scale and offset of the construction time bounds, vertices moving outside are clamped.
+  void updateVertices(int frameIndex, const std::vector<Vertex> &vertices);
+
+  // false until the staged uploads for this model have landed on the device
+  bool isReady();
+
+  const VertexLayout &getVertexLayout() const { return vertexLayout; }
+  // to be pushed with every draw, see VertexLayout
+  const PositionDequantization &getPositionDequantization() const {
+    return positionDequantization;
+  }
+  // bytes of vertex and index data on the device, one copy per frame in flight when Dynamic
+  VkDeviceSize getVertexBufferSize() const;
+  VkDeviceSize getIndexBufferSize() const;
+  VkIndexType getIndexType() const { return indexType; }
+
+  // 8 bit indices for up to 255 vertices when the device supports them, 16 bit for up to
+  // 65535, 32 bit beyond
+  static VkIndexType chooseIndexType(uint32_t vertexCount, bool uint8Supported);
+
+  // at least LOD 0 for indexed models, empty otherwise; errors grow with the level
+  const std::vector<MeshLod> &getLods() const { return lods; }
+
+  // empty unless built with meshlets; they cover LOD 0 in order
+  const std::vector<Meshlet> &getMeshlets() const { return meshlets; }
+  bool hasMeshlets() const { return !meshlets.empty(); }
+
+  uint32_t getVertexCount() const { return vertexCount; }
+  uint32_t getIndexCount() const { return indexCount; }  // of all levels of detail together
+  bool hasIndices() const { return hasIndexBuffer; }
+
+  // local space bounds of the builder vertices
+  const glm::vec3 &getBoundsMin() const { return boundsMin; }
+  const glm::vec3 &getBoundsMax() const { return boundsMax; }
+  const glm::vec4 &getBoundingSphere() const { return boundingSphere; }  // xyz center, w radius
 
  private:
-  void createVertexBuffers(const std::vector<Vertex> &vertices);
-  void createIndexBuffers(const std::vector<uint32_t> &indices);
+  void createVertexBuffers(const Vertex *vertices, uint32_t count);
+  void createIndexBuffers(const uint32_t *indices, uint32_t count);
+  void computeBounds(const Vertex *vertices, uint32_t count);
+  void writeVertices(int frameIndex, const Vertex *vertices);
+  void encodeVertices(const Vertex *vertices, uint8_t *dst) const;
 
   Device &device;
+  VertexUsage vertexUsage;
+  VertexLayout vertexLayout;
+  PositionDequantization positionDequantization{};
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
+  Allocation vertexBufferAllocation;
   uint32_t vertexCount;
+  VkDeviceSize vertexFrameStride = 0;
 
   bool hasIndexBuffer = false;
   VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
+  Allocation indexBufferAllocation;
   uint32_t indexCount;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+  glm::vec3 boundsMin{0.f};
+  glm::vec3 boundsMax{0.f};
+  glm::vec4 boundingSphere{0.f};
+  std::vector<MeshLod> lods;
+  std::vector<Meshlet> meshlets;
+
+  UploadTicket uploadTicket = 0;
+  bool uploadComplete = false;
 };
 }  // namespace learnVulkan
\ No newline at end of file
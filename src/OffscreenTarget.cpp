@@ -0,0 +1,383 @@
+#include "OffscreenTarget.hpp"
+
+#include "SwapChain.hpp"
+
+// std
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+OffscreenTarget::OffscreenTarget(Device &deviceRef, VkExtent2D extent, uint32_t framesInFlight)
+    : device{deviceRef}, extent{extent}, framesInFlight{framesInFlight} {
+  assert(
+      framesInFlight >= 1 && framesInFlight <= SwapChain::MAX_FRAMES_IN_FLIGHT &&
+      "Frames in flight out of range");
+  colorFormat = findColorFormat();
+  depthFormat = findDepthFormat();
+  createRenderPass();
+  createImages();
+  createFramebuffers();
+  createReadbackResources();
+  createSyncObjects();
+}
+
+OffscreenTarget::~OffscreenTarget() {
+  vkFreeCommandBuffers(
+      device.device(),
+      device.getCommandPool(),
+      static_cast<uint32_t>(readbackCommandBuffers.size()),
+      readbackCommandBuffers.data());
+
+  for (size_t i = 0; i < colorImages.size(); i++) {
+    vkDestroyFramebuffer(device.device(), framebuffers[i], nullptr);
+    vkDestroyImageView(device.device(), colorImageViews[i], nullptr);
+    device.destroyImage(colorImages[i], colorImageAllocations[i]);
+    vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
+    device.destroyImage(depthImages[i], depthImageAllocations[i]);
+    device.destroyBuffer(readbackBuffers[i], readbackAllocations[i]);
+    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
+  }
+
+  vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  vkDestroyRenderPass(device.device(), loadRenderPass, nullptr);
+}
+
+void OffscreenTarget::waitForFrameSlot() {
+  vkWaitForFences(
+      device.device(),
+      1,
+      &inFlightFences[currentFrame],
+      VK_TRUE,
+      std::numeric_limits<uint64_t>::max());
+}
+
+VkResult OffscreenTarget::acquireNextImage(uint32_t *imageIndex) {
+  waitForFrameSlot();
+  *imageIndex = static_cast<uint32_t>(currentFrame);
+  return VK_SUCCESS;
+}
+
+VkResult OffscreenTarget::submitCommandBuffers(
+    const VkCommandBuffer *buffers, uint32_t *imageIndex) {
+  // the copy goes in the same submission, ordered after the render pass by its dependency
+  std::array<VkCommandBuffer, 2> commandBuffers = {
+      buffers[0], readbackCommandBuffers[*imageIndex]};
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = readbackEnabled ? 2 : 1;
+  submitInfo.pCommandBuffers = commandBuffers.data();
+
+  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
+  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to submit draw command buffer!");
+  }
+  if (readbackEnabled) {
+    lastReadbackImage = static_cast<int>(*imageIndex);
+  }
+  return VK_SUCCESS;
+}
+
+// nothing to present to, the image just stays around for readback
+VkResult OffscreenTarget::presentImage(uint32_t * /*imageIndex*/) {
+  currentFrame = (currentFrame + 1) % framesInFlight;
+  return VK_SUCCESS;
+}
+
+bool OffscreenTarget::readback(std::vector<uint8_t> &rgba) {
+  if (lastReadbackImage < 0) {
+    return false;
+  }
+  // a later frame on the same image without readback leaves the buffer alone, so waiting
+  // on the image's current fence is always enough
+  vkWaitForFences(
+      device.device(),
+      1,
+      &inFlightFences[lastReadbackImage],
+      VK_TRUE,
+      std::numeric_limits<uint64_t>::max());
+
+  size_t size = static_cast<size_t>(extent.width) * extent.height * 4;
+  rgba.resize(size);
+  memcpy(rgba.data(), readbackAllocations[lastReadbackImage].mappedData, size);
+  return true;
+}
+
+void OffscreenTarget::createRenderPass() {
+  VkAttachmentDescription depthAttachment{};
+  depthAttachment.format = depthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference depthAttachmentRef{};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  // same as the swap chain pass except that the image ends up ready to be copied from
+  VkAttachmentDescription colorAttachment = {};
+  colorAttachment.format = colorFormat;
+  colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  VkAttachmentReference colorAttachmentRef = {};
+  colorAttachmentRef.attachment = 0;
+  colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].srcAccessMask = 0;
+  dependencies[0].srcStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].dstStageMask =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  // the readback copy, submitted right after the frame's own command buffer
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
+
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create render pass!");
+  }
+
+  // the load pass starts from the layouts the pass above ends in, and waits for its writes
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments = {colorAttachment, depthAttachment};
+  dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask |=
+      VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &loadRenderPass) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create render pass!");
+  }
+}
+
+void OffscreenTarget::createImages() {
+  size_t imageCount = framesInFlight;
+  colorImages.resize(imageCount);
+  colorImageAllocations.resize(imageCount);
+  colorImageViews.resize(imageCount);
+  depthImages.resize(imageCount);
+  depthImageAllocations.resize(imageCount);
+  depthImageViews.resize(imageCount);
+
+  for (size_t i = 0; i < imageCount; i++) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = colorFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    device.createImageWithInfo(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        colorImages[i],
+        colorImageAllocations[i]);
+
+    imageInfo.format = depthFormat;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    device.createImageWithInfo(
+        imageInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        depthImages[i],
+        depthImageAllocations[i]);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = colorImages[i];
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = colorFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &colorImageViews[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create texture image view!");
+    }
+
+    viewInfo.image = depthImages[i];
+    viewInfo.format = depthFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (vkCreateImageView(device.device(), &viewInfo, nullptr, &depthImageViews[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create texture image view!");
+    }
+  }
+}
+
+void OffscreenTarget::createFramebuffers() {
+  framebuffers.resize(colorImages.size());
+  for (size_t i = 0; i < colorImages.size(); i++) {
+    std::array<VkImageView, 2> attachments = {colorImageViews[i], depthImageViews[i]};
+
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = renderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(device.device(), &framebufferInfo, nullptr, &framebuffers[i]) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create framebuffer!");
+    }
+  }
+}
+
+// The copies never change, so they are recorded once here instead of every frame.
+void OffscreenTarget::createReadbackResources() {
+  size_t imageCount = colorImages.size();
+  VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+  readbackBuffers.resize(imageCount);
+  readbackAllocations.resize(imageCount);
+  readbackCommandBuffers.resize(imageCount);
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = device.getCommandPool();
+  allocInfo.commandBufferCount = static_cast<uint32_t>(imageCount);
+  if (vkAllocateCommandBuffers(device.device(), &allocInfo, readbackCommandBuffers.data()) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate readback command buffers!");
+  }
+
+  for (size_t i = 0; i < imageCount; i++) {
+    device.createBuffer(
+        size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        readbackBuffers[i],
+        readbackAllocations[i]);
+
+    VkCommandBuffer commandBuffer = readbackCommandBuffers[i];
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording command buffer!");
+    }
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(
+        commandBuffer,
+        colorImages[i],
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        readbackBuffers[i],
+        1,
+        &region);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = readbackBuffers[i];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        0,
+        nullptr,
+        1,
+        &barrier,
+        0,
+        nullptr);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record command buffer!");
+    }
+  }
+}
+
+void OffscreenTarget::createSyncObjects() {
+  inFlightFences.resize(colorImages.size());
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  for (auto &fence : inFlightFences) {
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create synchronization objects for a frame!");
+    }
+  }
+}
+
+// RGBA byte order so readback rows can be written to image files without swizzling; sRGB to
+// match the gamma of the window's B8G8R8A8_SRGB swap chain.
+VkFormat OffscreenTarget::findColorFormat() {
+  return device.findSupportedFormat(
+      {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM},
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+}
+
+VkFormat OffscreenTarget::findDepthFormat() {
+  return device.findSupportedFormat(
+      {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+      VK_IMAGE_TILING_OPTIMAL,
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+}
+
+}  // namespace learnVulkan
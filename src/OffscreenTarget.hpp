@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Device.hpp"
+#include "RenderTarget.hpp"
+#include "SwapChain.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Render target without a surface: one color and depth image per frame in flight, drawn
+// with the same render pass layout as the SwapChain and never presented. With readback
+// enabled every submitted frame is also copied into a host visible buffer, so the last
+// finished frame can be read back as tightly packed RGBA8 rows, top row first.
+class OffscreenTarget : public RenderTarget {
+ public:
+  OffscreenTarget(
+      Device &deviceRef,
+      VkExtent2D extent,
+      uint32_t framesInFlight = SwapChain::DEFAULT_FRAMES_IN_FLIGHT);
+  ~OffscreenTarget() override;
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  VkFramebuffer getFrameBuffer(int index) override { return framebuffers[index]; }
+  VkRenderPass getRenderPass() override { return renderPass; }
+  VkRenderPass getLoadRenderPass() override { return loadRenderPass; }
+  VkImage getDepthImage(int index) override { return depthImages[index]; }
+  VkImageView getDepthImageView(int index) override { return depthImageViews[index]; }
+  VkFormat getDepthFormat() override { return depthFormat; }
+  VkExtent2D getSwapChainExtent() override { return extent; }
+  VkFormat getImageFormat() const { return colorFormat; }
+
+  void waitForFrameSlot() override;
+  VkResult acquireNextImage(uint32_t *imageIndex) override;
+  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) override;
+  VkResult presentImage(uint32_t *imageIndex) override;
+
+  // Copies every frame submitted from now on to host memory. Off by default, since the
+  // copy costs bandwidth that a pure throughput run does not need.
+  void setReadbackEnabled(bool enabled) { readbackEnabled = enabled; }
+  bool isReadbackEnabled() const { return readbackEnabled; }
+  // Waits for the most recently submitted frame and copies its pixels into rgba. Returns
+  // false if no frame was submitted with readback enabled yet.
+  bool readback(std::vector<uint8_t> &rgba);
+
+ private:
+  void createImages();
+  void createRenderPass();
+  void createFramebuffers();
+  void createReadbackResources();
+  void createSyncObjects();
+  VkFormat findColorFormat();
+  VkFormat findDepthFormat();
+
+  Device &device;
+  VkExtent2D extent;
+  uint32_t framesInFlight;
+  VkFormat colorFormat;
+  VkFormat depthFormat;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkRenderPass loadRenderPass = VK_NULL_HANDLE;
+
+  // one of each per frame in flight, the image index is the frame index
+  std::vector<VkImage> colorImages;
+  std::vector<Allocation> colorImageAllocations;
+  std::vector<VkImageView> colorImageViews;
+  std::vector<VkImage> depthImages;
+  std::vector<Allocation> depthImageAllocations;
+  std::vector<VkImageView> depthImageViews;
+  std::vector<VkFramebuffer> framebuffers;
+
+  // pre-recorded image to buffer copies, appended to a frame's submission for readback
+  std::vector<VkBuffer> readbackBuffers;
+  std::vector<Allocation> readbackAllocations;
+  std::vector<VkCommandBuffer> readbackCommandBuffers;
+
+  std::vector<VkFence> inFlightFences;
+  size_t currentFrame = 0;
+
+  bool readbackEnabled = false;
+  int lastReadbackImage = -1;  // image of the last frame submitted with a readback copy
+};
+
+}  // namespace learnVulkan
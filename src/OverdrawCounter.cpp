@@ -0,0 +1,86 @@
+#include "OverdrawCounter.hpp"
+
+// std
+#include <cassert>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+OverdrawCounter::OverdrawCounter(Device &device, uint32_t framesInFlight) : device{device} {
+  supported = device.supportsPipelineStatistics();
+  frames.resize(framesInFlight);
+  if (!supported) {
+    return;
+  }
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  poolInfo.queryCount = framesInFlight;
+  poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+  if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline statistics query pool!");
+  }
+}
+
+OverdrawCounter::~OverdrawCounter() {
+  if (queryPool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device.device(), queryPool, nullptr);
+  }
+}
+
+// Only called after the frame's fence was waited on, so the result is available and the
+// query is not waited for.
+void OverdrawCounter::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+  if (!supported) {
+    return;
+  }
+  FrameQuery &frame = frames[frameIndex];
+  uint32_t query = static_cast<uint32_t>(frameIndex);
+  if (frame.pending) {
+    frame.pending = false;
+    uint64_t fragmentCount = 0;
+    if (vkGetQueryPoolResults(
+            device.device(),
+            queryPool,
+            query,
+            1,
+            sizeof(fragmentCount),
+            &fragmentCount,
+            sizeof(fragmentCount),
+            VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      resultValid = true;
+      lastFragmentCount = fragmentCount;
+      lastOverdraw = frame.pixelCount > 0 ? static_cast<float>(fragmentCount) /
+                                                static_cast<float>(frame.pixelCount)
+                                          : 0.f;
+    }
+  }
+  vkCmdResetQueryPool(commandBuffer, queryPool, query, 1);
+  currentFrame = frameIndex;
+}
+
+void OverdrawCounter::begin(
+    VkCommandBuffer commandBuffer, uint64_t pixelCount, bool secondaryContents) {
+  if (!supported || currentFrame < 0 ||
+      (secondaryContents && !device.supportsInheritedQueries())) {
+    return;
+  }
+  assert(!active && "OverdrawCounter::begin called twice");
+  frames[currentFrame].pixelCount = pixelCount;
+  vkCmdBeginQuery(commandBuffer, queryPool, static_cast<uint32_t>(currentFrame), 0);
+  active = true;
+  inherited = secondaryContents;
+}
+
+void OverdrawCounter::end(VkCommandBuffer commandBuffer) {
+  if (!active) {
+    return;
+  }
+  vkCmdEndQuery(commandBuffer, queryPool, static_cast<uint32_t>(currentFrame));
+  frames[currentFrame].pending = true;
+  active = false;
+  inherited = false;
+  currentFrame = -1;
+}
+
+}  // namespace learnVulkan
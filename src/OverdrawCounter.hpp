@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Device.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Measures overdraw as fragment shader invocations per pixel of the render target, with a
+// pipeline statistics query around the frame's passes. Fragments the depth test rejects
+// before shading are not counted, so the ratio drops toward 1 as draws go front to back or
+// behind a depth pre-pass, while depth only draws without fragment stage add nothing.
+//
+// Like Profiler's timestamps it uses one query per frame in flight, read back when the frame
+// slot comes around again, so results lag by the frames in flight and never stall. Needs
+// Device::supportsPipelineStatistics; without it, or when the frame executes secondary
+// command buffers and Device::supportsInheritedQueries is false, frames go unmeasured.
+class OverdrawCounter {
+ public:
+  OverdrawCounter(Device &device, uint32_t framesInFlight);
+  ~OverdrawCounter();
+
+  OverdrawCounter(const OverdrawCounter &) = delete;
+  OverdrawCounter &operator=(const OverdrawCounter &) = delete;
+
+  bool isSupported() const { return supported; }
+
+  // Outside any render pass, after Renderer::beginFrame: reads back what the slot measured
+  // last time and resets its query.
+  void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+  // Around every pass to count, outside of them; pixelCount is the target's width * height.
+  // Pass secondaryContents when a pass inside executes secondary command buffers, which then
+  // have to be begun with getInheritedStatistics in their inheritance info.
+  void begin(VkCommandBuffer commandBuffer, uint64_t pixelCount, bool secondaryContents);
+  void end(VkCommandBuffer commandBuffer);
+
+  // statistics of the active query for VkCommandBufferInheritanceInfo::pipelineStatistics,
+  // 0 while none is active
+  VkQueryPipelineStatisticFlags getInheritedStatistics() const {
+    return active && inherited ? VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT : 0;
+  }
+
+  // of the most recently read back frame; false until one was measured
+  bool hasResult() const { return resultValid; }
+  uint64_t getFragmentCount() const { return lastFragmentCount; }
+  float getOverdraw() const { return lastOverdraw; }
+
+ private:
+  struct FrameQuery {
+    uint64_t pixelCount = 0;
+    bool pending = false;  // the query was ended and not read back yet
+  };
+
+  Device &device;
+  bool supported = false;
+  VkQueryPool queryPool = VK_NULL_HANDLE;  // one query per frame in flight
+  std::vector<FrameQuery> frames;
+  int currentFrame = -1;
+  bool active = false;
+  bool inherited = false;
+
+  bool resultValid = false;
+  uint64_t lastFragmentCount = 0;
+  float lastOverdraw = 0.f;
+};
+
+}  // namespace learnVulkan
@@ -1,5 +1,5 @@
 #include "Pipeline.hpp"
-#include "Model.hpp"
+#include "VertexLayout.hpp"
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
@@ -54,12 +54,16 @@ namespace learnVulkan
             "Cannot create graphics pipeline: no renderPass provided in config info");
 
         // Read the SPIR-V binary code for the vertex and fragment shaders from the file paths provided.
+        bool hasFragmentStage = !fragFilepath.empty();
         auto vertCode = readFile(vertFilepath);
-        auto fragCode = readFile(fragFilepath);
 
         // Create Vulkan shader modules for the vertex and fragment shaders.
         createShaderModule(vertCode, &vertShaderModule);
-        createShaderModule(fragCode, &fragShaderModule);
+        fragShaderModule = VK_NULL_HANDLE;
+        if (hasFragmentStage) {
+            auto fragCode = readFile(fragFilepath);
+            createShaderModule(fragCode, &fragShaderModule);
+        }
 
         // Define the shader stage for the vertex shader.
         VkPipelineShaderStageCreateInfo shaderStages[2];
@@ -78,8 +82,8 @@ namespace learnVulkan
         shaderStages[1].pNext = nullptr;
         shaderStages[1].pSpecializationInfo = nullptr;
 
-        auto bindingDescriptions = Model::Vertex::getBindingDescriptions();
-        auto attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+        auto& bindingDescriptions = configInfo.bindingDescriptions;
+        auto& attributeDescriptions = configInfo.attributeDescriptions;
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
         vertexInputInfo.vertexAttributeDescriptionCount =
@@ -88,16 +92,11 @@ namespace learnVulkan
         vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
         vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 
-        vertexInputInfo.vertexAttributeDescriptionCount =static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
-
 
         // Define the graphics pipeline configuration.
         VkGraphicsPipelineCreateInfo pipelineInfo = {};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2; // Two shader stages: vertex and fragment.
+        pipelineInfo.stageCount = hasFragmentStage ? 2 : 1; // Vertex, and fragment unless depth only.
         pipelineInfo.pStages = shaderStages; // Shader stage array.
 
         // Pipeline states provided from configInfo.
@@ -122,7 +121,7 @@ namespace learnVulkan
         // Create the graphics pipeline.
         if (vkCreateGraphicsPipelines(
                 device.device(), // Logical device.
-                VK_NULL_HANDLE, // Pipeline cache (not used here).
+                device.pipelineCache(), // Pipeline cache, persisted across runs by Device.
                 1, // Number of pipelines to create.
                 &pipelineInfo, // Pipeline configuration.
                 nullptr, // Custom allocator (optional).
@@ -250,6 +249,11 @@ namespace learnVulkan
         configInfo.depthStencilInfo.front = {};  // Optional: Front-facing stencil operations.
         configInfo.depthStencilInfo.back = {};   // Optional: Back-facing stencil operations.
 
+        // Vertex Input: Per-vertex data in the standard layout; systems drawing other layouts
+        // replace these with VertexLayout descriptions and may add their own bindings.
+        configInfo.bindingDescriptions = VertexLayout::standard().getBindingDescriptions();
+        configInfo.attributeDescriptions = VertexLayout::standard().getAttributeDescriptions();
+
         configInfo.dynamicStateEnables = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
         configInfo.dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
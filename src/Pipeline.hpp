@@ -19,6 +19,8 @@ namespace learnVulkan
         VkPipelineColorBlendAttachmentState colorBlendAttachment;
         VkPipelineColorBlendStateCreateInfo colorBlendInfo;
         VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
         std::vector<VkDynamicState> dynamicStateEnables;//Resizeing
         VkPipelineDynamicStateCreateInfo dynamicStateInfo;
         VkPipelineLayout pipelineLayout = nullptr;
@@ -28,9 +30,11 @@ namespace learnVulkan
 
     class Pipeline
     {
-    private:
-        static std::vector<char> readFile(const std::string& filePath);
     public:
+        static std::vector<char> readFile(const std::string& filePath);
+
+        // An empty fragmentFilePath creates a pipeline without fragment stage, for depth only
+        // passes; its config must then mask all color writes.
         Pipeline(
             Device& device,
             const std::string& vertexFilePath,
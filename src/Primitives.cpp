@@ -0,0 +1,93 @@
+#include "Primitives.hpp"
+
+// std
+#include <cassert>
+
+namespace learnVulkan {
+
+Model::Builder buildCube(glm::vec3 offset, Model::VertexUsage vertexUsage) {
+  Model::Builder modelBuilder{};
+  modelBuilder.vertices = {
+      // left face (white)
+      {{-.5f, -.5f, -.5f}, {.9f, .9f, .9f}},
+      {{-.5f, .5f, .5f}, {.9f, .9f, .9f}},
+      {{-.5f, -.5f, .5f}, {.9f, .9f, .9f}},
+      {{-.5f, .5f, -.5f}, {.9f, .9f, .9f}},
+
+      // right face (yellow)
+      {{.5f, -.5f, -.5f}, {.8f, .8f, .1f}},
+      {{.5f, .5f, .5f}, {.8f, .8f, .1f}},
+      {{.5f, -.5f, .5f}, {.8f, .8f, .1f}},
+      {{.5f, .5f, -.5f}, {.8f, .8f, .1f}},
+
+      // top face (orange, remember y axis points down)
+      {{-.5f, -.5f, -.5f}, {.9f, .6f, .1f}},
+      {{.5f, -.5f, .5f}, {.9f, .6f, .1f}},
+      {{-.5f, -.5f, .5f}, {.9f, .6f, .1f}},
+      {{.5f, -.5f, -.5f}, {.9f, .6f, .1f}},
+
+      // bottom face (red)
+      {{-.5f, .5f, -.5f}, {.8f, .1f, .1f}},
+      {{.5f, .5f, .5f}, {.8f, .1f, .1f}},
+      {{-.5f, .5f, .5f}, {.8f, .1f, .1f}},
+      {{.5f, .5f, -.5f}, {.8f, .1f, .1f}},
+
+      // nose face (blue)
+      {{-.5f, -.5f, 0.5f}, {.1f, .1f, .8f}},
+      {{.5f, .5f, 0.5f}, {.1f, .1f, .8f}},
+      {{-.5f, .5f, 0.5f}, {.1f, .1f, .8f}},
+      {{.5f, -.5f, 0.5f}, {.1f, .1f, .8f}},
+
+      // tail face (green)
+      {{-.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
+      {{.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
+      {{-.5f, .5f, -0.5f}, {.1f, .8f, .1f}},
+      {{.5f, -.5f, -0.5f}, {.1f, .8f, .1f}},
+  };
+  for (auto &v : modelBuilder.vertices) {
+    v.position += offset;
+  }
+
+  modelBuilder.indices = {0,  1,  2,  0,  3,  1,  4,  5,  6,  4,  7,  5,  8,  9,  10, 8,  11, 9,
+                          12, 13, 14, 12, 15, 13, 16, 17, 18, 16, 19, 17, 20, 21, 22, 20, 23, 21};
+  modelBuilder.vertexUsage = vertexUsage;
+  return modelBuilder;
+}
+
+Model::Builder buildGrid(uint32_t resolution, Model::VertexUsage vertexUsage) {
+  assert(resolution > 0 && "Grid needs at least one quad per side");
+  Model::Builder modelBuilder{};
+  uint32_t side = resolution + 1;
+  modelBuilder.vertices.reserve(static_cast<size_t>(side) * side);
+  for (uint32_t z = 0; z < side; z++) {
+    for (uint32_t x = 0; x < side; x++) {
+      float u = static_cast<float>(x) / static_cast<float>(resolution);
+      float v = static_cast<float>(z) / static_cast<float>(resolution);
+      modelBuilder.vertices.push_back({{u - .5f, 0.f, v - .5f}, {u, .5f, v}});
+    }
+  }
+
+  modelBuilder.indices.reserve(static_cast<size_t>(resolution) * resolution * 6);
+  for (uint32_t z = 0; z < resolution; z++) {
+    for (uint32_t x = 0; x < resolution; x++) {
+      uint32_t corner = z * side + x;
+      modelBuilder.indices.insert(
+          modelBuilder.indices.end(),
+          {corner, corner + side + 1, corner + side, corner, corner + 1, corner + side + 1});
+    }
+  }
+  modelBuilder.vertexUsage = vertexUsage;
+  return modelBuilder;
+}
+
+std::unique_ptr<Model> createCubeModel(
+    Device &device, glm::vec3 offset, Model::VertexUsage vertexUsage) {
+  return std::make_unique<Model>(device, buildCube(offset, vertexUsage));
+}
+
+std::unique_ptr<Model> createGridModel(
+    Device &device, uint32_t resolution, Model::VertexUsage vertexUsage) {
+  return std::make_unique<Model>(device, buildGrid(resolution, vertexUsage));
+}
+
+}  // namespace learnVulkan
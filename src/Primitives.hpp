@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Device.hpp"
+#include "Model.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <memory>
+
+namespace learnVulkan {
+
+// The build* functions only produce the geometry and may run on any thread, the create*
+// functions also allocate and upload the model.
+
+// Unit cube centered on offset, one color per face, indexed.
+Model::Builder buildCube(
+    glm::vec3 offset, Model::VertexUsage vertexUsage = Model::VertexUsage::Static);
+std::unique_ptr<Model> createCubeModel(
+    Device &device,
+    glm::vec3 offset,
+    Model::VertexUsage vertexUsage = Model::VertexUsage::Static);
+
+// Flat resolution x resolution quad grid in the xz plane spanning [-0.5, 0.5], with
+// (resolution + 1)^2 vertices. Used to build meshes of arbitrary size for throughput tests.
+Model::Builder buildGrid(
+    uint32_t resolution, Model::VertexUsage vertexUsage = Model::VertexUsage::Static);
+std::unique_ptr<Model> createGridModel(
+    Device &device,
+    uint32_t resolution,
+    Model::VertexUsage vertexUsage = Model::VertexUsage::Static);
+
+}  // namespace learnVulkan
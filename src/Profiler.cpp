@@ -0,0 +1,325 @@
+#include "Profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+Profiler::Profiler(Device &device, uint32_t framesInFlight)
+    : device{device}, origin{std::chrono::steady_clock::now()} {
+  // timestampComputeAndGraphics guarantees timestamps on every graphics and compute queue
+  timestampsSupported = device.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+  timestampPeriodNs = device.properties.limits.timestampPeriod;
+
+  gpuFrames.resize(framesInFlight);
+  if (timestampsSupported) {
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * MAX_GPU_SCOPES;
+    for (auto &frame : gpuFrames) {
+      if (vkCreateQueryPool(device.device(), &poolInfo, nullptr, &frame.queryPool) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+      }
+      frame.events.reserve(MAX_GPU_SCOPES);
+      frame.openScopes.reserve(MAX_GPU_SCOPES);
+    }
+    queryResults.resize(2 * MAX_GPU_SCOPES);
+  }
+  cpuEvents.reserve(256);
+  openCpuScopes.reserve(64);
+}
+
+Profiler::~Profiler() {
+  for (auto &frame : gpuFrames) {
+    if (frame.queryPool != VK_NULL_HANDLE) {
+      vkDestroyQueryPool(device.device(), frame.queryPool, nullptr);
+    }
+  }
+}
+
+void Profiler::setEnabled(bool enable) {
+  if (enable == enabled) {
+    return;
+  }
+  enabled = enable;
+  // whatever was half recorded is dropped, the next frame starts clean
+  cpuEvents.clear();
+  openCpuScopes.clear();
+  frameStartUs = -1.0;
+  for (auto &frame : gpuFrames) {
+    frame.events.clear();
+    frame.openScopes.clear();
+    frame.queryCount = 0;
+    frame.pending = false;
+  }
+  currentGpuFrame = nullptr;
+}
+
+double Profiler::nowUs() const {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin)
+      .count();
+}
+
+void Profiler::beginFrame() {
+  if (!enabled) {
+    return;
+  }
+  double now = nowUs();
+  assert(openCpuScopes.empty() && "CPU scope left open across frames");
+  if (frameStartUs >= 0.0) {
+    addTraceEvent("frame", false, frameStartUs, now - frameStartUs);
+    addSample("frame", false, static_cast<float>((now - frameStartUs) / 1000.0));
+    for (const auto &event : cpuEvents) {
+      addTraceEvent(event.name, false, event.startUs, event.endUs - event.startUs);
+      addSample(event.name, false, static_cast<float>((event.endUs - event.startUs) / 1000.0));
+    }
+    flushSamples(false);
+  }
+  cpuEvents.clear();
+  frameStartUs = now;
+}
+
+uint32_t Profiler::beginCpuScope(const char *name) {
+  if (!enabled) {
+    return NO_SCOPE;
+  }
+  uint32_t scope = static_cast<uint32_t>(cpuEvents.size());
+  cpuEvents.push_back({name, nowUs(), 0.0});
+  openCpuScopes.push_back(scope);
+  return scope;
+}
+
+void Profiler::endCpuScope(uint32_t scope) {
+  if (!enabled || scope >= cpuEvents.size()) {
+    return;  // toggled while the scope was open
+  }
+  assert(!openCpuScopes.empty() && openCpuScopes.back() == scope && "CPU scopes must nest");
+  cpuEvents[scope].endUs = nowUs();
+  openCpuScopes.pop_back();
+}
+
+void Profiler::beginGpuFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+  if (!enabled || !timestampsSupported) {
+    return;
+  }
+  GpuFrame &frame = gpuFrames[frameIndex];
+  if (frame.pending) {
+    resolveGpuFrame(frame);
+  }
+  vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, 2 * MAX_GPU_SCOPES);
+  frame.events.clear();
+  frame.openScopes.clear();
+  frame.queryCount = 0;
+  frame.submitUs = nowUs();
+  frame.pending = true;
+  currentGpuFrame = &frame;
+  frameScope = beginGpuScope(commandBuffer, "gpu frame");
+}
+
+void Profiler::endGpuFrame(VkCommandBuffer commandBuffer) {
+  if (currentGpuFrame == nullptr) {
+    return;
+  }
+  if (frameScope != NO_SCOPE) {
+    endGpuScope(commandBuffer, frameScope);
+    frameScope = NO_SCOPE;
+  }
+  assert(currentGpuFrame->openScopes.empty() && "GPU scope left open at the end of the frame");
+  currentGpuFrame = nullptr;
+}
+
+uint32_t Profiler::beginGpuScope(VkCommandBuffer commandBuffer, const char *name) {
+  if (!enabled || currentGpuFrame == nullptr ||
+      currentGpuFrame->queryCount + 2 > 2 * MAX_GPU_SCOPES) {
+    return NO_SCOPE;
+  }
+  GpuFrame &frame = *currentGpuFrame;
+  uint32_t scope = static_cast<uint32_t>(frame.events.size());
+  frame.events.push_back({name, frame.queryCount, frame.queryCount + 1});
+  frame.queryCount += 2;
+  frame.openScopes.push_back(scope);
+  vkCmdWriteTimestamp(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      frame.queryPool,
+      frame.events[scope].beginQuery);
+  return scope;
+}
+
+void Profiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+  if (!enabled || currentGpuFrame == nullptr || scope >= currentGpuFrame->events.size()) {
+    return;
+  }
+  GpuFrame &frame = *currentGpuFrame;
+  assert(!frame.openScopes.empty() && frame.openScopes.back() == scope && "GPU scopes must nest");
+  frame.openScopes.pop_back();
+  vkCmdWriteTimestamp(
+      commandBuffer,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      frame.queryPool,
+      frame.events[scope].endQuery);
+}
+
+// Only called after the frame's fence was waited on, so the results are available and the
+// query is not waited for.
+void Profiler::resolveGpuFrame(GpuFrame &frame) {
+  frame.pending = false;
+  if (frame.queryCount == 0) {
+    return;
+  }
+  VkResult result = vkGetQueryPoolResults(
+      device.device(),
+      frame.queryPool,
+      0,
+      frame.queryCount,
+      sizeof(uint64_t) * frame.queryCount,
+      queryResults.data(),
+      sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS) {
+    return;
+  }
+
+  if (!gpuClockAnchored) {
+    gpuClockAnchored = true;
+    gpuAnchorTicks = queryResults[frame.events.front().beginQuery];
+    gpuAnchorUs = frame.submitUs;
+  }
+  double usPerTick = timestampPeriodNs / 1000.0;
+  for (const auto &event : frame.events) {
+    uint64_t begin = queryResults[event.beginQuery];
+    uint64_t end = queryResults[event.endQuery];
+    double durationUs = end > begin ? static_cast<double>(end - begin) * usPerTick : 0.0;
+    double startUs =
+        gpuAnchorUs + (static_cast<double>(begin) - static_cast<double>(gpuAnchorTicks)) * usPerTick;
+    addTraceEvent(event.name, true, startUs, durationUs);
+    addSample(event.name, true, static_cast<float>(durationUs / 1000.0));
+  }
+  flushSamples(true);
+}
+
+void Profiler::addSample(const char *name, bool gpu, float ms) {
+  for (auto &history : histories) {
+    if (history.gpu == gpu && (history.name == name || strcmp(history.name, name) == 0)) {
+      history.frameTotalMs += ms;
+      history.touched = true;
+      return;
+    }
+  }
+  ScopeHistory history{};
+  history.name = name;
+  history.gpu = gpu;
+  history.samplesMs.reserve(HISTORY_FRAMES);
+  history.frameTotalMs = ms;
+  history.touched = true;
+  histories.push_back(std::move(history));
+}
+
+void Profiler::flushSamples(bool gpu) {
+  for (auto &history : histories) {
+    if (history.gpu != gpu || !history.touched) {
+      continue;
+    }
+    if (history.samplesMs.size() < HISTORY_FRAMES) {
+      history.samplesMs.push_back(history.frameTotalMs);
+    } else {
+      history.samplesMs[history.next] = history.frameTotalMs;
+    }
+    history.next = (history.next + 1) % HISTORY_FRAMES;
+    history.frameTotalMs = 0.f;
+    history.touched = false;
+  }
+}
+
+void Profiler::addTraceEvent(const char *name, bool gpu, double startUs, double durationUs) {
+  TraceEvent event{name, gpu, startUs, durationUs};
+  if (traceEvents.size() < MAX_TRACE_EVENTS) {
+    traceEvents.push_back(event);
+  } else {
+    traceEvents[nextTraceEvent] = event;
+  }
+  nextTraceEvent = (nextTraceEvent + 1) % MAX_TRACE_EVENTS;
+}
+
+std::vector<Profiler::ScopeStats> Profiler::getStats() const {
+  std::vector<ScopeStats> stats;
+  std::vector<float> sorted;
+  for (const auto &history : histories) {
+    if (history.samplesMs.empty()) {
+      continue;
+    }
+    sorted = history.samplesMs;
+    std::sort(sorted.begin(), sorted.end());
+    float sum = 0.f;
+    for (float sample : sorted) {
+      sum += sample;
+    }
+    size_t p99Index = std::min(sorted.size() - 1, (sorted.size() * 99) / 100);
+
+    ScopeStats scope{};
+    scope.name = history.name;
+    scope.gpu = history.gpu;
+    scope.sampleCount = static_cast<uint32_t>(sorted.size());
+    scope.minMs = sorted.front();
+    scope.avgMs = sum / static_cast<float>(sorted.size());
+    scope.p99Ms = sorted[p99Index];
+    stats.push_back(scope);
+  }
+  return stats;
+}
+
+void Profiler::clearStats() {
+  histories.clear();
+  traceEvents.clear();
+  nextTraceEvent = 0;
+}
+
+void Profiler::printStats(std::ostream &out) const {
+  out << std::left << std::setw(24) << "scope" << std::right << std::setw(10) << "min ms"
+      << std::setw(10) << "avg ms" << std::setw(10) << "p99 ms" << std::setw(10) << "samples"
+      << "\n";
+  out << std::fixed << std::setprecision(3);
+  for (const auto &scope : getStats()) {
+    out << std::left << std::setw(24) << ((scope.gpu ? "gpu: " : "cpu: ") + scope.name)
+        << std::right << std::setw(10) << scope.minMs << std::setw(10) << scope.avgMs
+        << std::setw(10) << scope.p99Ms << std::setw(10) << scope.sampleCount << "\n";
+  }
+  out << std::defaultfloat;
+}
+
+void Profiler::writeChromeTrace(const std::string &path) const {
+  std::ofstream file{path, std::ios::trunc};
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file for writing: " + path);
+  }
+
+  // oldest event first when the ring has wrapped
+  size_t count = traceEvents.size();
+  size_t first = count < MAX_TRACE_EVENTS ? 0 : nextTraceEvent;
+
+  file << std::fixed << std::setprecision(3);
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+          "\"args\":{\"name\":\"CPU\"}},\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,"
+          "\"args\":{\"name\":\"GPU\"}}";
+  for (size_t i = 0; i < count; i++) {
+    const TraceEvent &event = traceEvents[(first + i) % count];
+    file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+         << (event.gpu ? 1 : 0) << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs
+         << "}";
+  }
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  if (!file) {
+    throw std::runtime_error("failed to write trace: " + path);
+  }
+}
+
+}  // namespace learnVulkan
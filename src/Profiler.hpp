@@ -0,0 +1,185 @@
+#pragma once
+
+#include "Device.hpp"
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace learnVulkan {
+
+// CPU scoped timers and GPU timestamp queries, resolved into rolling per-scope statistics
+// and a Chrome trace (chrome://tracing, Perfetto). Scope names must be string literals or
+// otherwise outlive the profiler; scopes with the same name in one frame add up to one
+// sample. CPU scopes are only recorded on the thread that drives the frame.
+//
+// GPU timestamps use one query pool per frame in flight. A frame's queries are read back
+// when its slot comes around again, after the renderer waited for its fence, so GPU
+// results lag as many frames behind as there are frames in flight and never stall.
+//
+// Disabled, which is the default, every entry point returns after checking one flag.
+class Profiler {
+ public:
+  static constexpr uint32_t MAX_GPU_SCOPES = 128;  // per frame
+  static constexpr uint32_t HISTORY_FRAMES = 300;  // samples kept for the statistics
+  static constexpr size_t MAX_TRACE_EVENTS = 200000;
+
+  struct ScopeStats {
+    std::string name;
+    bool gpu;
+    uint32_t sampleCount;
+    float minMs;
+    float avgMs;
+    float p99Ms;
+  };
+
+  class CpuScope {
+   public:
+    CpuScope(Profiler &profiler, const char *name) : profiler{profiler} {
+      if (profiler.enabled) {
+        scope = profiler.beginCpuScope(name);
+      }
+    }
+    ~CpuScope() {
+      if (scope != NO_SCOPE) {
+        profiler.endCpuScope(scope);
+      }
+    }
+    CpuScope(const CpuScope &) = delete;
+    CpuScope &operator=(const CpuScope &) = delete;
+
+   private:
+    Profiler &profiler;
+    uint32_t scope = NO_SCOPE;
+  };
+
+  class GpuScope {
+   public:
+    GpuScope(Profiler &profiler, VkCommandBuffer commandBuffer, const char *name)
+        : profiler{profiler}, commandBuffer{commandBuffer} {
+      if (profiler.enabled) {
+        scope = profiler.beginGpuScope(commandBuffer, name);
+      }
+    }
+    ~GpuScope() {
+      if (scope != NO_SCOPE) {
+        profiler.endGpuScope(commandBuffer, scope);
+      }
+    }
+    GpuScope(const GpuScope &) = delete;
+    GpuScope &operator=(const GpuScope &) = delete;
+
+   private:
+    Profiler &profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t scope = NO_SCOPE;
+  };
+
+  Profiler(Device &device, uint32_t framesInFlight);
+  ~Profiler();
+
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+
+  void setEnabled(bool enable);
+  bool isEnabled() const { return enabled; }
+  bool hasGpuTimestamps() const { return timestampsSupported; }
+
+  // Frame boundaries, driven by Renderer. beginFrame closes the previous CPU frame;
+  // beginGpuFrame runs once the frame slot's fence was waited on, resolves the queries the
+  // slot recorded last time and resets them in the new command buffer, outside any render
+  // pass. endGpuFrame goes right before the command buffer is ended.
+  void beginFrame();
+  void beginGpuFrame(VkCommandBuffer commandBuffer, int frameIndex);
+  void endGpuFrame(VkCommandBuffer commandBuffer);
+
+  // raw scope API behind CpuScope and GpuScope; prefer those
+  uint32_t beginCpuScope(const char *name);
+  void endCpuScope(uint32_t scope);
+  uint32_t beginGpuScope(VkCommandBuffer commandBuffer, const char *name);
+  void endGpuScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+  // min / average / 99th percentile over the last HISTORY_FRAMES samples of every scope
+  std::vector<ScopeStats> getStats() const;
+  // drops the sample histories and trace events collected so far
+  void clearStats();
+  void printStats(std::ostream &out) const;
+  // Writes the recorded events in the Chrome trace event format, CPU scopes on one track
+  // and GPU scopes on another. Throws if the file cannot be written.
+  void writeChromeTrace(const std::string &path) const;
+
+ private:
+  static constexpr uint32_t NO_SCOPE = ~0u;
+
+  struct CpuEvent {
+    const char *name;
+    double startUs;
+    double endUs;
+  };
+
+  struct GpuEvent {
+    const char *name;
+    uint32_t beginQuery;
+    uint32_t endQuery;
+  };
+
+  struct GpuFrame {
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    std::vector<GpuEvent> events;
+    std::vector<uint32_t> openScopes;  // stack of indices into events
+    uint32_t queryCount = 0;
+    double submitUs = 0.0;  // CPU time the frame was recorded, anchors the GPU track
+    bool pending = false;   // holds queries that were not read back yet
+  };
+
+  struct TraceEvent {
+    const char *name;
+    bool gpu;
+    double startUs;
+    double durationUs;
+  };
+
+  // samples of one scope name, a ring of HISTORY_FRAMES
+  struct ScopeHistory {
+    const char *name;
+    bool gpu;
+    std::vector<float> samplesMs;
+    uint32_t next = 0;
+    float frameTotalMs = 0.f;  // accumulated over the current frame
+    bool touched = false;
+  };
+
+  double nowUs() const;
+  void resolveGpuFrame(GpuFrame &frame);
+  void addSample(const char *name, bool gpu, float ms);
+  void flushSamples(bool gpu);
+  void addTraceEvent(const char *name, bool gpu, double startUs, double durationUs);
+
+  Device &device;
+  bool enabled = false;
+  bool timestampsSupported = false;
+  float timestampPeriodNs = 1.f;
+  std::chrono::steady_clock::time_point origin;
+
+  std::vector<CpuEvent> cpuEvents;  // current CPU frame
+  std::vector<uint32_t> openCpuScopes;
+  double frameStartUs = -1.0;
+
+  std::vector<GpuFrame> gpuFrames;  // one per frame in flight
+  GpuFrame *currentGpuFrame = nullptr;
+  uint32_t frameScope = NO_SCOPE;
+  std::vector<uint64_t> queryResults;
+  // GPU ticks are mapped to the CPU clock once, at the first resolved frame
+  bool gpuClockAnchored = false;
+  uint64_t gpuAnchorTicks = 0;
+  double gpuAnchorUs = 0.0;
+
+  std::vector<ScopeHistory> histories;
+  std::vector<TraceEvent> traceEvents;  // ring of MAX_TRACE_EVENTS
+  size_t nextTraceEvent = 0;
+};
+
+}  // namespace learnVulkan
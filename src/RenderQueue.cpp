@@ -0,0 +1,71 @@
+#include "RenderQueue.hpp"
+
+// std
+#include <array>
+#include <cassert>
+#include <cstring>
+
+namespace learnVulkan {
+
+static constexpr uint32_t STATE_BITS =
+    RenderQueue::PIPELINE_BITS + RenderQueue::MODEL_BITS + RenderQueue::LOD_BITS;
+
+static uint32_t depthBits(float depth) {
+  // negative depths and NaN sort as the nearest
+  if (!(depth > 0.f)) {
+    return 0;
+  }
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits;
+}
+
+uint64_t RenderQueue::makeKey(
+    Layer layer, uint32_t pipeline, uint32_t model, uint32_t lod, float depth) {
+  assert(pipeline < (1u << PIPELINE_BITS) && "Too many pipelines for the sort key");
+  assert(model < (1u << MODEL_BITS) && "Too many models for the sort key");
+  assert(lod < (1u << LOD_BITS) && "Too many levels of detail for the sort key");
+  uint64_t state = (static_cast<uint64_t>(pipeline) << (MODEL_BITS + LOD_BITS)) |
+                   (static_cast<uint64_t>(model) << LOD_BITS) | lod;
+  if (layer == Layer::Opaque) {
+    return (state << 32) | depthBits(depth);
+  }
+  uint64_t backToFront = static_cast<uint32_t>(~depthBits(depth));
+  return (1ull << 63) | (backToFront << STATE_BITS) | state;
+}
+
+void RenderQueue::sort() {
+  size_t count = entries.size();
+  if (count < 2) {
+    return;
+  }
+
+  // all eight byte histograms in one pass over the keys
+  std::array<std::array<uint32_t, 256>, 8> histograms{};
+  for (const Entry &entry : entries) {
+    for (uint32_t pass = 0; pass < 8; pass++) {
+      histograms[pass][(entry.key >> (8 * pass)) & 0xff]++;
+    }
+  }
+
+  scratch.resize(count);
+  for (uint32_t pass = 0; pass < 8; pass++) {
+    std::array<uint32_t, 256> &histogram = histograms[pass];
+    uint32_t shift = 8 * pass;
+    if (histogram[(entries[0].key >> shift) & 0xff] == count) {
+      continue;  // every key has the same byte here
+    }
+    uint32_t offset = 0;
+    for (uint32_t &bucket : histogram) {
+      uint32_t bucketCount = bucket;
+      bucket = offset;
+      offset += bucketCount;
+    }
+    for (const Entry &entry : entries) {
+      scratch[histogram[(entry.key >> shift) & 0xff]++] = entry;
+    }
+    entries.swap(scratch);
+  }
+}
+
+}  // namespace learnVulkan
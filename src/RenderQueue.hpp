@@ -0,0 +1,52 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// Draw items ordered by 64 bit sort keys, rebuilt every frame. Opaque keys hold the pipeline,
+// the model and its level of detail, then the depth, so draws sharing state follow each other
+// and, within a model, the nearest surfaces fill the depth buffer first and hide what comes
+// after them. Transparent keys sort after every opaque one and by depth first, back to front,
+// as blending needs; state only breaks ties there.
+//
+//   opaque       | 0 | pipeline:7 | model:20 | lod:4 | depth:32    |
+//   transparent  | 1 | ~depth:32  | pipeline:7 | model:20 | lod:4 |
+//
+// Depth is a non-negative float whose bit pattern already sorts like its value. sort is an
+// LSD radix sort over bytes, stable and linear in the item count; passes over bytes that
+// every key shares, such as the pipeline of a single layout scene, are skipped.
+class RenderQueue {
+ public:
+  enum class Layer : uint32_t { Opaque = 0, Transparent = 1 };
+
+  static constexpr uint32_t PIPELINE_BITS = 7;
+  static constexpr uint32_t MODEL_BITS = 20;
+  static constexpr uint32_t LOD_BITS = 4;
+
+  // depth is any measure that grows away from the camera, e.g. the squared distance
+  static uint64_t makeKey(
+      Layer layer, uint32_t pipeline, uint32_t model, uint32_t lod, float depth);
+
+  void clear() { entries.clear(); }
+  void reserve(uint32_t count) { entries.reserve(count); }
+  void push(uint64_t key, uint32_t item) { entries.push_back({key, item}); }
+  void sort();
+
+  uint32_t size() const { return static_cast<uint32_t>(entries.size()); }
+  uint32_t itemAt(uint32_t index) const { return entries[index].item; }
+  uint64_t keyAt(uint32_t index) const { return entries[index].key; }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    uint32_t item;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<Entry> scratch;  // ping-pong buffer of the radix passes
+};
+
+}  // namespace learnVulkan
@@ -0,0 +1,44 @@
+#pragma once
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+namespace learnVulkan {
+
+// What Renderer draws into: the window's SwapChain, or an OffscreenTarget when running
+// without a display. acquireNextImage waits for the frame slot to become free and picks the
+// image, submitCommandBuffers submits the frame's command buffer, and presentImage presents
+// it, if there is anything to present to, and moves on to the next frame slot. A target cycles
+// through a fixed number of frame slots, the frames in flight, chosen at construction.
+class RenderTarget {
+ public:
+  virtual ~RenderTarget() = default;
+
+  virtual VkFramebuffer getFrameBuffer(int index) = 0;
+  virtual VkRenderPass getRenderPass() = 0;
+  virtual VkExtent2D getSwapChainExtent() = 0;
+  // Compatible with getRenderPass, so it takes the same framebuffers and pipelines, but loads
+  // color and depth instead of clearing them: it continues a frame whose pass was ended to
+  // run work outside of it, such as building a depth pyramid.
+  virtual VkRenderPass getLoadRenderPass() = 0;
+
+  // Depth attachment of each image. Both passes store it and leave it in
+  // DEPTH_STENCIL_ATTACHMENT_OPTIMAL; it can also be sampled.
+  virtual VkImage getDepthImage(int index) = 0;
+  virtual VkImageView getDepthImageView(int index) = 0;
+  virtual VkFormat getDepthFormat() = 0;
+
+  // Blocks until the GPU is done with the current frame slot. acquireNextImage does the same
+  // wait, so calling this first only moves the wait earlier.
+  virtual void waitForFrameSlot() = 0;
+  virtual VkResult acquireNextImage(uint32_t *imageIndex) = 0;
+  virtual VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) = 0;
+  virtual VkResult presentImage(uint32_t *imageIndex) = 0;
+
+  float extentAspectRatio() {
+    VkExtent2D extent = getSwapChainExtent();
+    return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+  }
+};
+
+}  // namespace learnVulkan
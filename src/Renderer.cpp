@@ -1,42 +1,99 @@
 #include "Renderer.hpp"
 
+#include "ImageWriter.hpp"
+
 // std
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <stdexcept>
 
 namespace learnVulkan {
 
-Renderer::Renderer(Window& window, Device& device)
+Renderer::Renderer(Window* window, Device& device, VkExtent2D headlessExtent)
     : m_Window{window}, m_Device{device} {
-  recreateSwapChain();
+  if (m_Window != nullptr) {
+    recreateSwapChain();
+  } else {
+    auto offscreen = std::make_unique<OffscreenTarget>(m_Device, headlessExtent);
+    m_Offscreen = offscreen.get();
+    m_Target = std::move(offscreen);
+  }
   createCommandBuffers();
 }
 
 Renderer::~Renderer() { freeCommandBuffers(); }
 
 void Renderer::recreateSwapChain() {
-  auto extent = m_Window.getExtent();
+  assert(m_Window != nullptr && "A headless renderer has no swap chain");
+  auto extent = m_Window->getExtent();
   while (extent.width == 0 || extent.height == 0) {
-    extent = m_Window.getExtent();
+    extent = m_Window->getExtent();
     glfwWaitEvents();
   }
   vkDeviceWaitIdle(m_Device.device());
 
-  if (m_SwapChain == nullptr) {
-    m_SwapChain = std::make_unique<SwapChain>(m_Device, extent);
+  if (m_Target == nullptr) {
+    m_Target = std::make_unique<SwapChain>(m_Device, extent, m_FramesInFlight, m_PresentMode);
   } else {
-    std::shared_ptr<SwapChain> oldSwapChain = std::move(m_SwapChain);
-    m_SwapChain = std::make_unique<SwapChain>(m_Device, extent, oldSwapChain);
+    std::shared_ptr<SwapChain> oldSwapChain{static_cast<SwapChain*>(m_Target.release())};
+    auto swapChain = std::make_unique<SwapChain>(
+        m_Device, extent, oldSwapChain, m_FramesInFlight, m_PresentMode);
 
-    if (!oldSwapChain->compareSwapFormats(*m_SwapChain.get())) {
+    if (!oldSwapChain->compareSwapFormats(*swapChain)) {
       throw std::runtime_error("Swap chain image(or depth) format has changed!");
     }
+    m_Target = std::move(swapChain);
+  }
+}
+
+void Renderer::setFramesInFlight(uint32_t count) {
+  assert(!isFrameStarted && "Can't change frames in flight while frame is in progress");
+  if (count < 1 || count > SwapChain::MAX_FRAMES_IN_FLIGHT) {
+    throw std::invalid_argument("frames in flight must be between 1 and 4");
+  }
+  if (count == m_FramesInFlight) {
+    return;
+  }
+  vkDeviceWaitIdle(m_Device.device());
+  m_FramesInFlight = count;
+  freeCommandBuffers();
+  if (isHeadless()) {
+    // a new target has no finished frame yet, so readback starts over
+    bool readbackEnabled = m_Offscreen->isReadbackEnabled();
+    VkExtent2D extent = m_Offscreen->getSwapChainExtent();
+    m_Target.reset();
+    auto offscreen = std::make_unique<OffscreenTarget>(m_Device, extent, m_FramesInFlight);
+    offscreen->setReadbackEnabled(readbackEnabled);
+    m_Offscreen = offscreen.get();
+    m_Target = std::move(offscreen);
+  } else {
+    recreateSwapChain();
+  }
+  createCommandBuffers();
+  currentFrameIndex = 0;
+}
+
+void Renderer::setPresentMode(PresentMode mode) {
+  assert(!isFrameStarted && "Can't change present mode while frame is in progress");
+  if (mode == m_PresentMode) {
+    return;
+  }
+  m_PresentMode = mode;
+  if (!isHeadless()) {
+    recreateSwapChain();
+  }
+}
+
+VkPresentModeKHR Renderer::getActivePresentMode() const {
+  if (isHeadless()) {
+    return VK_PRESENT_MODE_IMMEDIATE_KHR;
   }
+  return static_cast<const SwapChain*>(m_Target.get())->getPresentMode();
 }
 
 void Renderer::createCommandBuffers() {
-  commandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+  commandBuffers.resize(m_FramesInFlight);
 
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -59,12 +116,36 @@ void Renderer::freeCommandBuffers() {
   commandBuffers.clear();
 }
 
+void Renderer::waitForNextFrame() {
+  assert(!isFrameStarted && "Can't call waitForNextFrame while frame is in progress");
+  if (m_FramePacer.getMode() == FramePacer::Mode::LowLatency) {
+    Profiler::CpuScope scope{m_Profiler, "pacing"};
+    m_Target->waitForFrameSlot();
+    m_FramePacer.sleepBeforeInput();
+  }
+  m_FramePacer.markInputSampled();
+}
+
 VkCommandBuffer Renderer::beginFrame() {
   assert(!isFrameStarted && "Can't call beginFrame while already in progress");
 
-  auto result = m_SwapChain->acquireNextImage(&currentImageIndex);
+  m_Profiler.beginFrame();
+  if (!m_FramePacer.isInputSampled()) {
+    m_FramePacer.markInputSampled();
+  }
+  VkResult result;
+  {
+    Profiler::CpuScope scope{m_Profiler, "acquire"};
+    auto acquireStart = std::chrono::steady_clock::now();
+    result = m_Target->acquireNextImage(&currentImageIndex);
+    m_FramePacer.addBlockedTime(std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() - acquireStart)
+                                    .count());
+  }
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    // nothing was acquired, the caller skips this frame
     recreateSwapChain();
+    return nullptr;
   }
 
   if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
@@ -73,6 +154,9 @@ VkCommandBuffer Renderer::beginFrame() {
 
   isFrameStarted = true;
 
+  // uploads queued since the last frame go out as one transfer submission
+  m_Device.uploadScheduler().flush();
+
   auto commandBuffer = getCurrentCommandBuffer();
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -80,30 +164,60 @@ VkCommandBuffer Renderer::beginFrame() {
   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
     throw std::runtime_error("failed to begin recording command buffer!");
   }
+  // the frame slot's fence was waited on in acquire, so its old timestamps are ready
+  m_Profiler.beginGpuFrame(commandBuffer, currentFrameIndex);
   return commandBuffer;
 }
 
 void Renderer::endFrame() {
   assert(isFrameStarted && "Can't call endFrame while frame is not in progress");
   auto commandBuffer = getCurrentCommandBuffer();
+  m_Profiler.endGpuFrame(commandBuffer);
   if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
     throw std::runtime_error("failed to record command buffer!");
   }
 
-  auto result = m_SwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+  {
+    Profiler::CpuScope scope{m_Profiler, "submit"};
+    m_Target->submitCommandBuffers(&commandBuffer, &currentImageIndex);
+  }
+  VkResult result;
+  {
+    Profiler::CpuScope scope{m_Profiler, "present"};
+    auto presentStart = std::chrono::steady_clock::now();
+    result = m_Target->presentImage(&currentImageIndex);
+    m_FramePacer.addBlockedTime(std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() - presentStart)
+                                    .count());
+  }
+  m_FramePacer.markPresented();
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
-      m_Window.wasWindowResized()) {
-    m_Window.resetWindowResizedFlag();
+      (m_Window != nullptr && m_Window->wasWindowResized())) {
+    m_Window->resetWindowResizedFlag();
     recreateSwapChain();
   } else if (result != VK_SUCCESS) {
     throw std::runtime_error("failed to present swap chain image!");
   }
 
   isFrameStarted = false;
-  currentFrameIndex = (currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+  currentFrameIndex = (currentFrameIndex + 1) % m_FramesInFlight;
+}
+
+void Renderer::beginSwapChainRenderPass(
+    VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+  beginRenderPass(commandBuffer, m_Target->getRenderPass(), contents, "render pass");
 }
 
-void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+void Renderer::resumeSwapChainRenderPass(
+    VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+  beginRenderPass(commandBuffer, m_Target->getLoadRenderPass(), contents, "resumed render pass");
+}
+
+void Renderer::beginRenderPass(
+    VkCommandBuffer commandBuffer,
+    VkRenderPass renderPass,
+    VkSubpassContents contents,
+    const char* scopeName) {
   assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
   assert(
       commandBuffer == getCurrentCommandBuffer() &&
@@ -111,38 +225,65 @@ void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
 
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassInfo.renderPass = m_SwapChain->getRenderPass();
-  renderPassInfo.framebuffer = m_SwapChain->getFrameBuffer(currentImageIndex);
+  renderPassInfo.renderPass = renderPass;
+  renderPassInfo.framebuffer = m_Target->getFrameBuffer(currentImageIndex);
 
   renderPassInfo.renderArea.offset = {0, 0};
-  renderPassInfo.renderArea.extent = m_SwapChain->getSwapChainExtent();
+  renderPassInfo.renderArea.extent = m_Target->getSwapChainExtent();
 
+  // ignored by the load pass
   std::array<VkClearValue, 2> clearValues{};
   clearValues[0].color = {0.01f, 0.01f, 0.01f, 1.0f};
   clearValues[1].depthStencil = {1.0f, 0};
   renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
   renderPassInfo.pClearValues = clearValues.data();
 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  // outside the pass, a pass with secondary contents only allows vkCmdExecuteCommands
+  renderPassScope = m_Profiler.beginGpuScope(commandBuffer, scopeName);
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+  if (contents != VK_SUBPASS_CONTENTS_INLINE) {
+    return;
+  }
 
   VkViewport viewport{};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
-  viewport.width = static_cast<float>(m_SwapChain->getSwapChainExtent().width);
-  viewport.height = static_cast<float>(m_SwapChain->getSwapChainExtent().height);
+  viewport.width = static_cast<float>(m_Target->getSwapChainExtent().width);
+  viewport.height = static_cast<float>(m_Target->getSwapChainExtent().height);
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
-  VkRect2D scissor{{0, 0}, m_SwapChain->getSwapChainExtent()};
+  VkRect2D scissor{{0, 0}, m_Target->getSwapChainExtent()};
   vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
   vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
+void Renderer::setReadbackEnabled(bool enabled) {
+  assert(isHeadless() && "Frame readback needs a headless renderer");
+  m_Offscreen->setReadbackEnabled(enabled);
+}
+
+bool Renderer::readbackFrame(std::vector<uint8_t>& rgba) {
+  assert(isHeadless() && "Frame readback needs a headless renderer");
+  return m_Offscreen->readback(rgba);
+}
+
+bool Renderer::saveFrame(const std::string& path) {
+  std::vector<uint8_t> rgba;
+  if (!readbackFrame(rgba)) {
+    return false;
+  }
+  VkExtent2D extent = m_Offscreen->getSwapChainExtent();
+  writeImage(path, extent.width, extent.height, rgba.data());
+  return true;
+}
+
 void Renderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer) {
   assert(isFrameStarted && "Can't call endSwapChainRenderPass if frame is not in progress");
   assert(
       commandBuffer == getCurrentCommandBuffer() &&
       "Can't end render pass on command buffer from a different frame");
   vkCmdEndRenderPass(commandBuffer);
+  m_Profiler.endGpuScope(commandBuffer, renderPassScope);
 }
 
 }  // namespace learnVulkan
\ No newline at end of file
@@ -2,10 +2,14 @@
 #include "Window.hpp"
 #include "Model.hpp"
 #include "Device.hpp"
+#include "FramePacer.hpp"
+#include "OffscreenTarget.hpp"
+#include "Profiler.hpp"
 #include "SwapChain.hpp"
 
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace learnVulkan
@@ -13,22 +17,54 @@ namespace learnVulkan
     class Renderer
     {
     private:
-        Window& m_Window;
+        Window* m_Window = nullptr;  // null when rendering headless
         Device& m_Device;
-        std::unique_ptr<SwapChain> m_SwapChain;
+        std::unique_ptr<RenderTarget> m_Target;  // the swap chain, or the offscreen target
+        OffscreenTarget* m_Offscreen = nullptr;
+        Profiler m_Profiler{m_Device, SwapChain::MAX_FRAMES_IN_FLIGHT};
+        FramePacer m_FramePacer;
+        uint32_t m_FramesInFlight = SwapChain::DEFAULT_FRAMES_IN_FLIGHT;
+        PresentMode m_PresentMode = PresentMode::Mailbox;
+        uint32_t renderPassScope = 0;
         std::vector<VkCommandBuffer> commandBuffers;
 
         uint32_t currentImageIndex;
         int currentFrameIndex{0};
-        bool isFrameStarted;
+        bool isFrameStarted{false};
 
             
         void createCommandBuffers();
         void freeCommandBuffers();
         void recreateSwapChain();
+        void beginRenderPass(
+            VkCommandBuffer commandBuffer,
+            VkRenderPass renderPass,
+            VkSubpassContents contents,
+            const char* scopeName);
     public:
-        float getAspectRatio() const { return m_SwapChain->extentAspectRatio(); }
-        VkRenderPass getSwapChainRenderPass() const { return m_SwapChain->getRenderPass(); }
+        float getAspectRatio() const { return m_Target->extentAspectRatio(); }
+        VkRenderPass getSwapChainRenderPass() const { return m_Target->getRenderPass(); }
+        VkExtent2D getSwapChainExtent() const { return m_Target->getSwapChainExtent(); }
+        VkFramebuffer getCurrentFramebuffer() const {
+            assert(isFrameStarted && "Cannot get framebuffer when frame not in progress");
+            return m_Target->getFrameBuffer(currentImageIndex);
+        }
+        // depth attachment of the current frame, see RenderTarget::getDepthImage
+        VkImage getCurrentDepthImage() const {
+            assert(isFrameStarted && "Cannot get depth image when frame not in progress");
+            return m_Target->getDepthImage(currentImageIndex);
+        }
+        VkImageView getCurrentDepthImageView() const {
+            assert(isFrameStarted && "Cannot get depth image when frame not in progress");
+            return m_Target->getDepthImageView(currentImageIndex);
+        }
+        VkFormat getDepthFormat() const { return m_Target->getDepthFormat(); }
+        bool isHeadless() const { return m_Offscreen != nullptr; }
+        // Times acquire, submit and present on the CPU and the frame and render pass on the
+        // GPU; disabled until Profiler::setEnabled.
+        Profiler& profiler() { return m_Profiler; }
+        // Pacing mode and input to present latency, see waitForNextFrame.
+        FramePacer& framePacer() { return m_FramePacer; }
         bool isFrameInProgress() const { return isFrameStarted; }
         VkCommandBuffer getCurrentCommandBuffer() const {
             assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
@@ -40,15 +76,52 @@ namespace learnVulkan
             return currentFrameIndex;
         }
 
-        Renderer(Window& window,Device& device);
+        Renderer(Window& window,Device& device) : Renderer{&window, device, {}} {}
+        // Without a window the renderer is headless and draws into offscreen images of
+        // headlessExtent; the frame API is the same, frames are just never presented.
+        Renderer(Window* window, Device& device, VkExtent2D headlessExtent);
         ~Renderer();
         Renderer(const Renderer&) = delete;
         Renderer &operator=(const Renderer&)=delete;
 
+        // Frames the CPU may record ahead of the GPU, 1 to SwapChain::MAX_FRAMES_IN_FLIGHT.
+        // More frames keep the GPU busier, fewer lower the latency. Waits for the device to
+        // go idle and recreates the render target, call it between frames.
+        void setFramesInFlight(uint32_t count);
+        uint32_t getFramesInFlight() const { return m_FramesInFlight; }
+
+        // Switches the requested present mode by recreating the swap chain, call it between
+        // frames. The active mode is what the surface supports closest to the request;
+        // headless frames are never throttled and report IMMEDIATE. The present rate is
+        // measured by framePacer().
+        void setPresentMode(PresentMode mode);
+        PresentMode getRequestedPresentMode() const { return m_PresentMode; }
+        VkPresentModeKHR getActivePresentMode() const;
+
+        // Call right before sampling input for the next frame. With LowLatency pacing it
+        // blocks until the frame slot is free and then for the pacer's delay, so input is
+        // read as late as possible. Marks the start of the input to present latency; without
+        // it, beginFrame does.
+        void waitForNextFrame();
         VkCommandBuffer beginFrame();
         void endFrame();
-        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+        // With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the pass may only execute secondary
+        // command buffers, which then set their own viewport and scissor.
+        void beginSwapChainRenderPass(
+            VkCommandBuffer commandBuffer,
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
         void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+        // Begins the pass again after it was ended earlier in the frame, keeping what was drawn
+        // and the depth buffer instead of clearing them.
+        void resumeSwapChainRenderPass(
+            VkCommandBuffer commandBuffer,
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+
+        // Headless only. With readback enabled every frame is copied to host memory, and
+        // the last finished one can be fetched as RGBA8 or saved as a .ppm or .png file.
+        void setReadbackEnabled(bool enabled);
+        bool readbackFrame(std::vector<uint8_t>& rgba);
+        bool saveFrame(const std::string& path);
 
     };    
 } // namespace learnVulkan
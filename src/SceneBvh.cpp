@@ -0,0 +1,125 @@
+#include "SceneBvh.hpp"
+
+namespace learnVulkan {
+
+void SceneBvh::setObjects(EntityRegistry &entities) {
+  const ModelId *models = entities.models();
+  itemGenerations.clear();
+  localBounds.clear();
+  std::vector<uint32_t> items;
+  std::vector<Aabb> bounds;
+  items.reserve(entities.size());
+  bounds.reserve(entities.size());
+  for (uint32_t i = 0; i < entities.size(); i++) {
+    if (models[i] == NO_MODEL) {
+      continue;
+    }
+    EntityHandle handle = entities.handleAt(i);
+    if (handle.index >= localBounds.size()) {
+      itemGenerations.resize(handle.index + 1);
+      localBounds.resize(handle.index + 1);
+    }
+    const Model &model = entities.getModel(models[i]);
+    itemGenerations[handle.index] = handle.generation;
+    localBounds[handle.index] = {model.getBoundsMin(), model.getBoundsMax()};
+    items.push_back(handle.index);
+    bounds.push_back(Aabb::transformed(localBounds[handle.index], entities.worldMatrix(i)));
+  }
+  bvh.build(items.data(), bounds.data(), static_cast<uint32_t>(items.size()));
+}
+
+void SceneBvh::updateChangedObjects(EntityRegistry &entities) {
+  for (uint32_t entityIndex : entities.getChangedTransforms()) {
+    uint32_t item;
+    if (findItem(entities, entityIndex, item)) {
+      refreshObject(entities, item, entityIndex);
+    }
+  }
+  bvh.refit();
+}
+
+void SceneBvh::updateModel(EntityRegistry &entities, ModelId id) {
+  const Model &model = entities.getModel(id);
+  const ModelId *models = entities.models();
+  for (uint32_t i = 0; i < entities.size(); i++) {
+    uint32_t item;
+    if (models[i] == id && findItem(entities, i, item)) {
+      localBounds[item] = {model.getBoundsMin(), model.getBoundsMax()};
+      refreshObject(entities, item, i);
+    }
+  }
+  bvh.refit();
+}
+
+bool SceneBvh::findEntity(
+    const EntityRegistry &entities, uint32_t item, uint32_t &entityIndex) const {
+  EntityHandle handle{item, itemGenerations[item]};
+  if (!entities.isAlive(handle)) {
+    return false;
+  }
+  entityIndex = entities.indexOf(handle);
+  return true;
+}
+
+bool SceneBvh::findItem(
+    const EntityRegistry &entities, uint32_t entityIndex, uint32_t &item) const {
+  EntityHandle handle = entities.handleAt(entityIndex);
+  if (!bvh.contains(handle.index) || itemGenerations[handle.index] != handle.generation) {
+    return false;
+  }
+  item = handle.index;
+  return true;
+}
+
+void SceneBvh::refreshObject(const EntityRegistry &entities, uint32_t item, uint32_t entityIndex) {
+  bvh.updateItem(item, Aabb::transformed(localBounds[item], entities.worldMatrix(entityIndex)));
+}
+
+// The tree hands back items; they are turned into dense indices in place.
+void SceneBvh::cullFrustum(
+    const EntityRegistry &entities,
+    const Frustum &frustum,
+    std::vector<uint32_t> &entityIndices) const {
+  size_t first = entityIndices.size();
+  bvh.queryFrustum(frustum, entityIndices);
+  size_t kept = first;
+  for (size_t i = first; i < entityIndices.size(); i++) {
+    uint32_t entityIndex;
+    if (findEntity(entities, entityIndices[i], entityIndex)) {
+      entityIndices[kept++] = entityIndex;
+    }
+  }
+  entityIndices.resize(kept);
+}
+
+bool SceneBvh::pick(const EntityRegistry &entities, const Ray &ray, RayHit &hit) const {
+  bool found = bvh.raycast(ray, hit, [&](uint32_t item, float &distance) {
+    uint32_t entityIndex;
+    if (!findEntity(entities, item, entityIndex)) {
+      return false;
+    }
+    // an affine transform keeps distances along the ray as long as the direction is not
+    // renormalized, so the model space hit is the world space one
+    glm::mat4 toLocal = glm::inverse(entities.worldMatrix(entityIndex));
+    Ray local{};
+    local.origin = glm::vec3(toLocal * glm::vec4(ray.origin, 1.f));
+    local.direction = glm::vec3(toLocal * glm::vec4(ray.direction, 0.f));
+    local.maxDistance = ray.maxDistance;
+    return intersectRayAabb(local, localBounds[item], distance);
+  });
+  // the hit item is still alive, its test above passed
+  return found && findEntity(entities, hit.item, hit.item);
+}
+
+Ray makePickRay(const glm::mat4 &projectionView, const glm::vec2 &ndc) {
+  glm::mat4 inverse = glm::inverse(projectionView);
+  glm::vec4 nearPoint = inverse * glm::vec4(ndc.x, ndc.y, 0.f, 1.f);
+  glm::vec4 farPoint = inverse * glm::vec4(ndc.x, ndc.y, 1.f, 1.f);
+  Ray ray{};
+  ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+  ray.direction = glm::vec3(farPoint) / farPoint.w - ray.origin;
+  ray.maxDistance = 1.f;
+  return ray;
+}
+
+}  // namespace learnVulkan
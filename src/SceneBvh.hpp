@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Bvh.hpp"
+#include "EntityRegistry.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <vector>
+
+namespace learnVulkan {
+
+// Bvh over the world space boxes of every entity with a model, the model's bounds moved by
+// the entity's world matrix. Items are the EntityHandle indices of the entities present at
+// setObjects, which unlike dense indices survive the swap of EntityRegistry::destroy:
+// destroyed entities drop out of the results, and the queries translate items back to the
+// current dense indices. Entities created afterwards are only found once setObjects is
+// called again; moving entities only refits the tree.
+class SceneBvh {
+ public:
+  void setObjects(EntityRegistry &entities);
+  // Refits the boxes of every entity whose world matrix changed in the last
+  // EntityRegistry::updateWorldTransforms.
+  void updateChangedObjects(EntityRegistry &entities);
+  // Picks up the new bounds of a model swapped in with EntityRegistry::replaceModel.
+  void updateModel(EntityRegistry &entities, ModelId id);
+
+  // Appends the dense indices of the live entities whose box intersects the frustum.
+  void cullFrustum(
+      const EntityRegistry &entities,
+      const Frustum &frustum,
+      std::vector<uint32_t> &entityIndices) const;
+  // Nearest entity along the ray, tested against its model's bounds in model space, which fit
+  // rotated entities tighter than their world boxes. hit.item is the dense entity index.
+  bool pick(const EntityRegistry &entities, const Ray &ray, RayHit &hit) const;
+
+  const Bvh &getBvh() const { return bvh; }
+
+ private:
+  // the dense index of the entity an item was added for, false once it was destroyed
+  bool findEntity(const EntityRegistry &entities, uint32_t item, uint32_t &entityIndex) const;
+  // the item of a dense index, false for entities not in the tree
+  bool findItem(const EntityRegistry &entities, uint32_t entityIndex, uint32_t &item) const;
+  void refreshObject(const EntityRegistry &entities, uint32_t item, uint32_t entityIndex);
+
+  Bvh bvh;
+  // per EntityHandle::index, of the entity added by setObjects
+  std::vector<uint32_t> itemGenerations;
+  std::vector<Aabb> localBounds;  // of its model
+};
+
+// Ray from the camera through a point given in normalized device coordinates, [-1, 1] with y
+// down as in Vulkan. Distances along it run from 0 at the near plane to 1 at the far plane.
+Ray makePickRay(const glm::mat4 &projectionView, const glm::vec2 &ndc);
+
+}  // namespace learnVulkan
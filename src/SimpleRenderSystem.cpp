@@ -6,9 +6,17 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include "GpuCullingSystem.hpp"
+#include "SceneBvh.hpp"
+#include "SwapChain.hpp"
+
 // std
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstring>
 #include <stdexcept>
 
 namespace learnVulkan {
@@ -16,21 +24,57 @@ namespace learnVulkan {
 struct SimplePushConstantData {
   glm::mat4 transform{1.f};
   alignas(16) glm::vec3 color;
+  // set per model, instanced paths push only this part for every batch
+  alignas(16) PositionDequantization positionDequantization{};
 };
 
+constexpr VkShaderStageFlags PUSH_CONSTANT_STAGES =
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+// Moves the model's bounding sphere into world space the way GpuCullingSystem does, so both
+// paths pick the same level for the same object.
+static uint32_t selectLod(
+    const LodSelector& selector,
+    const Model& model,
+    const glm::mat4& world,
+    const glm::vec3& cameraPosition) {
+  if (selector.getThreshold() < 0.f || model.getLods().size() < 2) {
+    return 0;
+  }
+  const glm::vec4& localSphere = model.getBoundingSphere();
+  float maxScale = glm::max(
+      glm::length(glm::vec3(world[0])),
+      glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+  glm::vec3 center = glm::vec3(world * glm::vec4(glm::vec3(localSphere), 1.f));
+  float distance =
+      distanceToSphere(cameraPosition, glm::vec4(center, localSphere.w * maxScale));
+  return selector.select(model.getLods(), maxScale, distance);
+}
+
+static uint64_t triangleCount(const Model& model, uint32_t lod) {
+  return model.hasIndices() ? model.getLods()[lod].indexCount / 3 : model.getVertexCount() / 3;
+}
+
 SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass)
-    : m_Device{device} {
+    : m_Device{device}, m_RenderPass{renderPass} {
   createPipelineLayout();
-  createPipeline(renderPass);
+  getPipelines(VertexLayout::standard());
+  instanceBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 }
 
 SimpleRenderSystem::~SimpleRenderSystem() {
+  destroyRecorders();
+  for (auto& frameBuffer : instanceBuffers) {
+    if (frameBuffer.buffer != VK_NULL_HANDLE) {
+      m_Device.destroyBuffer(frameBuffer.buffer, frameBuffer.allocation);
+    }
+  }
   vkDestroyPipelineLayout(m_Device.device(), pipelineLayout, nullptr);
 }
 
 void SimpleRenderSystem::createPipelineLayout() {
   VkPushConstantRange pushConstantRange{};
-  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  pushConstantRange.stageFlags = PUSH_CONSTANT_STAGES;
   pushConstantRange.offset = 0;
   pushConstantRange.size = sizeof(SimplePushConstantData);
 
@@ -46,46 +90,712 @@ void SimpleRenderSystem::createPipelineLayout() {
   }
 }
 
-void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+// The depth pre-pass writes depth only, without fragment stage; the color pass after it keeps
+// the depth buffer as it is and shades the fragments matching it.
+void SimpleRenderSystem::configureDrawPass(PipelineConfigInfo& configInfo, DrawPass pass) {
+  if (pass == DrawPass::DepthOnly) {
+    configInfo.colorBlendAttachment.colorWriteMask = 0;
+  } else if (pass == DrawPass::ColorAfterDepth) {
+    configInfo.depthStencilInfo.depthWriteEnable = VK_FALSE;
+    configInfo.depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+  }
+}
+
+std::unique_ptr<Pipeline> SimpleRenderSystem::createPipeline(
+    const VertexLayout& layout, DrawPass pass) {
   assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
   PipelineConfigInfo pipelineConfig{};
   Pipeline::defaultPipelineConfigInfo(pipelineConfig);
-  pipelineConfig.renderPass = renderPass;
+  configureDrawPass(pipelineConfig, pass);
+  pipelineConfig.renderPass = m_RenderPass;
   pipelineConfig.pipelineLayout = pipelineLayout;
-  m_Pipeline = std::make_unique<Pipeline>(
+  pipelineConfig.bindingDescriptions = layout.getBindingDescriptions();
+  pipelineConfig.attributeDescriptions = layout.getAttributeDescriptions();
+  return std::make_unique<Pipeline>(
       m_Device,
       "../src/shaders/compiled/simple_shader.vert.spv",
-      "../src/shaders/compiled/simple_shader.frag.spv",
+      pass == DrawPass::DepthOnly ? "" : "../src/shaders/compiled/simple_shader.frag.spv",
       pipelineConfig);
 }
 
-void SimpleRenderSystem::renderGameObjects(
-    VkCommandBuffer commandBuffer,     
-    std::vector<GameObject>& gameObjects,
-    const Camera& camera) {
-  m_Pipeline->bind(commandBuffer);
+std::unique_ptr<Pipeline> SimpleRenderSystem::createInstancedPipeline(
+    const VertexLayout& layout, DrawPass pass) {
+  assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+  PipelineConfigInfo pipelineConfig{};
+  Pipeline::defaultPipelineConfigInfo(pipelineConfig);
+  configureDrawPass(pipelineConfig, pass);
+  pipelineConfig.renderPass = m_RenderPass;
+  pipelineConfig.pipelineLayout = pipelineLayout;
+  pipelineConfig.bindingDescriptions = layout.getBindingDescriptions();
+  pipelineConfig.attributeDescriptions = layout.getAttributeDescriptions();
+
+  VkVertexInputBindingDescription instanceBinding{};
+  instanceBinding.binding = 1;
+  instanceBinding.stride = sizeof(InstanceData);
+  instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  pipelineConfig.bindingDescriptions.push_back(instanceBinding);
+
+  // a mat4 attribute occupies four consecutive locations, one per column
+  for (uint32_t column = 0; column < 4; column++) {
+    VkVertexInputAttributeDescription attribute{};
+    attribute.binding = 1;
+    attribute.location = 2 + column;
+    attribute.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attribute.offset = offsetof(InstanceData, transform) + sizeof(glm::vec4) * column;
+    pipelineConfig.attributeDescriptions.push_back(attribute);
+  }
+
+  return std::make_unique<Pipeline>(
+      m_Device,
+      "../src/shaders/compiled/instanced_shader.vert.spv",
+      pass == DrawPass::DepthOnly ? "" : "../src/shaders/compiled/simple_shader.frag.spv",
+      pipelineConfig);
+}
+
+const SimpleRenderSystem::LayoutPipelines& SimpleRenderSystem::getPipelines(
+    const VertexLayout& layout) {
+  LayoutPipelines& pipelines = m_Pipelines[layout.key()];
+  if (pipelines.perObject == nullptr) {
+    pipelines.sortId = static_cast<uint32_t>(m_Pipelines.size() - 1);
+    assert(
+        pipelines.sortId < (1u << RenderQueue::PIPELINE_BITS) &&
+        "Too many vertex layouts for the draw sort keys");
+    pipelines.perObject = createPipeline(layout, DrawPass::Color);
+    pipelines.instanced = createInstancedPipeline(layout, DrawPass::Color);
+  }
+  if (depthPrePassEnabled && pipelines.perObjectDepthOnly == nullptr) {
+    pipelines.perObjectDepthOnly = createPipeline(layout, DrawPass::DepthOnly);
+    pipelines.instancedDepthOnly = createInstancedPipeline(layout, DrawPass::DepthOnly);
+    pipelines.perObjectAfterDepth = createPipeline(layout, DrawPass::ColorAfterDepth);
+    pipelines.instancedAfterDepth = createInstancedPipeline(layout, DrawPass::ColorAfterDepth);
+  }
+  return pipelines;
+}
+
+Pipeline* SimpleRenderSystem::LayoutPipelines::select(bool instancedDraw, DrawPass pass) const {
+  switch (pass) {
+    case DrawPass::DepthOnly:
+      return instancedDraw ? instancedDepthOnly.get() : perObjectDepthOnly.get();
+    case DrawPass::ColorAfterDepth:
+      return instancedDraw ? instancedAfterDepth.get() : perObjectAfterDepth.get();
+    default:
+      return instancedDraw ? instanced.get() : perObject.get();
+  }
+}
+
+const SimpleRenderSystem::LayoutPipelines& SimpleRenderSystem::findPipelines(
+    const VertexLayout& layout) const {
+  auto found = m_Pipelines.find(layout.key());
+  assert(found != m_Pipelines.end() && "Pipelines of a vertex layout are created before recording");
+  return found->second;
+}
+
+// Squared distance to the entity's origin is enough to order the draws of one model front to
+// back and saves a square root per entity.
+uint64_t SimpleRenderSystem::makeSortKey(
+    const EntityRegistry& entities,
+    uint32_t entity,
+    uint32_t lod,
+    const glm::vec3& cameraPosition) const {
+  ModelId id = entities.models()[entity];
+  glm::vec3 offset = glm::vec3(entities.worldMatrix(entity)[3]) - cameraPosition;
+  return RenderQueue::makeKey(
+      RenderQueue::Layer::Opaque, modelSortIds[id], id, lod, glm::dot(offset, offset));
+}
+
+void SimpleRenderSystem::pushDequantization(VkCommandBuffer commandBuffer, const Model& model) {
+  vkCmdPushConstants(
+      commandBuffer,
+      pipelineLayout,
+      PUSH_CONSTANT_STAGES,
+      offsetof(SimplePushConstantData, positionDequantization),
+      sizeof(PositionDequantization),
+      &model.getPositionDequantization());
+}
+
+// The frame's previous contents are no longer read by the GPU once beginFrame has waited on
+// its fence, so a frame's own buffer can be replaced in place.
+void SimpleRenderSystem::reserveInstances(FrameInstanceBuffer& frameBuffer, uint32_t instanceCount) {
+  if (instanceCount <= frameBuffer.capacity) {
+    return;
+  }
+  if (frameBuffer.buffer != VK_NULL_HANDLE) {
+    m_Device.destroyBuffer(frameBuffer.buffer, frameBuffer.allocation);
+  }
+
+  uint32_t capacity = std::max(frameBuffer.capacity * 2, 256u);
+  while (capacity < instanceCount) {
+    capacity *= 2;
+  }
+  m_Device.createBuffer(
+      sizeof(InstanceData) * capacity,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      frameBuffer.buffer,
+      frameBuffer.allocation);
+  frameBuffer.capacity = capacity;
+}
+
+void SimpleRenderSystem::setRecordThreadCount(uint32_t threadCount) {
+  assert(threadCount > 0 && "At least one recording thread is required");
+  if (threadCount == recordThreadCount) {
+    return;
+  }
+  // the pools of the old thread count may still back command buffers in flight
+  vkDeviceWaitIdle(m_Device.device());
+  destroyRecorders();
+  recordThreadCount = threadCount;
+  if (threadCount > 1) {
+    createRecorders();
+  }
+}
+
+// Every task gets its own pool per frame in flight: command pools are externally
+// synchronized, and a frame's pool can only be reset once its fence has signalled.
+void SimpleRenderSystem::createRecorders() {
+  QueueFamilyIndices queueFamilyIndices = m_Device.findPhysicalQueueFamilies();
+
+  recorders.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (auto& frameRecorders : recorders) {
+    frameRecorders.resize(recordThreadCount);
+    for (auto& recorder : frameRecorders) {
+      VkCommandPoolCreateInfo poolInfo{};
+      poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+      poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      if (vkCreateCommandPool(m_Device.device(), &poolInfo, nullptr, &recorder.commandPool) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create recording command pool!");
+      }
+
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      allocInfo.commandPool = recorder.commandPool;
+      allocInfo.commandBufferCount = 1;
+      if (vkAllocateCommandBuffers(m_Device.device(), &allocInfo, &recorder.commandBuffer) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate secondary command buffer!");
+      }
+    }
+  }
+  // the calling thread records too, so it takes one of the tasks itself
+  recordPool = std::make_unique<ThreadPool>(recordThreadCount - 1);
+}
+
+void SimpleRenderSystem::destroyRecorders() {
+  recordPool.reset();
+  for (auto& frameRecorders : recorders) {
+    for (auto& recorder : frameRecorders) {
+      // destroying the pool frees its command buffer
+      vkDestroyCommandPool(m_Device.device(), recorder.commandPool, nullptr);
+    }
+  }
+  recorders.clear();
+}
+
+void SimpleRenderSystem::renderEntities(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    EntityRegistry& entities,
+    const Camera& camera,
+    const RecordTarget* recordTarget) {
+  auto recordStart = std::chrono::high_resolution_clock::now();
   auto projectionView = camera.getProjection() * camera.getView();
+  glm::vec3 cameraPosition = glm::vec3(glm::inverse(camera.getView())[3]);
+  updateModelReadiness(entities);
+  if (m_Bvh != nullptr) {
+    candidateEntities.clear();
+    m_Bvh->cullFrustum(entities, Frustum::fromMatrix(projectionView), candidateEntities);
+  }
+
+  // With the depth pre-pass the items [0, drawCount) record the depth only draws and
+  // [drawCount, 2 * drawCount) the same draws again for color. Chunks are executed in order,
+  // so the depth buffer is complete before the first color draw.
+  bool depthPrePass = depthPrePassEnabled;
+  uint32_t drawCount = 0;
+  auto forEachPass = [&](uint32_t first, uint32_t last, const auto& recordPass) {
+    if (!depthPrePass) {
+      recordPass(first, last, DrawPass::Color);
+      return;
+    }
+    if (first < drawCount) {
+      recordPass(first, std::min(last, drawCount), DrawPass::DepthOnly);
+    }
+    if (last > drawCount) {
+      recordPass(
+          std::max(first, drawCount) - drawCount, last - drawCount, DrawPass::ColorAfterDepth);
+    }
+  };
+
+  lastPipelineBindCount = 0;
+  lastModelBindCount = 0;
+  RecordRangeFn recordRange;
+  if (instancingEnabled) {
+    drawCount = drawSortingEnabled ? prepareSortedInstances(frameIndex, entities, cameraPosition)
+                                   : prepareInstanced(frameIndex, entities, cameraPosition);
+    recordRange = [&](VkCommandBuffer buffer, uint32_t first, uint32_t last) {
+      forEachPass(first, last, [&](uint32_t passFirst, uint32_t passLast, DrawPass pass) {
+        recordInstanced(buffer, frameIndex, passFirst, passLast, projectionView, pass);
+      });
+    };
+  } else {
+    drawCount = preparePerObject(entities, cameraPosition);
+    recordRange = [&](VkCommandBuffer buffer, uint32_t first, uint32_t last) {
+      forEachPass(first, last, [&](uint32_t passFirst, uint32_t passLast, DrawPass pass) {
+        recordPerObject(buffer, frameIndex, entities, passFirst, passLast, projectionView, pass);
+      });
+    };
+  }
+  uint32_t itemCount = depthPrePass ? drawCount * 2 : drawCount;
+
+  if (recordThreadCount > 1) {
+    assert(recordTarget != nullptr && "Multithreaded recording needs a record target");
+    recordParallel(commandBuffer, frameIndex, *recordTarget, itemCount, recordRange);
+  } else {
+    recordRange(commandBuffer, 0, itemCount);
+  }
+  // one draw per entity, or per model batch when instanced, in every pass
+  lastDrawCount = itemCount;
+
+  lastRecordMs = std::chrono::duration<float, std::chrono::milliseconds::period>(
+                     std::chrono::high_resolution_clock::now() - recordStart)
+                     .count();
+}
+
+// Splits [0, itemCount) into one contiguous chunk per task. Each task records its chunk into
+// a secondary command buffer from its own pool; the primary then executes them in task order,
+// which keeps the draw order identical to the single threaded path.
+void SimpleRenderSystem::recordParallel(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    const RecordTarget& recordTarget,
+    uint32_t itemCount,
+    const RecordRangeFn& recordRange) {
+  if (itemCount == 0) {
+    return;
+  }
+  uint32_t taskCount = std::min(recordThreadCount, itemCount);
+  uint32_t chunkSize = (itemCount + taskCount - 1) / taskCount;
+  taskCount = (itemCount + chunkSize - 1) / chunkSize;
+
+  std::vector<Recorder>& frameRecorders = recorders[frameIndex];
+  std::atomic<bool> recordFailed{false};
+  recordPool->run(taskCount, [&](uint32_t task) {
+    Recorder& recorder = frameRecorders[task];
+    vkResetCommandPool(m_Device.device(), recorder.commandPool, 0);
 
-  for (auto& obj : gameObjects) {
-    //obj.transform.rotation.y = glm::mod(obj.transform.rotation.y + 0.01f, glm::two_pi<float>());
-    //obj.transform.rotation.x = glm::mod(obj.transform.rotation.x + 0.005f, glm::two_pi<float>());
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = recordTarget.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = recordTarget.framebuffer;
+    inheritanceInfo.pipelineStatistics = recordTarget.pipelineStatistics;
 
-    
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    if (vkBeginCommandBuffer(recorder.commandBuffer, &beginInfo) != VK_SUCCESS) {
+      recordFailed = true;
+      return;
+    }
 
-    SimplePushConstantData push{};    
-    push.color = obj.color;
-    push.transform = projectionView * obj.transform.mat4();
+    // dynamic state is not inherited from the primary
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(recordTarget.extent.width);
+    viewport.height = static_cast<float>(recordTarget.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor{{0, 0}, recordTarget.extent};
+    vkCmdSetViewport(recorder.commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(recorder.commandBuffer, 0, 1, &scissor);
+
+    uint32_t first = task * chunkSize;
+    recordRange(recorder.commandBuffer, first, std::min(first + chunkSize, itemCount));
+
+    if (vkEndCommandBuffer(recorder.commandBuffer) != VK_SUCCESS) {
+      recordFailed = true;
+    }
+  });
+  // exceptions cannot cross the worker threads, so failures are reported from here
+  if (recordFailed) {
+    throw std::runtime_error("failed to record secondary command buffer!");
+  }
+
+  secondaryBuffers.clear();
+  for (uint32_t task = 0; task < taskCount; task++) {
+    secondaryBuffers.push_back(frameRecorders[task].commandBuffer);
+  }
+  vkCmdExecuteCommands(
+      commandBuffer, static_cast<uint32_t>(secondaryBuffers.size()), secondaryBuffers.data());
+}
+
+// Readiness is resolved once per model on the calling thread: Model::isReady polls the
+// upload scheduler, which must not be touched from the recording threads. The same goes for
+// creating the pipelines of a new vertex layout.
+void SimpleRenderSystem::updateModelReadiness(EntityRegistry& entities) {
+  modelReady.resize(entities.getModelCount());
+  modelSortIds.resize(entities.getModelCount());
+  for (ModelId id = 0; id < entities.getModelCount(); id++) {
+    Model& model = entities.getModel(id);
+    modelReady[id] = model.isReady();
+    if (modelReady[id]) {
+      modelSortIds[id] = getPipelines(model.getVertexLayout()).sortId;
+    }
+  }
+}
+
+uint32_t SimpleRenderSystem::getCandidateCount(const EntityRegistry& entities) const {
+  return m_Bvh != nullptr ? static_cast<uint32_t>(candidateEntities.size()) : entities.size();
+}
+
+// Levels of detail are picked here rather than while recording, so the triangle count is
+// known on the calling thread. Sorting then reorders recordEntities and entityLods together.
+uint32_t SimpleRenderSystem::preparePerObject(
+    EntityRegistry& entities, const glm::vec3& cameraPosition) {
+  const ModelId* models = entities.models();
+  recordEntities.clear();
+  entityLods.clear();
+  renderQueue.clear();
+  lastTriangleCount = 0;
+  uint32_t candidateCount = getCandidateCount(entities);
+  for (uint32_t candidate = 0; candidate < candidateCount; candidate++) {
+    uint32_t i = candidateAt(candidate);
+    if (models[i] != NO_MODEL && modelReady[models[i]]) {
+      const Model& model = entities.getModel(models[i]);
+      uint32_t lod = selectLod(m_LodSelector, model, entities.worldMatrix(i), cameraPosition);
+      if (drawSortingEnabled) {
+        renderQueue.push(
+            makeSortKey(entities, i, lod, cameraPosition),
+            static_cast<uint32_t>(recordEntities.size()));
+      }
+      recordEntities.push_back(i);
+      entityLods.push_back(lod);
+      lastTriangleCount += triangleCount(model, lod);
+    }
+  }
+
+  uint32_t drawCount = static_cast<uint32_t>(recordEntities.size());
+  if (drawSortingEnabled && drawCount > 1) {
+    renderQueue.sort();
+    sortedEntities.resize(drawCount);
+    sortedLods.resize(drawCount);
+    for (uint32_t i = 0; i < drawCount; i++) {
+      uint32_t item = renderQueue.itemAt(i);
+      sortedEntities[i] = recordEntities[item];
+      sortedLods[i] = entityLods[item];
+    }
+    recordEntities.swap(sortedEntities);
+    entityLods.swap(sortedLods);
+  }
+  return drawCount;
+}
+
+void SimpleRenderSystem::recordPerObject(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    EntityRegistry& entities,
+    uint32_t first,
+    uint32_t last,
+    const glm::mat4& projectionView,
+    DrawPass pass) {
+  if (first == last) {
+    return;
+  }
+
+  const ModelId* models = entities.models();
+  const glm::vec3* colors = entities.colors();
+  Pipeline* boundPipeline = nullptr;
+  const Model* boundModel = nullptr;
+  uint32_t pipelineBinds = 0;
+  uint32_t modelBinds = 0;
+  for (uint32_t i = first; i < last; i++) {
+    uint32_t entity = recordEntities[i];
+    Model& model = entities.getModel(models[entity]);
+    Pipeline* pipeline = findPipelines(model.getVertexLayout()).select(false, pass);
+    if (pipeline != boundPipeline) {
+      pipeline->bind(commandBuffer);
+      boundPipeline = pipeline;
+      pipelineBinds++;
+    }
+
+    SimplePushConstantData push{};
+    push.color = colors[entity];
+    push.transform = projectionView * entities.worldMatrix(entity);
+    push.positionDequantization = model.getPositionDequantization();
 
     vkCmdPushConstants(
         commandBuffer,
         pipelineLayout,
-        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+        PUSH_CONSTANT_STAGES,
         0,
         sizeof(SimplePushConstantData),
         &push);
-    obj.model->bind(commandBuffer);
-    obj.model->draw(commandBuffer);
+    // vertex and index buffer bindings survive pipeline changes
+    if (&model != boundModel) {
+      model.bind(commandBuffer, frameIndex);
+      boundModel = &model;
+      modelBinds++;
+    }
+    model.draw(commandBuffer, 1, 0, entityLods[i]);
+  }
+  lastPipelineBindCount += pipelineBinds;
+  lastModelBindCount += modelBinds;
+}
+
+// Entities are bucketed by model id and level of detail with two linear passes over the
+// dense arrays: one to count instances per bucket, one to write each instance into its
+// bucket's contiguous range.
+uint32_t SimpleRenderSystem::prepareInstanced(
+    int frameIndex, EntityRegistry& entities, const glm::vec3& cameraPosition) {
+  const ModelId* models = entities.models();
+  const glm::vec3* colors = entities.colors();
+
+  batchOfModel.assign(entities.getModelCount() * MAX_MESH_LODS, NO_BATCH);
+  batches.clear();
+  entityLods.resize(entities.size());
+  uint32_t candidateCount = getCandidateCount(entities);
+  for (uint32_t candidate = 0; candidate < candidateCount; candidate++) {
+    uint32_t i = candidateAt(candidate);
+    ModelId id = models[i];
+    if (id == NO_MODEL || !modelReady[id]) {
+      continue;
+    }
+    Model& model = entities.getModel(id);
+    uint32_t lod = selectLod(m_LodSelector, model, entities.worldMatrix(i), cameraPosition);
+    entityLods[i] = lod;
+    uint32_t& batchIndex = batchOfModel[id * MAX_MESH_LODS + lod];
+    if (batchIndex == NO_BATCH) {
+      batchIndex = static_cast<uint32_t>(batches.size());
+      batches.push_back({&model, lod, 0, 0});
+    }
+    batches[batchIndex].instanceCount++;
+  }
+  lastTriangleCount = 0;
+  if (batches.empty()) {
+    return 0;
+  }
+
+  uint32_t totalInstances = 0;
+  for (auto& batch : batches) {
+    lastTriangleCount += triangleCount(*batch.model, batch.lod) * batch.instanceCount;
+    batch.firstInstance = totalInstances;
+    totalInstances += batch.instanceCount;
+    batch.instanceCount = 0;  // reused as the write cursor below
+  }
+
+  FrameInstanceBuffer& frameBuffer = instanceBuffers[frameIndex];
+  reserveInstances(frameBuffer, totalInstances);
+  auto* instances = static_cast<InstanceData*>(frameBuffer.allocation.mappedData);
+  for (uint32_t candidate = 0; candidate < candidateCount; candidate++) {
+    uint32_t i = candidateAt(candidate);
+    ModelId id = models[i];
+    if (id == NO_MODEL || !modelReady[id]) {
+      continue;
+    }
+    InstanceBatch& batch = batches[batchOfModel[id * MAX_MESH_LODS + entityLods[i]]];
+    InstanceData& instance = instances[batch.firstInstance + batch.instanceCount++];
+    instance.transform = entities.worldMatrix(i);
+    instance.color = glm::vec4(colors[i], 1.f);
+  }
+  return static_cast<uint32_t>(batches.size());
+}
+
+// Sorted, the instances of a model and level of detail are one run of the queue: each run
+// becomes a batch, in key order, with its instances written front to back.
+uint32_t SimpleRenderSystem::prepareSortedInstances(
+    int frameIndex, EntityRegistry& entities, const glm::vec3& cameraPosition) {
+  const ModelId* models = entities.models();
+  const glm::vec3* colors = entities.colors();
+
+  renderQueue.clear();
+  entityLods.resize(entities.size());
+  uint32_t candidateCount = getCandidateCount(entities);
+  for (uint32_t candidate = 0; candidate < candidateCount; candidate++) {
+    uint32_t i = candidateAt(candidate);
+    ModelId id = models[i];
+    if (id == NO_MODEL || !modelReady[id]) {
+      continue;
+    }
+    uint32_t lod =
+        selectLod(m_LodSelector, entities.getModel(id), entities.worldMatrix(i), cameraPosition);
+    entityLods[i] = lod;
+    renderQueue.push(makeSortKey(entities, i, lod, cameraPosition), i);
+  }
+  renderQueue.sort();
+
+  batches.clear();
+  lastTriangleCount = 0;
+  uint32_t totalInstances = renderQueue.size();
+  if (totalInstances == 0) {
+    return 0;
+  }
+
+  FrameInstanceBuffer& frameBuffer = instanceBuffers[frameIndex];
+  reserveInstances(frameBuffer, totalInstances);
+  auto* instances = static_cast<InstanceData*>(frameBuffer.allocation.mappedData);
+  for (uint32_t instance = 0; instance < totalInstances; instance++) {
+    uint32_t i = renderQueue.itemAt(instance);
+    Model* model = &entities.getModel(models[i]);
+    uint32_t lod = entityLods[i];
+    if (batches.empty() || batches.back().model != model || batches.back().lod != lod) {
+      batches.push_back({model, lod, instance, 0});
+    }
+    batches.back().instanceCount++;
+    lastTriangleCount += triangleCount(*model, lod);
+    instances[instance].transform = entities.worldMatrix(i);
+    instances[instance].color = glm::vec4(colors[i], 1.f);
+  }
+  return static_cast<uint32_t>(batches.size());
+}
+
+void SimpleRenderSystem::recordInstanced(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    uint32_t first,
+    uint32_t last,
+    const glm::mat4& projectionView,
+    DrawPass pass) {
+  if (first == last) {
+    return;
+  }
+
+  // push constants and bindings stay valid across pipelines sharing the layout
+  SimplePushConstantData push{};
+  push.transform = projectionView;
+  vkCmdPushConstants(
+      commandBuffer,
+      pipelineLayout,
+      PUSH_CONSTANT_STAGES,
+      0,
+      sizeof(SimplePushConstantData),
+      &push);
+
+  VkBuffer instanceBuffer = instanceBuffers[frameIndex].buffer;
+  VkDeviceSize instanceOffset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+
+  Pipeline* boundPipeline = nullptr;
+  const Model* boundModel = nullptr;
+  uint32_t pipelineBinds = 0;
+  uint32_t modelBinds = 0;
+  for (uint32_t i = first; i < last; i++) {
+    InstanceBatch& batch = batches[i];
+    Pipeline* pipeline = findPipelines(batch.model->getVertexLayout()).select(true, pass);
+    if (pipeline != boundPipeline) {
+      pipeline->bind(commandBuffer);
+      boundPipeline = pipeline;
+      pipelineBinds++;
+    }
+    // consecutive levels of detail of one model share its buffers and dequantization
+    if (batch.model != boundModel) {
+      pushDequantization(commandBuffer, *batch.model);
+      batch.model->bind(commandBuffer, frameIndex);
+      boundModel = batch.model;
+      modelBinds++;
+    }
+    batch.model->draw(commandBuffer, batch.instanceCount, batch.firstInstance, batch.lod);
+  }
+  lastPipelineBindCount += pipelineBinds;
+  lastModelBindCount += modelBinds;
+}
+
+void SimpleRenderSystem::renderIndirect(
+    VkCommandBuffer commandBuffer,
+    int frameIndex,
+    GpuCullingSystem& cullingSystem,
+    const Camera& camera,
+    bool latePass) {
+  lastDrawCount = 0;
+  lastPipelineBindCount = 0;
+  lastModelBindCount = 0;
+  if (cullingSystem.getObjectCount() == 0) {
+    return;
+  }
+
+  SimplePushConstantData push{};
+  push.transform = camera.getProjection() * camera.getView();
+  vkCmdPushConstants(
+      commandBuffer,
+      pipelineLayout,
+      PUSH_CONSTANT_STAGES,
+      0,
+      sizeof(SimplePushConstantData),
+      &push);
+  Pipeline* boundPipeline = nullptr;
+
+  // Every batch starts its instances at firstInstance 0 with the vertex buffer offset to its
+  // range, which keeps the path free of the drawIndirectFirstInstance feature. Batches whose
+  // model is culled entirely still issue a draw, with an instanceCount of zero. With levels of
+  // detail a batch has one command per level; multi draw covers them in one call, otherwise
+  // each level is drawn with the offset to its own range. Batches culled per meshlet are the
+  // exception: their commands name the instance themselves and are drawn in as few multi
+  // draws as maxDrawIndirectCount allows. The late pass reads the second half of the commands
+  // and instances.
+  VkDeviceSize drawBase = latePass ? cullingSystem.getLateDrawOffset() : 0;
+  uint32_t instanceBase = latePass ? cullingSystem.getLateInstanceOffset() : 0;
+  VkBuffer instanceBuffer = cullingSystem.getInstanceBuffer(frameIndex);
+  VkBuffer drawBuffer = cullingSystem.getDrawBuffer(frameIndex);
+  VkBuffer meshletDrawBuffer = cullingSystem.getMeshletDrawBuffer(frameIndex);
+  uint32_t maxDrawCount = m_Device.properties.limits.maxDrawIndirectCount;
+  for (const auto& batch : cullingSystem.getBatches()) {
+    if (!batch.model->isReady() || (latePass && batch.meshletCount > 0)) {
+      continue;
+    }
+    Pipeline* pipeline = getPipelines(batch.model->getVertexLayout()).instanced.get();
+    if (pipeline != boundPipeline) {
+      pipeline->bind(commandBuffer);
+      boundPipeline = pipeline;
+      lastPipelineBindCount++;
+    }
+    lastModelBindCount++;
+    pushDequantization(commandBuffer, *batch.model);
+    uint32_t batchScope =
+        m_Profiler != nullptr ? m_Profiler->beginGpuScope(commandBuffer, "draw batch") : 0;
+    if (batch.meshletCount > 0) {
+      VkDeviceSize instanceOffset = 0;
+      vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+      batch.model->bind(commandBuffer, frameIndex);
+      uint32_t commandCount = batch.objectCount * batch.meshletCount;
+      for (uint32_t first = 0; first < commandCount; first += maxDrawCount) {
+        vkCmdDrawIndexedIndirect(
+            commandBuffer,
+            meshletDrawBuffer,
+            batch.meshletDrawOffset + sizeof(VkDrawIndexedIndirectCommand) * first,
+            std::min(maxDrawCount, commandCount - first),
+            sizeof(VkDrawIndexedIndirectCommand));
+        lastDrawCount++;
+      }
+    } else if (!batch.model->hasIndices()) {
+      VkDeviceSize instanceOffset = sizeof(InstanceData) * (instanceBase + batch.instanceBase);
+      vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+      batch.model->bind(commandBuffer, frameIndex);
+      vkCmdDrawIndirect(commandBuffer, drawBuffer, drawBase + batch.drawOffset, 1, 0);
+      lastDrawCount++;
+    } else {
+      batch.model->bind(commandBuffer, frameIndex);
+      uint32_t lodCount = cullingSystem.isLodSelectionActive() ? batch.lodCount : 1;
+      uint32_t drawsPerCall = m_Device.supportsMultiDrawIndirect() ? lodCount : 1;
+      for (uint32_t lod = 0; lod < lodCount; lod += drawsPerCall) {
+        VkDeviceSize instanceOffset =
+            sizeof(InstanceData) * (instanceBase + batch.instanceBase + lod * batch.objectCount);
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+        vkCmdDrawIndexedIndirect(
+            commandBuffer,
+            drawBuffer,
+            drawBase + batch.drawOffset + sizeof(VkDrawIndexedIndirectCommand) * lod,
+            drawsPerCall,
+            sizeof(VkDrawIndexedIndirectCommand));
+        lastDrawCount++;
+      }
+    }
+    if (m_Profiler != nullptr) {
+      m_Profiler->endGpuScope(commandBuffer, batchScope);
+    }
   }
 }
 
@@ -1,35 +1,251 @@
 #pragma once
 
 #include "Device.hpp"
-#include "GameObject.hpp"
+#include "EntityRegistry.hpp"
+#include "MeshLod.hpp"
 #include "Pipeline.hpp"
 #include "Camera.hpp"
+#include "Profiler.hpp"
+#include "RenderQueue.hpp"
+#include "ThreadPool.hpp"
 
 // std
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace learnVulkan {
+    class GpuCullingSystem;
+    class SceneBvh;
+
+    // Per-instance vertex data of the instanced paths, also written by the culling shader.
+    // Color travels with the instance just as it does in the push constants; the current
+    // shaders only read the transform.
+    struct InstanceData {
+      glm::mat4 transform{1.f};
+      glm::vec4 color{};
+    };
+
     class SimpleRenderSystem {
     public:
+    // Pipelines are created per vertex layout the first time a model using it is drawn; those
+    // of the standard layout right away.
     SimpleRenderSystem(Device &device, VkRenderPass renderPass);
     ~SimpleRenderSystem();
 
     SimpleRenderSystem(const SimpleRenderSystem &) = delete;
     SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
-    void renderGameObjects(
+    // Where secondary command buffers recorded by worker threads will be executed.
+    struct RecordTarget {
+      VkRenderPass renderPass;
+      VkFramebuffer framebuffer;
+      VkExtent2D extent;
+      // statistics of a query active around the render pass, see
+      // OverdrawCounter::getInheritedStatistics
+      VkQueryPipelineStatisticFlags pipelineStatistics = 0;
+    };
+
+    // Draws every entity with a model, using the world matrices cached by
+    // EntityRegistry::updateWorldTransforms, in the order of a RenderQueue unless sorting is
+    // disabled. With more than one recording thread the draws are
+    // recorded into secondary command buffers: begin the render pass with
+    // getSubpassContents() and pass a recordTarget.
+    void renderEntities(
+      VkCommandBuffer commandBuffer,
+      int frameIndex,
+      EntityRegistry &entities,
+      const Camera &camera,
+      const RecordTarget *recordTarget = nullptr);
+
+    // Draws what GpuCullingSystem::cull left visible for this frame, or with latePass what
+    // GpuCullingSystem::cullLate found visible after the occlusion test. Objects culled per
+    // meshlet are drawn by the early pass only.
+    void renderIndirect(
       VkCommandBuffer commandBuffer,
-      std::vector<GameObject> &gameObjects,
-      const Camera &camera);
+      int frameIndex,
+      GpuCullingSystem &cullingSystem,
+      const Camera &camera,
+      bool latePass = false);
+
+    // Instanced rendering groups objects by model and draws each group with one call.
+    void setInstancingEnabled(bool enabled) { instancingEnabled = enabled; }
+    bool isInstancingEnabled() const { return instancingEnabled; }
+
+    // renderEntities sorts its draws by pipeline, model and level of detail, and within those
+    // front to back, so state changes are few and near surfaces hide the ones behind them
+    // early. Instanced batches keep their instances front to back. Disabled, draws follow
+    // the entity order.
+    void setDrawSortingEnabled(bool enabled) { drawSortingEnabled = enabled; }
+    bool isDrawSortingEnabled() const { return drawSortingEnabled; }
+
+    // With the depth pre-pass renderEntities first draws everything into the depth buffer
+    // without fragment shading, then draws the colors testing LESS_OR_EQUAL against it, so
+    // every pixel is shaded once. Worth it when fragments are expensive and overdraw is high;
+    // it draws the geometry twice. Relies on both vertex shaders declaring gl_Position
+    // invariant, so the two passes compute bit-identical depths; the Shaders build target
+    // recompiles their SPIR-V.
+    void setDepthPrePassEnabled(bool enabled) { depthPrePassEnabled = enabled; }
+    bool isDepthPrePassEnabled() const { return depthPrePassEnabled; }
+
+    // renderEntities draws each entity at the level of detail the selector picks for its
+    // model's bounding sphere; the default selector keeps LOD 0. renderIndirect draws what
+    // GpuCullingSystem::setLodSelector picked instead.
+    void setLodSelector(const LodSelector &selector) { m_LodSelector = selector; }
+
+    // With a SceneBvh, renderEntities only considers the entities whose world box the BVH finds
+    // in the camera frustum instead of walking all of them. Entities the BVH does not know,
+    // e.g. those created after its last SceneBvh::setObjects, are then not drawn.
+    void setBvh(const SceneBvh *bvh) { m_Bvh = bvh; }
+
+    // Waits for the device to go idle, call it between frames.
+    void setRecordThreadCount(uint32_t threadCount);
+    uint32_t getRecordThreadCount() const { return recordThreadCount; }
+    VkSubpassContents getSubpassContents() const {
+      return recordThreadCount > 1 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                   : VK_SUBPASS_CONTENTS_INLINE;
+    }
+    // CPU time spent in the last renderEntities call
+    float getLastRecordMs() const { return lastRecordMs; }
+    // draw calls recorded by the last renderEntities or renderIndirect call, the depth
+    // pre-pass included
+    uint32_t getLastDrawCount() const { return lastDrawCount; }
+    // triangles drawn by the last renderEntities call, once even with the depth pre-pass
+    uint64_t getLastTriangleCount() const { return lastTriangleCount; }
+    // pipeline and vertex buffer binds recorded by the last renderEntities or renderIndirect
+    // call; every secondary command buffer starts without any state bound
+    uint32_t getLastPipelineBindCount() const { return lastPipelineBindCount; }
+    uint32_t getLastModelBindCount() const { return lastModelBindCount; }
+    // With a profiler, renderIndirect wraps every draw batch in a GPU timestamp scope.
+    void setProfiler(Profiler *profiler) { m_Profiler = profiler; }
 
     private:
+    struct InstanceBatch {
+      Model *model;
+      uint32_t lod;
+      uint32_t firstInstance;
+      uint32_t instanceCount;
+    };
+
+    struct FrameInstanceBuffer {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      Allocation allocation{};
+      uint32_t capacity = 0;
+    };
+
+    enum class DrawPass { Color, DepthOnly, ColorAfterDepth };
+
+    // one pipeline pair per vertex layout in use, plus the pairs of the depth pre-pass once
+    // it was enabled
+    struct LayoutPipelines {
+      uint32_t sortId;  // dense, the pipeline field of the sort keys
+      std::unique_ptr<Pipeline> perObject;
+      std::unique_ptr<Pipeline> instanced;
+      std::unique_ptr<Pipeline> perObjectDepthOnly;
+      std::unique_ptr<Pipeline> instancedDepthOnly;
+      std::unique_ptr<Pipeline> perObjectAfterDepth;
+      std::unique_ptr<Pipeline> instancedAfterDepth;
+
+      Pipeline *select(bool instancedDraw, DrawPass pass) const;
+    };
+
+    struct Recorder {
+      VkCommandPool commandPool = VK_NULL_HANDLE;
+      VkCommandBuffer commandBuffer = VK_NULL_HANDLE;  // secondary
+    };
+
+    // records the items [first, last) of the prepared frame into a command buffer
+    using RecordRangeFn = std::function<void(VkCommandBuffer, uint32_t, uint32_t)>;
+
     void createPipelineLayout();
-    void createPipeline(VkRenderPass renderPass);
+    static void configureDrawPass(PipelineConfigInfo &configInfo, DrawPass pass);
+    std::unique_ptr<Pipeline> createPipeline(const VertexLayout &layout, DrawPass pass);
+    std::unique_ptr<Pipeline> createInstancedPipeline(const VertexLayout &layout, DrawPass pass);
+    // creates the layout's pipelines when missing, main thread only
+    const LayoutPipelines &getPipelines(const VertexLayout &layout);
+    // recording threads only read pipelines that getPipelines created beforehand
+    const LayoutPipelines &findPipelines(const VertexLayout &layout) const;
+    void pushDequantization(VkCommandBuffer commandBuffer, const Model &model);
+    void reserveInstances(FrameInstanceBuffer &frameBuffer, uint32_t instanceCount);
+
+    void createRecorders();
+    void destroyRecorders();
+
+    void recordParallel(
+      VkCommandBuffer commandBuffer,
+      int frameIndex,
+      const RecordTarget &recordTarget,
+      uint32_t itemCount,
+      const RecordRangeFn &recordRange);
+    void updateModelReadiness(EntityRegistry &entities);
+    // the prepare functions walk the candidate entities, or all of them without a BVH
+    uint32_t getCandidateCount(const EntityRegistry &entities) const;
+    uint32_t candidateAt(uint32_t index) const {
+      return m_Bvh != nullptr ? candidateEntities[index] : index;
+    }
+    uint32_t preparePerObject(EntityRegistry &entities, const glm::vec3 &cameraPosition);
+    void recordPerObject(
+      VkCommandBuffer commandBuffer,
+      int frameIndex,
+      EntityRegistry &entities,
+      uint32_t first,
+      uint32_t last,
+      const glm::mat4 &projectionView,
+      DrawPass pass);
+    uint32_t prepareInstanced(
+      int frameIndex, EntityRegistry &entities, const glm::vec3 &cameraPosition);
+    uint32_t prepareSortedInstances(
+      int frameIndex, EntityRegistry &entities, const glm::vec3 &cameraPosition);
+    void recordInstanced(
+      VkCommandBuffer commandBuffer,
+      int frameIndex,
+      uint32_t first,
+      uint32_t last,
+      const glm::mat4 &projectionView,
+      DrawPass pass);
+    uint64_t makeSortKey(
+      const EntityRegistry &entities,
+      uint32_t entity,
+      uint32_t lod,
+      const glm::vec3 &cameraPosition) const;
 
     Device &m_Device;
 
-    std::unique_ptr<Pipeline> m_Pipeline;
+    VkRenderPass m_RenderPass;
+    std::unordered_map<uint32_t, LayoutPipelines> m_Pipelines;  // by VertexLayout::key
     VkPipelineLayout pipelineLayout;
+    bool depthPrePassEnabled = false;
+
+    bool instancingEnabled = true;
+    std::vector<FrameInstanceBuffer> instanceBuffers;  // one per frame in flight
+    // reused every frame so grouping does not allocate once the scene is stable
+    static constexpr uint32_t NO_BATCH = ~0u;
+    std::vector<uint8_t> modelReady;      // indexed by ModelId
+    std::vector<uint32_t> modelSortIds;   // LayoutPipelines::sortId of each ready model
+    std::vector<uint32_t> batchOfModel;   // indexed by ModelId * MAX_MESH_LODS + lod
+    std::vector<InstanceBatch> batches;
+    std::vector<uint32_t> recordEntities;  // dense indices of the entities to draw
+    std::vector<uint32_t> entityLods;      // level of detail per entity or recordEntities entry
+    bool drawSortingEnabled = true;
+    RenderQueue renderQueue;
+    std::vector<uint32_t> sortedEntities;  // recordEntities and entityLods in queue order
+    std::vector<uint32_t> sortedLods;
+    LodSelector m_LodSelector{};
+    const SceneBvh *m_Bvh = nullptr;
+    std::vector<uint32_t> candidateEntities;  // dense indices the BVH found in the frustum
+
+    uint32_t recordThreadCount = 1;
+    std::unique_ptr<ThreadPool> recordPool;
+    std::vector<std::vector<Recorder>> recorders;  // [frame in flight][task]
+    std::vector<VkCommandBuffer> secondaryBuffers;
+    float lastRecordMs = 0.f;
+    uint32_t lastDrawCount = 0;
+    uint64_t lastTriangleCount = 0;
+    // added up by the recording threads
+    std::atomic<uint32_t> lastPipelineBindCount{0};
+    std::atomic<uint32_t> lastModelBindCount{0};
+    Profiler *m_Profiler = nullptr;
     };
 }  // namespace learnVulkan
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Device.hpp"
+#include "RenderTarget.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
@@ -11,33 +12,60 @@
 #include <memory>
 namespace learnVulkan {
 
-class SwapChain {
- public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Requested presentation behaviour. The swap chain uses the closest mode the surface supports,
+// falling back to FIFO, which every surface has:
+// Fifo waits for vertical blank, FifoRelaxed tears instead when a frame is late, Mailbox
+// replaces the queued image without tearing, Immediate presents right away and may tear.
+// Uncapped takes whichever of Immediate and Mailbox exists, for throughput measurements.
+enum class PresentMode { Fifo, FifoRelaxed, Mailbox, Immediate, Uncapped };
+
+const char *presentModeName(VkPresentModeKHR mode);
 
-  SwapChain(Device &deviceRef, VkExtent2D windowExtent);
-  SwapChain(Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
-  ~SwapChain();
+class SwapChain : public RenderTarget {
+ public:
+  // Frames in flight are chosen at runtime in [1, MAX_FRAMES_IN_FLIGHT]. Per frame resources
+  // of the render systems are sized for the maximum, so the count can change without
+  // recreating them.
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+  static constexpr int DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+  SwapChain(
+      Device &deviceRef,
+      VkExtent2D windowExtent,
+      uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT,
+      PresentMode presentMode = PresentMode::Mailbox);
+  SwapChain(
+      Device &deviceRef,
+      VkExtent2D windowExtent,
+      std::shared_ptr<SwapChain> previous,
+      uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT,
+      PresentMode presentMode = PresentMode::Mailbox);
+  ~SwapChain() override;
 
   SwapChain(const SwapChain &) = delete;
   SwapChain & operator=(const SwapChain &) = delete;
 
-  VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
-  VkRenderPass getRenderPass() { return renderPass; }
+  VkFramebuffer getFrameBuffer(int index) override { return swapChainFramebuffers[index]; }
+  VkRenderPass getRenderPass() override { return renderPass; }
+  VkRenderPass getLoadRenderPass() override { return loadRenderPass; }
+  VkImage getDepthImage(int index) override { return depthImages[index]; }
+  VkImageView getDepthImageView(int index) override { return depthImageViews[index]; }
+  VkFormat getDepthFormat() override { return swapChainDepthFormat; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
-  VkExtent2D getSwapChainExtent() { return swapChainExtent; }
+  // the mode actually in use, after falling back from the requested one
+  VkPresentModeKHR getPresentMode() const { return activePresentMode; }
+  VkExtent2D getSwapChainExtent() override { return swapChainExtent; }
   uint32_t width() { return swapChainExtent.width; }
   uint32_t height() { return swapChainExtent.height; }
 
-  float extentAspectRatio() {
-    return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
-  }
   VkFormat findDepthFormat();
 
-  VkResult acquireNextImage(uint32_t *imageIndex);
-  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  void waitForFrameSlot() override;
+  VkResult acquireNextImage(uint32_t *imageIndex) override;
+  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex) override;
+  VkResult presentImage(uint32_t *imageIndex) override;
 
   bool compareSwapFormats(const SwapChain& swapChain) const {
     return swapChain.swapChainDepthFormat == swapChainDepthFormat && swapChain.swapChainImageFormat == swapChainImageFormat;
@@ -56,7 +84,7 @@ class SwapChain {
   VkSurfaceFormatKHR chooseSwapSurfaceFormat(
       const std::vector<VkSurfaceFormatKHR> &availableFormats);
   VkPresentModeKHR chooseSwapPresentMode(
-      const std::vector<VkPresentModeKHR> &availablePresentModes);
+      const std::vector<VkPresentModeKHR> &availablePresentModes) const;
   VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
   VkFormat swapChainImageFormat;
@@ -65,15 +93,19 @@ class SwapChain {
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
   VkRenderPass renderPass;
+  VkRenderPass loadRenderPass;
 
   std::vector<VkImage> depthImages;
-  std::vector<VkDeviceMemory> depthImageMemorys;
+  std::vector<Allocation> depthImageAllocations;
   std::vector<VkImageView> depthImageViews;
   std::vector<VkImage> swapChainImages;
   std::vector<VkImageView> swapChainImageViews;
 
   Device &device;
   VkExtent2D windowExtent;
+  uint32_t framesInFlight;
+  PresentMode requestedPresentMode;
+  VkPresentModeKHR activePresentMode = VK_PRESENT_MODE_FIFO_KHR;
 
   VkSwapchainKHR swapChain;
 
@@ -0,0 +1,69 @@
+#include "ThreadPool.hpp"
+
+namespace learnVulkan {
+
+ThreadPool::ThreadPool(uint32_t workerCount) {
+  workers.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; i++) {
+    workers.emplace_back([this] { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stopping = true;
+  }
+  workAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(uint32_t count, const std::function<void(uint32_t)> &task) {
+  if (count == 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock{mutex};
+  currentTask = &task;
+  taskCount = count;
+  nextTask = 0;
+  finishedTasks = 0;
+  generation++;
+  workAvailable.notify_all();
+
+  runTasks(lock);
+  workDone.wait(lock, [this] { return finishedTasks == taskCount; });
+  currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+  uint64_t seenGeneration = 0;
+  std::unique_lock<std::mutex> lock{mutex};
+  while (true) {
+    workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+    if (stopping) {
+      return;
+    }
+    seenGeneration = generation;
+    runTasks(lock);
+  }
+}
+
+// Claims task indices until none are left. The lock is only held while claiming, never while
+// a task runs.
+void ThreadPool::runTasks(std::unique_lock<std::mutex> &lock) {
+  while (currentTask != nullptr && nextTask < taskCount) {
+    uint32_t index = nextTask++;
+    const auto &task = *currentTask;
+    lock.unlock();
+    task(index);
+    lock.lock();
+    if (++finishedTasks == taskCount) {
+      workDone.notify_all();
+    }
+  }
+}
+
+}  // namespace learnVulkan
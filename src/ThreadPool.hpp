@@ -0,0 +1,47 @@
+#pragma once
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace learnVulkan {
+
+// Fixed set of worker threads running index based task lists. The calling thread takes part
+// in every run, so a pool of N threads executes on N + 1 threads in total.
+class ThreadPool {
+ public:
+  explicit ThreadPool(uint32_t workerCount);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+  // Calls task(i) for every i in [0, taskCount) and returns once all of them have finished.
+  // Each index runs exactly once, on any thread. Not reentrant.
+  void run(uint32_t taskCount, const std::function<void(uint32_t)> &task);
+
+ private:
+  void workerLoop();
+  void runTasks(std::unique_lock<std::mutex> &lock);
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable workAvailable;
+  std::condition_variable workDone;
+
+  // state of the current run, guarded by mutex
+  const std::function<void(uint32_t)> *currentTask = nullptr;
+  uint32_t taskCount = 0;
+  uint32_t nextTask = 0;
+  uint32_t finishedTasks = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+};
+
+}  // namespace learnVulkan
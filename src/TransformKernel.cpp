@@ -0,0 +1,113 @@
+#include "TransformKernel.hpp"
+
+#include "GameObject.hpp"
+#include "TransformKernelSimd.hpp"
+
+#if defined(LEARN_VULKAN_X86) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace learnVulkan {
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "kernels expect packed vec3");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "kernels expect packed mat4");
+
+static SimdLevel queryCpuSimdLevel() {
+#if defined(LEARN_VULKAN_X86) && defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool fma = (info[2] & (1 << 12)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  bool avx2 = false;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+  // the OS has to save the upper halves of the ymm registers on context switches
+  bool osSavesYmm = osxsave && (_xgetbv(0) & 6) == 6;
+  if (avx && avx2 && fma && osSavesYmm) {
+    return SimdLevel::Avx2;
+  }
+  return sse2 ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#elif defined(LEARN_VULKAN_X86)
+  // libgcc's feature probe also checks that the OS enabled the AVX state
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return SimdLevel::Avx2;
+  }
+  return __builtin_cpu_supports("sse2") ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel detectSimdLevel() {
+  static const SimdLevel level = queryCpuSimdLevel();
+  return level;
+}
+
+const char *simdLevelName(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::Avx2:
+      return "avx2";
+    case SimdLevel::Sse2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
+
+void computeTransforms(
+    const glm::vec3 *translations,
+    const glm::vec3 *rotations,
+    const glm::vec3 *scales,
+    uint32_t count,
+    const glm::mat4 &projectionView,
+    glm::mat4 *world,
+    glm::mat4 *mvp) {
+  computeTransforms(
+      detectSimdLevel(), translations, rotations, scales, count, projectionView, world, mvp);
+}
+
+void computeTransforms(
+    SimdLevel level,
+    const glm::vec3 *translations,
+    const glm::vec3 *rotations,
+    const glm::vec3 *scales,
+    uint32_t count,
+    const glm::mat4 &projectionView,
+    glm::mat4 *world,
+    glm::mat4 *mvp) {
+  if (count == 0) {
+    return;
+  }
+#ifdef LEARN_VULKAN_X86
+  if (level != SimdLevel::Scalar) {
+    auto kernel = level == SimdLevel::Avx2 ? simd::computeTransformsAvx2
+                                           : simd::computeTransformsSse2;
+    kernel(
+        &translations[0].x,
+        &rotations[0].x,
+        &scales[0].x,
+        count,
+        &projectionView[0][0],
+        &world[0][0][0],
+        mvp != nullptr ? &mvp[0][0][0] : nullptr);
+    return;
+  }
+#endif
+
+  for (uint32_t i = 0; i < count; i++) {
+    world[i] = TransformComponent::compose(translations[i], rotations[i], scales[i]);
+    if (mvp != nullptr) {
+      mvp[i] = projectionView * world[i];
+    }
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,44 @@
+#pragma once
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+
+namespace learnVulkan {
+
+// Instruction sets the batched transform kernel can run on, slowest first.
+enum class SimdLevel { Scalar, Sse2, Avx2 };
+
+// Best level supported by both the CPU and the OS, detected once.
+SimdLevel detectSimdLevel();
+const char *simdLevelName(SimdLevel level);
+
+// Builds world[i] = TransformComponent::compose(translations[i], rotations[i], scales[i]) for
+// count entities and, when mvp is not null, mvp[i] = projectionView * world[i]. The SIMD
+// levels process 4 (SSE2) or 8 (AVX2) entities at a time with a polynomial sincos, which
+// agrees with the scalar path to within a few float ulps for angles of reasonable magnitude.
+void computeTransforms(
+    const glm::vec3 *translations,
+    const glm::vec3 *rotations,
+    const glm::vec3 *scales,
+    uint32_t count,
+    const glm::mat4 &projectionView,
+    glm::mat4 *world,
+    glm::mat4 *mvp);
+
+// Same as above on an explicit level; levels above detectSimdLevel() must not be requested.
+void computeTransforms(
+    SimdLevel level,
+    const glm::vec3 *translations,
+    const glm::vec3 *rotations,
+    const glm::vec3 *scales,
+    uint32_t count,
+    const glm::mat4 &projectionView,
+    glm::mat4 *world,
+    glm::mat4 *mvp);
+
+}  // namespace learnVulkan
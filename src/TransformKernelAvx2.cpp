@@ -0,0 +1,80 @@
+#include "TransformKernelSimd.hpp"
+
+#ifdef LEARN_VULKAN_X86
+
+// Compiled with AVX2 and FMA enabled (see CMakeLists.txt); only reached after
+// detectSimdLevel() confirmed both are usable.
+
+#include "TransformKernelImpl.hpp"
+
+// libs
+#include <immintrin.h>
+
+namespace learnVulkan {
+namespace simd {
+namespace {
+
+struct Avx2Ops {
+  using V = __m256;
+  using I = __m256i;
+  static constexpr uint32_t LANES = 8;
+
+  static V set1(float value) { return _mm256_set1_ps(value); }
+  static V load(const float *src) { return _mm256_load_ps(src); }
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+  static V andp(V a, V b) { return _mm256_and_ps(a, b); }
+  static V andnotp(V a, V b) { return _mm256_andnot_ps(a, b); }
+  static V orp(V a, V b) { return _mm256_or_ps(a, b); }
+  static V xorp(V a, V b) { return _mm256_xor_ps(a, b); }
+
+  static I set1i(int32_t value) { return _mm256_set1_epi32(value); }
+  static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+  static I subi(I a, I b) { return _mm256_sub_epi32(a, b); }
+  static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+  static I andnoti(I a, I b) { return _mm256_andnot_si256(a, b); }
+  static I cmpeqi(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+  static I slli29(I a) { return _mm256_slli_epi32(a, 29); }
+  static I cvtt(V a) { return _mm256_cvttps_epi32(a); }
+  static V cvt(I a) { return _mm256_cvtepi32_ps(a); }
+  static V castToFloat(I a) { return _mm256_castsi256_ps(a); }
+
+  // writes (x[i], y[i], z[i], w[i]) to dst + 16 * i, transposing each 128 bit half
+  static void storeColumns(V x, V y, V z, V w, float *dst) {
+    __m128 x0 = _mm256_castps256_ps128(x), x1 = _mm256_extractf128_ps(x, 1);
+    __m128 y0 = _mm256_castps256_ps128(y), y1 = _mm256_extractf128_ps(y, 1);
+    __m128 z0 = _mm256_castps256_ps128(z), z1 = _mm256_extractf128_ps(z, 1);
+    __m128 w0 = _mm256_castps256_ps128(w), w1 = _mm256_extractf128_ps(w, 1);
+    _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+    _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+    _mm_storeu_ps(dst, x0);
+    _mm_storeu_ps(dst + 16, y0);
+    _mm_storeu_ps(dst + 32, z0);
+    _mm_storeu_ps(dst + 48, w0);
+    _mm_storeu_ps(dst + 64, x1);
+    _mm_storeu_ps(dst + 80, y1);
+    _mm_storeu_ps(dst + 96, z1);
+    _mm_storeu_ps(dst + 112, w1);
+  }
+};
+
+}  // namespace
+
+void computeTransformsAvx2(
+    const float *translations,
+    const float *rotations,
+    const float *scales,
+    uint32_t count,
+    const float *projectionView,
+    float *world,
+    float *mvp) {
+  TransformKernel<Avx2Ops>::run(
+      translations, rotations, scales, count, projectionView, world, mvp);
+}
+
+}  // namespace simd
+}  // namespace learnVulkan
+
+#endif
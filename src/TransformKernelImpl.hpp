@@ -0,0 +1,195 @@
+#pragma once
+
+// Shared body of the SIMD transform kernels, included only by TransformKernelSse2.cpp and
+// TransformKernelAvx2.cpp. Ops supplies the float vector V, the int vector I, LANES and the
+// primitive operations; everything here is written once against that interface.
+
+// std
+#include <cstdint>
+#include <cstring>
+
+namespace learnVulkan {
+namespace simd {
+namespace {
+
+template <typename Ops>
+struct TransformKernel {
+  using V = typename Ops::V;
+  using I = typename Ops::I;
+  static constexpr uint32_t LANES = Ops::LANES;
+
+  // Cephes style sincos: reduce to [-pi/4, pi/4] around the nearest multiple of pi/2, in
+  // three steps so the reduction stays exact, then evaluate the sin and cos minimax
+  // polynomials and swap/negate them per octant.
+  static inline void sincos(V x, V &sinOut, V &cosOut) {
+    const V signMask = Ops::castToFloat(Ops::set1i(static_cast<int32_t>(0x80000000u)));
+
+    V sinSign = Ops::andp(x, signMask);
+    x = Ops::andnotp(signMask, x);
+
+    I octant = Ops::cvtt(Ops::mul(x, Ops::set1(1.27323954473516f)));  // 4 / pi
+    octant = Ops::andi(Ops::addi(octant, Ops::set1i(1)), Ops::set1i(~1));
+    V y = Ops::cvt(octant);
+
+    V sinSwapSign = Ops::castToFloat(Ops::slli29(Ops::andi(octant, Ops::set1i(4))));
+    V cosSign = Ops::castToFloat(
+        Ops::slli29(Ops::andnoti(Ops::subi(octant, Ops::set1i(2)), Ops::set1i(4))));
+    V useSinPoly = Ops::castToFloat(
+        Ops::cmpeqi(Ops::andi(octant, Ops::set1i(2)), Ops::set1i(0)));
+    sinSign = Ops::xorp(sinSign, sinSwapSign);
+
+    x = Ops::fmadd(y, Ops::set1(-0.78515625f), x);
+    x = Ops::fmadd(y, Ops::set1(-2.4187564849853515625e-4f), x);
+    x = Ops::fmadd(y, Ops::set1(-3.77489497744594108e-8f), x);
+
+    V z = Ops::mul(x, x);
+
+    V cosPoly = Ops::set1(2.443315711809948e-5f);
+    cosPoly = Ops::fmadd(cosPoly, z, Ops::set1(-1.388731625493765e-3f));
+    cosPoly = Ops::fmadd(cosPoly, z, Ops::set1(4.166664568298827e-2f));
+    cosPoly = Ops::mul(Ops::mul(cosPoly, z), z);
+    cosPoly = Ops::fmadd(z, Ops::set1(-0.5f), cosPoly);
+    cosPoly = Ops::add(cosPoly, Ops::set1(1.f));
+
+    V sinPoly = Ops::set1(-1.9515295891e-4f);
+    sinPoly = Ops::fmadd(sinPoly, z, Ops::set1(8.3321608736e-3f));
+    sinPoly = Ops::fmadd(sinPoly, z, Ops::set1(-1.6666654611e-1f));
+    sinPoly = Ops::fmadd(Ops::mul(sinPoly, z), x, x);
+
+    V sinValue = Ops::orp(Ops::andp(useSinPoly, sinPoly), Ops::andnotp(useSinPoly, cosPoly));
+    V cosValue = Ops::orp(Ops::andp(useSinPoly, cosPoly), Ops::andnotp(useSinPoly, sinPoly));
+    sinOut = Ops::xorp(sinValue, sinSign);
+    cosOut = Ops::xorp(cosValue, cosSign);
+  }
+
+  // deinterleaves LANES packed xyz triples
+  static inline void loadXyz(const float *src, V &x, V &y, V &z) {
+    alignas(32) float xs[LANES];
+    alignas(32) float ys[LANES];
+    alignas(32) float zs[LANES];
+    for (uint32_t i = 0; i < LANES; i++) {
+      xs[i] = src[3 * i];
+      ys[i] = src[3 * i + 1];
+      zs[i] = src[3 * i + 2];
+    }
+    x = Ops::load(xs);
+    y = Ops::load(ys);
+    z = Ops::load(zs);
+  }
+
+  // Computes exactly LANES entities. pv holds the 16 projection view elements, each
+  // broadcast to all lanes, in column major order.
+  static inline void computeBlock(
+      const float *translations,
+      const float *rotations,
+      const float *scales,
+      const V *pv,
+      float *world,
+      float *mvp) {
+    V tx, ty, tz, rx, ry, rz, sx, sy, sz;
+    loadXyz(translations, tx, ty, tz);
+    loadXyz(rotations, rx, ry, rz);
+    loadXyz(scales, sx, sy, sz);
+
+    V s1, c1, s2, c2, s3, c3;
+    sincos(ry, s1, c1);
+    sincos(rx, s2, c2);
+    sincos(rz, s3, c3);
+
+    // same terms as TransformComponent::compose
+    V s2s3 = Ops::mul(s2, s3);
+    V c3s2 = Ops::mul(c3, s2);
+    V m[3][3];
+    m[0][0] = Ops::mul(sx, Ops::fmadd(s1, s2s3, Ops::mul(c1, c3)));
+    m[0][1] = Ops::mul(sx, Ops::mul(c2, s3));
+    m[0][2] = Ops::mul(sx, Ops::sub(Ops::mul(c1, s2s3), Ops::mul(c3, s1)));
+    m[1][0] = Ops::mul(sy, Ops::sub(Ops::mul(c3s2, s1), Ops::mul(c1, s3)));
+    m[1][1] = Ops::mul(sy, Ops::mul(c2, c3));
+    m[1][2] = Ops::mul(sy, Ops::fmadd(c1, c3s2, Ops::mul(s1, s3)));
+    m[2][0] = Ops::mul(sz, Ops::mul(c2, s1));
+    m[2][1] = Ops::mul(sz, Ops::sub(Ops::set1(0.f), s2));
+    m[2][2] = Ops::mul(sz, Ops::mul(c1, c2));
+
+    const V zero = Ops::set1(0.f);
+    const V one = Ops::set1(1.f);
+    for (uint32_t column = 0; column < 3; column++) {
+      Ops::storeColumns(m[column][0], m[column][1], m[column][2], zero, world + 4 * column);
+    }
+    Ops::storeColumns(tx, ty, tz, one, world + 12);
+
+    if (mvp == nullptr) {
+      return;
+    }
+    // projectionView * world, using that the world matrix has (0, 0, 0, 1) as its last row
+    for (uint32_t column = 0; column < 3; column++) {
+      V rows[4];
+      for (uint32_t row = 0; row < 4; row++) {
+        rows[row] = Ops::fmadd(
+            pv[row],
+            m[column][0],
+            Ops::fmadd(pv[4 + row], m[column][1], Ops::mul(pv[8 + row], m[column][2])));
+      }
+      Ops::storeColumns(rows[0], rows[1], rows[2], rows[3], mvp + 4 * column);
+    }
+    V rows[4];
+    for (uint32_t row = 0; row < 4; row++) {
+      rows[row] = Ops::fmadd(
+          pv[row],
+          tx,
+          Ops::fmadd(pv[4 + row], ty, Ops::fmadd(pv[8 + row], tz, pv[12 + row])));
+    }
+    Ops::storeColumns(rows[0], rows[1], rows[2], rows[3], mvp + 12);
+  }
+
+  static void run(
+      const float *translations,
+      const float *rotations,
+      const float *scales,
+      uint32_t count,
+      const float *projectionView,
+      float *world,
+      float *mvp) {
+    V pv[16];
+    for (uint32_t i = 0; i < 16; i++) {
+      pv[i] = Ops::set1(projectionView[i]);
+    }
+
+    uint32_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+      computeBlock(
+          translations + 3 * i,
+          rotations + 3 * i,
+          scales + 3 * i,
+          pv,
+          world + 16 * i,
+          mvp != nullptr ? mvp + 16 * i : nullptr);
+    }
+    if (i == count) {
+      return;
+    }
+
+    // the tail runs as one padded block through scratch memory
+    uint32_t rest = count - i;
+    float tailInput[3][3 * LANES] = {};
+    float tailWorld[16 * LANES];
+    float tailMvp[16 * LANES];
+    memcpy(tailInput[0], translations + 3 * i, sizeof(float) * 3 * rest);
+    memcpy(tailInput[1], rotations + 3 * i, sizeof(float) * 3 * rest);
+    memcpy(tailInput[2], scales + 3 * i, sizeof(float) * 3 * rest);
+    computeBlock(
+        tailInput[0],
+        tailInput[1],
+        tailInput[2],
+        pv,
+        tailWorld,
+        mvp != nullptr ? tailMvp : nullptr);
+    memcpy(world + 16 * i, tailWorld, sizeof(float) * 16 * rest);
+    if (mvp != nullptr) {
+      memcpy(mvp + 16 * i, tailMvp, sizeof(float) * 16 * rest);
+    }
+  }
+};
+
+}  // namespace
+}  // namespace simd
+}  // namespace learnVulkan
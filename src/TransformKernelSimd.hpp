@@ -0,0 +1,38 @@
+#pragma once
+
+// Entry points of the per instruction set transform kernels. They only see raw floats: the
+// AVX2 translation unit is compiled with different target flags, and sharing inline glm code
+// with it would let the linker pick AVX2 copies for callers on any CPU.
+
+// std
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LEARN_VULKAN_X86 1
+#endif
+
+namespace learnVulkan {
+namespace simd {
+
+// translations, rotations and scales hold count packed xyz triples; projectionView, world and
+// mvp are column major 4x4 matrices. mvp may be null.
+void computeTransformsSse2(
+    const float *translations,
+    const float *rotations,
+    const float *scales,
+    uint32_t count,
+    const float *projectionView,
+    float *world,
+    float *mvp);
+
+void computeTransformsAvx2(
+    const float *translations,
+    const float *rotations,
+    const float *scales,
+    uint32_t count,
+    const float *projectionView,
+    float *world,
+    float *mvp);
+
+}  // namespace simd
+}  // namespace learnVulkan
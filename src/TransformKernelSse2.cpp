@@ -0,0 +1,68 @@
+#include "TransformKernelSimd.hpp"
+
+#ifdef LEARN_VULKAN_X86
+
+#include "TransformKernelImpl.hpp"
+
+// libs
+#include <emmintrin.h>
+
+namespace learnVulkan {
+namespace simd {
+namespace {
+
+struct Sse2Ops {
+  using V = __m128;
+  using I = __m128i;
+  static constexpr uint32_t LANES = 4;
+
+  static V set1(float value) { return _mm_set1_ps(value); }
+  static V load(const float *src) { return _mm_load_ps(src); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V fmadd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static V andp(V a, V b) { return _mm_and_ps(a, b); }
+  static V andnotp(V a, V b) { return _mm_andnot_ps(a, b); }
+  static V orp(V a, V b) { return _mm_or_ps(a, b); }
+  static V xorp(V a, V b) { return _mm_xor_ps(a, b); }
+
+  static I set1i(int32_t value) { return _mm_set1_epi32(value); }
+  static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+  static I subi(I a, I b) { return _mm_sub_epi32(a, b); }
+  static I andi(I a, I b) { return _mm_and_si128(a, b); }
+  static I andnoti(I a, I b) { return _mm_andnot_si128(a, b); }
+  static I cmpeqi(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+  static I slli29(I a) { return _mm_slli_epi32(a, 29); }
+  static I cvtt(V a) { return _mm_cvttps_epi32(a); }
+  static V cvt(I a) { return _mm_cvtepi32_ps(a); }
+  static V castToFloat(I a) { return _mm_castsi128_ps(a); }
+
+  // writes (x[i], y[i], z[i], w[i]) to dst + 16 * i, i.e. one column of every lane's matrix
+  static void storeColumns(V x, V y, V z, V w, float *dst) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(dst, x);
+    _mm_storeu_ps(dst + 16, y);
+    _mm_storeu_ps(dst + 32, z);
+    _mm_storeu_ps(dst + 48, w);
+  }
+};
+
+}  // namespace
+
+void computeTransformsSse2(
+    const float *translations,
+    const float *rotations,
+    const float *scales,
+    uint32_t count,
+    const float *projectionView,
+    float *world,
+    float *mvp) {
+  TransformKernel<Sse2Ops>::run(
+      translations, rotations, scales, count, projectionView, world, mvp);
+}
+
+}  // namespace simd
+}  // namespace learnVulkan
+
+#endif
@@ -0,0 +1,220 @@
+#include "UploadScheduler.hpp"
+
+#include "Device.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace learnVulkan {
+
+// copies are split so one large mesh cannot monopolize the whole ring
+static constexpr VkDeviceSize RING_CHUNK_DIVISOR = 4;
+static constexpr VkDeviceSize RING_ALIGNMENT = 16;
+
+UploadScheduler::UploadScheduler(Device &device, VkDeviceSize ringSize)
+    : device{device}, ringSize{ringSize} {
+  createCommandPool();
+  device.createBuffer(
+      ringSize,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      ringBuffer,
+      ringAllocation);
+}
+
+UploadScheduler::~UploadScheduler() {
+  waitIdle();
+  for (auto &batch : freeBatches) {
+    vkDestroyFence(device.device(), batch.fence, nullptr);
+  }
+  // destroying the pool frees every command buffer allocated from it
+  vkDestroyCommandPool(device.device(), commandPool, nullptr);
+  device.destroyBuffer(ringBuffer, ringAllocation);
+}
+
+void UploadScheduler::createCommandPool() {
+  QueueFamilyIndices queueFamilyIndices = device.findPhysicalQueueFamilies();
+
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+  poolInfo.flags =
+      VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+  if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create upload command pool!");
+  }
+}
+
+UploadTicket UploadScheduler::enqueueBufferUpload(
+    VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+  UploadTicket ticket = completedTicket;
+  const char *src = static_cast<const char *>(data);
+  const VkDeviceSize maxChunk = ringSize / RING_CHUNK_DIVISOR;
+
+  while (size > 0) {
+    VkDeviceSize chunk = std::min(size, maxChunk);
+    VkDeviceSize ringOffset = reserveRingSpace(chunk);
+    memcpy(static_cast<char *>(ringAllocation.mappedData) + ringOffset, src, chunk);
+
+    Batch &batch = openBatch();
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = ringOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = chunk;
+    vkCmdCopyBuffer(batch.commandBuffer, ringBuffer, dstBuffer, 1, &copyRegion);
+
+    ticket = batch.ticket;
+    src += chunk;
+    dstOffset += chunk;
+    size -= chunk;
+  }
+  return ticket;
+}
+
+void UploadScheduler::flush() {
+  if (!batchOpen) {
+    return;
+  }
+  if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("failed to record upload command buffer!");
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &recording.commandBuffer;
+
+  if (vkQueueSubmit(device.transferQueue(), 1, &submitInfo, recording.fence) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit upload command buffer!");
+  }
+
+  recording.ringEnd = ringHead;
+  inFlight.push_back(recording);
+  recording = Batch{};
+  batchOpen = false;
+}
+
+bool UploadScheduler::isComplete(UploadTicket ticket) {
+  if (ticket <= completedTicket) {
+    return true;
+  }
+  retireCompletedBatches();
+  return ticket <= completedTicket;
+}
+
+void UploadScheduler::wait(UploadTicket ticket) {
+  if (batchOpen && ticket >= recording.ticket) {
+    flush();
+  }
+  while (ticket > completedTicket && !inFlight.empty()) {
+    waitForOldestBatch();
+  }
+}
+
+void UploadScheduler::waitIdle() {
+  flush();
+  while (!inFlight.empty()) {
+    waitForOldestBatch();
+  }
+}
+
+// Reserves size bytes in the ring and returns their offset. When the ring is full the
+// current batch is submitted so its space can be recycled, and only as a last resort the
+// oldest batch is waited on.
+VkDeviceSize UploadScheduler::reserveRingSpace(VkDeviceSize size) {
+  if (!batchOpen && inFlight.empty()) {
+    ringHead = ringTail = 0;
+  }
+
+  bool retried = false;
+  while (true) {
+    uint64_t start = (ringHead + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    if (start % ringSize + size > ringSize) {
+      start += ringSize - start % ringSize;
+    }
+    if (start + size - ringTail <= ringSize) {
+      ringHead = start + size;
+      return start % ringSize;
+    }
+
+    flush();
+    if (!retried) {
+      retireCompletedBatches();
+      retried = true;
+    } else {
+      waitForOldestBatch();
+    }
+    if (inFlight.empty()) {
+      ringHead = ringTail = 0;
+    }
+  }
+}
+
+UploadScheduler::Batch &UploadScheduler::openBatch() {
+  if (batchOpen) {
+    return recording;
+  }
+
+  if (!freeBatches.empty()) {
+    recording = freeBatches.back();
+    freeBatches.pop_back();
+    vkResetFences(device.device(), 1, &recording.fence);
+  } else {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device.device(), &allocInfo, &recording.commandBuffer) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(device.device(), &fenceInfo, nullptr, &recording.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload fence!");
+    }
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(recording.commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw std::runtime_error("failed to begin upload command buffer!");
+  }
+
+  recording.ticket = nextTicket++;
+  batchOpen = true;
+  return recording;
+}
+
+// A fence signalled by vkQueueSubmit covers every earlier submission on the queue, so
+// batches retire strictly in submission order.
+void UploadScheduler::retireCompletedBatches() {
+  size_t retired = 0;
+  while (retired < inFlight.size() &&
+         vkGetFenceStatus(device.device(), inFlight[retired].fence) == VK_SUCCESS) {
+    completedTicket = inFlight[retired].ticket;
+    ringTail = inFlight[retired].ringEnd;
+    freeBatches.push_back(inFlight[retired]);
+    retired++;
+  }
+  inFlight.erase(inFlight.begin(), inFlight.begin() + retired);
+}
+
+void UploadScheduler::waitForOldestBatch() {
+  vkWaitForFences(
+      device.device(),
+      1,
+      &inFlight.front().fence,
+      VK_TRUE,
+      std::numeric_limits<uint64_t>::max());
+  retireCompletedBatches();
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "MemoryAllocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+class Device;
+
+// Handed back for every enqueued upload; poll it with UploadScheduler::isComplete.
+using UploadTicket = uint64_t;
+
+// Streams data to device local buffers through a persistently mapped staging ring.
+// Copies are recorded into one command buffer per batch and submitted together on the
+// transfer queue by flush(); each batch signals a fence that retires its ring space.
+class UploadScheduler {
+ public:
+  static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+
+  UploadScheduler(Device &device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+  ~UploadScheduler();
+
+  UploadScheduler(const UploadScheduler &) = delete;
+  UploadScheduler &operator=(const UploadScheduler &) = delete;
+
+  // Copies data into the ring right away and records a copy into dstBuffer. The copy is
+  // submitted with the next flush().
+  UploadTicket enqueueBufferUpload(
+      VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+
+  // Submits every copy recorded since the last flush as a single batch.
+  void flush();
+
+  bool isComplete(UploadTicket ticket);
+  void wait(UploadTicket ticket);
+  void waitIdle();
+
+ private:
+  struct Batch {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    UploadTicket ticket = 0;
+    uint64_t ringEnd = 0;
+  };
+
+  void createCommandPool();
+  VkDeviceSize reserveRingSpace(VkDeviceSize size);
+  Batch &openBatch();
+  void retireCompletedBatches();
+  void waitForOldestBatch();
+
+  Device &device;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+
+  VkBuffer ringBuffer = VK_NULL_HANDLE;
+  Allocation ringAllocation{};
+  VkDeviceSize ringSize;
+  // monotonically increasing byte cursors, wrapped with % ringSize
+  uint64_t ringHead = 0;
+  uint64_t ringTail = 0;
+
+  bool batchOpen = false;
+  Batch recording{};
+  std::vector<Batch> inFlight;  // oldest first
+  std::vector<Batch> freeBatches;
+
+  UploadTicket nextTicket = 1;
+  UploadTicket completedTicket = 0;
+};
+
+}  // namespace learnVulkan
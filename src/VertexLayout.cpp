@@ -0,0 +1,222 @@
+#include "VertexLayout.hpp"
+
+// libs
+#include <glm/gtc/packing.hpp>
+
+// std
+#include <cstring>
+
+namespace learnVulkan {
+
+namespace {
+
+uint32_t positionSize(VertexLayout::Position format) {
+  return format == VertexLayout::Position::Float32 ? 12 : 8;
+}
+
+uint32_t colorSize(VertexLayout::Color format) {
+  return format == VertexLayout::Color::Float32 ? 12 : 4;
+}
+
+uint32_t normalSize(VertexLayout::Normal format) {
+  switch (format) {
+    case VertexLayout::Normal::None:
+      return 0;
+    case VertexLayout::Normal::Float32:
+      return 12;
+    case VertexLayout::Normal::Octahedral:
+      return 4;
+  }
+  return 0;
+}
+
+uint32_t uvSize(VertexLayout::Uv format) {
+  switch (format) {
+    case VertexLayout::Uv::None:
+      return 0;
+    case VertexLayout::Uv::Float32:
+      return 8;
+    case VertexLayout::Uv::Float16:
+      return 4;
+  }
+  return 0;
+}
+
+// attributes are packed in location order: position, color, normal, uv
+struct AttributeOffsets {
+  uint32_t position;
+  uint32_t color;
+  uint32_t normal;
+  uint32_t uv;
+  uint32_t stride;
+};
+
+AttributeOffsets attributeOffsets(const VertexLayout &layout) {
+  AttributeOffsets offsets{};
+  offsets.position = 0;
+  offsets.color = offsets.position + positionSize(layout.position);
+  offsets.normal = offsets.color + colorSize(layout.color);
+  offsets.uv = offsets.normal + normalSize(layout.normal);
+  offsets.stride = offsets.uv + uvSize(layout.uv);
+  return offsets;
+}
+
+glm::vec2 octahedralEncode(glm::vec3 n) {
+  float sum = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+  if (sum == 0.f) {
+    return {0.f, 0.f};
+  }
+  n /= sum;
+  if (n.z >= 0.f) {
+    return {n.x, n.y};
+  }
+  // the lower half is folded over the diagonals of the square
+  return {
+      (1.f - glm::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+      (1.f - glm::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f)};
+}
+
+template <typename T>
+void store(uint8_t *dst, const T &value) {
+  memcpy(dst, &value, sizeof(T));
+}
+
+}  // namespace
+
+VertexLayout VertexLayout::compressed() {
+  return {Position::Snorm16, Color::Unorm8, Normal::Octahedral, Uv::Float16};
+}
+
+VertexLayout VertexLayout::compact() {
+  return {Position::Snorm16, Color::Unorm8, Normal::None, Uv::None};
+}
+
+uint32_t VertexLayout::stride() const { return attributeOffsets(*this).stride; }
+
+uint32_t VertexLayout::key() const {
+  return static_cast<uint32_t>(position) | static_cast<uint32_t>(color) << 8 |
+         static_cast<uint32_t>(normal) << 16 | static_cast<uint32_t>(uv) << 24;
+}
+
+std::vector<VkVertexInputBindingDescription> VertexLayout::getBindingDescriptions() const {
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+  bindingDescriptions[0].binding = 0;
+  bindingDescriptions[0].stride = stride();
+  bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return bindingDescriptions;
+}
+
+// Four component 16 bit formats stand in for three component ones, which few devices can
+// fetch; the shader simply ignores w.
+std::vector<VkVertexInputAttributeDescription> VertexLayout::getAttributeDescriptions() const {
+  AttributeOffsets offsets = attributeOffsets(*this);
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+
+  VkVertexInputAttributeDescription attribute{};
+  attribute.binding = 0;
+  attribute.location = 0;
+  switch (position) {
+    case Position::Float32:
+      attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+      break;
+    case Position::Float16:
+      attribute.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+      break;
+    case Position::Snorm16:
+      attribute.format = VK_FORMAT_R16G16B16A16_SNORM;
+      break;
+  }
+  attribute.offset = offsets.position;
+  attributeDescriptions.push_back(attribute);
+
+  attribute.location = 1;
+  attribute.format =
+      color == Color::Float32 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+  attribute.offset = offsets.color;
+  attributeDescriptions.push_back(attribute);
+
+  if (normal != Normal::None) {
+    attribute.location = 6;
+    attribute.format =
+        normal == Normal::Float32 ? VK_FORMAT_R32G32B32_SFLOAT : VK_FORMAT_R16G16_SNORM;
+    attribute.offset = offsets.normal;
+    attributeDescriptions.push_back(attribute);
+  }
+
+  if (uv != Uv::None) {
+    attribute.location = 7;
+    attribute.format = uv == Uv::Float32 ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R16G16_SFLOAT;
+    attribute.offset = offsets.uv;
+    attributeDescriptions.push_back(attribute);
+  }
+  return attributeDescriptions;
+}
+
+PositionDequantization VertexLayout::dequantization(
+    glm::vec3 boundsMin, glm::vec3 boundsMax) const {
+  PositionDequantization result{};
+  if (position == Position::Float32) {
+    return result;
+  }
+  // halves keep the most precision around zero, so both compressed formats are centered
+  glm::vec3 center = (boundsMin + boundsMax) * .5f;
+  result.offset = glm::vec4(center, 0.f);
+  if (position == Position::Snorm16) {
+    glm::vec3 halfExtent = (boundsMax - boundsMin) * .5f;
+    // a flat axis still needs a scale that can be divided by
+    result.scale = glm::vec4(glm::max(halfExtent, glm::vec3(1e-6f)), 1.f);
+  }
+  return result;
+}
+
+void VertexLayout::encode(
+    const glm::vec3 &positionValue,
+    const glm::vec3 &colorValue,
+    const glm::vec3 &normalValue,
+    const glm::vec2 &uvValue,
+    const PositionDequantization &dequantization,
+    uint8_t *dst) const {
+  AttributeOffsets offsets = attributeOffsets(*this);
+
+  glm::vec3 local = (positionValue - glm::vec3(dequantization.offset)) /
+                    glm::vec3(dequantization.scale);
+  switch (position) {
+    case Position::Float32:
+      store(dst + offsets.position, positionValue);
+      break;
+    case Position::Float16: {
+      uint16_t packed[4] = {
+          glm::packHalf1x16(local.x), glm::packHalf1x16(local.y), glm::packHalf1x16(local.z),
+          glm::packHalf1x16(1.f)};
+      store(dst + offsets.position, packed);
+      break;
+    }
+    case Position::Snorm16: {
+      uint16_t packed[4] = {
+          glm::packSnorm1x16(local.x), glm::packSnorm1x16(local.y), glm::packSnorm1x16(local.z),
+          glm::packSnorm1x16(1.f)};
+      store(dst + offsets.position, packed);
+      break;
+    }
+  }
+
+  if (color == Color::Float32) {
+    store(dst + offsets.color, colorValue);
+  } else {
+    store(dst + offsets.color, glm::packUnorm4x8(glm::vec4(colorValue, 1.f)));
+  }
+
+  if (normal == Normal::Float32) {
+    store(dst + offsets.normal, normalValue);
+  } else if (normal == Normal::Octahedral) {
+    store(dst + offsets.normal, glm::packSnorm2x16(octahedralEncode(normalValue)));
+  }
+
+  if (uv == Uv::Float32) {
+    store(dst + offsets.uv, uvValue);
+  } else if (uv == Uv::Float16) {
+    store(dst + offsets.uv, glm::packHalf2x16(uvValue));
+  }
+}
+
+}  // namespace learnVulkan
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Device.hpp"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace learnVulkan {
+
+// position = fetched * scale + offset in the vertex shader, pushed per mesh
+struct PositionDequantization {
+  glm::vec4 scale{1.f};
+  glm::vec4 offset{0.f};
+};
+
+// How a model's vertices are stored on the GPU. Meshes are built, cached and kept on the CPU
+// as Model::Vertex; the layout only decides the encoding at upload, and pipelines take their
+// vertex input description from it. Every format is fetched as float, so the shaders are the
+// same for all layouts apart from the position dequantization.
+//
+// Locations: 0 position, 1 color, 6 normal, 7 uv (2-5 hold the instance transform). Normals
+// and uvs are carried for later shading and are left out of a layout with None.
+struct VertexLayout {
+  enum class Position : uint8_t {
+    Float32,  // 12 bytes
+    Float16,  // 8 bytes, relative to the mesh center
+    Snorm16,  // 8 bytes, normalized to the mesh bounds; 1/65535 of the extent per step
+  };
+  enum class Color : uint8_t {
+    Float32,  // 12 bytes
+    Unorm8,   // 4 bytes, rgba with alpha 1
+  };
+  enum class Normal : uint8_t {
+    None,
+    Float32,     // 12 bytes
+    Octahedral,  // 4 bytes, two snorm16, see below
+  };
+  enum class Uv : uint8_t {
+    None,
+    Float32,  // 8 bytes
+    Float16,  // 4 bytes
+  };
+
+  Position position = Position::Float32;
+  Color color = Color::Float32;
+  Normal normal = Normal::Float32;
+  Uv uv = Uv::Float32;
+
+  // matches Model::Vertex byte for byte, 44 bytes
+  static VertexLayout standard() { return {}; }
+  // snorm16 positions, rgba8 colors, octahedral normals and half uvs, 20 bytes
+  static VertexLayout compressed();
+  // snorm16 positions and rgba8 colors only, what the current shaders read, 12 bytes
+  static VertexLayout compact();
+
+  uint32_t stride() const;
+  // distinct for every combination of formats, e.g. to key pipeline caches
+  uint32_t key() const;
+  bool operator==(const VertexLayout &other) const { return key() == other.key(); }
+  bool operator!=(const VertexLayout &other) const { return key() != other.key(); }
+
+  std::vector<VkVertexInputBindingDescription> getBindingDescriptions() const;
+  std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() const;
+
+  // Scale and offset that map the bounds onto what the position format stores best.
+  PositionDequantization dequantization(glm::vec3 boundsMin, glm::vec3 boundsMax) const;
+
+  // Writes one vertex, stride() bytes, to dst. Normals are expected to be unit length or zero.
+  // Octahedral normals fold the unit sphere onto a square; a shader decodes them with
+  //   n = vec3(e, 1 - |e.x| - |e.y|); if (n.z < 0) n.xy = (1 - |n.yx|) * sign(n.xy);
+  // followed by normalize(n).
+  void encode(
+      const glm::vec3 &position,
+      const glm::vec3 &color,
+      const glm::vec3 &normal,
+      const glm::vec2 &uv,
+      const PositionDequantization &dequantization,
+      uint8_t *dst) const;
+};
+
+}  // namespace learnVulkan
@@ -1,12 +1,78 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include "App.hpp"
 
-int main() {
-    learnVulkan::App app{};
+// usage: VulkanProject [--headless] [--frames N] [--output frame.png|frame.ppm]
+//                      [--profile] [--trace trace.json]
+//                      [--frames-in-flight 1-4] [--low-latency]
+//                      [--present-mode fifo|fifo-relaxed|mailbox|immediate|uncapped]
+//                      [--mesh file.obj]... [--vertex-layout standard|compressed|compact]
+//                      [--meshlets] [--lod-error PIXELS] [--occlusion]
+static learnVulkan::PresentMode parsePresentMode(const std::string& name) {
+    using learnVulkan::PresentMode;
+    if (name == "fifo") return PresentMode::Fifo;
+    if (name == "fifo-relaxed") return PresentMode::FifoRelaxed;
+    if (name == "mailbox") return PresentMode::Mailbox;
+    if (name == "immediate") return PresentMode::Immediate;
+    if (name == "uncapped") return PresentMode::Uncapped;
+    throw std::invalid_argument("unknown present mode: " + name);
+}
+
+static learnVulkan::VertexLayout parseVertexLayout(const std::string& name) {
+    using learnVulkan::VertexLayout;
+    if (name == "standard") return VertexLayout::standard();
+    if (name == "compressed") return VertexLayout::compressed();
+    if (name == "compact") return VertexLayout::compact();
+    throw std::invalid_argument("unknown vertex layout: " + name);
+}
+
+static learnVulkan::AppConfig parseArguments(int argc, char** argv) {
+    learnVulkan::AppConfig config{};
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            config.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            config.outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            config.profile = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+            config.tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue) {
+            config.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            config.lowLatency = true;
+        } else if (strcmp(argv[i], "--present-mode") == 0 && hasValue) {
+            config.presentMode = parsePresentMode(argv[++i]);
+        } else if (strcmp(argv[i], "--mesh") == 0 && hasValue) {
+            config.meshPaths.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--vertex-layout") == 0 && hasValue) {
+            config.meshLayout = parseVertexLayout(argv[++i]);
+        } else if (strcmp(argv[i], "--meshlets") == 0) {
+            config.meshlets = true;
+        } else if (strcmp(argv[i], "--lod-error") == 0 && hasValue) {
+            config.lodPixelError = std::stof(argv[++i]);
+        } else if (strcmp(argv[i], "--occlusion") == 0) {
+            config.occlusionCulling = true;
+        } else {
+            throw std::invalid_argument(std::string("unknown or incomplete argument: ") + argv[i]);
+        }
+    }
+    if (!config.outputPath.empty() && !config.headless) {
+        throw std::invalid_argument("--output needs --headless");
+    }
+    return config;
+}
+
+int main(int argc, char** argv) {
     try
     {
+        learnVulkan::App app{parseArguments(argc, argv)};
         app.run();
     }
     catch(const std::exception& e)
@@ -16,4 +82,4 @@ int main() {
     }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -14,8 +14,8 @@ SHADER_DIR=$(pwd)
 OUTPUT_DIR="${SHADER_DIR}/compiled"
 mkdir -p "$OUTPUT_DIR"
 
-# Compile all .vert and .frag files
-for SHADER_FILE in "${SHADER_DIR}"/*.{vert,frag}; do
+# Compile all .vert, .frag and .comp files
+for SHADER_FILE in "${SHADER_DIR}"/*.{vert,frag,comp}; do
     if [ -f "$SHADER_FILE" ]; then
         FILENAME=$(basename -- "$SHADER_FILE")
         EXT="${FILENAME##*.}"
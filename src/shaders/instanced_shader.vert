@@ -0,0 +1,26 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+
+// per-instance world transform, one mat4 spans locations 2-5
+layout(location = 2) in mat4 instanceTransform;
+
+layout(location = 0) out vec3 fragColor;
+
+// the depth pre-pass and the color pass after it must produce the same depths
+invariant gl_Position;
+
+layout(push_constant) uniform Push {
+  mat4 transform;  // projection * view for instanced draws
+  vec3 color;
+  // quantized positions of the model's vertex layout, see VertexLayout
+  vec4 positionScale;
+  vec4 positionOffset;
+} push;
+
+void main() {
+  vec3 localPosition = position * push.positionScale.xyz + push.positionOffset.xyz;
+  gl_Position = push.transform * instanceTransform * vec4(localPosition, 1.0);
+  fragColor = color;
+}
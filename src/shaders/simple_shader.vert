@@ -5,12 +5,19 @@ layout(location = 1) in vec3 color;
 
 layout(location = 0) out vec3 fragColor;
 
+// the depth pre-pass and the color pass after it must produce the same depths
+invariant gl_Position;
+
 layout(push_constant) uniform Push {
   mat4 transform;
   vec3 color;
+  // quantized positions of the model's vertex layout, see VertexLayout
+  vec4 positionScale;
+  vec4 positionOffset;
 } push;
 
 void main() {
-  gl_Position = push.transform * vec4(position, 1.0);
+  vec3 localPosition = position * push.positionScale.xyz + push.positionOffset.xyz;
+  gl_Position = push.transform * vec4(localPosition, 1.0);
   fragColor = color;
 }
\ No newline at end of file
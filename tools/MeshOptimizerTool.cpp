@@ -0,0 +1,150 @@
+// Optimizes OBJ meshes offline: reorders triangles for the post transform vertex cache and
+// for overdraw, renumbers vertices for fetch locality, writes the result back as OBJ and
+// refreshes its binary mesh cache together with the level of detail chain, so the engine maps
+// the optimized mesh without reordering or simplifying it at load. Prints the vertex cache
+// statistics before and after, and the levels of detail.
+//
+// usage: MeshOptimizerTool input.obj [--output out.obj] [--overdraw-threshold T]
+//                          [--cache-size N] [--dry-run]
+//
+// Without --output the input file is rewritten. --overdraw-threshold bounds how much worse
+// the ACMR may get for the overdraw order (1 turns it off, default 1.05); --cache-size only
+// changes the FIFO size of the reported statistics (default 16). --dry-run reports without
+// writing anything.
+
+#include "MeshLoader.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace learnVulkan;
+
+namespace {
+
+struct Options {
+  std::string inputPath;
+  std::string outputPath;  // empty: rewrite the input
+  float overdrawThreshold = 1.05f;
+  uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE;
+  bool dryRun = false;
+};
+
+Options parseArguments(int argc, char **argv) {
+  Options options{};
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (strcmp(argv[i], "--output") == 0 && hasValue) {
+      options.outputPath = argv[++i];
+    } else if (strcmp(argv[i], "--overdraw-threshold") == 0 && hasValue) {
+      options.overdrawThreshold = std::stof(argv[++i]);
+    } else if (strcmp(argv[i], "--cache-size") == 0 && hasValue) {
+      options.cacheSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+    } else if (strcmp(argv[i], "--dry-run") == 0) {
+      options.dryRun = true;
+    } else if (argv[i][0] != '-' && options.inputPath.empty()) {
+      options.inputPath = argv[i];
+    } else {
+      throw std::invalid_argument(std::string("unknown or incomplete argument: ") + argv[i]);
+    }
+  }
+
+  if (options.inputPath.empty()) {
+    throw std::invalid_argument("no input file given");
+  }
+  if (options.overdrawThreshold < 1.f) {
+    throw std::invalid_argument("--overdraw-threshold must be at least 1");
+  }
+  if (options.cacheSize < 3) {
+    throw std::invalid_argument("--cache-size must be at least 3");
+  }
+  if (options.outputPath.empty()) {
+    options.outputPath = options.inputPath;
+  }
+  return options;
+}
+
+void printStats(const char *label, const VertexCacheStats &stats) {
+  printf("  %-7s ACMR %.3f  ATVR %.3f\n", label, stats.acmr, stats.atvr);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  try {
+    Options options = parseArguments(argc, argv);
+
+    Model::Builder builder{};
+    loadObj(options.inputPath, builder);
+    uint32_t vertexCount = static_cast<uint32_t>(builder.vertices.size());
+    VertexCacheStats before = analyzeVertexCache(
+        builder.indices.data(), builder.indices.size(), vertexCount, options.cacheSize);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    MeshOptimizationStats stats = optimizeMesh(builder, options.overdrawThreshold);
+    double optimizeMs = std::chrono::duration<double, std::milli>(
+                            std::chrono::high_resolution_clock::now() - start)
+                            .count();
+    VertexCacheStats after = analyzeVertexCache(
+        builder.indices.data(),
+        builder.indices.size(),
+        static_cast<uint32_t>(builder.vertices.size()),
+        options.cacheSize);
+
+    printf(
+        "%s: %u vertices, %zu triangles, optimized in %.1f ms\n",
+        options.inputPath.c_str(),
+        vertexCount,
+        builder.indices.size() / 3,
+        optimizeMs);
+    printf("  vertex cache, FIFO of %u\n", options.cacheSize);
+    printStats("before", before);
+    printStats("after", after);
+    printf(
+        "  overdraw order %s\n",
+        stats.overdrawApplied ? "applied" : "skipped, it would cost too much cache locality");
+    if (builder.vertices.size() != vertexCount) {
+      printf("  dropped %zu unreferenced vertices\n", vertexCount - builder.vertices.size());
+    }
+
+    // the OBJ file keeps LOD 0 only, the chain goes to the cache
+    if (!options.dryRun) {
+      writeObj(options.outputPath, builder);
+    }
+    start = std::chrono::high_resolution_clock::now();
+    generateLods(builder);
+    double lodMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+    printf("  %zu levels of detail, simplified in %.1f ms\n", builder.lods.size(), lodMs);
+    for (size_t i = 0; i < builder.lods.size(); i++) {
+      printf(
+          "  LOD %zu  %8u triangles  error %g\n",
+          i,
+          builder.lods[i].indexCount / 3,
+          builder.lods[i].error);
+    }
+
+    if (!options.dryRun) {
+      std::string cachePath = meshCachePath(options.outputPath);
+      // the cache carries meshlets for loads that ask for them
+      builder.buildMeshlets();
+      if (writeMeshCache(cachePath, options.outputPath, builder)) {
+        printf("wrote %s and %s\n", options.outputPath.c_str(), cachePath.c_str());
+      } else {
+        printf("wrote %s, its mesh cache could not be written\n", options.outputPath.c_str());
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}